@@ -14,21 +14,38 @@ uniform mat4 gLightWVP; // required only for shadow mapping (spot/directional li
 uniform mat4 gWorld;
 uniform vec4 gClipPlane;
 
+// Quantized vertices (see BasicMesh::SetVertexFormat). The defaults match
+// the float layout.
+uniform vec3 gPosOffset = vec3(0.0, 0.0, 0.0);
+uniform vec3 gPosScale = vec3(1.0, 1.0, 1.0);
+uniform bool gOctNormals = false;
+
 out vec2 VTexCoord;
 out vec3 VNormal;
 out vec3 VLocalPos;
 out vec3 VWorldPos;
 out vec4 VLightSpacePos; // required only for shadow mapping (spot/directional light)
 
+vec3 DecodeOctNormal(vec2 e)
+{
+    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return normalize(n);
+}
+
 void main()
 {
-    vec4 Pos4 = vec4(Position, 1.0);
+    vec4 Pos4 = vec4(gPosOffset + Position * gPosScale, 1.0);
     gl_Position = gWVP * Pos4;
     VTexCoord = TexCoord;
-    VNormal = Normal;
-    VLocalPos = Position;
+    VNormal = gOctNormals ? DecodeOctNormal(Normal.xy) : Normal;
+    VLocalPos = Pos4.xyz;
     VWorldPos = (gWorld * Pos4).xyz;
-    VLightSpacePos = gLightWVP * vec4(Position, 1.0); // required only for shadow mapping (spot/directional light)
+    VLightSpacePos = gLightWVP * Pos4; // required only for shadow mapping (spot/directional light)
 
-    gl_ClipDistance[0] = dot(vec4(Position, 1.0), gClipPlane);
+    gl_ClipDistance[0] = dot(Pos4, gClipPlane);
 }
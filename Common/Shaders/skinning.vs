@@ -14,6 +14,12 @@ uniform mat4 gWorld;
 uniform mat4 gLightWVP; // required only for shadow mapping (spot/directional light)
 uniform vec4 gClipPlane;
 
+// Quantized vertices (see BasicMesh::SetVertexFormat). The defaults match
+// the float layout.
+uniform vec3 gPosOffset = vec3(0.0, 0.0, 0.0);
+uniform vec3 gPosScale = vec3(1.0, 1.0, 1.0);
+uniform bool gOctNormals = false;
+
 out vec2 TexCoord0;
 out vec3 Normal0;
 out vec3 LocalPos0;
@@ -21,6 +27,17 @@ out vec3 WorldPos0;
 out vec4 LightSpacePos0; // required only for shadow mapping (spot/directional light)
 noperspective out vec3 EdgeDistance0; // to match lighting_new_to_vs.gs
 
+vec3 DecodeOctNormal(vec2 e)
+{
+    vec3 n = vec3(e.x, e.y, 1.0 - abs(e.x) - abs(e.y));
+
+    if (n.z < 0.0) {
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    }
+
+    return normalize(n);
+}
+
 void main()
 {
     mat4 BoneTransform = gBones[BoneIDs[0]] * Weights[0];
@@ -28,14 +45,17 @@ void main()
     BoneTransform     += gBones[BoneIDs[2]] * Weights[2];
     BoneTransform     += gBones[BoneIDs[3]] * Weights[3];
 
-    vec4 PosL = BoneTransform * vec4(Position, 1.0);
+    vec4 Pos4 = vec4(gPosOffset + Position * gPosScale, 1.0);
+    vec3 N = gOctNormals ? DecodeOctNormal(Normal.xy) : Normal;
+
+    vec4 PosL = BoneTransform * Pos4;
     gl_Position = gWVP * PosL;
     TexCoord0 = TexCoord;
-    Normal0 = Normal;
+    Normal0 = N;
     LocalPos0 = PosL.xyz;
     WorldPos0 = (gWorld * PosL).xyz;
-    LightSpacePos0 = gLightWVP * vec4(Position, 1.0); // required only for shadow mapping (spot/directional light)
+    LightSpacePos0 = gLightWVP * Pos4; // required only for shadow mapping (spot/directional light)
     EdgeDistance0 = vec3(-1.0, -1.0, -1.0);   // not used by the default subtechnique
 
-    gl_ClipDistance[0] = dot(vec4(Position, 1.0), gClipPlane);
+    gl_ClipDistance[0] = dot(Pos4, gClipPlane);
 }
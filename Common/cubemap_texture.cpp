@@ -19,6 +19,7 @@
 #include <iostream>
 #include "ogldev_cubemap_texture.h"
 #include "ogldev_util.h"
+#include "ogldev_texture.h"
 #include "3rdparty/stb_image.h"
 
 static const GLenum types[6] = {  GL_TEXTURE_CUBE_MAP_POSITIVE_X,
@@ -62,33 +63,60 @@ bool CubemapTexture::Load()
 {
     stbi_set_flip_vertically_on_load(0);
 
+    int Width[6], Height[6], BPP[6];
+    unsigned char* image_data[6];
+    vector<TextureMipLevel> Levels[6];
+
+    const MipmapGenerator& Mipmaps = GetMipmapGenerator();
+
+    // The faces are decoded (and their mipmaps are filtered) in parallel, only
+    // the upload must stay on the GL thread
+    ParallelFor(ARRAY_SIZE_IN_ELEMENTS(types), [&](int i) {
+        image_data[i] = stbi_load(m_fileNames[i].c_str(), &Width[i], &Height[i], &BPP[i], 0);
+
+        if (image_data[i] && Mipmaps.IsEnabled()) {
+            Levels[i].resize(1);
+            Levels[i][0].Width = Width[i];
+            Levels[i][0].Height = Height[i];
+            Levels[i][0].Data.assign(image_data[i], image_data[i] + (size_t)Width[i] * Height[i] * BPP[i]);
+            bool SRGB = true;   // the faces are color images
+            Mipmaps.GenerateCached(m_fileNames[i], BPP[i], SRGB, Levels[i], 1);
+        }
+    });
+
     glGenTextures(1, &m_textureObj);
     glBindTexture(GL_TEXTURE_CUBE_MAP, m_textureObj);
 
     for (unsigned int i = 0 ; i < ARRAY_SIZE_IN_ELEMENTS(types) ; i++) {
-        int Width, Height;
-        void* pData = NULL;
+        if (!image_data[i]) {
+            printf("Can't load texture from '%s'\n", m_fileNames[i].c_str());
+            exit(0);
+        }
 
-        int BPP;
-        unsigned char* image_data = stbi_load(m_fileNames[i].c_str(), &Width, &Height, &BPP, 0);
+        printf("Width %d, height %d, bpp %d\n", Width[i], Height[i], BPP[i]);
 
-        if (!image_data) {
-            printf("Can't load texture from '%s' - %s\n", m_fileNames[i].c_str(), stbi_failure_reason());
-            exit(0);
+        glTexImage2D(types[i], 0, GL_RGB, Width[i], Height[i], 0, GL_RGB, GL_UNSIGNED_BYTE, image_data[i]);
+
+        // the rows of the small mip levels are not 4 byte aligned
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+        for (int Level = 1 ; Level < (int)Levels[i].size() ; Level++) {
+            const TextureMipLevel& Mip = Levels[i][Level];
+            glTexImage2D(types[i], Level, GL_RGB, Mip.Width, Mip.Height, 0, GL_RGB, GL_UNSIGNED_BYTE, Mip.Data.data());
         }
 
-        printf("Width %d, height %d, bpp %d\n", Width, Height, BPP);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
 
-        pData = image_data;
+        int NumLevels = std::max((int)Levels[i].size(), 1);
 
-        glTexImage2D(types[i], 0, GL_RGB, Width, Height, 0, GL_RGB, GL_UNSIGNED_BYTE, pData);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, (NumLevels > 1) ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, NumLevels - 1);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
 
-        stbi_image_free(image_data);
+        stbi_image_free(image_data[i]);
     }
 
     return true;
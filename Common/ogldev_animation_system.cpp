@@ -0,0 +1,211 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <cfloat>
+#include <string.h>
+
+#include "ogldev_animation_system.h"
+
+
+AnimationSystem::AnimationSystem()
+{
+    for (int i = 0 ; i < ANIMATION_LOD_TIERS - 1 ; i++) {
+        m_lodDistances[i] = FLT_MAX;
+    }
+}
+
+
+void AnimationSystem::InitAnimationSystem(int NumThreads)
+{
+    m_pool.Start(NumThreads);
+
+    m_ranges.reset(new WorkerRange[m_pool.GetNumThreads()]);
+}
+
+
+void AnimationSystem::SetLODDistances(float Tier1, float Tier2, float Tier3)
+{
+    m_lodDistances[0] = Tier1;
+    m_lodDistances[1] = Tier2;
+    m_lodDistances[2] = Tier3;
+}
+
+
+int AnimationSystem::GetLODTier(float DistanceToCamera) const
+{
+    int Tier = 0;
+
+    while ((Tier < ANIMATION_LOD_TIERS - 1) && (DistanceToCamera >= m_lodDistances[Tier])) {
+        Tier++;
+    }
+
+    return Tier;
+}
+
+
+void AnimationSystem::Update(const std::vector<AnimationInstance>& Instances)
+{
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    int NumInstances = (int)Instances.size();
+
+    // the palettes are laid out before the workers start so each one writes to its own slice
+    m_paletteOffsets.resize(NumInstances + 1);
+    m_paletteOffsets[0] = 0;
+
+    for (int i = 0 ; i < NumInstances ; i++) {
+        m_paletteOffsets[i + 1] = m_paletteOffsets[i] + Instances[i].pMesh->NumBones();
+    }
+
+    m_palettes.resize(m_paletteOffsets[NumInstances]);
+    m_states.resize(NumInstances);
+    m_pInstances = &Instances;
+
+    if (!m_ranges) {
+        InitAnimationSystem(1);
+    }
+
+    int NumThreads = m_pool.GetNumThreads();
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        m_ranges[i].Next = NumInstances * i / NumThreads;
+        m_ranges[i].End = NumInstances * (i + 1) / NumThreads;
+    }
+
+    m_pool.Run([this](int WorkerIndex) { RunWorker(WorkerIndex); });
+
+    m_pInstances = NULL;
+
+    m_lastNumEvaluatedBones = 0;
+
+    for (int i = 0 ; i < ANIMATION_LOD_TIERS ; i++) {
+        m_lastNumInstancesInTier[i] = 0;
+    }
+
+    for (int i = 0 ; i < NumInstances ; i++) {
+        m_lastNumEvaluatedBones += m_states[i].NumEvaluatedBones;
+        m_lastNumInstancesInTier[m_states[i].Tier]++;
+    }
+
+    m_lastUpdateMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+}
+
+
+// A worker drains its own range first and then steals from the others. Every
+// instance is claimed by an atomic increment so it is evaluated exactly once.
+void AnimationSystem::RunWorker(int WorkerIndex)
+{
+    int NumThreads = m_pool.GetNumThreads();
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        WorkerRange& Range = m_ranges[(WorkerIndex + i) % NumThreads];
+
+        for (;;) {
+            int InstanceIndex = Range.Next++;
+
+            if (InstanceIndex >= Range.End) {
+                break;
+            }
+
+            EvaluateInstance(InstanceIndex);
+        }
+    }
+}
+
+
+// Palette += (Target - Palette) / NumSteps. The matrices are blended linearly
+// which is close enough for the small steps between two evaluations.
+static void StepPalette(std::vector<Matrix4f>& Palette, const std::vector<Matrix4f>& Target, int NumSteps)
+{
+    float Factor = 1.0f / (float)NumSteps;
+
+    for (unsigned int i = 0 ; i < Palette.size() ; i++) {
+        float* pDst = &Palette[i].m[0][0];
+        const float* pSrc = &Target[i].m[0][0];
+
+        for (int j = 0 ; j < 16 ; j++) {
+            pDst[j] += (pSrc[j] - pDst[j]) * Factor;
+        }
+    }
+}
+
+
+// When the skeleton of a low tier instance is evaluated the time is extrapolated
+// to the last update before the next evaluation, using the time step of the
+// previous update. The palette then takes one step towards the result in each
+// update so it is always at the time of the update.
+void AnimationSystem::EvaluateInstance(int InstanceIndex)
+{
+    const AnimationInstance& Instance = (*m_pInstances)[InstanceIndex];
+    InstanceState& State = m_states[InstanceIndex];
+
+    int Tier = GetLODTier(Instance.DistanceToCamera);
+    int Period = 1 << Tier;
+
+    // a new animation is evaluated right away
+    bool Restart = (State.Tier < 0) ||
+                   (State.pMesh != Instance.pMesh) ||
+                   (State.AnimationIndex != Instance.AnimationIndex) ||
+                   (State.EndAnimationIndex != Instance.EndAnimationIndex);
+
+    float DeltaTimeSec = Restart ? 0.0f : std::max(Instance.AnimationTimeSec - State.LastAnimationTimeSec, 0.0f);
+
+    State.NumEvaluatedBones = 0;
+
+    if (Restart || (Period == 1) || (State.StepsLeft == 0) || (Tier != State.Tier)) {
+        // Instances that enter a tier together (or start together) are spread over the updates of the period
+        int NumSteps = (Restart || (Period == 1)) ? 1 :
+                       ((Tier != State.Tier) || State.Restarted) ? 1 + (InstanceIndex % Period) : Period;
+
+        float TargetTimeSec = Instance.AnimationTimeSec + DeltaTimeSec * (float)(NumSteps - 1);
+        bool Reduced = (Tier == ANIMATION_LOD_TIERS - 1);
+
+        State.Target.resize(Instance.pMesh->NumBones());
+
+        if (Instance.BlendFactor > 0.0f) {
+            Instance.pMesh->GetBoneTransformsBlended(TargetTimeSec, State.Target.data(), State.Cursors,
+                                                     Instance.AnimationIndex, Instance.EndAnimationIndex, Instance.BlendFactor, Reduced);
+        } else {
+            Instance.pMesh->GetBoneTransforms(TargetTimeSec, State.Target.data(), State.Cursors, Instance.AnimationIndex, Reduced);
+        }
+
+        State.NumEvaluatedBones = State.Cursors.NumEvaluatedBones;
+        State.StepsLeft = NumSteps;
+
+        if (Restart) {
+            State.Palette = State.Target;
+        }
+
+        State.Restarted = Restart;
+    }
+
+    StepPalette(State.Palette, State.Target, State.StepsLeft);
+    State.StepsLeft--;
+
+    State.Tier = Tier;
+    State.pMesh = Instance.pMesh;
+    State.AnimationIndex = Instance.AnimationIndex;
+    State.EndAnimationIndex = Instance.EndAnimationIndex;
+    State.LastAnimationTimeSec = Instance.AnimationTimeSec;
+
+    memcpy(&m_palettes[m_paletteOffsets[InstanceIndex]], State.Palette.data(), State.Palette.size() * sizeof(Matrix4f));
+}
+
@@ -0,0 +1,228 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "ogldev_util.h"
+#include "ogldev_artifact_cache.h"
+
+#define ARTIFACT_MAGIC      "OGAC"
+#define ARTIFACT_VERSION    1
+
+struct ArtifactHeader {
+    char Magic[4];
+    unsigned int Version = ARTIFACT_VERSION;
+    unsigned long long Key = 0;
+    char Generator[32] = {};
+    unsigned long long DataSize = 0;
+    unsigned long long DataHash = 0;
+    float GenerationMs = 0.0f;
+    unsigned int Padding = 0;
+};
+
+
+ArtifactKey::ArtifactKey(const char* pGenerator)
+{
+    m_generator = pGenerator;
+    m_hash = ArtifactCache::HashData(pGenerator, strlen(pGenerator));
+}
+
+
+ArtifactKey& ArtifactKey::Add(const void* pData, size_t Size)
+{
+    m_hash = ArtifactCache::HashData(pData, Size, m_hash);
+
+    return *this;
+}
+
+
+ArtifactKey& ArtifactKey::Add(const char* pStr)
+{
+    // the terminating zero separates consecutive strings
+    return Add(pStr, strlen(pStr) + 1);
+}
+
+
+ArtifactCache::ArtifactCache(const char* pCacheDir)
+{
+    m_cacheDir = pCacheDir;
+}
+
+
+std::string ArtifactCache::GetArtifactPath(const ArtifactKey& Key) const
+{
+    char Hash[17];
+    snprintf(Hash, sizeof(Hash), "%016llx", Key.GetHash());
+
+    return m_cacheDir + "/" + Key.GetGenerator() + "_" + Hash + ".bin";
+}
+
+
+void ArtifactCache::GetArtifact(const ArtifactKey& Key, std::vector<unsigned char>& Data,
+                                const std::function<void(std::vector<unsigned char>& Data)>& Generate, size_t ExpectedSize)
+{
+    if (!m_enabled) {
+        Data.clear();
+        Generate(Data);
+        return;
+    }
+
+    long long StartTime = GetCurrentTimeMillis();
+    float GenerationMs = 0.0f;
+
+    if (Load(Key, Data, GenerationMs) && ((ExpectedSize == 0) || (Data.size() == ExpectedSize))) {
+        float LoadMs = (float)(GetCurrentTimeMillis() - StartTime);
+        float SavedMs = GenerationMs - LoadMs;
+
+        m_numHits++;
+        m_bytesLoaded += Data.size();
+        m_timeSavedMs += SavedMs;
+
+        printf("Artifact cache hit: %s %016llx, %zu bytes loaded in %.0f ms (saved %.0f ms)\n",
+               Key.GetGenerator(), Key.GetHash(), Data.size(), LoadMs, SavedMs);
+        return;
+    }
+
+    Data.clear();
+
+    StartTime = GetCurrentTimeMillis();
+    Generate(Data);
+    GenerationMs = (float)(GetCurrentTimeMillis() - StartTime);
+
+    m_numMisses++;
+
+    printf("Artifact cache miss: %s %016llx, generated in %.0f ms\n", Key.GetGenerator(), Key.GetHash(), GenerationMs);
+
+    if (Store(Key, Data, GenerationMs)) {
+        m_bytesStored += Data.size();
+    }
+}
+
+
+bool ArtifactCache::Load(const ArtifactKey& Key, std::vector<unsigned char>& Data, float& GenerationMs)
+{
+    std::string Path = GetArtifactPath(Key);
+
+    FILE* f = fopen(Path.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    ArtifactHeader Header;
+    bool Valid = (fread(&Header, sizeof(Header), 1, f) == 1) &&
+                 (memcmp(Header.Magic, ARTIFACT_MAGIC, 4) == 0) &&
+                 (Header.Version == ARTIFACT_VERSION) &&
+                 (Header.Key == Key.GetHash());
+
+    if (Valid) {
+        Data.resize((size_t)Header.DataSize);
+        Valid = (Data.size() == 0) || (fread(&Data[0], 1, Data.size(), f) == Data.size());
+    }
+
+    fclose(f);
+
+    if (Valid && (HashData(Data.data(), Data.size()) != Header.DataHash)) {
+        Valid = false;
+    }
+
+    if (!Valid) {
+        printf("%s: ignoring invalid artifact '%s'\n", __FUNCTION__, Path.c_str());
+        Data.clear();
+        return false;
+    }
+
+    GenerationMs = Header.GenerationMs;
+
+    return true;
+}
+
+
+bool ArtifactCache::Store(const ArtifactKey& Key, const std::vector<unsigned char>& Data, float GenerationMs)
+{
+#ifdef _WIN32
+    int res = _mkdir(m_cacheDir.c_str());
+#else
+    int res = mkdir(m_cacheDir.c_str(), 0755);
+#endif
+
+    if ((res != 0) && (errno != EEXIST)) {
+        printf("%s: error creating the cache directory '%s': %s\n", __FUNCTION__, m_cacheDir.c_str(), strerror(errno));
+        return false;
+    }
+
+    ArtifactHeader Header;
+    memcpy(Header.Magic, ARTIFACT_MAGIC, 4);
+    Header.Key = Key.GetHash();
+    strncpy(Header.Generator, Key.GetGenerator(), sizeof(Header.Generator) - 1);
+    Header.DataSize = Data.size();
+    Header.DataHash = HashData(Data.data(), Data.size());
+    Header.GenerationMs = GenerationMs;
+
+    // written under a temporary name so that an interrupted write never leaves a truncated artifact behind
+    std::string Path = GetArtifactPath(Key);
+    std::string TempPath = Path + ".tmp";
+
+    FILE* f = fopen(TempPath.c_str(), "wb");
+
+    if (!f) {
+        printf("%s: error opening '%s'\n", __FUNCTION__, TempPath.c_str());
+        return false;
+    }
+
+    bool Success = (fwrite(&Header, sizeof(Header), 1, f) == 1) &&
+                   ((Data.size() == 0) || (fwrite(&Data[0], 1, Data.size(), f) == Data.size()));
+
+    Success = (fclose(f) == 0) && Success;
+
+    if (Success) {
+        remove(Path.c_str());
+        Success = (rename(TempPath.c_str(), Path.c_str()) == 0);
+    }
+
+    if (!Success) {
+        printf("%s: error writing '%s'\n", __FUNCTION__, Path.c_str());
+        remove(TempPath.c_str());
+    }
+
+    return Success;
+}
+
+
+void ArtifactCache::PrintStats() const
+{
+    printf("Artifact cache '%s': %d hits, %d misses, %zu KB loaded, %zu KB stored, %.0f ms saved\n",
+           m_cacheDir.c_str(), m_numHits, m_numMisses, m_bytesLoaded / 1024, m_bytesStored / 1024, m_timeSavedMs);
+}
+
+
+ArtifactCache& GetArtifactCache()
+{
+    static ArtifactCache Cache;
+
+    return Cache;
+}
@@ -16,6 +16,10 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stddef.h>
+
 #include "ogldev_basic_mesh.h"
 #include "ogldev_engine_common.h"
 
@@ -27,6 +31,10 @@ using namespace std;
 #define TEX_COORD_LOCATION 1
 #define NORMAL_LOCATION    2
 
+#define MESH_CACHE_MAGIC   "OGMC"
+#define MESH_CACHE_VERSION 4
+#define MESH_CACHE_ALIGN   16
+
 
 BasicMesh::~BasicMesh()
 {
@@ -44,6 +52,36 @@ void BasicMesh::Clear()
         glDeleteVertexArrays(1, &m_VAO);
         m_VAO = 0;
     }
+
+    for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+        GetTextureRegistry().Release(m_Materials[i].pDiffuse);
+        m_Materials[i].pDiffuse = NULL;
+        GetTextureRegistry().Release(m_Materials[i].pSpecularExponent);
+        m_Materials[i].pSpecularExponent = NULL;
+    }
+
+    m_MeshCache.Close();
+
+    m_numLODs = 1;
+    m_meshlets.clear();
+}
+
+
+void BasicMesh::FreeScene()
+{
+    m_Importer.FreeScene();
+    m_pScene = NULL;
+}
+
+
+void BasicMesh::SetLODRatios(const std::vector<float>& Ratios)
+{
+    if (Ratios.size() > MESH_MAX_LODS - 1) {
+        printf("%s:%d - too many LODs (%d), the max is %d\n", __FILE__, __LINE__, (int)Ratios.size() + 1, MESH_MAX_LODS);
+        exit(0);
+    }
+
+    m_lodRatios = Ratios;
 }
 
 
@@ -64,15 +102,30 @@ bool BasicMesh::LoadMesh(const string& Filename)
 
     bool Ret = false;
 
-    m_pScene = m_Importer.ReadFile(Filename.c_str(), ASSIMP_LOAD_FLAGS);
+    bool UseMeshCache = false;
+#ifdef USE_MESH_CACHE
+    UseMeshCache = IsMeshCacheSupported();
+#endif
 
-    if (m_pScene) {
-        m_GlobalInverseTransform = m_pScene->mRootNode->mTransformation;
-        m_GlobalInverseTransform = m_GlobalInverseTransform.Inverse();
-        Ret = InitFromScene(m_pScene, Filename);
-    }
-    else {
-        printf("Error parsing '%s': '%s'\n", Filename.c_str(), m_Importer.GetErrorString());
+    m_pScene = NULL;
+
+    if (UseMeshCache && LoadMeshCache(Filename)) {
+        Ret = true;
+    } else {
+        m_pScene = m_Importer.ReadFile(Filename.c_str(), ASSIMP_LOAD_FLAGS);
+
+        if (m_pScene) {
+            m_GlobalInverseTransform = m_pScene->mRootNode->mTransformation;
+            m_GlobalInverseTransform = m_GlobalInverseTransform.Inverse();
+            Ret = InitFromScene(m_pScene, Filename);
+
+            if (Ret && UseMeshCache) {
+                SaveMeshCache(Filename);
+            }
+        }
+        else {
+            printf("Error parsing '%s': '%s'\n", Filename.c_str(), m_Importer.GetErrorString());
+        }
     }
 
     // Make sure the VAO is not changed from the outside
@@ -80,6 +133,15 @@ bool BasicMesh::LoadMesh(const string& Filename)
         glBindVertexArray(0);
     }
 
+    // The texture files were decoded in the background while the vertices were
+    // processed. Unless the application streams them in via Update() every frame
+    // they are all uploaded here.
+    if (!GetTextureLoader().IsStreaming()) {
+        GetTextureLoader().Finish();
+    }
+
+    GetTextureRegistry().PrintStats();
+
     return Ret;
 }
 
@@ -97,6 +159,10 @@ bool BasicMesh::InitFromScene(const aiScene* pScene, const string& Filename)
 
     InitAllMeshes(pScene);
 
+    if (m_meshletsEnabled && AreMeshletsSupported()) {
+        BuildMeshlets();
+    }
+
     if (!InitMaterials(pScene, Filename)) {
         return false;
     }
@@ -112,32 +178,61 @@ void BasicMesh::CountVerticesAndIndices(const aiScene* pScene, unsigned int& Num
     for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
         m_Meshes[i].MaterialIndex = pScene->mMeshes[i]->mMaterialIndex;
         m_Meshes[i].NumIndices = pScene->mMeshes[i]->mNumFaces * 3;
+        m_Meshes[i].NumVertices = pScene->mMeshes[i]->mNumVertices;
         m_Meshes[i].BaseVertex = NumVertices;
         m_Meshes[i].BaseIndex = NumIndices;
 
         NumVertices += pScene->mMeshes[i]->mNumVertices;
         NumIndices  += m_Meshes[i].NumIndices;
+
+#ifdef USE_MESH_OPTIMIZER
+        // room for the simplified LODs - none of them is larger than the full mesh
+        NumIndices  += m_Meshes[i].NumIndices * (uint)m_lodRatios.size();
+#endif
     }
 }
 
 
+// The arrays are allocated in full (rather than reserved) because each mesh
+// is written directly into its own range by InitAllMeshes.
 void BasicMesh::ReserveSpace(unsigned int NumVertices, unsigned int NumIndices)
 {
-    m_Vertices.reserve(NumVertices);
-    m_Indices.reserve(NumIndices);
+    m_Vertices.clear();
+    m_Vertices.resize(NumVertices);
+    m_Indices.clear();
+    m_Indices.resize(NumIndices);
 }
 
 
 void BasicMesh::InitAllMeshes(const aiScene* pScene)
 {
-    for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
+    // The meshes don't share any data so they are converted in parallel.
+    // CountVerticesAndIndices has already assigned the range of every mesh.
+    ParallelFor((int)m_Meshes.size(), [&](int i) {
         const aiMesh* paiMesh = pScene->mMeshes[i];
 #ifdef USE_MESH_OPTIMIZER
         InitSingleMeshOpt(i, paiMesh);
 #else
         InitSingleMesh(i, paiMesh);
 #endif
+    });
+
+#ifdef USE_MESH_OPTIMIZER
+    CompactMeshes();
+
+    m_numLODs = 1;
+
+    for (uint i = 0 ; i < m_Meshes.size() ; i++) {
+        m_numLODs = std::max(m_numLODs, m_Meshes[i].NumLODs);
     }
+#endif
+}
+
+
+void BasicMesh::CompactMeshes()
+{
+    CompactMeshArrays(m_Meshes, m_Vertices, m_Indices);
+    CalcBoundingSphere(m_Vertices, (uint)m_Vertices.size());
 }
 
 
@@ -149,6 +244,8 @@ void BasicMesh::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
     // Populate the vertex attribute vectors
     Vertex v;
 
+    Vertex* pVertices = m_Vertices.data() + m_Meshes[MeshIndex].BaseVertex;
+
     for (unsigned int i = 0; i < paiMesh->mNumVertices; i++) {
         const aiVector3D& pPos = paiMesh->mVertices[i];
         // printf("%d: ", i); Vector3f v(pPos.x, pPos.y, pPos.z); v.Print();
@@ -165,15 +262,17 @@ void BasicMesh::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
         const aiVector3D& pTexCoord = paiMesh->HasTextureCoords(0) ? paiMesh->mTextureCoords[0][i] : Zero3D;
         v.TexCoords = Vector2f(pTexCoord.x, pTexCoord.y);
 
-        m_Vertices.push_back(v);
+        pVertices[i] = v;
     }
 
+    uint* pIndices = m_Indices.data() + m_Meshes[MeshIndex].BaseIndex;
+
     // Populate the index buffer
     for (unsigned int i = 0; i < paiMesh->mNumFaces; i++) {
         const aiFace& Face = paiMesh->mFaces[i];
-        m_Indices.push_back(Face.mIndices[0]);
-        m_Indices.push_back(Face.mIndices[1]);
-        m_Indices.push_back(Face.mIndices[2]);
+        pIndices[i * 3 + 0] = Face.mIndices[0];
+        pIndices[i * 3 + 1] = Face.mIndices[1];
+        pIndices[i * 3 + 2] = Face.mIndices[2];
     }
 }
 
@@ -208,9 +307,6 @@ void BasicMesh::InitSingleMeshOpt(uint MeshIndex, const aiMesh* paiMesh)
         Vertices[i] = v;
     }
 
-    m_Meshes[MeshIndex].BaseVertex = (uint)m_Vertices.size();
-    m_Meshes[MeshIndex].BaseIndex = (uint)m_Indices.size();
-
     int NumIndices = paiMesh->mNumFaces * 3;
 
     std::vector<uint> Indices;
@@ -234,7 +330,7 @@ void BasicMesh::OptimizeMesh(int MeshIndex, std::vector<uint>&Indices, std::vect
     size_t NumVertices = Vertices.size();
 
     // Create a remap table
-    std::vector<unsigned int> remap(NumIndices);
+    std::vector<unsigned int> remap(NumVertices);
     size_t OptVertexCount = meshopt_generateVertexRemap(remap.data(),    // dst addr
                                                         Indices.data(),  // src indices
                                                         NumIndices,      // ...and size
@@ -261,30 +357,262 @@ void BasicMesh::OptimizeMesh(int MeshIndex, std::vector<uint>&Indices, std::vect
     // Optimization #4: optimize access to the vertex buffer
     meshopt_optimizeVertexFetch(OptVertices.data(), OptIndices.data(), NumIndices, OptVertices.data(), OptVertexCount, sizeof(Vertex));
 
-    // Optimization #5: create a simplified version of the model
-    float Threshold = 1.0f;
-    size_t TargetIndexCount = (size_t)(NumIndices * Threshold);
-    
-    float TargetError = 0.0f;
-    std::vector<unsigned int> SimplifiedIndices(OptIndices.size());
-    size_t OptIndexCount = meshopt_simplify(SimplifiedIndices.data(), OptIndices.data(), NumIndices,
-                                            &OptVertices[0].Position.x, OptVertexCount, sizeof(Vertex), TargetIndexCount, TargetError);
-
-    static int num_indices = 0;
-    num_indices += (int)NumIndices;
-    static int opt_indices = 0;
-    opt_indices += (int)OptIndexCount;
-    printf("Num indices %d\n", num_indices);
-    //printf("Target num indices %d\n", TargetIndexCount);
-    printf("Optimized number of indices %d\n", opt_indices);
-    SimplifiedIndices.resize(OptIndexCount);
-    
-    // Concatenate the local arrays into the class attributes arrays
-    m_Indices.insert(m_Indices.end(), SimplifiedIndices.begin(), SimplifiedIndices.end());
+    // Copy the local arrays to the start of the range of the mesh. The optimized mesh
+    // is never larger than the original so it fits. CompactMeshes closes the gaps.
+    std::copy(OptIndices.begin(), OptIndices.end(), m_Indices.begin() + m_Meshes[MeshIndex].BaseIndex);
+
+    std::copy(OptVertices.begin(), OptVertices.end(), m_Vertices.begin() + m_Meshes[MeshIndex].BaseVertex);
+
+    m_Meshes[MeshIndex].NumIndices = (uint)NumIndices;
+    m_Meshes[MeshIndex].NumVertices = (uint)OptVertexCount;
+
+    // Optimization #5: create simplified versions of the model
+    GenerateLODs(MeshIndex, &OptVertices[0].Position.x, OptVertexCount, sizeof(Vertex));
+}
+
+
+void BasicMesh::GenerateLODs(uint MeshIndex, const float* pPositions, size_t NumVertices, size_t VertexStride)
+{
+    BasicMeshEntry& Mesh = m_Meshes[MeshIndex];
+    uint* pIndices = m_Indices.data() + Mesh.BaseIndex;
+
+    Mesh.NumLODs = 1;
+    Mesh.LODFirstIndex[0] = 0;
+    Mesh.LODNumIndices[0] = Mesh.NumIndices;
+
+    for (uint LOD = 1 ; LOD <= m_lodRatios.size() ; LOD++) {
+        const uint* pSrc = pIndices + Mesh.LODFirstIndex[LOD - 1];
+        size_t NumSrcIndices = Mesh.LODNumIndices[LOD - 1];
+        uint* pDst = pIndices + Mesh.LODFirstIndex[LOD - 1] + NumSrcIndices;
+
+        size_t TargetIndexCount = (size_t)(Mesh.NumIndices * m_lodRatios[LOD - 1]) / 3 * 3;
+
+        // Each LOD is simplified from the previous one. This is faster than starting
+        // from the full mesh every time.
+        size_t NumDstIndices = meshopt_simplify(pDst, pSrc, NumSrcIndices, pPositions, NumVertices, VertexStride,
+                                                TargetIndexCount, MESH_LOD_MAX_ERROR);
+
+        // the error limit is reached and the rest of the LODs would be the same
+        if (NumDstIndices == NumSrcIndices) {
+            break;
+        }
+
+        meshopt_optimizeVertexCache(pDst, pDst, NumDstIndices, NumVertices);
+
+        Mesh.LODFirstIndex[LOD] = Mesh.LODFirstIndex[LOD - 1] + (uint)NumSrcIndices;
+        Mesh.LODNumIndices[LOD] = (uint)NumDstIndices;
+        Mesh.NumLODs++;
+    }
+}
+
+
+void BasicMesh::GetLODRange(const BasicMeshEntry& Mesh, uint LOD, uint& BaseIndex, uint& NumIndices) const
+{
+    // a mesh that could not be simplified as much as the others stays on its last LOD
+    LOD = std::min(LOD, Mesh.NumLODs - 1);
 
-    m_Vertices.insert(m_Vertices.end(), OptVertices.begin(), OptVertices.end());
+    if (LOD == 0) {
+        BaseIndex = Mesh.BaseIndex;
+        NumIndices = Mesh.NumIndices;
+    } else {
+        BaseIndex = Mesh.BaseIndex + Mesh.LODFirstIndex[LOD];
+        NumIndices = Mesh.LODNumIndices[LOD];
+    }
+}
+
+
+uint BasicMesh::SelectLOD(const Matrix4f& WVP) const
+{
+    if (m_numLODs <= 1) {
+        return 0;
+    }
+
+    Vector4f Center = WVP * Vector4f(m_boundingCenter, 1.0f);
+
+    // behind or at the camera
+    if (Center.w <= 0.0f) {
+        return 0;
+    }
+
+    // The length of the second row is the vertical projection scale times the world
+    // scale. The projected diameter divided by the NDC height (2) is the fraction
+    // of the screen height that is covered by the model.
+    float Scale = sqrtf(WVP.m[1][0] * WVP.m[1][0] + WVP.m[1][1] * WVP.m[1][1] + WVP.m[1][2] * WVP.m[1][2]);
+    float ScreenSize = m_boundingRadius * Scale / Center.w;
+
+    for (uint LOD = m_numLODs - 1 ; LOD > 0 ; LOD--) {
+        if (ScreenSize < MESH_LOD_FULL_DETAIL_SIZE * sqrtf(m_lodRatios[LOD - 1])) {
+            return LOD;
+        }
+    }
+
+    return 0;
+}
+
+
+void BasicMesh::BuildMeshlets()
+{
+    std::vector<std::vector<Meshlet>> MeshMeshlets(m_Meshes.size());
+
+    ParallelFor((int)m_Meshes.size(), [&](int i) {
+        BuildMeshMeshlets(i, MeshMeshlets[i]);
+    });
+
+    m_meshlets.clear();
+
+    for (uint i = 0 ; i < m_Meshes.size() ; i++) {
+        m_Meshes[i].FirstMeshlet = (uint)m_meshlets.size();
+        m_Meshes[i].NumMeshlets = (uint)MeshMeshlets[i].size();
+        m_meshlets.insert(m_meshlets.end(), MeshMeshlets[i].begin(), MeshMeshlets[i].end());
+    }
 
-    m_Meshes[MeshIndex].NumIndices = (uint)OptIndexCount;
+    printf("Built %d meshlets\n", (int)m_meshlets.size());
+}
+
+
+void BasicMesh::BuildMeshMeshlets(uint MeshIndex, std::vector<Meshlet>& Meshlets)
+{
+    const BasicMeshEntry& Mesh = m_Meshes[MeshIndex];
+
+    if (Mesh.NumIndices == 0) {
+        return;
+    }
+
+    uint* pIndices = m_Indices.data() + Mesh.BaseIndex;
+    const float* pPositions = &m_Vertices[Mesh.BaseVertex].Position.x;
+
+    size_t MaxClusters = meshopt_buildMeshletsBound(Mesh.NumIndices, MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES);
+    std::vector<meshopt_Meshlet> Clusters(MaxClusters);
+    std::vector<unsigned int> ClusterVertices(MaxClusters * MESHLET_MAX_VERTICES);
+    std::vector<unsigned char> ClusterTriangles(MaxClusters * MESHLET_MAX_TRIANGLES * 3);
+
+    size_t NumClusters = meshopt_buildMeshlets(Clusters.data(), ClusterVertices.data(), ClusterTriangles.data(),
+                                               pIndices, Mesh.NumIndices, pPositions, Mesh.NumVertices, sizeof(Vertex),
+                                               MESHLET_MAX_VERTICES, MESHLET_MAX_TRIANGLES, MESHLET_CONE_WEIGHT);
+
+    Meshlets.resize(NumClusters);
+
+    // The triangles are written back in cluster order (the clusters are built
+    // from copies) so that every meshlet is a single range of the index buffer
+    uint NumIndices = 0;
+
+    for (size_t c = 0 ; c < NumClusters ; c++) {
+        const meshopt_Meshlet& Cluster = Clusters[c];
+        const unsigned int* pClusterVertices = &ClusterVertices[Cluster.vertex_offset];
+        const unsigned char* pClusterTriangles = &ClusterTriangles[Cluster.triangle_offset];
+
+        Meshlet& m = Meshlets[c];
+        m.FirstIndex = NumIndices;
+        m.NumIndices = Cluster.triangle_count * 3;
+
+        for (uint i = 0 ; i < m.NumIndices ; i++) {
+            pIndices[NumIndices++] = pClusterVertices[pClusterTriangles[i]];
+        }
+
+        meshopt_Bounds Bounds = meshopt_computeMeshletBounds(pClusterVertices, pClusterTriangles, Cluster.triangle_count,
+                                                             pPositions, Mesh.NumVertices, sizeof(Vertex));
+
+        memcpy(m.Center, Bounds.center, sizeof(m.Center));
+        m.Radius = Bounds.radius;
+        memcpy(m.ConeApex, Bounds.cone_apex, sizeof(m.ConeApex));
+        memcpy(m.ConeAxis, Bounds.cone_axis, sizeof(m.ConeAxis));
+        m.ConeCutoff = Bounds.cone_cutoff;
+    }
+
+    assert(NumIndices == Mesh.NumIndices);
+}
+
+
+void BasicMesh::CullMeshlets(const Matrix4f& WVP)
+{
+    // The frustum planes in the local space of the model (Gribb & Hartmann):
+    // w + x, w - x, w + y, w - y, w + z, w - z
+    float Planes[6][4];
+
+    for (int i = 0 ; i < 3 ; i++) {
+        for (int j = 0 ; j < 4 ; j++) {
+            Planes[i * 2][j] = WVP.m[3][j] + WVP.m[i][j];
+            Planes[i * 2 + 1][j] = WVP.m[3][j] - WVP.m[i][j];
+        }
+    }
+
+    for (int i = 0 ; i < 6 ; i++) {
+        float Len = sqrtf(Planes[i][0] * Planes[i][0] + Planes[i][1] * Planes[i][1] + Planes[i][2] * Planes[i][2]);
+
+        for (int j = 0 ; j < 4 ; j++) {
+            Planes[i][j] /= Len;
+        }
+    }
+
+    // The camera is the only point that is projected to w = 0 with x = y = 0.
+    // An orthographic projection has no such point and the cones are ignored.
+    Vector4f Camera = WVP.Inverse() * Vector4f(0.0f, 0.0f, 1.0f, 0.0f);
+    bool ConeCulling = fabsf(Camera.w) > 1e-6f;
+    Vector3f CameraPos = ConeCulling ? Vector3f(Camera.x, Camera.y, Camera.z) / Camera.w : Vector3f(0.0f, 0.0f, 0.0f);
+
+    m_drawCounts.clear();
+    m_drawOffsets.clear();
+    m_drawBaseVertices.clear();
+    m_meshDrawStart.resize(m_Meshes.size() + 1);
+    m_numVisibleMeshlets = 0;
+
+    for (uint i = 0 ; i < m_Meshes.size() ; i++) {
+        const BasicMeshEntry& Mesh = m_Meshes[i];
+
+        m_meshDrawStart[i] = (uint)m_drawCounts.size();
+
+        // adjacent visible meshlets are merged into a single draw
+        uint RangeStart = 0;
+        uint RangeCount = 0;
+
+        for (uint j = 0 ; j < Mesh.NumMeshlets ; j++) {
+            const Meshlet& m = m_meshlets[Mesh.FirstMeshlet + j];
+
+            bool Visible = true;
+
+            for (int p = 0 ; Visible && (p < 6) ; p++) {
+                float Dist = Planes[p][0] * m.Center[0] + Planes[p][1] * m.Center[1] + Planes[p][2] * m.Center[2] + Planes[p][3];
+                Visible = (Dist >= -m.Radius);
+            }
+
+            if (Visible && ConeCulling) {
+                // all the triangles face away from the camera
+                Vector3f Dir = Vector3f(m.ConeApex[0], m.ConeApex[1], m.ConeApex[2]) - CameraPos;
+                float Len = Dir.Length();
+                float Dot = (Dir.x * m.ConeAxis[0] + Dir.y * m.ConeAxis[1] + Dir.z * m.ConeAxis[2]);
+                Visible = (Dot < m.ConeCutoff * Len);
+            }
+
+            if (!Visible) {
+                continue;
+            }
+
+            m_numVisibleMeshlets++;
+
+            uint FirstIndex = Mesh.BaseIndex + m.FirstIndex;
+
+            if ((RangeCount > 0) && (RangeStart + RangeCount == FirstIndex)) {
+                RangeCount += m.NumIndices;
+            } else {
+                if (RangeCount > 0) {
+                    m_drawCounts.push_back(RangeCount);
+                    m_drawOffsets.push_back((void*)(sizeof(unsigned int) * RangeStart));
+                    m_drawBaseVertices.push_back(Mesh.BaseVertex);
+                }
+
+                RangeStart = FirstIndex;
+                RangeCount = m.NumIndices;
+            }
+        }
+
+        if (RangeCount > 0) {
+            m_drawCounts.push_back(RangeCount);
+            m_drawOffsets.push_back((void*)(sizeof(unsigned int) * RangeStart));
+            m_drawBaseVertices.push_back(Mesh.BaseVertex);
+        }
+    }
+
+    m_meshDrawStart[m_Meshes.size()] = (uint)m_drawCounts.size();
 }
 
 
@@ -339,9 +667,8 @@ void BasicMesh::LoadDiffuseTexture(const string& Dir, const aiMaterial* pMateria
 void BasicMesh::LoadDiffuseTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded diffuse texture type '%s'\n", paiTexture->achFormatHint);
-    m_Materials[MaterialIndex].pDiffuse = new Texture(GL_TEXTURE_2D);
     int buffer_size = paiTexture->mWidth;
-    m_Materials[MaterialIndex].pDiffuse->Load(buffer_size, paiTexture->pcData);
+    m_Materials[MaterialIndex].pDiffuse = GetTextureRegistry().AcquireEmbedded(buffer_size, paiTexture->pcData, true);
 }
 
 
@@ -361,15 +688,9 @@ void BasicMesh::LoadDiffuseTextureFromFile(const string& Dir, const aiString& Pa
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pDiffuse = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+    m_Materials[MaterialIndex].pDiffuse = GetTextureRegistry().AcquireFile(FullPath, true);
 
-    if (!m_Materials[MaterialIndex].pDiffuse->Load()) {
-        printf("Error loading diffuse texture '%s'\n", FullPath.c_str());
-        exit(0);
-    }
-    else {
-        printf("Loaded diffuse texture '%s' at index %d\n", FullPath.c_str(), MaterialIndex);
-    }
+    printf("Queued diffuse texture '%s' at index %d\n", FullPath.c_str(), MaterialIndex);
 }
 
 
@@ -396,9 +717,8 @@ void BasicMesh::LoadSpecularTexture(const string& Dir, const aiMaterial* pMateri
 void BasicMesh::LoadSpecularTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded specular texture type '%s'\n", paiTexture->achFormatHint);
-    m_Materials[MaterialIndex].pSpecularExponent = new Texture(GL_TEXTURE_2D);
     int buffer_size = paiTexture->mWidth;
-    m_Materials[MaterialIndex].pSpecularExponent->Load(buffer_size, paiTexture->pcData);
+    m_Materials[MaterialIndex].pSpecularExponent = GetTextureRegistry().AcquireEmbedded(buffer_size, paiTexture->pcData);
 }
 
 
@@ -414,15 +734,9 @@ void BasicMesh::LoadSpecularTextureFromFile(const string& Dir, const aiString& P
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pSpecularExponent = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+    m_Materials[MaterialIndex].pSpecularExponent = GetTextureRegistry().AcquireFile(FullPath);
 
-    if (!m_Materials[MaterialIndex].pSpecularExponent->Load()) {
-        printf("Error loading specular texture '%s'\n", FullPath.c_str());
-        exit(0);
-    }
-    else {
-        printf("Loaded specular texture '%s'\n", FullPath.c_str());
-    }
+    printf("Queued specular texture '%s'\n", FullPath.c_str());
 }
 
 void BasicMesh::LoadColors(const aiMaterial* pMaterial, int index)
@@ -467,20 +781,25 @@ void BasicMesh::LoadColors(const aiMaterial* pMaterial, int index)
 void BasicMesh::PopulateBuffers()
 {
     if (IsGLVersionHigher(4, 5)) {
-        PopulateBuffersDSA();
+        PopulateBuffersDSA(m_Vertices.data(), (uint)m_Vertices.size(), m_Indices.data(), (uint)m_Indices.size());
     } else {
-        PopulateBuffersNonDSA();
+        PopulateBuffersNonDSA(m_Vertices.data(), (uint)m_Vertices.size(), m_Indices.data(), (uint)m_Indices.size());
     }
 }
 
 
-void BasicMesh::PopulateBuffersNonDSA()
+void BasicMesh::PopulateBuffersNonDSA(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices)
 {
+    if (m_vertexFormat != VERTEX_FORMAT_FLOAT) {
+        PopulateQuantizedBuffers((const Vertex*)pVertices, NumVertices, pIndices, NumIndices);
+        return;
+    }
+
     glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[VERTEX_BUFFER]);
     glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
 
-    glBufferData(GL_ARRAY_BUFFER, sizeof(m_Vertices[0]) * m_Vertices.size(), &m_Vertices[0], GL_STATIC_DRAW);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(m_Indices[0]) * m_Indices.size(), &m_Indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * NumVertices, pVertices, GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * NumIndices, pIndices, GL_STATIC_DRAW);
     
     size_t NumFloats = 0;
 
@@ -497,10 +816,15 @@ void BasicMesh::PopulateBuffersNonDSA()
 }
 
 
-void BasicMesh::PopulateBuffersDSA()
+void BasicMesh::PopulateBuffersDSA(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices)
 {
-    glNamedBufferStorage(m_Buffers[VERTEX_BUFFER], sizeof(m_Vertices[0]) * m_Vertices.size(), m_Vertices.data(), 0);
-    glNamedBufferStorage(m_Buffers[INDEX_BUFFER], sizeof(m_Indices[0]) * m_Indices.size(), m_Indices.data(), 0);
+    if (m_vertexFormat != VERTEX_FORMAT_FLOAT) {
+        PopulateQuantizedBuffers((const Vertex*)pVertices, NumVertices, pIndices, NumIndices);
+        return;
+    }
+
+    glNamedBufferStorage(m_Buffers[VERTEX_BUFFER], sizeof(Vertex) * NumVertices, pVertices, 0);
+    glNamedBufferStorage(m_Buffers[INDEX_BUFFER], sizeof(uint) * NumIndices, pIndices, 0);
 
     glVertexArrayVertexBuffer(m_VAO, 0, m_Buffers[VERTEX_BUFFER], 0, sizeof(Vertex));
     glVertexArrayElementBuffer(m_VAO, m_Buffers[INDEX_BUFFER]);
@@ -523,8 +847,179 @@ void BasicMesh::PopulateBuffersDSA()
 }
 
 
+// octahedral mapping of a unit vector to [-1, 1]^2
+static void OctEncode(const Vector3f& n, float& u, float& v)
+{
+    float Sum = fabsf(n.x) + fabsf(n.y) + fabsf(n.z);
+
+    if (Sum == 0.0f) {
+        u = v = 0.0f;
+        return;
+    }
+
+    u = n.x / Sum;
+    v = n.y / Sum;
+
+    // the lower hemisphere is folded over the diagonals
+    if (n.z < 0.0f) {
+        float x = u;
+        float y = v;
+        u = (1.0f - fabsf(y)) * ((x >= 0.0f) ? 1.0f : -1.0f);
+        v = (1.0f - fabsf(x)) * ((y >= 0.0f) ? 1.0f : -1.0f);
+    }
+}
+
+
+void BasicMesh::CalcPositionDecode(const float* pPositions, uint NumVertices, size_t VertexStride)
+{
+    m_posOffset = Vector3f(0.0f, 0.0f, 0.0f);
+    m_posScale = Vector3f(1.0f, 1.0f, 1.0f);
+
+    if ((m_vertexFormat != VERTEX_FORMAT_QUANTIZED) || (NumVertices == 0)) {
+        return;
+    }
+
+    Vector3f Min(pPositions[0], pPositions[1], pPositions[2]);
+    Vector3f Max = Min;
+
+    for (uint i = 1 ; i < NumVertices ; i++) {
+        const float* p = (const float*)((const char*)pPositions + i * VertexStride);
+        Min = Vector3f(std::min(Min.x, p[0]), std::min(Min.y, p[1]), std::min(Min.z, p[2]));
+        Max = Vector3f(std::max(Max.x, p[0]), std::max(Max.y, p[1]), std::max(Max.z, p[2]));
+    }
+
+    m_posOffset = Min;
+    m_posScale = Max - Min;
+
+    // flat models
+    if (m_posScale.x == 0.0f) m_posScale.x = 1.0f;
+    if (m_posScale.y == 0.0f) m_posScale.y = 1.0f;
+    if (m_posScale.z == 0.0f) m_posScale.z = 1.0f;
+}
+
+
+void BasicMesh::QuantizeVertex(const Vector3f& Pos, const Vector2f& TexCoords, const Vector3f& Normal, QuantizedVertex& Vertex) const
+{
+    if (m_vertexFormat == VERTEX_FORMAT_QUANTIZED) {
+        Vertex.Position[0] = (unsigned short)meshopt_quantizeUnorm((Pos.x - m_posOffset.x) / m_posScale.x, 16);
+        Vertex.Position[1] = (unsigned short)meshopt_quantizeUnorm((Pos.y - m_posOffset.y) / m_posScale.y, 16);
+        Vertex.Position[2] = (unsigned short)meshopt_quantizeUnorm((Pos.z - m_posOffset.z) / m_posScale.z, 16);
+    } else {
+        Vertex.Position[0] = meshopt_quantizeHalf(Pos.x);
+        Vertex.Position[1] = meshopt_quantizeHalf(Pos.y);
+        Vertex.Position[2] = meshopt_quantizeHalf(Pos.z);
+    }
+
+    Vertex.Position[3] = 0;
+
+    Vertex.TexCoords[0] = meshopt_quantizeHalf(TexCoords.x);
+    Vertex.TexCoords[1] = meshopt_quantizeHalf(TexCoords.y);
+
+    float u, v;
+    OctEncode(Normal, u, v);
+    Vertex.Normal[0] = (short)meshopt_quantizeSnorm(u, 16);
+    Vertex.Normal[1] = (short)meshopt_quantizeSnorm(v, 16);
+}
+
+
+void BasicMesh::SetupQuantizedAttribs(GLsizei Stride)
+{
+    GLenum PosType = (m_vertexFormat == VERTEX_FORMAT_QUANTIZED) ? GL_UNSIGNED_SHORT : GL_HALF_FLOAT;
+    GLboolean PosNormalized = (m_vertexFormat == VERTEX_FORMAT_QUANTIZED) ? GL_TRUE : GL_FALSE;
+
+    GLuint PosOffset = (GLuint)offsetof(QuantizedVertex, Position);
+    GLuint TexCoordsOffset = (GLuint)offsetof(QuantizedVertex, TexCoords);
+    GLuint NormalOffset = (GLuint)offsetof(QuantizedVertex, Normal);
+
+    if (IsGLVersionHigher(4, 5)) {
+        glEnableVertexArrayAttrib(m_VAO, POSITION_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, POSITION_LOCATION, 3, PosType, PosNormalized, PosOffset);
+        glVertexArrayAttribBinding(m_VAO, POSITION_LOCATION, 0);
+
+        glEnableVertexArrayAttrib(m_VAO, TEX_COORD_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, TEX_COORD_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, TexCoordsOffset);
+        glVertexArrayAttribBinding(m_VAO, TEX_COORD_LOCATION, 0);
+
+        glEnableVertexArrayAttrib(m_VAO, NORMAL_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE, NormalOffset);
+        glVertexArrayAttribBinding(m_VAO, NORMAL_LOCATION, 0);
+    } else {
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glVertexAttribPointer(POSITION_LOCATION, 3, PosType, PosNormalized, Stride, (const void*)(size_t)PosOffset);
+
+        glEnableVertexAttribArray(TEX_COORD_LOCATION);
+        glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_HALF_FLOAT, GL_FALSE, Stride, (const void*)(size_t)TexCoordsOffset);
+
+        glEnableVertexAttribArray(NORMAL_LOCATION);
+        glVertexAttribPointer(NORMAL_LOCATION, 2, GL_SHORT, GL_TRUE, Stride, (const void*)(size_t)NormalOffset);
+    }
+}
+
+
+void BasicMesh::CheckFloatVertexFormat(const char* pCaller) const
+{
+    if (m_vertexFormat != VERTEX_FORMAT_FLOAT) {
+        printf("%s: the quantized vertex formats are not supported by this draw\n", pCaller);
+        exit(0);
+    }
+}
+
+
+void BasicMesh::PopulateQuantizedBuffers(const Vertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices)
+{
+    CalcPositionDecode(&pVertices[0].Position.x, NumVertices, sizeof(Vertex));
+
+    vector<QuantizedVertex> QuantizedVertices(NumVertices);
+
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        QuantizeVertex(pVertices[i].Position, pVertices[i].TexCoords, pVertices[i].Normal, QuantizedVertices[i]);
+    }
+
+    GLsizei Stride = sizeof(QuantizedVertex);
+
+    if (IsGLVersionHigher(4, 5)) {
+        glNamedBufferStorage(m_Buffers[VERTEX_BUFFER], Stride * NumVertices, QuantizedVertices.data(), 0);
+        glNamedBufferStorage(m_Buffers[INDEX_BUFFER], sizeof(uint) * NumIndices, pIndices, 0);
+
+        glVertexArrayVertexBuffer(m_VAO, 0, m_Buffers[VERTEX_BUFFER], 0, Stride);
+        glVertexArrayElementBuffer(m_VAO, m_Buffers[INDEX_BUFFER]);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[VERTEX_BUFFER]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
+
+        glBufferData(GL_ARRAY_BUFFER, Stride * NumVertices, QuantizedVertices.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint) * NumIndices, pIndices, GL_STATIC_DRAW);
+    }
+
+    SetupQuantizedAttribs(Stride);
+
+    printf("Quantized %d vertices to %d bytes each (from %d)\n", NumVertices, Stride, (int)sizeof(Vertex));
+}
+
+
 // Introduced in youtube tutorial #18
 void BasicMesh::Render(IRenderCallbacks* pRenderCallbacks)
+{
+    RenderLOD(0, pRenderCallbacks);
+}
+
+
+void BasicMesh::Render(const Matrix4f& WVP, IRenderCallbacks* pRenderCallbacks)
+{
+    uint LOD = SelectLOD(WVP);
+
+    // the meshlets cover only the full LOD
+    bool UseVisibleMeshlets = (LOD == 0) && !m_meshlets.empty();
+
+    if (UseVisibleMeshlets) {
+        CullMeshlets(WVP);
+    }
+
+    RenderLOD(LOD, pRenderCallbacks, UseVisibleMeshlets);
+}
+
+
+void BasicMesh::RenderLOD(uint LOD, IRenderCallbacks* pRenderCallbacks, bool UseVisibleMeshlets)
 {
     glBindVertexArray(m_VAO);
 
@@ -557,11 +1052,29 @@ void BasicMesh::Render(IRenderCallbacks* pRenderCallbacks)
             }
         }
 
-        glDrawElementsBaseVertex(GL_TRIANGLES,
-                                 m_Meshes[i].NumIndices,
-                                 GL_UNSIGNED_INT,
-                                 (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
-                                 m_Meshes[i].BaseVertex);
+        if (UseVisibleMeshlets) {
+            uint FirstDraw = m_meshDrawStart[i];
+            uint NumDraws = m_meshDrawStart[i + 1] - FirstDraw;
+
+            if (NumDraws > 0) {
+                glMultiDrawElementsBaseVertex(GL_TRIANGLES,
+                                              &m_drawCounts[FirstDraw],
+                                              GL_UNSIGNED_INT,
+                                              &m_drawOffsets[FirstDraw],
+                                              NumDraws,
+                                              &m_drawBaseVertices[FirstDraw]);
+            }
+        } else {
+            uint BaseIndex = 0;
+            uint NumIndices = 0;
+            GetLODRange(m_Meshes[i], LOD, BaseIndex, NumIndices);
+
+            glDrawElementsBaseVertex(GL_TRIANGLES,
+                                     NumIndices,
+                                     GL_UNSIGNED_INT,
+                                     (void*)(sizeof(unsigned int) * BaseIndex),
+                                     m_Meshes[i].BaseVertex);
+        }
     }
 
     // Make sure the VAO is not changed from the outside
@@ -571,6 +1084,8 @@ void BasicMesh::Render(IRenderCallbacks* pRenderCallbacks)
 
 void BasicMesh::Render(unsigned int DrawIndex, unsigned int PrimID)
 {
+    CheckFloatVertexFormat(__FUNCTION__);
+
     glBindVertexArray(m_VAO);
 
     unsigned int MaterialIndex = m_Meshes[DrawIndex].MaterialIndex;
@@ -599,6 +1114,43 @@ void BasicMesh::Render(unsigned int DrawIndex, unsigned int PrimID)
 // Used only by instancing
 void BasicMesh::Render(unsigned int NumInstances, const Matrix4f* WVPMats, const Matrix4f* WorldMats)
 {
+    CheckFloatVertexFormat(__FUNCTION__);
+
+    // the instances of LOD i are at [FirstInstance[i], FirstInstance[i + 1])
+    uint FirstInstance[MESH_MAX_LODS + 1] = { 0 };
+    FirstInstance[1] = NumInstances;
+
+    if (m_numLODs > 1) {
+        // group the instances by LOD so that every LOD of a mesh is a single draw
+        uint NumInstancesPerLOD[MESH_MAX_LODS] = { 0 };
+
+        m_instanceLODs.resize(NumInstances);
+
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            m_instanceLODs[i] = SelectLOD(WVPMats[i]);
+            NumInstancesPerLOD[m_instanceLODs[i]]++;
+        }
+
+        uint NextInstance[MESH_MAX_LODS];
+
+        for (uint LOD = 0 ; LOD < m_numLODs ; LOD++) {
+            NextInstance[LOD] = FirstInstance[LOD];
+            FirstInstance[LOD + 1] = FirstInstance[LOD] + NumInstancesPerLOD[LOD];
+        }
+
+        m_lodWVPMats.resize(NumInstances);
+        m_lodWorldMats.resize(NumInstances);
+
+        for (uint i = 0 ; i < NumInstances ; i++) {
+            uint Dst = NextInstance[m_instanceLODs[i]]++;
+            m_lodWVPMats[Dst] = WVPMats[i];
+            m_lodWorldMats[Dst] = WorldMats[i];
+        }
+
+        WVPMats = m_lodWVPMats.data();
+        WorldMats = m_lodWorldMats.data();
+    }
+
     glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[WVP_MAT_BUFFER]);
     glBufferData(GL_ARRAY_BUFFER, sizeof(Matrix4f) * NumInstances, WVPMats, GL_DYNAMIC_DRAW);
 
@@ -620,12 +1172,34 @@ void BasicMesh::Render(unsigned int NumInstances, const Matrix4f* WVPMats, const
             m_Materials[MaterialIndex].pSpecularExponent->Bind(SPECULAR_EXPONENT_UNIT);
         }
 
-        glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
-                                          m_Meshes[i].NumIndices,
-                                          GL_UNSIGNED_INT,
-                                          (void*)(sizeof(unsigned int) * m_Meshes[i].BaseIndex),
-                                          NumInstances,
-                                          m_Meshes[i].BaseVertex);
+        for (uint LOD = 0 ; LOD < m_numLODs ; LOD++) {
+            uint NumLODInstances = FirstInstance[LOD + 1] - FirstInstance[LOD];
+
+            if (NumLODInstances == 0) {
+                continue;
+            }
+
+            uint BaseIndex = 0;
+            uint NumIndices = 0;
+            GetLODRange(m_Meshes[i], LOD, BaseIndex, NumIndices);
+
+            if (FirstInstance[LOD] == 0) {
+                glDrawElementsInstancedBaseVertex(GL_TRIANGLES,
+                                                  NumIndices,
+                                                  GL_UNSIGNED_INT,
+                                                  (void*)(sizeof(unsigned int) * BaseIndex),
+                                                  NumLODInstances,
+                                                  m_Meshes[i].BaseVertex);
+            } else {
+                glDrawElementsInstancedBaseVertexBaseInstance(GL_TRIANGLES,
+                                                              NumIndices,
+                                                              GL_UNSIGNED_INT,
+                                                              (void*)(sizeof(unsigned int) * BaseIndex),
+                                                              NumLODInstances,
+                                                              m_Meshes[i].BaseVertex,
+                                                              FirstInstance[LOD]);
+            }
+        }
     }
 
     // Make sure the VAO is not changed from the outside
@@ -649,6 +1223,26 @@ void BasicMesh::GetLeadingVertex(uint DrawIndex, uint PrimID, Vector3f& Vertex)
 {
     uint MeshIndex = DrawIndex; // Each mesh is rendered in its own draw call
 
+    if (!m_pScene) {
+        if (!m_MeshCache.IsOpen()) {
+            printf("%s: the scene was released\n", __FUNCTION__);
+            return;
+        }
+
+        // loaded from the mesh cache - the final buffers are still mapped
+        const MeshCacheHeader* pHeader = (const MeshCacheHeader*)m_MeshCache.GetData();
+        const unsigned char* pVertices = m_MeshCache.GetData() + pHeader->VerticesOffset;
+        const uint* pIndices = (const uint*)(m_MeshCache.GetData() + pHeader->IndicesOffset);
+
+        assert(MeshIndex < m_Meshes.size());
+        assert(PrimID * 3 < m_Meshes[MeshIndex].NumIndices);
+
+        uint LeadingIndex = pIndices[m_Meshes[MeshIndex].BaseIndex + PrimID * 3];
+        // every vertex type starts with the position
+        Vertex = *(const Vector3f*)(pVertices + (size_t)(m_Meshes[MeshIndex].BaseVertex + LeadingIndex) * pHeader->VertexSize);
+        return;
+    }
+
     assert(MeshIndex < m_pScene->mNumMeshes);
     const aiMesh* paiMesh = m_pScene->mMeshes[MeshIndex];
 
@@ -663,3 +1257,319 @@ void BasicMesh::GetLeadingVertex(uint DrawIndex, uint PrimID, Vector3f& Vertex)
     Vertex.y = Pos.y;
     Vertex.z = Pos.z;
 }
+
+
+static long long AlignOffset(long long Offset)
+{
+    return (Offset + MESH_CACHE_ALIGN - 1) / MESH_CACHE_ALIGN * MESH_CACHE_ALIGN;
+}
+
+
+// the offsets and sizes come from the file so they may be garbage
+static bool IsCacheRangeValid(long long Offset, long long RangeSize, long long FileSize)
+{
+    return (Offset >= 0) && (RangeSize >= 0) && (RangeSize <= FileSize) && (Offset <= FileSize - RangeSize);
+}
+
+
+bool BasicMesh::GetSourceFileInfo(const string& Filename, long long& Size, long long& ModTime)
+{
+    struct stat st;
+
+    if (stat(Filename.c_str(), &st) != 0) {
+        return false;
+    }
+
+    Size = (long long)st.st_size;
+    ModTime = (long long)st.st_mtime;
+
+    return true;
+}
+
+
+// the cache is rebuilt when the way the model is imported changes
+uint BasicMesh::GetMeshCacheFlags() const
+{
+    uint Flags = ASSIMP_LOAD_FLAGS;
+
+#ifdef USE_MESH_OPTIMIZER
+    Flags |= 0x80000000;
+#endif
+
+    if (m_meshletsEnabled && AreMeshletsSupported()) {
+        Flags |= 0x40000000;
+    }
+
+    return Flags;
+}
+
+
+bool BasicMesh::LoadMeshCache(const string& Filename)
+{
+    long long SourceSize = 0;
+    long long SourceModTime = 0;
+
+    if (!GetSourceFileInfo(Filename, SourceSize, SourceModTime)) {
+        return false;
+    }
+
+    string CacheFilename = Filename + MESH_CACHE_EXT;
+
+    if (!m_MeshCache.Open(CacheFilename.c_str())) {
+        return false;
+    }
+
+    const unsigned char* pData = m_MeshCache.GetData();
+    long long Size = (long long)m_MeshCache.GetSize();
+    const MeshCacheHeader* pHeader = (const MeshCacheHeader*)pData;
+
+    bool Valid = (Size >= (long long)sizeof(MeshCacheHeader)) &&
+                 (memcmp(pHeader->Magic, MESH_CACHE_MAGIC, 4) == 0) &&
+                 (pHeader->Version == MESH_CACHE_VERSION) &&
+                 (pHeader->Flags == GetMeshCacheFlags()) &&
+                 (pHeader->VertexSize == GetCacheVertexSize()) &&
+                 (pHeader->NumLODs >= 1) && (pHeader->NumLODs <= MESH_MAX_LODS) &&
+                 (pHeader->SourceSize == SourceSize) &&
+                 (pHeader->SourceModTime == SourceModTime);
+
+    Valid = Valid &&
+            IsCacheRangeValid(pHeader->VerticesOffset, (long long)pHeader->NumVertices * pHeader->VertexSize, Size) &&
+            IsCacheRangeValid(pHeader->IndicesOffset, (long long)(pHeader->NumIndices * sizeof(uint)), Size) &&
+            IsCacheRangeValid(pHeader->MeshesOffset, (long long)(pHeader->NumMeshes * sizeof(MeshCacheEntry)), Size) &&
+            IsCacheRangeValid(pHeader->MaterialsOffset, (long long)(pHeader->NumMaterials * sizeof(MeshCacheMaterial)), Size) &&
+            IsCacheRangeValid(pHeader->MeshletsOffset, (long long)(pHeader->NumMeshlets * sizeof(Meshlet)), Size) &&
+            IsCacheRangeValid(pHeader->ExtraOffset, pHeader->ExtraSize, Size);
+
+    // the LOD thresholds are derived from the ratios
+    for (uint i = 0 ; Valid && (i < MESH_MAX_LODS - 1) ; i++) {
+        float Ratio = (i < m_lodRatios.size()) ? m_lodRatios[i] : 0.0f;
+        Valid = (pHeader->LODRatios[i] == Ratio);
+    }
+
+    Valid = Valid && LoadMeshCacheExtra(pData + pHeader->ExtraOffset, pHeader->ExtraSize);
+
+    if (!Valid) {
+        printf("Mesh cache '%s' is out of date - loading '%s'\n", CacheFilename.c_str(), Filename.c_str());
+        m_MeshCache.Close();
+        return false;
+    }
+
+    const MeshCacheEntry* pMeshes = (const MeshCacheEntry*)(pData + pHeader->MeshesOffset);
+
+    m_Meshes.resize(pHeader->NumMeshes);
+
+    for (uint i = 0 ; i < pHeader->NumMeshes ; i++) {
+        m_Meshes[i].NumIndices = pMeshes[i].NumIndices;
+        m_Meshes[i].NumVertices = pMeshes[i].NumVertices;
+        m_Meshes[i].BaseVertex = pMeshes[i].BaseVertex;
+        m_Meshes[i].BaseIndex = pMeshes[i].BaseIndex;
+        m_Meshes[i].MaterialIndex = pMeshes[i].MaterialIndex;
+        m_Meshes[i].NumLODs = pMeshes[i].NumLODs;
+        memcpy(m_Meshes[i].LODFirstIndex, pMeshes[i].LODFirstIndex, sizeof(m_Meshes[i].LODFirstIndex));
+        memcpy(m_Meshes[i].LODNumIndices, pMeshes[i].LODNumIndices, sizeof(m_Meshes[i].LODNumIndices));
+        m_Meshes[i].FirstMeshlet = pMeshes[i].FirstMeshlet;
+        m_Meshes[i].NumMeshlets = pMeshes[i].NumMeshlets;
+    }
+
+    const Meshlet* pMeshlets = (const Meshlet*)(pData + pHeader->MeshletsOffset);
+    m_meshlets.assign(pMeshlets, pMeshlets + pHeader->NumMeshlets);
+
+    m_numLODs = pHeader->NumLODs;
+    m_boundingCenter = Vector3f(pHeader->BoundingCenter[0], pHeader->BoundingCenter[1], pHeader->BoundingCenter[2]);
+    m_boundingRadius = pHeader->BoundingRadius;
+
+    const MeshCacheMaterial* pMaterials = (const MeshCacheMaterial*)(pData + pHeader->MaterialsOffset);
+
+    m_Materials.resize(pHeader->NumMaterials);
+
+    for (uint i = 0 ; i < pHeader->NumMaterials ; i++) {
+        m_Materials[i].AmbientColor = pMaterials[i].AmbientColor;
+        m_Materials[i].DiffuseColor = pMaterials[i].DiffuseColor;
+        m_Materials[i].SpecularColor = pMaterials[i].SpecularColor;
+        bool SRGB = true;
+        m_Materials[i].pDiffuse = LoadCachedTexture(pMaterials[i].DiffuseTexture, SRGB);
+        m_Materials[i].pSpecularExponent = LoadCachedTexture(pMaterials[i].SpecularTexture);
+    }
+
+    // straight from the mapping to the GPU
+    const void* pVertices = pData + pHeader->VerticesOffset;
+    const uint* pIndices = (const uint*)(pData + pHeader->IndicesOffset);
+
+    PopulateCachedBuffers(pVertices, pHeader->NumVertices, pIndices, pHeader->NumIndices);
+
+    printf("Loaded '%s' from the mesh cache: %d meshes, %d vertices, %d indices\n", Filename.c_str(),
+           pHeader->NumMeshes, pHeader->NumVertices, pHeader->NumIndices);
+
+    return GLCheckError();
+}
+
+
+const void* BasicMesh::GetCacheVertices(uint& NumVertices) const
+{
+    NumVertices = (uint)m_Vertices.size();
+    return m_Vertices.data();
+}
+
+
+void BasicMesh::PopulateCachedBuffers(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices)
+{
+    if (IsGLVersionHigher(4, 5)) {
+        PopulateBuffersDSA(pVertices, NumVertices, pIndices, NumIndices);
+    } else {
+        PopulateBuffersNonDSA(pVertices, NumVertices, pIndices, NumIndices);
+    }
+}
+
+
+Texture* BasicMesh::LoadCachedTexture(const char* pFilename, bool SRGB)
+{
+    if (pFilename[0] == 0) {
+        return NULL;
+    }
+
+    return GetTextureRegistry().AcquireFile(pFilename, SRGB);
+}
+
+
+void BasicMesh::SaveMeshCache(const string& Filename)
+{
+    string CacheFilename = Filename + MESH_CACHE_EXT;
+
+    vector<MeshCacheMaterial> Materials(m_Materials.size());
+
+    for (uint i = 0 ; i < m_Materials.size() ; i++) {
+        MeshCacheMaterial& CacheMaterial = Materials[i];
+        ZERO_MEM(CacheMaterial.DiffuseTexture);
+        ZERO_MEM(CacheMaterial.SpecularTexture);
+
+        CacheMaterial.AmbientColor = m_Materials[i].AmbientColor;
+        CacheMaterial.DiffuseColor = m_Materials[i].DiffuseColor;
+        CacheMaterial.SpecularColor = m_Materials[i].SpecularColor;
+
+        const Texture* Textures[2] = { m_Materials[i].pDiffuse, m_Materials[i].pSpecularExponent };
+        char* Paths[2] = { CacheMaterial.DiffuseTexture, CacheMaterial.SpecularTexture };
+
+        for (int t = 0 ; t < 2 ; t++) {
+            if (!Textures[t]) {
+                continue;
+            }
+
+            // embedded textures are not written to the cache
+            const string& TextureFilename = Textures[t]->GetFileName();
+
+            if (TextureFilename.empty() || (TextureFilename.size() >= sizeof(CacheMaterial.DiffuseTexture))) {
+                printf("'%s' uses an embedded texture - not creating a mesh cache\n", Filename.c_str());
+                return;
+            }
+
+            strcpy(Paths[t], TextureFilename.c_str());
+        }
+    }
+
+    vector<MeshCacheEntry> Meshes(m_Meshes.size());
+
+    for (uint i = 0 ; i < m_Meshes.size() ; i++) {
+        Meshes[i].NumIndices = m_Meshes[i].NumIndices;
+        Meshes[i].NumVertices = m_Meshes[i].NumVertices;
+        Meshes[i].BaseVertex = m_Meshes[i].BaseVertex;
+        Meshes[i].BaseIndex = m_Meshes[i].BaseIndex;
+        Meshes[i].MaterialIndex = m_Meshes[i].MaterialIndex;
+        Meshes[i].NumLODs = m_Meshes[i].NumLODs;
+        memcpy(Meshes[i].LODFirstIndex, m_Meshes[i].LODFirstIndex, sizeof(Meshes[i].LODFirstIndex));
+        memcpy(Meshes[i].LODNumIndices, m_Meshes[i].LODNumIndices, sizeof(Meshes[i].LODNumIndices));
+        Meshes[i].FirstMeshlet = m_Meshes[i].FirstMeshlet;
+        Meshes[i].NumMeshlets = m_Meshes[i].NumMeshlets;
+    }
+
+    uint NumVertices = 0;
+    const void* pVertices = GetCacheVertices(NumVertices);
+
+    vector<unsigned char> Extra;
+    SaveMeshCacheExtra(Extra);
+
+    MeshCacheHeader Header;
+    memset(&Header, 0, sizeof(Header));
+    memcpy(Header.Magic, MESH_CACHE_MAGIC, 4);
+    Header.Version = MESH_CACHE_VERSION;
+    Header.Flags = GetMeshCacheFlags();
+    Header.VertexSize = GetCacheVertexSize();
+    Header.NumVertices = NumVertices;
+    Header.NumIndices = (uint)m_Indices.size();
+    Header.NumMeshes = (uint)Meshes.size();
+    Header.NumMaterials = (uint)Materials.size();
+    Header.NumLODs = m_numLODs;
+
+    for (uint i = 0 ; i < m_lodRatios.size() ; i++) {
+        Header.LODRatios[i] = m_lodRatios[i];
+    }
+
+    Header.BoundingCenter[0] = m_boundingCenter.x;
+    Header.BoundingCenter[1] = m_boundingCenter.y;
+    Header.BoundingCenter[2] = m_boundingCenter.z;
+    Header.BoundingRadius = m_boundingRadius;
+
+    if (!GetSourceFileInfo(Filename, Header.SourceSize, Header.SourceModTime)) {
+        return;
+    }
+
+    Header.VerticesOffset = AlignOffset(sizeof(Header));
+    Header.IndicesOffset = AlignOffset(Header.VerticesOffset + (long long)NumVertices * Header.VertexSize);
+    Header.MeshesOffset = AlignOffset(Header.IndicesOffset + (long long)m_Indices.size() * sizeof(uint));
+    Header.MaterialsOffset = AlignOffset(Header.MeshesOffset + (long long)Meshes.size() * sizeof(MeshCacheEntry));
+    Header.NumMeshlets = (uint)m_meshlets.size();
+    Header.MeshletsOffset = AlignOffset(Header.MaterialsOffset + (long long)Materials.size() * sizeof(MeshCacheMaterial));
+    Header.ExtraOffset = AlignOffset(Header.MeshletsOffset + (long long)m_meshlets.size() * sizeof(Meshlet));
+    Header.ExtraSize = (long long)Extra.size();
+
+    struct Section {
+        long long Offset;
+        const void* pData;
+        size_t Size;
+    } Sections[] = {
+        { 0,                      &Header,          sizeof(Header) },
+        { Header.VerticesOffset,  pVertices,         (size_t)NumVertices * Header.VertexSize },
+        { Header.IndicesOffset,   m_Indices.data(),  m_Indices.size() * sizeof(uint) },
+        { Header.MeshesOffset,    Meshes.data(),     Meshes.size() * sizeof(MeshCacheEntry) },
+        { Header.MaterialsOffset, Materials.data(),  Materials.size() * sizeof(MeshCacheMaterial) },
+        { Header.MeshletsOffset,  m_meshlets.data(), m_meshlets.size() * sizeof(Meshlet) },
+        { Header.ExtraOffset,     Extra.data(),      Extra.size() },
+    };
+
+    // written under a temporary name so that a partial file is never mapped
+    string TempFilename = CacheFilename + ".tmp";
+
+    FILE* f = fopen(TempFilename.c_str(), "wb");
+
+    if (!f) {
+        printf("Error creating the mesh cache '%s'\n", TempFilename.c_str());
+        return;
+    }
+
+    bool Success = true;
+    long long Pos = 0;
+    const char Padding[MESH_CACHE_ALIGN] = { 0 };
+
+    for (int i = 0 ; (i < (int)ARRAY_SIZE_IN_ELEMENTS(Sections)) && Success ; i++) {
+        Success = (fwrite(Padding, 1, (size_t)(Sections[i].Offset - Pos), f) == (size_t)(Sections[i].Offset - Pos));
+
+        if (Success && (Sections[i].Size > 0)) {
+            Success = (fwrite(Sections[i].pData, 1, Sections[i].Size, f) == Sections[i].Size);
+        }
+
+        Pos = Sections[i].Offset + (long long)Sections[i].Size;
+    }
+
+    Success = (fclose(f) == 0) && Success;
+
+    if (Success) {
+        remove(CacheFilename.c_str());
+        Success = (rename(TempFilename.c_str(), CacheFilename.c_str()) == 0);
+    }
+
+    if (Success) {
+        printf("Created the mesh cache '%s'\n", CacheFilename.c_str());
+    } else {
+        printf("Error writing the mesh cache '%s'\n", CacheFilename.c_str());
+        remove(TempFilename.c_str());
+    }
+}
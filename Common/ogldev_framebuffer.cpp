@@ -12,6 +12,12 @@ Framebuffer::Framebuffer()
 
 
 Framebuffer::~Framebuffer()
+{
+	Destroy();
+}
+
+
+void Framebuffer::Destroy()
 {
 	if (m_fbo != 0) {
 		glDeleteFramebuffers(1, &m_fbo);
@@ -24,6 +30,10 @@ Framebuffer::~Framebuffer()
 	if (m_depthBuffer != 0) {
 		glDeleteTextures(1, &m_depthBuffer);
 	}
+
+	m_fbo = 0;
+	m_textureBuffer = 0;
+	m_depthBuffer = 0;
 }
 
 
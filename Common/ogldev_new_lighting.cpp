@@ -144,6 +144,9 @@ bool LightingTechnique::InitCommon()
     PBRMaterialLoc.IsMetal = GetUniformLocation("gPBRmaterial.IsMetal");
     PBRMaterialLoc.Color = GetUniformLocation("gPBRmaterial.Color");
     ClipPlaneLoc = GetUniformLocation("gClipPlane");
+    PosOffsetLoc = GetUniformLocation("gPosOffset");
+    PosScaleLoc = GetUniformLocation("gPosScale");
+    OctNormalsLoc = GetUniformLocation("gOctNormals");
     WireframeWidthLoc = GetUniformLocation("gWireframeWidth");
     WireframeColorLoc = GetUniformLocation("gWireframeColor");
 
@@ -641,6 +644,15 @@ void LightingTechnique::SetClipPlane(const Vector3f& Normal, const Vector3f& Poi
 }
 
 
+// see BasicMesh::GetVertexDecode
+void LightingTechnique::SetVertexDecode(const Vector3f& PosOffset, const Vector3f& PosScale, bool OctNormals)
+{
+    glUniform3f(PosOffsetLoc, PosOffset.x, PosOffset.y, PosOffset.z);
+    glUniform3f(PosScaleLoc, PosScale.x, PosScale.y, PosScale.z);
+    glUniform1i(OctNormalsLoc, OctNormals ? 1 : 0);
+}
+
+
 void LightingTechnique::SetWireframeWidth(float Width)
 {
     if (WireframeWidthLoc == INVALID_UNIFORM_LOCATION) {
@@ -214,6 +214,11 @@ void PhongRenderer::Render(BasicMesh* pMesh)
 
     m_lightingTech.SetMaterial(pMesh->GetMaterial());
 
+    Vector3f PosOffset, PosScale;
+    bool OctNormals = false;
+    pMesh->GetVertexDecode(PosOffset, PosScale, OctNormals);
+    m_lightingTech.SetVertexDecode(PosOffset, PosScale, OctNormals);
+
     if (m_isPBR) {
         m_lightingTech.SetPBR(true);
         m_lightingTech.SetPBRMaterial(pMesh->GetPBRMaterial());
@@ -233,19 +238,25 @@ void PhongRenderer::Render(BasicMesh* pMesh)
         m_lightingTech.SetViewportMatrix(m_pCamera->GetViewportMatrix());
     }
 
-    pMesh->Render();
+    pMesh->Render(WVP);
 }
 
 
 void PhongRenderer::RenderAnimation(SkinnedMesh* pMesh, float AnimationTimeSec, int AnimationIndex)
 {
-    RenderAnimationCommon(pMesh);
-
     vector<Matrix4f> Transforms;
     pMesh->GetBoneTransforms(AnimationTimeSec, Transforms, AnimationIndex);
 
-    for (uint i = 0 ; i < Transforms.size() ; i++) {
-        m_skinningTech.SetBoneTransform(i, Transforms[i]);
+    RenderAnimation(pMesh, Transforms.data(), (uint)Transforms.size());
+}
+
+
+void PhongRenderer::RenderAnimation(SkinnedMesh* pMesh, const Matrix4f* pBoneTransforms, uint NumBones)
+{
+    RenderAnimationCommon(pMesh);
+
+    for (uint i = 0 ; i < NumBones ; i++) {
+        m_skinningTech.SetBoneTransform(i, pBoneTransforms[i]);
     }
 
     pMesh->Render();
@@ -304,6 +315,11 @@ void PhongRenderer::RenderAnimationCommon(SkinnedMesh* pMesh)
 
     m_skinningTech.SetMaterial(pMesh->GetMaterial());
 
+    Vector3f PosOffset, PosScale;
+    bool OctNormals = false;
+    pMesh->GetVertexDecode(PosOffset, PosScale, OctNormals);
+    m_skinningTech.SetVertexDecode(PosOffset, PosScale, OctNormals);
+
     PBRMaterial Material;
     Material.Roughness = 0.43f;
     Material.IsMetal = false;
@@ -341,7 +357,16 @@ void PhongRenderer::RenderToShadowMap(BasicMesh* pMesh, const SpotLight& SpotLig
     Matrix4f Projection;
     Projection.InitPersProjTransform(persProjInfo);
 
-    Matrix4f WVP = Projection * View * World;
+    // shadow_map.vs has no vertex decode so it is folded into the matrix
+    Vector3f PosOffset, PosScale;
+    bool OctNormals = false;
+    pMesh->GetVertexDecode(PosOffset, PosScale, OctNormals);
+
+    Matrix4f Translation, Scale;
+    Translation.InitTranslationTransform(PosOffset);
+    Scale.InitScaleTransform(PosScale);
+
+    Matrix4f WVP = Projection * View * World * Translation * Scale;
 
     m_shadowMapTech.SetWVP(WVP);
 
@@ -21,6 +21,11 @@
 
 #include "3rdparty/meshoptimizer/src/meshoptimizer.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define CPU_SKINNING_USE_SSE
+#include <emmintrin.h>
+#endif
+
 using namespace std;
 
 #define POSITION_LOCATION    0
@@ -38,8 +43,171 @@ SkinnedMesh::~SkinnedMesh()
 
 void SkinnedMesh::ReserveSpace(unsigned int NumVertices, unsigned int NumIndices)
 {
-    BasicMesh::ReserveSpace(NumVertices, NumIndices);
+    m_SkinnedVertices.clear();
+    m_SkinnedVertices.resize(NumVertices);
+    m_Indices.clear();
+    m_Indices.resize(NumIndices);
     InitializeRequiredNodeMap(m_pScene->mRootNode);
+    RegisterBones(m_pScene);
+}
+
+
+// The bone ids and the required nodes are shared by all the meshes so they are
+// set up here before the meshes are loaded in parallel. This also keeps the
+// bone ids in the same order as a serial load.
+void SkinnedMesh::RegisterBones(const aiScene* pScene)
+{
+    for (uint MeshIndex = 0 ; MeshIndex < pScene->mNumMeshes ; MeshIndex++) {
+        const aiMesh* pMesh = pScene->mMeshes[MeshIndex];
+
+        for (uint i = 0 ; i < pMesh->mNumBones ; i++) {
+            const aiBone* pBone = pMesh->mBones[i];
+
+            int BoneId = GetBoneId(pBone);
+
+            if (BoneId == m_BoneInfo.size()) {
+                BoneInfo bi(pBone->mOffsetMatrix);
+                m_BoneInfo.push_back(bi);
+            }
+
+            MarkRequiredNodesForBone(pBone);
+        }
+    }
+
+    BuildSkeleton(pScene);
+
+    m_bakedClips.clear();
+
+    if (m_bakeSampleRate > 0.0f) {
+        BakeClips(pScene);
+    }
+}
+
+
+// Flattens the required nodes of the hierarchy into an array where every node
+// comes after its parent and resolves the names of the nodes into bone and
+// channel indices once so that evaluating a frame doesn't touch any string.
+void SkinnedMesh::BuildSkeleton(const aiScene* pScene)
+{
+    m_skeleton.clear();
+
+    AddSkeletonNode(pScene->mRootNode, -1);
+
+    map<string,int> NodeNameToIndex;
+
+    for (int i = 0 ; i < (int)m_skeleton.size() ; i++) {
+        NodeNameToIndex[m_skeleton[i].Name] = i;
+    }
+
+    m_nodeChannels.resize(pScene->mNumAnimations);
+
+    for (uint AnimIndex = 0 ; AnimIndex < pScene->mNumAnimations ; AnimIndex++) {
+        const aiAnimation* pAnimation = pScene->mAnimations[AnimIndex];
+
+        m_nodeChannels[AnimIndex].assign(m_skeleton.size(), -1);
+
+        for (uint i = 0 ; i < pAnimation->mNumChannels ; i++) {
+            map<string,int>::const_iterator it = NodeNameToIndex.find(pAnimation->mChannels[i]->mNodeName.C_Str());
+
+            // channels of nodes that don't affect any bone are never evaluated
+            if (it != NodeNameToIndex.end()) {
+                m_nodeChannels[AnimIndex][it->second] = i;
+            }
+        }
+    }
+
+    UpdateReducedSkeleton();
+}
+
+
+void SkinnedMesh::SetReducedSkeletonDepth(uint MaxDepth)
+{
+    m_reducedSkeletonDepth = (int)MaxDepth;
+    m_reducedSkeletonMask.clear();
+
+    UpdateReducedSkeleton();
+}
+
+
+void SkinnedMesh::SetReducedSkeletonMask(const vector<string>& FrozenBones)
+{
+    m_reducedSkeletonMask = FrozenBones;
+
+    UpdateReducedSkeleton();
+}
+
+
+void SkinnedMesh::UpdateReducedSkeleton()
+{
+    m_frozenNodes.assign(m_skeleton.size(), 0);
+
+    // the nodes come after their parents so going backwards finds the bones that have bones below them
+    vector<char> HasChildBones(m_skeleton.size(), 0);
+
+    for (int i = (int)m_skeleton.size() - 1 ; i >= 0 ; i--) {
+        const SkeletonNode& Node = m_skeleton[i];
+
+        if ((Node.Parent >= 0) && ((Node.BoneIndex >= 0) || HasChildBones[i])) {
+            HasChildBones[Node.Parent] = 1;
+        }
+    }
+
+    for (uint i = 0 ; i < m_skeleton.size() ; i++) {
+        const SkeletonNode& Node = m_skeleton[i];
+
+        if ((Node.Parent >= 0) && m_frozenNodes[Node.Parent]) {
+            m_frozenNodes[i] = 1;
+        } else if (Node.BoneIndex < 0) {
+            continue;
+        } else if (!m_reducedSkeletonMask.empty()) {
+            m_frozenNodes[i] = std::find(m_reducedSkeletonMask.begin(), m_reducedSkeletonMask.end(), Node.Name) != m_reducedSkeletonMask.end();
+        } else if (m_reducedSkeletonDepth >= 0) {
+            m_frozenNodes[i] = Node.BoneDepth > m_reducedSkeletonDepth;
+        } else {
+            m_frozenNodes[i] = !HasChildBones[i];
+        }
+    }
+}
+
+
+void SkinnedMesh::AddSkeletonNode(const aiNode* pNode, int Parent)
+{
+    SkeletonNode Node;
+    Node.Name = pNode->mName.C_Str();
+    Node.Parent = Parent;
+    Node.Transformation = Matrix4f(pNode->mTransformation);
+
+    map<string,uint>::const_iterator it = m_BoneNameToIndexMap.find(pNode->mName.C_Str());
+
+    if (it != m_BoneNameToIndexMap.end()) {
+        Node.BoneIndex = (int)it->second;
+    }
+
+    int ParentDepth = (Parent >= 0) ? m_skeleton[Parent].BoneDepth : -1;
+    Node.BoneDepth = (Node.BoneIndex >= 0) ? ParentDepth + 1 : ParentDepth;
+
+    int NodeIndex = (int)m_skeleton.size();
+    m_skeleton.push_back(Node);
+
+    for (uint i = 0 ; i < pNode->mNumChildren ; i++) {
+        map<string,NodeInfo>::const_iterator Child = m_requiredNodeMap.find(pNode->mChildren[i]->mName.C_Str());
+
+        if (Child == m_requiredNodeMap.end()) {
+            printf("Child %s cannot be found in the required node map\n", pNode->mChildren[i]->mName.C_Str());
+            assert(0);
+        }
+
+        if (Child->second.isRequired) {
+            AddSkeletonNode(pNode->mChildren[i], NodeIndex);
+        }
+    }
+}
+
+
+void SkinnedMesh::CompactMeshes()
+{
+    CompactMeshArrays(m_Meshes, m_SkinnedVertices, m_Indices);
+    CalcBoundingSphere(m_SkinnedVertices, (uint)m_SkinnedVertices.size());
 }
 
 
@@ -51,6 +219,8 @@ void SkinnedMesh::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
     // Populate the vertex attribute vectors
     SkinnedVertex v;
 
+    SkinnedVertex* pVertices = m_SkinnedVertices.data() + m_Meshes[MeshIndex].BaseVertex;
+
     for (unsigned int i = 0; i < paiMesh->mNumVertices; i++) {
         const aiVector3D& pPos = paiMesh->mVertices[i];
         // printf("%d: ", i); Vector3f v(pPos.x, pPos.y, pPos.z); v.Print();
@@ -68,15 +238,17 @@ void SkinnedMesh::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
         const aiVector3D& pTexCoord = paiMesh->HasTextureCoords(0) ? paiMesh->mTextureCoords[0][i] : Zero3D;
         v.TexCoords = Vector2f(pTexCoord.x, pTexCoord.y);
 
-        m_SkinnedVertices.push_back(v);
+        pVertices[i] = v;
     }
 
+    uint* pIndices = m_Indices.data() + m_Meshes[MeshIndex].BaseIndex;
+
     // Populate the index buffer
     for (unsigned int i = 0; i < paiMesh->mNumFaces; i++) {
         const aiFace& Face = paiMesh->mFaces[i];
-        m_Indices.push_back(Face.mIndices[0]);
-        m_Indices.push_back(Face.mIndices[1]);
-        m_Indices.push_back(Face.mIndices[2]);
+        pIndices[i * 3 + 0] = Face.mIndices[0];
+        pIndices[i * 3 + 1] = Face.mIndices[1];
+        pIndices[i * 3 + 2] = Face.mIndices[2];
     }
 
     LoadMeshBones(MeshIndex, paiMesh, m_SkinnedVertices, m_Meshes[MeshIndex].BaseVertex);
@@ -113,9 +285,6 @@ void SkinnedMesh::InitSingleMeshOpt(uint MeshIndex, const aiMesh* paiMesh)
         SkinnedVertices[i] = v;
     }
 
-    m_Meshes[MeshIndex].BaseVertex = (uint)m_SkinnedVertices.size();
-    m_Meshes[MeshIndex].BaseIndex = (uint)m_Indices.size();    
-
     int NumIndices = paiMesh->mNumFaces * 3;
 
     std::vector<uint> Indices;
@@ -139,8 +308,8 @@ void SkinnedMesh::OptimizeMesh(int MeshIndex, std::vector<uint>& Indices, std::v
 {
     size_t NumIndices = Indices.size();
 
-    std::vector<unsigned int> remap(NumIndices);
-    size_t OptVertexCount = meshopt_generateVertexRemap(remap.data(), Indices.data(), Indices.size(), SkinnedVertices.data(), Indices.size(), sizeof(SkinnedVertex));
+    std::vector<unsigned int> remap(SkinnedVertices.size());
+    size_t OptVertexCount = meshopt_generateVertexRemap(remap.data(), Indices.data(), Indices.size(), SkinnedVertices.data(), SkinnedVertices.size(), sizeof(SkinnedVertex));
 
     std::vector<uint> OptIndices;
     std::vector<SkinnedVertex> OptVertices;
@@ -157,21 +326,15 @@ void SkinnedMesh::OptimizeMesh(int MeshIndex, std::vector<uint>& Indices, std::v
 
     meshopt_optimizeVertexFetch(OptVertices.data(), OptIndices.data(), NumIndices, OptVertices.data(), OptVertexCount, sizeof(SkinnedVertex));
 
-    float Threshold = 1.0f;
-    size_t TargetIndexCount = (size_t)(NumIndices * Threshold);
-    float TargetError = 1.0f;
-    std::vector<unsigned int> IndicesLod(OptIndices.size());
-    size_t OptIndexCount = meshopt_simplify(&IndicesLod[0], OptIndices.data(), OptIndices.size(),
-        &OptVertices[0].Position.x, OptVertexCount, sizeof(SkinnedVertex), TargetIndexCount, TargetError);
-
-    OptIndices = IndicesLod;
-    OptIndices.resize(OptIndexCount);
+    std::copy(OptIndices.begin(), OptIndices.end(), m_Indices.begin() + m_Meshes[MeshIndex].BaseIndex);
 
-    m_Indices.insert(m_Indices.end(), OptIndices.begin(), OptIndices.end());
+    std::copy(OptVertices.begin(), OptVertices.end(), m_SkinnedVertices.begin() + m_Meshes[MeshIndex].BaseVertex);
 
-    m_SkinnedVertices.insert(m_SkinnedVertices.end(), OptVertices.begin(), OptVertices.end());
+    m_Meshes[MeshIndex].NumIndices = (uint)NumIndices;
+    m_Meshes[MeshIndex].NumVertices = (uint)OptVertexCount;
 
-    m_Meshes[MeshIndex].NumIndices = (uint)OptIndexCount;
+    // the LODs share the vertices (and the bones) of the full mesh
+    GenerateLODs(MeshIndex, &OptVertices[0].Position.x, OptVertexCount, sizeof(SkinnedVertex));
 }
 
 
@@ -188,27 +351,25 @@ void SkinnedMesh::LoadMeshBones(uint MeshIndex, const aiMesh* pMesh, vector<Skin
         // printf("Bone %d %s\n", i, pMesh->mBones[i]->mName.C_Str());
         LoadSingleBone(MeshIndex, pMesh->mBones[i], SkinnedVertices, BaseVertex);
     }
+
+    for (uint i = 0 ; i < pMesh->mNumVertices ; i++) {
+        SkinnedVertices[BaseVertex + i].Bones.Normalize();
+    }
 }
 
 
+// called in parallel for different meshes - the bone was already added by RegisterBones
+// so GetBoneId only looks it up
 void SkinnedMesh::LoadSingleBone(uint MeshIndex, const aiBone* pBone, vector<SkinnedVertex>& SkinnedVertices, int BaseVertex)
 {
     int BoneId = GetBoneId(pBone);
 
-    if (BoneId == m_BoneInfo.size()) {
-        BoneInfo bi(pBone->mOffsetMatrix);
-        // bi.OffsetMatrix.Print();
-        m_BoneInfo.push_back(bi);
-    }
-
     for (uint i = 0 ; i < pBone->mNumWeights ; i++) {
         const aiVertexWeight& vw = pBone->mWeights[i];
         uint GlobalVertexID = BaseVertex + pBone->mWeights[i].mVertexId;
         // printf("%d: %d %f\n",i, pBone->mWeights[i].mVertexId, vw.mWeight);
         SkinnedVertices[GlobalVertexID].Bones.AddBoneData(BoneId, vw.mWeight);
     }
-
-    MarkRequiredNodesForBone(pBone);
 }
 
 
@@ -257,13 +418,15 @@ int SkinnedMesh::GetBoneId(const aiBone* pBone)
     int BoneIndex = 0;
     string BoneName(pBone->mName.C_Str());
 
-    if (m_BoneNameToIndexMap.find(BoneName) == m_BoneNameToIndexMap.end()) {
+    map<string,uint>::const_iterator it = m_BoneNameToIndexMap.find(BoneName);
+
+    if (it == m_BoneNameToIndexMap.end()) {
         // Allocate an index for a new bone
         BoneIndex = (int)m_BoneNameToIndexMap.size();
         m_BoneNameToIndexMap[BoneName] = BoneIndex;
     }
     else {
-        BoneIndex = m_BoneNameToIndexMap[BoneName];
+        BoneIndex = it->second;
     }
 
     return BoneIndex;
@@ -272,12 +435,259 @@ int SkinnedMesh::GetBoneId(const aiBone* pBone)
 
 void SkinnedMesh::PopulateBuffers()
 {
-    if (IsGLVersionHigher(4, 5)) {
+    if ((m_vertexFormat != VERTEX_FORMAT_FLOAT) || (m_boneWeightFormat != BONE_WEIGHT_FORMAT_FLOAT)) {
+        PopulatePackedBuffers();
+    }
+    else if (IsGLVersionHigher(4, 5)) {
         PopulateBuffersDSA();
     }
     else {
         PopulateBuffersNonDSA();
     }
+
+    if (m_cpuSkinning) {
+        PrepareCPUSkinning();
+    }
+}
+
+
+// The bind pose is copied into blocks of CPU_SKINNING_BLOCK_SIZE vertices with
+// every attribute in its own array. The last block is padded with vertices that
+// have no weights.
+void SkinnedMesh::PrepareCPUSkinning()
+{
+    uint NumVertices = (uint)m_SkinnedVertices.size();
+    uint NumBlocks = (NumVertices + CPU_SKINNING_BLOCK_SIZE - 1) / CPU_SKINNING_BLOCK_SIZE;
+
+    m_skinningBlocks.clear();
+    m_skinningBlocks.resize(NumBlocks);
+
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        const SkinnedVertex& v = m_SkinnedVertices[i];
+        CPUSkinningBlock& Block = m_skinningBlocks[i / CPU_SKINNING_BLOCK_SIZE];
+        uint Lane = i % CPU_SKINNING_BLOCK_SIZE;
+
+        Block.PosX[Lane] = v.Position.x;
+        Block.PosY[Lane] = v.Position.y;
+        Block.PosZ[Lane] = v.Position.z;
+        Block.NormalX[Lane] = v.Normal.x;
+        Block.NormalY[Lane] = v.Normal.y;
+        Block.NormalZ[Lane] = v.Normal.z;
+
+        for (uint j = 0 ; j < MAX_NUM_BONES_PER_VERTEX ; j++) {
+            Block.BoneIDs[j][Lane] = v.Bones.BoneIDs[j];
+            Block.Weights[j][Lane] = v.Bones.Weights[j];
+        }
+    }
+}
+
+
+static const uint CPU_SKINNING_BLOCKS_PER_TASK = 256;
+
+
+void SkinnedMesh::CalcSkinnedVertices(const Matrix4f* pBoneTransforms, void* pPositions, void* pNormals, uint Stride, int NumThreads) const
+{
+    if (!m_cpuSkinning) {
+        printf("%s: CPU skinning was not enabled before LoadMesh\n", __FUNCTION__);
+        return;
+    }
+
+    uint NumBlocks = (uint)m_skinningBlocks.size();
+    int NumTasks = (int)((NumBlocks + CPU_SKINNING_BLOCKS_PER_TASK - 1) / CPU_SKINNING_BLOCKS_PER_TASK);
+
+    if (NumTasks <= 1) {
+        SkinBlocks(pBoneTransforms, 0, NumBlocks, (unsigned char*)pPositions, (unsigned char*)pNormals, Stride);
+        return;
+    }
+
+    ParallelFor(NumTasks, [&](int i) {
+        uint StartBlock = i * CPU_SKINNING_BLOCKS_PER_TASK;
+        uint EndBlock = std::min(StartBlock + CPU_SKINNING_BLOCKS_PER_TASK, NumBlocks);
+        SkinBlocks(pBoneTransforms, StartBlock, EndBlock, (unsigned char*)pPositions, (unsigned char*)pNormals, Stride);
+    }, NumThreads);
+}
+
+
+void SkinnedMesh::CalcSkinnedVerticesToBuffer(const Matrix4f* pBoneTransforms, GLuint Buffer, int NumThreads) const
+{
+    GLsizeiptr Size = (GLsizeiptr)(m_SkinnedVertices.size() * sizeof(Vector3f) * 2);
+    GLbitfield Access = GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT;
+
+    unsigned char* pData = NULL;
+
+    if (IsGLVersionHigher(4, 5)) {
+        pData = (unsigned char*)glMapNamedBufferRange(Buffer, 0, Size, Access);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+        pData = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, Size, Access);
+    }
+
+    if (!pData) {
+        printf("%s: cannot map buffer %d\n", __FUNCTION__, Buffer);
+    } else {
+        CalcSkinnedVertices(pBoneTransforms, pData, pData + sizeof(Vector3f), sizeof(Vector3f) * 2, NumThreads);
+    }
+
+    if (IsGLVersionHigher(4, 5)) {
+        if (pData) {
+            glUnmapNamedBuffer(Buffer);
+        }
+    } else {
+        if (pData) {
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+        }
+
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+
+static inline void StoreSkinnedVertex(unsigned char* pPositions, unsigned char* pNormals, uint Stride, uint Index,
+                                      float px, float py, float pz, float nx, float ny, float nz)
+{
+    float* pPos = (float*)(pPositions + (size_t)Index * Stride);
+    pPos[0] = px;
+    pPos[1] = py;
+    pPos[2] = pz;
+
+    if (pNormals) {
+        float* pNormal = (float*)(pNormals + (size_t)Index * Stride);
+        pNormal[0] = nx;
+        pNormal[1] = ny;
+        pNormal[2] = nz;
+    }
+}
+
+
+// The positions get the same blended matrix as in skinning.vs. The shader
+// passes the bind pose normal through but here the normal is transformed by
+// the blended matrix too (no inverse transpose) and normalized.
+void SkinnedMesh::SkinBlocks(const Matrix4f* pBoneTransforms, uint StartBlock, uint EndBlock,
+                             unsigned char* pPositions, unsigned char* pNormals, uint Stride) const
+{
+    uint NumVertices = (uint)m_SkinnedVertices.size();
+
+    for (uint b = StartBlock ; b < EndBlock ; b++) {
+        const CPUSkinningBlock& Block = m_skinningBlocks[b];
+        uint BaseVertex = b * CPU_SKINNING_BLOCK_SIZE;
+
+#ifdef CPU_SKINNING_USE_SSE
+        // the 8 vertices of the block are done as two groups of 4 lanes
+        for (uint Group = 0 ; Group < CPU_SKINNING_BLOCK_SIZE ; Group += 4) {
+            if (BaseVertex + Group >= NumVertices) {
+                break;
+            }
+
+            // Rows[r][l] = row r of the blended matrix of lane l (the top 3 rows are enough)
+            __m128 Rows[3][4];
+
+            for (uint l = 0 ; l < 4 ; l++) {
+                Rows[0][l] = Rows[1][l] = Rows[2][l] = _mm_setzero_ps();
+
+                for (uint j = 0 ; j < MAX_NUM_BONES_PER_VERTEX ; j++) {
+                    float Weight = Block.Weights[j][Group + l];
+
+                    if (Weight == 0.0f) {
+                        continue;
+                    }
+
+                    const float* pBone = &pBoneTransforms[Block.BoneIDs[j][Group + l]].m[0][0];
+                    __m128 w = _mm_set1_ps(Weight);
+
+                    Rows[0][l] = _mm_add_ps(Rows[0][l], _mm_mul_ps(_mm_loadu_ps(pBone), w));
+                    Rows[1][l] = _mm_add_ps(Rows[1][l], _mm_mul_ps(_mm_loadu_ps(pBone + 4), w));
+                    Rows[2][l] = _mm_add_ps(Rows[2][l], _mm_mul_ps(_mm_loadu_ps(pBone + 8), w));
+                }
+            }
+
+            // now Rows[r][c] = element (r, c) of the matrices of the 4 lanes
+            for (uint r = 0 ; r < 3 ; r++) {
+                _MM_TRANSPOSE4_PS(Rows[r][0], Rows[r][1], Rows[r][2], Rows[r][3]);
+            }
+
+            __m128 x = _mm_load_ps(Block.PosX + Group);
+            __m128 y = _mm_load_ps(Block.PosY + Group);
+            __m128 z = _mm_load_ps(Block.PosZ + Group);
+
+            __m128 Pos[3];
+            __m128 Normal[3];
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                Pos[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Rows[r][0], x), _mm_mul_ps(Rows[r][1], y)),
+                                    _mm_add_ps(_mm_mul_ps(Rows[r][2], z), Rows[r][3]));
+            }
+
+            x = _mm_load_ps(Block.NormalX + Group);
+            y = _mm_load_ps(Block.NormalY + Group);
+            z = _mm_load_ps(Block.NormalZ + Group);
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                Normal[r] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Rows[r][0], x), _mm_mul_ps(Rows[r][1], y)), _mm_mul_ps(Rows[r][2], z));
+            }
+
+            __m128 LengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(Normal[0], Normal[0]), _mm_mul_ps(Normal[1], Normal[1])),
+                                         _mm_mul_ps(Normal[2], Normal[2]));
+            __m128 InvLength = _mm_div_ps(_mm_set1_ps(1.0f), _mm_sqrt_ps(_mm_max_ps(LengthSq, _mm_set1_ps(1e-20f))));
+
+            float Out[6][4];
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                _mm_storeu_ps(Out[r], Pos[r]);
+                _mm_storeu_ps(Out[r + 3], _mm_mul_ps(Normal[r], InvLength));
+            }
+
+            uint NumLanes = std::min(NumVertices - (BaseVertex + Group), 4u);
+
+            for (uint l = 0 ; l < NumLanes ; l++) {
+                StoreSkinnedVertex(pPositions, pNormals, Stride, BaseVertex + Group + l,
+                                   Out[0][l], Out[1][l], Out[2][l], Out[3][l], Out[4][l], Out[5][l]);
+            }
+        }
+#else
+        uint NumLanes = std::min(NumVertices - BaseVertex, (uint)CPU_SKINNING_BLOCK_SIZE);
+
+        for (uint l = 0 ; l < NumLanes ; l++) {
+            float m[3][4] = {};
+
+            for (uint j = 0 ; j < MAX_NUM_BONES_PER_VERTEX ; j++) {
+                float Weight = Block.Weights[j][l];
+
+                if (Weight == 0.0f) {
+                    continue;
+                }
+
+                const Matrix4f& Bone = pBoneTransforms[Block.BoneIDs[j][l]];
+
+                for (uint r = 0 ; r < 3 ; r++) {
+                    for (uint c = 0 ; c < 4 ; c++) {
+                        m[r][c] += Bone.m[r][c] * Weight;
+                    }
+                }
+            }
+
+            float x = Block.PosX[l], y = Block.PosY[l], z = Block.PosZ[l];
+            float Pos[3];
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                Pos[r] = m[r][0] * x + m[r][1] * y + m[r][2] * z + m[r][3];
+            }
+
+            x = Block.NormalX[l];
+            y = Block.NormalY[l];
+            z = Block.NormalZ[l];
+            float Normal[3];
+
+            for (uint r = 0 ; r < 3 ; r++) {
+                Normal[r] = m[r][0] * x + m[r][1] * y + m[r][2] * z;
+            }
+
+            float InvLength = 1.0f / sqrtf(std::max(Normal[0] * Normal[0] + Normal[1] * Normal[1] + Normal[2] * Normal[2], 1e-20f));
+
+            StoreSkinnedVertex(pPositions, pNormals, Stride, BaseVertex + l,
+                               Pos[0], Pos[1], Pos[2], Normal[0] * InvLength, Normal[1] * InvLength, Normal[2] * InvLength);
+        }
+#endif
+    }
 }
 
 
@@ -349,289 +759,1067 @@ void SkinnedMesh::PopulateBuffersDSA()
 }
 
 
-
-uint SkinnedMesh::FindPosition(float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+// Writes the bone indices of a vertex (IndexSize bytes each) followed by the weights
+// in unorm of WeightSize bytes. The weights are sorted so the rounding error is added
+// to the first one and they still add up to exactly 1.
+static void PackBoneInfluences(const uint* pBoneIDs, const float* pWeights, uint IndexSize, uint WeightSize, unsigned char* pDst)
 {
-    for (uint i = 0 ; i < pNodeAnim->mNumPositionKeys - 1 ; i++) {
-        float t = (float)pNodeAnim->mPositionKeys[i + 1].mTime;
-        if (AnimationTimeTicks < t) {
-            return i;
-        }
+    int NumBits = WeightSize * 8;
+    int Weights[SkinnedMesh::MAX_NUM_BONES_PER_VERTEX];
+    int Sum = 0;
+
+    for (int i = 0 ; i < SkinnedMesh::MAX_NUM_BONES_PER_VERTEX ; i++) {
+        Weights[i] = meshopt_quantizeUnorm(pWeights[i], NumBits);
+        Sum += Weights[i];
+    }
+
+    if (Sum > 0) {
+        Weights[0] += (1 << NumBits) - 1 - Sum;
     }
 
-    return 0;
+    unsigned char* pDstWeights = pDst + SkinnedMesh::MAX_NUM_BONES_PER_VERTEX * IndexSize;
+
+    for (int i = 0 ; i < SkinnedMesh::MAX_NUM_BONES_PER_VERTEX ; i++) {
+        if (IndexSize == 2) {
+            unsigned short BoneID = (unsigned short)pBoneIDs[i];
+            memcpy(pDst + i * 2, &BoneID, 2);
+        } else {
+            pDst[i] = (unsigned char)pBoneIDs[i];
+        }
+
+        if (WeightSize == 2) {
+            unsigned short Weight = (unsigned short)Weights[i];
+            memcpy(pDstWeights + i * 2, &Weight, 2);
+        } else {
+            pDstWeights[i] = (unsigned char)Weights[i];
+        }
+    }
 }
 
 
-void SkinnedMesh::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+// Every vertex starts with the float attributes of SkinnedVertex or with a
+// QuantizedVertex and it is followed by the packed bone indices and weights.
+void SkinnedMesh::PopulatePackedBuffers()
 {
-    // we need at least two values to interpolate...
-    if (pNodeAnim->mNumPositionKeys == 1) {
-        Out = pNodeAnim->mPositionKeys[0].mValue;
-        return;
+    if (NumBones() > 65536) {
+        printf("%s:%d - %d bones don't fit in the 16 bit bone indices of the packed layout\n", __FILE__, __LINE__, NumBones());
+        exit(0);
     }
 
-    uint PositionIndex = FindPosition(AnimationTimeTicks, pNodeAnim);
-    uint NextPositionIndex = PositionIndex + 1;
-    assert(NextPositionIndex < pNodeAnim->mNumPositionKeys);
-    float t1 = (float)pNodeAnim->mPositionKeys[PositionIndex].mTime;
-    if (t1 > AnimationTimeTicks) {
-        Out = pNodeAnim->mPositionKeys[PositionIndex].mValue;
-    } else {
-        float t2 = (float)pNodeAnim->mPositionKeys[NextPositionIndex].mTime;
-        float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - t1) / DeltaTime;
-        assert(Factor >= 0.0f && Factor <= 1.0f);
-        const aiVector3D& Start = pNodeAnim->mPositionKeys[PositionIndex].mValue;
-        const aiVector3D& End = pNodeAnim->mPositionKeys[NextPositionIndex].mValue;
-        aiVector3D Delta = End - Start;
-        Out = Start + Factor * Delta;
+    bool Quantized = (m_vertexFormat != VERTEX_FORMAT_FLOAT);
+    uint NumVertices = (uint)m_SkinnedVertices.size();
+
+    uint IndexSize = (NumBones() > 256) ? 2 : 1;
+    uint WeightSize = (m_boneWeightFormat == BONE_WEIGHT_FORMAT_UNORM16) ? 2 : 1;
+    GLenum IndexType = (IndexSize == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+    GLenum WeightType = (WeightSize == 2) ? GL_UNSIGNED_SHORT : GL_UNSIGNED_BYTE;
+
+    // the position, texture coordinates and normal of SkinnedVertex
+    uint FloatAttribsSize = (uint)offsetof(SkinnedVertex, Bones);
+
+    GLuint BoneIDsOffset = Quantized ? (GLuint)sizeof(QuantizedVertex) : (GLuint)FloatAttribsSize;
+    GLuint WeightsOffset = BoneIDsOffset + MAX_NUM_BONES_PER_VERTEX * IndexSize;
+    GLsizei Stride = (GLsizei)(WeightsOffset + MAX_NUM_BONES_PER_VERTEX * WeightSize);
+
+    if (Quantized) {
+        CalcPositionDecode(&m_SkinnedVertices[0].Position.x, NumVertices, sizeof(SkinnedVertex));
     }
-}
 
+    vector<unsigned char> PackedVertices((size_t)Stride * NumVertices);
 
-uint SkinnedMesh::FindRotation(float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
-{
-    assert(pNodeAnim->mNumRotationKeys > 0);
+    for (uint i = 0 ; i < NumVertices ; i++) {
+        const SkinnedVertex& v = m_SkinnedVertices[i];
+        unsigned char* pVertex = &PackedVertices[(size_t)i * Stride];
 
-    for (uint i = 0 ; i < pNodeAnim->mNumRotationKeys - 1 ; i++) {
-        float t = (float)pNodeAnim->mRotationKeys[i + 1].mTime;
-        if (AnimationTimeTicks < t) {
-            return i;
+        if (Quantized) {
+            QuantizedVertex qv;
+            QuantizeVertex(v.Position, v.TexCoords, v.Normal, qv);
+            memcpy(pVertex, &qv, sizeof(qv));
+        } else {
+            memcpy(pVertex, &v, FloatAttribsSize);
         }
+
+        PackBoneInfluences(v.Bones.BoneIDs, v.Bones.Weights, IndexSize, WeightSize, pVertex + BoneIDsOffset);
     }
 
-    return 0;
-}
+    if (IsGLVersionHigher(4, 5)) {
+        glNamedBufferStorage(m_Buffers[VERTEX_BUFFER], PackedVertices.size(), PackedVertices.data(), 0);
+        glNamedBufferStorage(m_Buffers[INDEX_BUFFER], sizeof(m_Indices[0]) * m_Indices.size(), m_Indices.data(), GL_DYNAMIC_STORAGE_BIT);
 
+        glVertexArrayVertexBuffer(m_VAO, 0, m_Buffers[VERTEX_BUFFER], 0, Stride);
+        glVertexArrayElementBuffer(m_VAO, m_Buffers[INDEX_BUFFER]);
+    } else {
+        glBindBuffer(GL_ARRAY_BUFFER, m_Buffers[VERTEX_BUFFER]);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_Buffers[INDEX_BUFFER]);
 
-void SkinnedMesh::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
-{
-    // we need at least two values to interpolate...
-    if (pNodeAnim->mNumRotationKeys == 1) {
-        Out = pNodeAnim->mRotationKeys[0].mValue;
-        return;
+        glBufferData(GL_ARRAY_BUFFER, PackedVertices.size(), PackedVertices.data(), GL_STATIC_DRAW);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(m_Indices[0]) * m_Indices.size(), &m_Indices[0], GL_STATIC_DRAW);
     }
 
-    uint RotationIndex = FindRotation(AnimationTimeTicks, pNodeAnim);
-    uint NextRotationIndex = RotationIndex + 1;
-    assert(NextRotationIndex < pNodeAnim->mNumRotationKeys);
-    float t1 = (float)pNodeAnim->mRotationKeys[RotationIndex].mTime;
-    if (t1 > AnimationTimeTicks) {
-        Out = pNodeAnim->mRotationKeys[RotationIndex].mValue;
+    if (Quantized) {
+        SetupQuantizedAttribs(Stride);
     } else {
-        float t2 = (float)pNodeAnim->mRotationKeys[NextRotationIndex].mTime;
-        float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - t1) / DeltaTime;
-        assert(Factor >= 0.0f && Factor <= 1.0f);
-        const aiQuaternion& StartRotationQ = pNodeAnim->mRotationKeys[RotationIndex].mValue;
-        const aiQuaternion& EndRotationQ   = pNodeAnim->mRotationKeys[NextRotationIndex].mValue;
-        aiQuaternion::Interpolate(Out, StartRotationQ, EndRotationQ, Factor);
+        SetupFloatAttribs(Stride);
     }
 
-    Out.Normalize();
-}
-
+    if (IsGLVersionHigher(4, 5)) {
+        glEnableVertexArrayAttrib(m_VAO, BONE_ID_LOCATION);
+        glVertexArrayAttribIFormat(m_VAO, BONE_ID_LOCATION, MAX_NUM_BONES_PER_VERTEX, IndexType, BoneIDsOffset);
+        glVertexArrayAttribBinding(m_VAO, BONE_ID_LOCATION, 0);
 
-uint SkinnedMesh::FindScaling(float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
-{
-    assert(pNodeAnim->mNumScalingKeys > 0);
+        glEnableVertexArrayAttrib(m_VAO, BONE_WEIGHT_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, BONE_WEIGHT_LOCATION, MAX_NUM_BONES_PER_VERTEX, WeightType, GL_TRUE, WeightsOffset);
+        glVertexArrayAttribBinding(m_VAO, BONE_WEIGHT_LOCATION, 0);
+    } else {
+        glEnableVertexAttribArray(BONE_ID_LOCATION);
+        glVertexAttribIPointer(BONE_ID_LOCATION, MAX_NUM_BONES_PER_VERTEX, IndexType, Stride, (const void*)(size_t)BoneIDsOffset);
 
-    for (uint i = 0 ; i < pNodeAnim->mNumScalingKeys - 1 ; i++) {
-        float t = (float)pNodeAnim->mScalingKeys[i + 1].mTime;
-        if (AnimationTimeTicks < t) {
-            return i;
-        }
+        glEnableVertexAttribArray(BONE_WEIGHT_LOCATION);
+        glVertexAttribPointer(BONE_WEIGHT_LOCATION, MAX_NUM_BONES_PER_VERTEX, WeightType, GL_TRUE, Stride, (const void*)(size_t)WeightsOffset);
     }
 
-    return 0;
+    printf("Packed %d skinned vertices to %d bytes each (from %d)\n", NumVertices, Stride, (int)sizeof(SkinnedVertex));
 }
 
 
-void SkinnedMesh::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+// the float attributes of SkinnedVertex at the start of a vertex of size Stride
+void SkinnedMesh::SetupFloatAttribs(GLsizei Stride)
 {
-    // we need at least two values to interpolate...
-    if (pNodeAnim->mNumScalingKeys == 1) {
-        Out = pNodeAnim->mScalingKeys[0].mValue;
-        return;
-    }
+    GLuint PosOffset = (GLuint)offsetof(SkinnedVertex, Position);
+    GLuint TexCoordsOffset = (GLuint)offsetof(SkinnedVertex, TexCoords);
+    GLuint NormalOffset = (GLuint)offsetof(SkinnedVertex, Normal);
 
-    uint ScalingIndex = FindScaling(AnimationTimeTicks, pNodeAnim);
-    uint NextScalingIndex = ScalingIndex + 1;
-    assert(NextScalingIndex < pNodeAnim->mNumScalingKeys);
-    float t1 = (float)pNodeAnim->mScalingKeys[ScalingIndex].mTime;
-    if (t1 > AnimationTimeTicks) {
-        Out = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
+    if (IsGLVersionHigher(4, 5)) {
+        glEnableVertexArrayAttrib(m_VAO, POSITION_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, PosOffset);
+        glVertexArrayAttribBinding(m_VAO, POSITION_LOCATION, 0);
+
+        glEnableVertexArrayAttrib(m_VAO, TEX_COORD_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE, TexCoordsOffset);
+        glVertexArrayAttribBinding(m_VAO, TEX_COORD_LOCATION, 0);
+
+        glEnableVertexArrayAttrib(m_VAO, NORMAL_LOCATION);
+        glVertexArrayAttribFormat(m_VAO, NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, NormalOffset);
+        glVertexArrayAttribBinding(m_VAO, NORMAL_LOCATION, 0);
     } else {
-        float t2 = (float)pNodeAnim->mScalingKeys[NextScalingIndex].mTime;
-        float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - (float)t1) / DeltaTime;
-        assert(Factor >= 0.0f && Factor <= 1.0f);
-        const aiVector3D& Start = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
-        const aiVector3D& End   = pNodeAnim->mScalingKeys[NextScalingIndex].mValue;
-        aiVector3D Delta = End - Start;
-        Out = Start + Factor * Delta;
+        glEnableVertexAttribArray(POSITION_LOCATION);
+        glVertexAttribPointer(POSITION_LOCATION, 3, GL_FLOAT, GL_FALSE, Stride, (const void*)(size_t)PosOffset);
+
+        glEnableVertexAttribArray(TEX_COORD_LOCATION);
+        glVertexAttribPointer(TEX_COORD_LOCATION, 2, GL_FLOAT, GL_FALSE, Stride, (const void*)(size_t)TexCoordsOffset);
+
+        glEnableVertexAttribArray(NORMAL_LOCATION);
+        glVertexAttribPointer(NORMAL_LOCATION, 3, GL_FLOAT, GL_FALSE, Stride, (const void*)(size_t)NormalOffset);
     }
 }
 
 
-void SkinnedMesh::ReadNodeHierarchy(float AnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform, const aiAnimation& Animation)
+void SkinnedMesh::BakeClips(const aiScene* pScene)
 {
-    string NodeName(pNode->mName.data);
-
-    Matrix4f NodeTransformation(pNode->mTransformation);
+    m_bakedClips.resize(pScene->mNumAnimations);
 
-    const aiNodeAnim* pNodeAnim = FindNodeAnim(Animation, NodeName);
+    ParallelFor((int)pScene->mNumAnimations, [&](int i) {
+        BakeClip(pScene->mAnimations[i], m_bakedClips[i]);
+    });
 
-    if (pNodeAnim) {
-        LocalTransform Transform;
-        CalcLocalTransform(Transform, AnimationTimeTicks, pNodeAnim);
+    size_t KeysSize = 0;
+    size_t BakedSize = 0;
 
-        Matrix4f ScalingM;
-        ScalingM.InitScaleTransform(Transform.Scaling.x, Transform.Scaling.y, Transform.Scaling.z);
-        //        printf("Scaling %f %f %f\n", Transoform.Scaling.x, Transform.Scaling.y, Transform.Scaling.z);
+    for (uint i = 0 ; i < pScene->mNumAnimations ; i++) {
+        const aiAnimation* pAnimation = pScene->mAnimations[i];
 
-        Matrix4f RotationM = Matrix4f(Transform.Rotation.GetMatrix());
-
-        Matrix4f TranslationM;
-        TranslationM.InitTranslationTransform(Transform.Translation.x, Transform.Translation.y, Transform.Translation.z);
-        //        printf("Translation %f %f %f\n", Transform.Translation.x, Transform.Translation.y, Transform.Translation.z);
+        for (uint c = 0 ; c < pAnimation->mNumChannels ; c++) {
+            const aiNodeAnim* pNodeAnim = pAnimation->mChannels[c];
+            KeysSize += pNodeAnim->mNumPositionKeys * sizeof(aiVectorKey) +
+                        pNodeAnim->mNumRotationKeys * sizeof(aiQuatKey) +
+                        pNodeAnim->mNumScalingKeys * sizeof(aiVectorKey);
+        }
 
-        // Combine the above transformations
-        NodeTransformation = TranslationM * RotationM * ScalingM;
+        BakedSize += m_bakedClips[i].GetSizeInBytes();
     }
 
-    Matrix4f GlobalTransformation = ParentTransform * NodeTransformation;
+    printf("Baked %d animations at %.0f samples per second: %d KB (the keys take %d KB)\n",
+           pScene->mNumAnimations, m_bakeSampleRate, (int)(BakedSize / 1024), (int)(KeysSize / 1024));
+}
 
-    if (m_BoneNameToIndexMap.find(NodeName) != m_BoneNameToIndexMap.end()) {
-        uint BoneIndex = m_BoneNameToIndexMap[NodeName];
-        m_BoneInfo[BoneIndex].FinalTransformation = m_GlobalInverseTransform * GlobalTransformation * m_BoneInfo[BoneIndex].OffsetMatrix;
-    }
 
-    for (uint i = 0 ; i < pNode->mNumChildren ; i++) {
-        string ChildName(pNode->mChildren[i]->mName.data);
+// The largest component of the unit quaternion is dropped and rebuilt from the
+// other three which are in [-1/sqrt(2), 1/sqrt(2)] and stored in 15 bits each.
+// The index of the dropped component takes the top bit of the first two.
+static void EncodeRotation(const aiQuaternion& q, unsigned short* pOut)
+{
+    float c[4] = { q.w, q.x, q.y, q.z };
 
-        map<string,NodeInfo>::iterator it = m_requiredNodeMap.find(ChildName);
+    int Largest = 0;
 
-        if (it == m_requiredNodeMap.end()) {
-            printf("Child %s cannot be found in the required node map\n", ChildName.c_str());
-            assert(0);
+    for (int i = 1 ; i < 4 ; i++) {
+        if (fabsf(c[i]) > fabsf(c[Largest])) {
+            Largest = i;
         }
+    }
+
+    // q and -q are the same rotation so the dropped component is always positive
+    float Sign = (c[Largest] < 0.0f) ? -1.0f : 1.0f;
+
+    int j = 0;
 
-        if (it->second.isRequired) {
-            ReadNodeHierarchy(AnimationTimeTicks, pNode->mChildren[i], GlobalTransformation, Animation);
+    for (int i = 0 ; i < 4 ; i++) {
+        if (i != Largest) {
+            float n = Sign * c[i] * 1.41421356f * 0.5f + 0.5f;     // [-1/sqrt(2), 1/sqrt(2)] -> [0, 1]
+            n = std::min(std::max(n, 0.0f), 1.0f);
+            pOut[j++] = (unsigned short)(n * 32767.0f + 0.5f);
         }
     }
+
+    pOut[0] |= (unsigned short)((Largest & 1) << 15);
+    pOut[1] |= (unsigned short)((Largest >> 1) << 15);
 }
 
 
-void SkinnedMesh::ReadNodeHierarchyBlended(float StartAnimationTimeTicks, float EndAnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform,
-                                           const aiAnimation& StartAnimation, const aiAnimation& EndAnimation, float BlendFactor)
+static aiQuaternion DecodeRotation(const unsigned short* pIn)
 {
-    string NodeName(pNode->mName.data);
+    int Largest = (pIn[0] >> 15) | ((pIn[1] >> 15) << 1);
 
-    Matrix4f NodeTransformation(pNode->mTransformation);
+    float Small[3];
+    float SumSq = 0.0f;
 
-    const aiNodeAnim* pStartNodeAnim = FindNodeAnim(StartAnimation, NodeName);
+    for (int i = 0 ; i < 3 ; i++) {
+        Small[i] = ((float)(pIn[i] & 0x7fff) / 32767.0f - 0.5f) * 1.41421356f;
+        SumSq += Small[i] * Small[i];
+    }
 
-    LocalTransform StartTransform;
+    float c[4];
+    int j = 0;
 
-    if (pStartNodeAnim) {
-        CalcLocalTransform(StartTransform, StartAnimationTimeTicks, pStartNodeAnim);
+    for (int i = 0 ; i < 4 ; i++) {
+        c[i] = (i == Largest) ? sqrtf(std::max(1.0f - SumSq, 0.0f)) : Small[j++];
     }
 
-    LocalTransform EndTransform;
+    return aiQuaternion(c[0], c[1], c[2], c[3]);
+}
+
 
-    const aiNodeAnim* pEndNodeAnim = FindNodeAnim(EndAnimation, NodeName);
+// Per track range and 16 bit unorm samples. A component that doesn't change
+// gets a zero step.
+void SkinnedMesh::QuantizedVectorTracks::AddTrack(const vector<aiVector3D>& Values)
+{
+    aiVector3D TrackMin = Values[0];
+    aiVector3D TrackMax = Values[0];
 
-    if ((pStartNodeAnim && !pEndNodeAnim) || (!pStartNodeAnim && pEndNodeAnim)) {
-        printf("On the node %s there is an animation node for only one of the start/end animations.\n", NodeName.c_str());
-        printf("This case is not supported\n");
-        exit(0);
+    for (uint i = 1 ; i < Values.size() ; i++) {
+        TrackMin.x = std::min(TrackMin.x, Values[i].x); TrackMax.x = std::max(TrackMax.x, Values[i].x);
+        TrackMin.y = std::min(TrackMin.y, Values[i].y); TrackMax.y = std::max(TrackMax.y, Values[i].y);
+        TrackMin.z = std::min(TrackMin.z, Values[i].z); TrackMax.z = std::max(TrackMax.z, Values[i].z);
     }
 
-    if (pEndNodeAnim) {
-        CalcLocalTransform(EndTransform, EndAnimationTimeTicks, pEndNodeAnim);
+    aiVector3D TrackStep = (TrackMax - TrackMin) / 65535.0f;
+
+    Min.push_back(TrackMin);
+    Step.push_back(TrackStep);
+    NumTracks++;
+}
+
+
+static unsigned short QuantizeUnorm16(float Value, float Min, float Step)
+{
+    if (Step == 0.0f) {
+        return 0;
     }
 
-    if (pStartNodeAnim && pEndNodeAnim) {
-        // Interpolate scaling
-        const aiVector3D& Scale0 = StartTransform.Scaling;
-        const aiVector3D& Scale1 = EndTransform.Scaling;
-        aiVector3D BlendedScaling = (1.0f - BlendFactor) * Scale0 + Scale1 * BlendFactor;
-        Matrix4f ScalingM;
-        ScalingM.InitScaleTransform(BlendedScaling.x, BlendedScaling.y, BlendedScaling.z);
+    float n = (Value - Min) / Step + 0.5f;
+
+    return (unsigned short)std::min(std::max(n, 0.0f), 65535.0f);
+}
 
-        // Interpolate rotation
-        const aiQuaternion& Rot0 = StartTransform.Rotation;
-        const aiQuaternion& Rot1 = EndTransform.Rotation;
-        aiQuaternion BlendedRot;
-        aiQuaternion::Interpolate(BlendedRot, Rot0, Rot1, BlendFactor);
-        Matrix4f RotationM = Matrix4f(BlendedRot.GetMatrix());
 
-        // Interpolate translation
-        const aiVector3D& Pos0 = StartTransform.Translation;
-        const aiVector3D& Pos1 = EndTransform.Translation;
-        aiVector3D BlendedTranslation = (1.0f - BlendFactor) * Pos0 + Pos1 * BlendFactor;
-        Matrix4f TranslationM;
-        TranslationM.InitTranslationTransform(BlendedTranslation.x, BlendedTranslation.y, BlendedTranslation.z);
+static const float BAKE_VECTOR_EPSILON = 1e-5f;
+static const float BAKE_ROTATION_EPSILON = 1e-6f;     // about 0.16 degree
 
-        // Combine it all
-        NodeTransformation = TranslationM * RotationM * ScalingM;
+
+static bool IsVectorTrackConstant(const vector<aiVector3D>& Values)
+{
+    for (uint i = 1 ; i < Values.size() ; i++) {
+        aiVector3D d = Values[i] - Values[0];
+        float Tolerance = BAKE_VECTOR_EPSILON * std::max(1.0f, Values[0].Length());
+
+        if ((fabsf(d.x) > Tolerance) || (fabsf(d.y) > Tolerance) || (fabsf(d.z) > Tolerance)) {
+            return false;
+        }
     }
 
-    Matrix4f GlobalTransformation = ParentTransform * NodeTransformation;
+    return true;
+}
+
 
-    if (m_BoneNameToIndexMap.find(NodeName) != m_BoneNameToIndexMap.end()) {
-        uint BoneIndex = m_BoneNameToIndexMap[NodeName];
-        m_BoneInfo[BoneIndex].FinalTransformation = m_GlobalInverseTransform * GlobalTransformation * m_BoneInfo[BoneIndex].OffsetMatrix;
+static bool IsRotationTrackConstant(const vector<aiQuaternion>& Values)
+{
+    for (uint i = 1 ; i < Values.size() ; i++) {
+        const aiQuaternion& a = Values[0];
+        const aiQuaternion& b = Values[i];
+        float Dot = a.w * b.w + a.x * b.x + a.y * b.y + a.z * b.z;
+
+        if (fabsf(Dot) < 1.0f - BAKE_ROTATION_EPSILON) {
+            return false;
+        }
     }
 
-    for (uint i = 0 ; i < pNode->mNumChildren ; i++) {
-        string ChildName(pNode->mChildren[i]->mName.data);
+    return true;
+}
 
-        map<string,NodeInfo>::iterator it = m_requiredNodeMap.find(ChildName);
 
-        if (it == m_requiredNodeMap.end()) {
-            printf("Child %s cannot be found in the required node map\n", ChildName.c_str());
-            assert(0);
+// The clip is sampled with the keyframe interpolation at a fixed rate from the
+// first tick. The last sample is at the end of the clip so the interval before
+// it may be shorter (see BakedClip::CalcFrame). Every channel becomes up to three tracks
+// (rotation, position and scaling) and the samples of all the tracks of a
+// frame are stored next to each other.
+void SkinnedMesh::BakeClip(const aiAnimation* pAnimation, BakedClip& Clip)
+{
+    Clip.TicksPerSecond = (float)(pAnimation->mTicksPerSecond != 0 ? pAnimation->mTicksPerSecond : 25.0f);
+    Clip.Duration = (float)pAnimation->mDuration;
+
+    // same as CalcAnimationTimeTicks
+    float DurationTicks = 0.0f;
+    modf(Clip.Duration, &DurationTicks);
+
+    Clip.SamplesPerTick = m_bakeSampleRate / Clip.TicksPerSecond;
+    Clip.NumSamples = (uint)ceilf(DurationTicks * Clip.SamplesPerTick) + 1;
+
+    uint NumChannels = pAnimation->mNumChannels;
+    uint NumSamples = Clip.NumSamples;
+
+    Clip.Tracks.resize(NumChannels);
+
+    vector<vector<aiQuaternion>> RotationTracks;
+    vector<vector<aiVector3D>> PositionTracks;
+    vector<vector<aiVector3D>> ScalingTracks;
+
+    vector<aiQuaternion> Rotations(NumSamples);
+    vector<aiVector3D> Positions(NumSamples);
+    vector<aiVector3D> Scalings(NumSamples);
+
+    for (uint c = 0 ; c < NumChannels ; c++) {
+        uint Cursors[3] = { 0, 0, 0 };
+
+        for (uint i = 0 ; i < NumSamples ; i++) {
+            float AnimationTimeTicks = (i < NumSamples - 1) ? (float)i / Clip.SamplesPerTick : DurationTicks;
+
+            LocalTransform Transform;
+            CalcLocalTransform(Transform, AnimationTimeTicks, pAnimation->mChannels[c], Cursors);
+
+            Rotations[i] = Transform.Rotation;
+            Positions[i] = Transform.Translation;
+            Scalings[i] = Transform.Scaling;
+        }
+
+        BakedClip::ChannelTracks& Track = Clip.Tracks[c];
+
+        Track.ConstRotation = Rotations[0];
+        Track.ConstPosition = Positions[0];
+        Track.ConstScaling = Scalings[0];
+
+        if (!IsRotationTrackConstant(Rotations)) {
+            Track.Rotation = (int)RotationTracks.size();
+            RotationTracks.push_back(Rotations);
         }
 
-        if (it->second.isRequired) {
-            ReadNodeHierarchyBlended(StartAnimationTimeTicks, EndAnimationTimeTicks,
-                                     pNode->mChildren[i], GlobalTransformation, StartAnimation, EndAnimation, BlendFactor);
+        if (!IsVectorTrackConstant(Positions)) {
+            Track.Position = (int)PositionTracks.size();
+            PositionTracks.push_back(Positions);
+            Clip.Positions.AddTrack(Positions);
+        }
+
+        if (!IsVectorTrackConstant(Scalings)) {
+            Track.Scaling = (int)ScalingTracks.size();
+            ScalingTracks.push_back(Scalings);
+            Clip.Scalings.AddTrack(Scalings);
+        }
+    }
+
+    Clip.NumRotationTracks = (uint)RotationTracks.size();
+    Clip.Rotations.resize(NumSamples * Clip.NumRotationTracks * 3);
+    Clip.Positions.Samples.resize(NumSamples * Clip.Positions.NumTracks * 3);
+    Clip.Scalings.Samples.resize(NumSamples * Clip.Scalings.NumTracks * 3);
+
+    for (uint i = 0 ; i < NumSamples ; i++) {
+        for (uint t = 0 ; t < Clip.NumRotationTracks ; t++) {
+            EncodeRotation(RotationTracks[t][i], &Clip.Rotations[(i * Clip.NumRotationTracks + t) * 3]);
+        }
+
+        for (uint t = 0 ; t < Clip.Positions.NumTracks ; t++) {
+            Clip.Positions.Encode(i, t, PositionTracks[t][i]);
+        }
+
+        for (uint t = 0 ; t < Clip.Scalings.NumTracks ; t++) {
+            Clip.Scalings.Encode(i, t, ScalingTracks[t][i]);
         }
     }
 }
 
 
-void SkinnedMesh::CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+void SkinnedMesh::QuantizedVectorTracks::Encode(uint Sample, uint Track, const aiVector3D& Value)
 {
-    CalcInterpolatedScaling(Transform.Scaling, AnimationTimeTicks, pNodeAnim);
-    CalcInterpolatedRotation(Transform.Rotation, AnimationTimeTicks, pNodeAnim);
-    CalcInterpolatedPosition(Transform.Translation, AnimationTimeTicks, pNodeAnim);
+    unsigned short* pOut = &Samples[(Sample * NumTracks + Track) * 3];
+
+    pOut[0] = QuantizeUnorm16(Value.x, Min[Track].x, Step[Track].x);
+    pOut[1] = QuantizeUnorm16(Value.y, Min[Track].y, Step[Track].y);
+    pOut[2] = QuantizeUnorm16(Value.z, Min[Track].z, Step[Track].z);
 }
 
 
-void SkinnedMesh::GetBoneTransforms(float TimeInSeconds, vector<Matrix4f>& Transforms, unsigned int AnimationIndex)
+aiVector3D SkinnedMesh::QuantizedVectorTracks::Decode(uint Sample, uint Track) const
 {
-    if (AnimationIndex >= m_pScene->mNumAnimations) {
-        printf("Invalid animation index %d, max is %d\n", AnimationIndex, m_pScene->mNumAnimations);
-        assert(0);
+    const unsigned short* pIn = &Samples[(Sample * NumTracks + Track) * 3];
+
+    return aiVector3D(Min[Track].x + (float)pIn[0] * Step[Track].x,
+                      Min[Track].y + (float)pIn[1] * Step[Track].y,
+                      Min[Track].z + (float)pIn[2] * Step[Track].z);
+}
+
+
+size_t SkinnedMesh::BakedClip::GetSizeInBytes() const
+{
+    return Tracks.size() * sizeof(ChannelTracks) +
+           Rotations.size() * sizeof(unsigned short) +
+           Positions.Samples.size() * sizeof(unsigned short) + Positions.NumTracks * sizeof(aiVector3D) * 2 +
+           Scalings.Samples.size() * sizeof(unsigned short) + Scalings.NumTracks * sizeof(aiVector3D) * 2;
+}
+
+
+// The two samples around the time and the factor between them
+void SkinnedMesh::BakedClip::CalcFrame(float AnimationTimeTicks, BakedFrame& Frame) const
+{
+    float Sample = AnimationTimeTicks * SamplesPerTick;
+
+    Frame.Sample0 = std::min((uint)std::max(Sample, 0.0f), NumSamples - 1);
+    Frame.Sample1 = std::min(Frame.Sample0 + 1, NumSamples - 1);
+
+    if ((Frame.Sample1 == NumSamples - 1) && (Frame.Sample0 != Frame.Sample1)) {
+        // the last sample is at the end of the clip rather than one step after the previous one
+        float StartTicks = (float)Frame.Sample0 / SamplesPerTick;
+        float IntervalTicks = floorf(Duration) - StartTicks;
+        Frame.Factor = (IntervalTicks > 0.0f) ? (AnimationTimeTicks - StartTicks) / IntervalTicks : 1.0f;
+    } else {
+        Frame.Factor = Sample - (float)Frame.Sample0;
     }
 
-    Matrix4f Identity;
-    Identity.InitIdentity();
+    Frame.Factor = std::min(std::max(Frame.Factor, 0.0f), 1.0f);
+}
 
-    float AnimationTimeTicks = CalcAnimationTimeTicks(TimeInSeconds, AnimationIndex);
-    const aiAnimation& Animation = *m_pScene->mAnimations[AnimationIndex];
 
-    ReadNodeHierarchy(AnimationTimeTicks, m_pScene->mRootNode, Identity, Animation);
-    Transforms.resize(m_BoneInfo.size());
+void SkinnedMesh::BakedClip::Sample(uint ChannelIndex, const BakedFrame& Frame, LocalTransform& Transform) const
+{
+    const ChannelTracks& Track = Tracks[ChannelIndex];
+
+    if (Track.Rotation >= 0) {
+        aiQuaternion q0 = DecodeRotation(&Rotations[(Frame.Sample0 * NumRotationTracks + Track.Rotation) * 3]);
+        aiQuaternion q1 = DecodeRotation(&Rotations[(Frame.Sample1 * NumRotationTracks + Track.Rotation) * 3]);
+
+        // the encoding may flip the sign so take the short way between the samples
+        float Dot = q0.w * q1.w + q0.x * q1.x + q0.y * q1.y + q0.z * q1.z;
+        float f1 = (Dot < 0.0f) ? -Frame.Factor : Frame.Factor;
+        float f0 = 1.0f - Frame.Factor;
+
+        Transform.Rotation = aiQuaternion(q0.w * f0 + q1.w * f1, q0.x * f0 + q1.x * f1, q0.y * f0 + q1.y * f1, q0.z * f0 + q1.z * f1);
+        Transform.Rotation.Normalize();
+    } else {
+        Transform.Rotation = Track.ConstRotation;
+    }
+
+    if (Track.Position >= 0) {
+        aiVector3D p0 = Positions.Decode(Frame.Sample0, Track.Position);
+        aiVector3D p1 = Positions.Decode(Frame.Sample1, Track.Position);
+        Transform.Translation = p0 + (p1 - p0) * Frame.Factor;
+    } else {
+        Transform.Translation = Track.ConstPosition;
+    }
+
+    if (Track.Scaling >= 0) {
+        aiVector3D s0 = Scalings.Decode(Frame.Sample0, Track.Scaling);
+        aiVector3D s1 = Scalings.Decode(Frame.Sample1, Track.Scaling);
+        Transform.Scaling = s0 + (s1 - s0) * Frame.Factor;
+    } else {
+        Transform.Scaling = Track.ConstScaling;
+    }
+}
+
+
+void SkinnedMesh::ReleaseScene()
+{
+    if (m_bakedClips.size() != NumAnimations()) {
+        printf("The scene is needed to sample the animations that were not baked\n");
+        return;
+    }
+
+    m_requiredNodeMap.clear();
+
+    FreeScene();
+}
+
+
+template<typename T>
+static void WriteCacheValue(vector<unsigned char>& Data, const T& Value)
+{
+    const unsigned char* p = (const unsigned char*)&Value;
+    Data.insert(Data.end(), p, p + sizeof(T));
+}
+
+
+template<typename T>
+static void WriteCacheArray(vector<unsigned char>& Data, const vector<T>& Values)
+{
+    WriteCacheValue(Data, (uint)Values.size());
+    const unsigned char* p = (const unsigned char*)Values.data();
+    Data.insert(Data.end(), p, p + Values.size() * sizeof(T));
+}
+
+
+static void WriteCacheString(vector<unsigned char>& Data, const string& s)
+{
+    WriteCacheValue(Data, (uint)s.size());
+    Data.insert(Data.end(), s.begin(), s.end());
+}
+
+
+// reads back what the functions above wrote and fails instead of going past the end
+struct CacheReader {
+    const unsigned char* pData;
+    long long Size;
+    long long Pos = 0;
+
+    CacheReader(const unsigned char* p, long long s) : pData(p), Size(s) {}
+
+    template<typename T>
+    bool Read(T& Value)
+    {
+        if (Pos + (long long)sizeof(T) > Size) {
+            return false;
+        }
+
+        memcpy(&Value, pData + Pos, sizeof(T));
+        Pos += sizeof(T);
+        return true;
+    }
+
+    template<typename T>
+    bool ReadArray(vector<T>& Values)
+    {
+        uint Count = 0;
+
+        if (!Read(Count) || (Pos + (long long)(Count * sizeof(T)) > Size)) {
+            return false;
+        }
+
+        Values.resize(Count);
+        memcpy(Values.data(), pData + Pos, Count * sizeof(T));
+        Pos += Count * sizeof(T);
+        return true;
+    }
+
+    bool ReadString(string& s)
+    {
+        uint Length = 0;
+
+        if (!Read(Length) || (Pos + Length > Size)) {
+            return false;
+        }
+
+        s.assign((const char*)pData + Pos, Length);
+        Pos += Length;
+        return true;
+    }
+};
+
+
+const void* SkinnedMesh::GetCacheVertices(uint& NumVertices) const
+{
+    NumVertices = (uint)m_SkinnedVertices.size();
+    return m_SkinnedVertices.data();
+}
+
+
+// the vertices are copied because the bone influences are packed (and the bind
+// pose is kept for CPU skinning) by PopulateBuffers
+void SkinnedMesh::PopulateCachedBuffers(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices)
+{
+    const SkinnedVertex* pSkinnedVertices = (const SkinnedVertex*)pVertices;
+
+    m_SkinnedVertices.assign(pSkinnedVertices, pSkinnedVertices + NumVertices);
+    m_Indices.assign(pIndices, pIndices + NumIndices);
+
+    PopulateBuffers();
+}
+
+
+// Everything that the animation needs once the aiScene is gone: the bones, the
+// skeleton with its channels and the baked clips.
+void SkinnedMesh::SaveMeshCacheExtra(vector<unsigned char>& Data) const
+{
+    WriteCacheValue(Data, m_bakeSampleRate);
+    WriteCacheValue(Data, m_GlobalInverseTransform);
+
+    WriteCacheValue(Data, (uint)m_BoneNameToIndexMap.size());
+
+    for (map<string,uint>::const_iterator it = m_BoneNameToIndexMap.begin() ; it != m_BoneNameToIndexMap.end() ; it++) {
+        WriteCacheString(Data, it->first);
+        WriteCacheValue(Data, it->second);
+    }
+
+    WriteCacheValue(Data, (uint)m_BoneInfo.size());
 
     for (uint i = 0 ; i < m_BoneInfo.size() ; i++) {
-        Transforms[i] = m_BoneInfo[i].FinalTransformation;
+        WriteCacheValue(Data, m_BoneInfo[i].OffsetMatrix);
+    }
+
+    WriteCacheValue(Data, (uint)m_skeleton.size());
+
+    for (uint i = 0 ; i < m_skeleton.size() ; i++) {
+        const SkeletonNode& Node = m_skeleton[i];
+        WriteCacheString(Data, Node.Name);
+        WriteCacheValue(Data, Node.Parent);
+        WriteCacheValue(Data, Node.BoneIndex);
+        WriteCacheValue(Data, Node.BoneDepth);
+        WriteCacheValue(Data, Node.Transformation);
+    }
+
+    WriteCacheValue(Data, (uint)m_nodeChannels.size());
+
+    for (uint i = 0 ; i < m_nodeChannels.size() ; i++) {
+        WriteCacheArray(Data, m_nodeChannels[i]);
+    }
+
+    WriteCacheValue(Data, (uint)m_bakedClips.size());
+
+    for (uint i = 0 ; i < m_bakedClips.size() ; i++) {
+        const BakedClip& Clip = m_bakedClips[i];
+        WriteCacheValue(Data, Clip.TicksPerSecond);
+        WriteCacheValue(Data, Clip.Duration);
+        WriteCacheValue(Data, Clip.SamplesPerTick);
+        WriteCacheValue(Data, Clip.NumSamples);
+        WriteCacheArray(Data, Clip.Tracks);
+        WriteCacheValue(Data, Clip.NumRotationTracks);
+        WriteCacheArray(Data, Clip.Rotations);
+
+        const QuantizedVectorTracks* pTracks[2] = { &Clip.Positions, &Clip.Scalings };
+
+        for (int t = 0 ; t < 2 ; t++) {
+            WriteCacheValue(Data, pTracks[t]->NumTracks);
+            WriteCacheArray(Data, pTracks[t]->Min);
+            WriteCacheArray(Data, pTracks[t]->Step);
+            WriteCacheArray(Data, pTracks[t]->Samples);
+        }
+    }
+}
+
+
+bool SkinnedMesh::LoadMeshCacheExtra(const unsigned char* pData, long long Size)
+{
+    CacheReader Reader(pData, Size);
+
+    float BakeSampleRate = 0.0f;
+    bool Valid = Reader.Read(BakeSampleRate) && (BakeSampleRate == m_bakeSampleRate) &&
+                 Reader.Read(m_GlobalInverseTransform);
+
+    uint NumBones = 0;
+    Valid = Valid && Reader.Read(NumBones);
+
+    for (uint i = 0 ; Valid && (i < NumBones) ; i++) {
+        string Name;
+        uint BoneIndex = 0;
+        Valid = Reader.ReadString(Name) && Reader.Read(BoneIndex);
+        m_BoneNameToIndexMap[Name] = BoneIndex;
+    }
+
+    uint NumBoneInfos = 0;
+    Valid = Valid && Reader.Read(NumBoneInfos);
+
+    for (uint i = 0 ; Valid && (i < NumBoneInfos) ; i++) {
+        Matrix4f OffsetMatrix;
+        Valid = Reader.Read(OffsetMatrix);
+        m_BoneInfo.push_back(BoneInfo(OffsetMatrix));
+    }
+
+    uint NumNodes = 0;
+    Valid = Valid && Reader.Read(NumNodes);
+
+    if (Valid) {
+        m_skeleton.resize(NumNodes);
+    }
+
+    for (uint i = 0 ; Valid && (i < NumNodes) ; i++) {
+        SkeletonNode& Node = m_skeleton[i];
+        Valid = Reader.ReadString(Node.Name) && Reader.Read(Node.Parent) && Reader.Read(Node.BoneIndex) &&
+                Reader.Read(Node.BoneDepth) && Reader.Read(Node.Transformation);
+    }
+
+    uint NumAnimations = 0;
+    Valid = Valid && Reader.Read(NumAnimations);
+
+    if (Valid) {
+        m_nodeChannels.resize(NumAnimations);
+    }
+
+    for (uint i = 0 ; Valid && (i < NumAnimations) ; i++) {
+        Valid = Reader.ReadArray(m_nodeChannels[i]);
+    }
+
+    uint NumClips = 0;
+    Valid = Valid && Reader.Read(NumClips) && (NumClips == NumAnimations);
+
+    if (Valid) {
+        m_bakedClips.resize(NumClips);
+    }
+
+    for (uint i = 0 ; Valid && (i < NumClips) ; i++) {
+        BakedClip& Clip = m_bakedClips[i];
+        Valid = Reader.Read(Clip.TicksPerSecond) && Reader.Read(Clip.Duration) && Reader.Read(Clip.SamplesPerTick) &&
+                Reader.Read(Clip.NumSamples) && Reader.ReadArray(Clip.Tracks) &&
+                Reader.Read(Clip.NumRotationTracks) && Reader.ReadArray(Clip.Rotations);
+
+        QuantizedVectorTracks* pTracks[2] = { &Clip.Positions, &Clip.Scalings };
+
+        for (int t = 0 ; Valid && (t < 2) ; t++) {
+            Valid = Reader.Read(pTracks[t]->NumTracks) && Reader.ReadArray(pTracks[t]->Min) &&
+                    Reader.ReadArray(pTracks[t]->Step) && Reader.ReadArray(pTracks[t]->Samples);
+        }
+    }
+
+    Valid = Valid && (Reader.Pos == Size);
+
+    if (!Valid) {
+        // the model is loaded through Assimp instead
+        m_BoneNameToIndexMap.clear();
+        m_BoneInfo.clear();
+        m_skeleton.clear();
+        m_nodeChannels.clear();
+        m_bakedClips.clear();
+        return false;
+    }
+
+    UpdateReducedSkeleton();
+
+    return true;
+}
+
+
+static const int KEY_CURSOR_MAX_STEPS = 4;
+
+
+// Returns the key that starts the segment which contains AnimationTimeTicks. When
+// the animation plays forward the time is usually still inside the segment of the
+// previous frame or in one of the next few so the search starts at the cursor.
+// A jump backwards (including the loop back to the start of the clip) or a jump
+// far ahead falls back to a binary search.
+template<typename KeyType>
+static uint FindKey(float AnimationTimeTicks, const KeyType* pKeys, uint NumKeys, uint& Cursor)
+{
+    uint LastSegment = NumKeys - 2;
+    uint i = std::min(Cursor, LastSegment);
+
+    if ((i == 0) || ((float)pKeys[i].mTime <= AnimationTimeTicks)) {
+        for (int Step = 0 ; Step < KEY_CURSOR_MAX_STEPS ; Step++) {
+            if ((i == LastSegment) || (AnimationTimeTicks < (float)pKeys[i + 1].mTime)) {
+                Cursor = i;
+                return i;
+            }
+
+            i++;
+        }
+    }
+
+    // the first segment that ends after AnimationTimeTicks
+    uint Low = 0;
+    uint High = LastSegment;
+
+    while (Low < High) {
+        uint Mid = (Low + High) / 2;
+
+        if (AnimationTimeTicks < (float)pKeys[Mid + 1].mTime) {
+            High = Mid;
+        } else {
+            Low = Mid + 1;
+        }
+    }
+
+    Cursor = Low;
+
+    return Low;
+}
+
+
+void SkinnedMesh::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint& Cursor)
+{
+    // we need at least two values to interpolate...
+    if (pNodeAnim->mNumPositionKeys == 1) {
+        Out = pNodeAnim->mPositionKeys[0].mValue;
+        return;
+    }
+
+    uint PositionIndex = FindKey(AnimationTimeTicks, pNodeAnim->mPositionKeys, pNodeAnim->mNumPositionKeys, Cursor);
+    uint NextPositionIndex = PositionIndex + 1;
+    assert(NextPositionIndex < pNodeAnim->mNumPositionKeys);
+    float t1 = (float)pNodeAnim->mPositionKeys[PositionIndex].mTime;
+    if (t1 > AnimationTimeTicks) {
+        Out = pNodeAnim->mPositionKeys[PositionIndex].mValue;
+    } else {
+        float t2 = (float)pNodeAnim->mPositionKeys[NextPositionIndex].mTime;
+        float DeltaTime = t2 - t1;
+        // past the last key the last value is held
+        float Factor = std::min((AnimationTimeTicks - t1) / DeltaTime, 1.0f);
+        assert(Factor >= 0.0f && Factor <= 1.0f);
+        const aiVector3D& Start = pNodeAnim->mPositionKeys[PositionIndex].mValue;
+        const aiVector3D& End = pNodeAnim->mPositionKeys[NextPositionIndex].mValue;
+        aiVector3D Delta = End - Start;
+        Out = Start + Factor * Delta;
+    }
+}
+
+
+void SkinnedMesh::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint& Cursor)
+{
+    // we need at least two values to interpolate...
+    if (pNodeAnim->mNumRotationKeys == 1) {
+        Out = pNodeAnim->mRotationKeys[0].mValue;
+        return;
+    }
+
+    uint RotationIndex = FindKey(AnimationTimeTicks, pNodeAnim->mRotationKeys, pNodeAnim->mNumRotationKeys, Cursor);
+    uint NextRotationIndex = RotationIndex + 1;
+    assert(NextRotationIndex < pNodeAnim->mNumRotationKeys);
+    float t1 = (float)pNodeAnim->mRotationKeys[RotationIndex].mTime;
+    if (t1 > AnimationTimeTicks) {
+        Out = pNodeAnim->mRotationKeys[RotationIndex].mValue;
+    } else {
+        float t2 = (float)pNodeAnim->mRotationKeys[NextRotationIndex].mTime;
+        float DeltaTime = t2 - t1;
+        // past the last key the last value is held
+        float Factor = std::min((AnimationTimeTicks - t1) / DeltaTime, 1.0f);
+        assert(Factor >= 0.0f && Factor <= 1.0f);
+        const aiQuaternion& StartRotationQ = pNodeAnim->mRotationKeys[RotationIndex].mValue;
+        const aiQuaternion& EndRotationQ   = pNodeAnim->mRotationKeys[NextRotationIndex].mValue;
+        aiQuaternion::Interpolate(Out, StartRotationQ, EndRotationQ, Factor);
+    }
+
+    Out.Normalize();
+}
+
+
+void SkinnedMesh::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint& Cursor)
+{
+    // we need at least two values to interpolate...
+    if (pNodeAnim->mNumScalingKeys == 1) {
+        Out = pNodeAnim->mScalingKeys[0].mValue;
+        return;
+    }
+
+    uint ScalingIndex = FindKey(AnimationTimeTicks, pNodeAnim->mScalingKeys, pNodeAnim->mNumScalingKeys, Cursor);
+    uint NextScalingIndex = ScalingIndex + 1;
+    assert(NextScalingIndex < pNodeAnim->mNumScalingKeys);
+    float t1 = (float)pNodeAnim->mScalingKeys[ScalingIndex].mTime;
+    if (t1 > AnimationTimeTicks) {
+        Out = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
+    } else {
+        float t2 = (float)pNodeAnim->mScalingKeys[NextScalingIndex].mTime;
+        float DeltaTime = t2 - t1;
+        float Factor = std::min((AnimationTimeTicks - (float)t1) / DeltaTime, 1.0f);
+        assert(Factor >= 0.0f && Factor <= 1.0f);
+        const aiVector3D& Start = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
+        const aiVector3D& End   = pNodeAnim->mScalingKeys[NextScalingIndex].mValue;
+        aiVector3D Delta = End - Start;
+        Out = Start + Factor * Delta;
+    }
+}
+
+
+// Same as TranslationM * RotationM * ScalingM without the matrix multiplications
+static void LocalTransformToMatrix(const aiVector3D& Scaling, const aiQuaternion& Rotation, const aiVector3D& Translation, Matrix4f& m)
+{
+    aiMatrix3x3 r = Rotation.GetMatrix();
+
+    m.m[0][0] = r.a1 * Scaling.x; m.m[0][1] = r.a2 * Scaling.y; m.m[0][2] = r.a3 * Scaling.z; m.m[0][3] = Translation.x;
+    m.m[1][0] = r.b1 * Scaling.x; m.m[1][1] = r.b2 * Scaling.y; m.m[1][2] = r.b3 * Scaling.z; m.m[1][3] = Translation.y;
+    m.m[2][0] = r.c1 * Scaling.x; m.m[2][1] = r.c2 * Scaling.y; m.m[2][2] = r.c3 * Scaling.z; m.m[2][3] = Translation.z;
+    m.m[3][0] = 0.0f;             m.m[3][1] = 0.0f;             m.m[3][2] = 0.0f;             m.m[3][3] = 1.0f;
+}
+
+
+// The nodes are stored parent first so the global transformation of the parent
+// is always ready when a node is reached. Returns the number of sampled bones.
+uint SkinnedMesh::EvaluateSkeleton(float AnimationTimeTicks, uint AnimationIndex, vector<uint>& Cursors,
+                                   vector<Matrix4f>& NodeTransforms, Matrix4f* pTransforms, bool Reduced)
+{
+    const vector<int>& NodeChannels = m_nodeChannels[AnimationIndex];
+    const char* pFrozen = Reduced ? m_frozenNodes.data() : NULL;
+    uint NumBones = 0;
+
+    BakedFrame Frame;
+
+    if (!m_bakedClips.empty()) {
+        m_bakedClips[AnimationIndex].CalcFrame(AnimationTimeTicks, Frame);
+    }
+
+    NodeTransforms.resize(m_skeleton.size());
+
+    for (uint i = 0 ; i < m_skeleton.size() ; i++) {
+        const SkeletonNode& Node = m_skeleton[i];
+        int ChannelIndex = NodeChannels[i];
+
+        Matrix4f NodeTransformation;
+
+        if ((ChannelIndex >= 0) && !(pFrozen && pFrozen[i])) {
+            NumBones += (Node.BoneIndex >= 0) ? 1 : 0;
+            LocalTransform Transform;
+            CalcChannelTransform(AnimationIndex, ChannelIndex, AnimationTimeTicks, Frame, Cursors, Transform);
+            LocalTransformToMatrix(Transform.Scaling, Transform.Rotation, Transform.Translation, NodeTransformation);
+        } else {
+            NodeTransformation = Node.Transformation;
+        }
+
+        NodeTransforms[i] = (Node.Parent >= 0) ? NodeTransforms[Node.Parent] * NodeTransformation : NodeTransformation;
+
+        if (Node.BoneIndex >= 0) {
+            pTransforms[Node.BoneIndex] = m_GlobalInverseTransform * NodeTransforms[i] * m_BoneInfo[Node.BoneIndex].OffsetMatrix;
+        }
+    }
+
+    return NumBones;
+}
+
+
+uint SkinnedMesh::EvaluateSkeletonBlended(float StartAnimationTimeTicks, float EndAnimationTimeTicks,
+                                          uint StartAnimIndex, uint EndAnimIndex, float BlendFactor,
+                                          vector<uint>& StartCursors, vector<uint>& EndCursors,
+                                          vector<Matrix4f>& NodeTransforms, Matrix4f* pTransforms, bool Reduced)
+{
+    const vector<int>& StartChannels = m_nodeChannels[StartAnimIndex];
+    const vector<int>& EndChannels = m_nodeChannels[EndAnimIndex];
+    const char* pFrozen = Reduced ? m_frozenNodes.data() : NULL;
+    uint NumBones = 0;
+
+    BakedFrame StartFrame;
+    BakedFrame EndFrame;
+
+    if (!m_bakedClips.empty()) {
+        m_bakedClips[StartAnimIndex].CalcFrame(StartAnimationTimeTicks, StartFrame);
+        m_bakedClips[EndAnimIndex].CalcFrame(EndAnimationTimeTicks, EndFrame);
+    }
+
+    NodeTransforms.resize(m_skeleton.size());
+
+    for (uint i = 0 ; i < m_skeleton.size() ; i++) {
+        const SkeletonNode& Node = m_skeleton[i];
+        int StartChannelIndex = StartChannels[i];
+        int EndChannelIndex = EndChannels[i];
+
+        if ((StartChannelIndex >= 0) != (EndChannelIndex >= 0)) {
+            printf("On the node %s there is an animation node for only one of the start/end animations.\n", Node.Name.c_str());
+            printf("This case is not supported\n");
+            exit(0);
+        }
+
+        Matrix4f NodeTransformation;
+
+        if ((StartChannelIndex >= 0) && !(pFrozen && pFrozen[i])) {
+            NumBones += (Node.BoneIndex >= 0) ? 1 : 0;
+            LocalTransform StartTransform;
+            CalcChannelTransform(StartAnimIndex, StartChannelIndex, StartAnimationTimeTicks, StartFrame, StartCursors, StartTransform);
+
+            LocalTransform EndTransform;
+            CalcChannelTransform(EndAnimIndex, EndChannelIndex, EndAnimationTimeTicks, EndFrame, EndCursors, EndTransform);
+
+            aiVector3D BlendedScaling = (1.0f - BlendFactor) * StartTransform.Scaling + EndTransform.Scaling * BlendFactor;
+
+            aiQuaternion BlendedRot;
+            aiQuaternion::Interpolate(BlendedRot, StartTransform.Rotation, EndTransform.Rotation, BlendFactor);
+
+            aiVector3D BlendedTranslation = (1.0f - BlendFactor) * StartTransform.Translation + EndTransform.Translation * BlendFactor;
+
+            LocalTransformToMatrix(BlendedScaling, BlendedRot, BlendedTranslation, NodeTransformation);
+        } else {
+            NodeTransformation = Node.Transformation;
+        }
+
+        NodeTransforms[i] = (Node.Parent >= 0) ? NodeTransforms[Node.Parent] * NodeTransformation : NodeTransformation;
+
+        if (Node.BoneIndex >= 0) {
+            pTransforms[Node.BoneIndex] = m_GlobalInverseTransform * NodeTransforms[i] * m_BoneInfo[Node.BoneIndex].OffsetMatrix;
+        }
     }
+
+    return NumBones;
+}
+
+
+// pCursors points to the scaling, rotation and position cursors of the channel
+void SkinnedMesh::CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint* pCursors)
+{
+    CalcInterpolatedScaling(Transform.Scaling, AnimationTimeTicks, pNodeAnim, pCursors[0]);
+    CalcInterpolatedRotation(Transform.Rotation, AnimationTimeTicks, pNodeAnim, pCursors[1]);
+    CalcInterpolatedPosition(Transform.Translation, AnimationTimeTicks, pNodeAnim, pCursors[2]);
+}
+
+
+// The baked clips are sampled from the frame and the time (see BakedClip::CalcFrame)
+void SkinnedMesh::CalcChannelTransform(uint AnimationIndex, int ChannelIndex, float AnimationTimeTicks, const BakedFrame& Frame,
+                                       vector<uint>& Cursors, LocalTransform& Transform)
+{
+    if (!m_bakedClips.empty()) {
+        m_bakedClips[AnimationIndex].Sample(ChannelIndex, Frame, Transform);
+    } else {
+        const aiNodeAnim* pNodeAnim = m_pScene->mAnimations[AnimationIndex]->mChannels[ChannelIndex];
+        CalcLocalTransform(Transform, AnimationTimeTicks, pNodeAnim, &Cursors[ChannelIndex * 3]);
+    }
+}
+
+
+vector<uint>& SkinnedMesh::GetAnimationCursors(AnimationCursors& Cursors, uint AnimationIndex)
+{
+    if (Cursors.Keys.size() != NumAnimations()) {
+        Cursors.Keys.resize(NumAnimations());
+    }
+
+    vector<uint>& Keys = Cursors.Keys[AnimationIndex];
+
+    // the baked clips don't search for keys
+    if (!m_bakedClips.empty()) {
+        return Keys;
+    }
+
+    uint NumCursors = m_pScene->mAnimations[AnimationIndex]->mNumChannels * 3;
+
+    if (Keys.size() != NumCursors) {
+        Keys.assign(NumCursors, 0);
+    }
+
+    return Keys;
+}
+
+
+void SkinnedMesh::GetBoneTransforms(float TimeInSeconds, vector<Matrix4f>& Transforms, unsigned int AnimationIndex)
+{
+    GetBoneTransforms(TimeInSeconds, Transforms, m_cursors, AnimationIndex);
+}
+
+
+void SkinnedMesh::GetBoneTransforms(float TimeInSeconds, vector<Matrix4f>& Transforms, AnimationCursors& Cursors, unsigned int AnimationIndex)
+{
+    Transforms.resize(m_BoneInfo.size());
+
+    GetBoneTransforms(TimeInSeconds, Transforms.data(), Cursors, AnimationIndex);
+}
+
+
+void SkinnedMesh::GetBoneTransforms(float TimeInSeconds, Matrix4f* pTransforms, AnimationCursors& Cursors, unsigned int AnimationIndex,
+                                    bool Reduced)
+{
+    if (AnimationIndex >= NumAnimations()) {
+        printf("Invalid animation index %d, max is %d\n", AnimationIndex, NumAnimations());
+        assert(0);
+    }
+
+    float AnimationTimeTicks = CalcAnimationTimeTicks(TimeInSeconds, AnimationIndex);
+
+    Cursors.NumEvaluatedBones = EvaluateSkeleton(AnimationTimeTicks, AnimationIndex, GetAnimationCursors(Cursors, AnimationIndex),
+                                                 Cursors.NodeTransforms, pTransforms, Reduced);
 }
 
 
@@ -641,13 +1829,38 @@ void SkinnedMesh::GetBoneTransformsBlended(float TimeInSeconds,
                                            unsigned int EndAnimIndex,
                                            float BlendFactor)
 {
-    if (StartAnimIndex >= m_pScene->mNumAnimations) {
-        printf("Invalid start animation index %d, max is %d\n", StartAnimIndex, m_pScene->mNumAnimations);
+    GetBoneTransformsBlended(TimeInSeconds, BlendedTransforms, m_cursors, StartAnimIndex, EndAnimIndex, BlendFactor);
+}
+
+
+void SkinnedMesh::GetBoneTransformsBlended(float TimeInSeconds,
+                                           vector<Matrix4f>& BlendedTransforms,
+                                           AnimationCursors& Cursors,
+                                           unsigned int StartAnimIndex,
+                                           unsigned int EndAnimIndex,
+                                           float BlendFactor)
+{
+    BlendedTransforms.resize(m_BoneInfo.size());
+
+    GetBoneTransformsBlended(TimeInSeconds, BlendedTransforms.data(), Cursors, StartAnimIndex, EndAnimIndex, BlendFactor);
+}
+
+
+void SkinnedMesh::GetBoneTransformsBlended(float TimeInSeconds,
+                                           Matrix4f* pBlendedTransforms,
+                                           AnimationCursors& Cursors,
+                                           unsigned int StartAnimIndex,
+                                           unsigned int EndAnimIndex,
+                                           float BlendFactor,
+                                           bool Reduced)
+{
+    if (StartAnimIndex >= NumAnimations()) {
+        printf("Invalid start animation index %d, max is %d\n", StartAnimIndex, NumAnimations());
         assert(0);
     }
 
-    if (EndAnimIndex >= m_pScene->mNumAnimations) {
-        printf("Invalid end animation index %d, max is %d\n", EndAnimIndex, m_pScene->mNumAnimations);
+    if (EndAnimIndex >= NumAnimations()) {
+        printf("Invalid end animation index %d, max is %d\n", EndAnimIndex, NumAnimations());
         assert(0);
     }
 
@@ -659,44 +1872,58 @@ void SkinnedMesh::GetBoneTransformsBlended(float TimeInSeconds,
     float StartAnimationTimeTicks = CalcAnimationTimeTicks(TimeInSeconds, StartAnimIndex);
     float EndAnimationTimeTicks = CalcAnimationTimeTicks(TimeInSeconds, EndAnimIndex);
 
-    const aiAnimation& StartAnimation = *m_pScene->mAnimations[StartAnimIndex];
-    const aiAnimation& EndAnimation = *m_pScene->mAnimations[EndAnimIndex];
+    // the first call sizes the outer vector so the second one doesn't invalidate StartCursors
+    vector<uint>& StartCursors = GetAnimationCursors(Cursors, StartAnimIndex);
+    vector<uint>& EndCursors = GetAnimationCursors(Cursors, EndAnimIndex);
 
-    Matrix4f Identity;
-    Identity.InitIdentity();
+    Cursors.NumEvaluatedBones = EvaluateSkeletonBlended(StartAnimationTimeTicks, EndAnimationTimeTicks, StartAnimIndex, EndAnimIndex, BlendFactor,
+                                                        StartCursors, EndCursors, Cursors.NodeTransforms, pBlendedTransforms, Reduced);
+}
 
-    ReadNodeHierarchyBlended(StartAnimationTimeTicks, EndAnimationTimeTicks, m_pScene->mRootNode, Identity, StartAnimation, EndAnimation, BlendFactor);
 
-    BlendedTransforms.resize(m_BoneInfo.size());
+uint SkinnedMesh::NumAnimations() const
+{
+    if (!m_bakedClips.empty()) {
+        return (uint)m_bakedClips.size();
+    }
 
-    for (uint i = 0 ; i < m_BoneInfo.size() ; i++) {
-        BlendedTransforms[i] = m_BoneInfo[i].FinalTransformation;
+    return m_pScene ? m_pScene->mNumAnimations : 0;
+}
+
+
+void SkinnedMesh::GetAnimationTiming(unsigned int AnimationIndex, float& TicksPerSecond, float& Duration) const
+{
+    if (!m_bakedClips.empty()) {
+        TicksPerSecond = m_bakedClips[AnimationIndex].TicksPerSecond;
+        Duration = m_bakedClips[AnimationIndex].Duration;
+    } else {
+        const aiAnimation* pAnimation = m_pScene->mAnimations[AnimationIndex];
+        TicksPerSecond = (float)(pAnimation->mTicksPerSecond != 0 ? pAnimation->mTicksPerSecond : 25.0f);
+        Duration = (float)pAnimation->mDuration;
     }
 }
 
 
+float SkinnedMesh::GetAnimationDurationSec(unsigned int AnimationIndex) const
+{
+    float TicksPerSecond = 0.0f;
+    float DurationTicks = 0.0f;
+    GetAnimationTiming(AnimationIndex, TicksPerSecond, DurationTicks);
+
+    return DurationTicks / TicksPerSecond;
+}
+
+
 float SkinnedMesh::CalcAnimationTimeTicks(float TimeInSeconds, unsigned int AnimationIndex)
 {
-    float TicksPerSecond = (float)(m_pScene->mAnimations[AnimationIndex]->mTicksPerSecond != 0 ? m_pScene->mAnimations[AnimationIndex]->mTicksPerSecond : 25.0f);
+    float TicksPerSecond = 0.0f;
+    float FullDuration = 0.0f;
+    GetAnimationTiming(AnimationIndex, TicksPerSecond, FullDuration);
     float TimeInTicks = TimeInSeconds * TicksPerSecond;
     // we need to use the integral part of mDuration for the total length of the animation
     float Duration = 0.0f;
-    float fraction = modf((float)m_pScene->mAnimations[AnimationIndex]->mDuration, &Duration);
+    float fraction = modf(FullDuration, &Duration);
     float AnimationTimeTicks = fmod(TimeInTicks, Duration);
     return AnimationTimeTicks;
 }
 
-
-const aiNodeAnim* SkinnedMesh::FindNodeAnim(const aiAnimation&
-                                            Animation, const string& NodeName)
-{
-    for (uint i = 0 ; i < Animation.mNumChannels ; i++) {
-        const aiNodeAnim* pNodeAnim = Animation.mChannels[i];
-
-        if (string(pNodeAnim->mNodeName.data) == NodeName) {
-            return pNodeAnim;
-        }
-    }
-
-    return NULL;
-}
@@ -17,9 +17,15 @@
 */
 
 #include <iostream>
+#include <stdlib.h>
 #include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <sys/stat.h>
 #include "ogldev_util.h"
 #include "ogldev_texture.h"
+#include "ogldev_texture_compressor.h"
+#include "ogldev_artifact_cache.h"
 #include "3rdparty/stb_image.h"
 #include "3rdparty/stb_image_write.h"
 
@@ -38,15 +44,23 @@ Texture::Texture(GLenum TextureTarget)
 
 void Texture::Load(u32 BufferSize, void* pData)
 {
-    void* pImageData = stbi_load_from_memory((const stbi_uc*)pData, BufferSize, &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
+    unsigned char* pImageData = stbi_load_from_memory((const stbi_uc*)pData, BufferSize, &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
 
-    LoadInternal(pImageData);
+    if ((m_textureTarget == GL_TEXTURE_2D) && GetMipmapGenerator().IsEnabled()) {
+        LoadInternalMipmapped(pImageData);
+    } else {
+        LoadInternal(pImageData);
+    }
 
     stbi_image_free(pImageData);
 }
 
 bool Texture::Load()
 {
+    if (LoadCompressed()) {
+        return true;
+    }
+
     stbi_set_flip_vertically_on_load(1);
 
     unsigned char* pImageData = stbi_load(m_fileName.c_str(), &m_imageWidth, &m_imageHeight, &m_imageBPP, 0);
@@ -58,12 +72,172 @@ bool Texture::Load()
 
     printf("Width %d, height %d, bpp %d\n", m_imageWidth, m_imageHeight, m_imageBPP);
 
-    LoadInternal(pImageData);
+    if ((m_textureTarget == GL_TEXTURE_2D) && GetMipmapGenerator().IsEnabled()) {
+        LoadInternalMipmapped(pImageData);
+    } else {
+        LoadInternal(pImageData);
+    }
+
+    stbi_image_free(pImageData);
+
+    return true;
+}
+
+
+size_t Texture::GetSizeInBytes() const
+{
+    if (m_compressedSize > 0) {
+        return m_compressedSize;
+    }
+
+    size_t Size = (size_t)m_imageWidth * m_imageHeight * m_imageBPP;
+
+    // a full mip chain adds a third
+    return Size + Size / 3;
+}
+
+
+static bool IsOlderThan(const std::string& Filename0, const std::string& Filename1)
+{
+    struct stat Stat0;
+    struct stat Stat1;
+
+    if ((stat(Filename0.c_str(), &Stat0) != 0) || (stat(Filename1.c_str(), &Stat1) != 0)) {
+        return false;
+    }
+
+    return Stat0.st_mtime < Stat1.st_mtime;
+}
+
+
+bool ReadCompressedTexture(const std::string& Filename, GLenum& InternalFormat, std::vector<TextureMipLevel>& Levels)
+{
+    std::string ContainerFilename = GetCompressedTextureFileName(Filename);
+
+    FILE* f = fopen(ContainerFilename.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    if (IsOlderThan(ContainerFilename, Filename)) {
+        printf("'%s' is older than the image - ignored\n", ContainerFilename.c_str());
+        fclose(f);
+        return false;
+    }
+
+    CompressedTextureHeader Header;
+
+    bool Success = (fread(&Header, sizeof(Header), 1, f) == 1) &&
+                   (Header.Magic == COMPRESSED_TEXTURE_MAGIC) &&
+                   (Header.Version == COMPRESSED_TEXTURE_VERSION) &&
+                   (Header.Format < BLOCK_FORMAT_COUNT) &&
+                   (Header.NumLevels > 0) && (Header.NumLevels <= 32);
+
+    if (Success) {
+        Levels.resize(Header.NumLevels);
+
+        for (int i = 0 ; Success && (i < (int)Header.NumLevels) ; i++) {
+            CompressedLevelHeader LevelHeader;
+
+            Success = (fread(&LevelHeader, sizeof(LevelHeader), 1, f) == 1);
+
+            if (Success) {
+                Levels[i].Width = LevelHeader.Width;
+                Levels[i].Height = LevelHeader.Height;
+                Levels[i].Data.resize(LevelHeader.Size);
+
+                Success = (fread(Levels[i].Data.data(), LevelHeader.Size, 1, f) == 1);
+            }
+        }
+    }
+
+    fclose(f);
+
+    if (!Success) {
+        printf("Invalid compressed texture '%s'\n", ContainerFilename.c_str());
+        Levels.clear();
+        return false;
+    }
+
+    InternalFormat = GetBlockFormatGL((BLOCK_FORMAT)Header.Format);
 
     return true;
 }
 
 
+// The texture must be created by the caller. With DSA it must also have its storage.
+static void UploadCompressedLevel(GLuint TextureObj, GLenum InternalFormat, int Level, const TextureMipLevel& Mip)
+{
+    if (IsGLVersionHigher(4, 5)) {
+        glCompressedTextureSubImage2D(TextureObj, Level, 0, 0, Mip.Width, Mip.Height, InternalFormat, (GLsizei)Mip.Data.size(), Mip.Data.data());
+    } else {
+        glBindTexture(GL_TEXTURE_2D, TextureObj);
+        glCompressedTexImage2D(GL_TEXTURE_2D, Level, InternalFormat, Mip.Width, Mip.Height, 0, (GLsizei)Mip.Data.size(), Mip.Data.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+}
+
+
+bool Texture::LoadCompressed()
+{
+    if (m_textureTarget != GL_TEXTURE_2D) {
+        return false;
+    }
+
+    GLenum InternalFormat = 0;
+    std::vector<TextureMipLevel> Levels;
+
+    if (!ReadCompressedTexture(m_fileName, InternalFormat, Levels)) {
+        return false;
+    }
+
+    m_imageWidth = Levels[0].Width;
+    m_imageHeight = Levels[0].Height;
+    m_compressedSize = 0;
+
+    int NumLevels = (int)Levels.size();
+
+    if (IsGLVersionHigher(4, 5)) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &m_textureObj);
+        glTextureStorage2D(m_textureObj, NumLevels, InternalFormat, m_imageWidth, m_imageHeight);
+    } else {
+        glGenTextures(1, &m_textureObj);
+    }
+
+    for (int i = 0 ; i < NumLevels ; i++) {
+        UploadCompressedLevel(m_textureObj, InternalFormat, i, Levels[i]);
+        m_compressedSize += Levels[i].Data.size();
+    }
+
+    if (IsGLVersionHigher(4, 5)) {
+        glTextureParameteri(m_textureObj, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(m_textureObj, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(m_textureObj, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(m_textureObj, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    } else {
+        glBindTexture(GL_TEXTURE_2D, m_textureObj);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, NumLevels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    printf("Width %d, height %d, compressed (%d levels, %d bytes)\n", m_imageWidth, m_imageHeight, NumLevels, (int)m_compressedSize);
+
+    return true;
+}
+
+
+void Texture::LoadAsync()
+{
+    GetTextureLoader().LoadAsync(this);
+}
+
+
 void Texture::Load(const std::string& Filename)
 {
     m_fileName = Filename;
@@ -183,6 +357,65 @@ void Texture::LoadInternalDSA(const void* pImageData)
 }
 
 
+static void GetTextureFormats(int BPP, GLenum& InternalFormat, GLenum& Format);
+
+
+void Texture::LoadInternalMipmapped(const unsigned char* pImageData)
+{
+    std::vector<TextureMipLevel> Levels(1);
+    Levels[0].Width = m_imageWidth;
+    Levels[0].Height = m_imageHeight;
+    Levels[0].Data.assign(pImageData, pImageData + (size_t)m_imageWidth * m_imageHeight * m_imageBPP);
+
+    // embedded textures have no file to cache next to
+    if (m_fileName.empty()) {
+        GetMipmapGenerator().Generate(m_imageBPP, m_srgb, Levels);
+    } else {
+        GetMipmapGenerator().GenerateCached(m_fileName, m_imageBPP, m_srgb, Levels);
+    }
+
+    GLenum InternalFormat = 0;
+    GLenum Format = 0;
+    GetTextureFormats(m_imageBPP, InternalFormat, Format);
+
+    int NumLevels = (int)Levels.size();
+
+    // the rows of the small mip levels are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (IsGLVersionHigher(4, 5)) {
+        glCreateTextures(GL_TEXTURE_2D, 1, &m_textureObj);
+        glTextureStorage2D(m_textureObj, NumLevels, InternalFormat, m_imageWidth, m_imageHeight);
+
+        for (int i = 0 ; i < NumLevels ; i++) {
+            glTextureSubImage2D(m_textureObj, i, 0, 0, Levels[i].Width, Levels[i].Height, Format, GL_UNSIGNED_BYTE, Levels[i].Data.data());
+        }
+
+        glTextureParameteri(m_textureObj, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(m_textureObj, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(m_textureObj, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(m_textureObj, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    } else {
+        glGenTextures(1, &m_textureObj);
+        glBindTexture(GL_TEXTURE_2D, m_textureObj);
+
+        for (int i = 0 ; i < NumLevels ; i++) {
+            glTexImage2D(GL_TEXTURE_2D, i, InternalFormat, Levels[i].Width, Levels[i].Height, 0, Format, GL_UNSIGNED_BYTE, Levels[i].Data.data());
+        }
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, NumLevels - 1);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+
 void Texture::LoadF32(int Width, int Height, const float* pImageData)
 {
     if (!IsGLVersionHigher(4, 5)) {
@@ -217,11 +450,873 @@ void Texture::Bind(GLenum TextureUnit)
 void Texture::BindInternalNonDSA(GLenum TextureUnit)
 {
     glActiveTexture(TextureUnit);
-    glBindTexture(m_textureTarget, m_textureObj);
+    glBindTexture(m_textureTarget, m_textureObj ? m_textureObj : AsyncTextureLoader::GetPlaceholderTexture());
 }
 
 
 void Texture::BindInternalDSA(GLenum TextureUnit)
 {
-    glBindTextureUnit(TextureUnit - GL_TEXTURE0, m_textureObj);
+    glBindTextureUnit(TextureUnit - GL_TEXTURE0, m_textureObj ? m_textureObj : AsyncTextureLoader::GetPlaceholderTexture());
+}
+
+
+static void GetTextureFormats(int BPP, GLenum& InternalFormat, GLenum& Format)
+{
+    switch (BPP) {
+    case 1:
+        InternalFormat = GL_R8;
+        Format = GL_RED;
+        break;
+
+    case 2:
+        InternalFormat = GL_RG8;
+        Format = GL_RG;
+        break;
+
+    case 3:
+        InternalFormat = GL_RGB8;
+        Format = GL_RGB;
+        break;
+
+    case 4:
+        InternalFormat = GL_RGBA8;
+        Format = GL_RGBA;
+        break;
+
+    default:
+        NOT_IMPLEMENTED;
+    }
+}
+
+
+MipmapGenerator& GetMipmapGenerator()
+{
+    static MipmapGenerator Generator;
+
+    return Generator;
+}
+
+
+static const int MIPMAP_KAISER_RADIUS = 3;         // source texels on each side of the center of the destination texel
+static const float MIPMAP_KAISER_ALPHA = 4.0f;
+
+#define MIPMAP_CACHE_MAGIC   0x50494D4F  // "OMIP"
+#define MIPMAP_CACHE_VERSION 1
+
+// The cache file starts with this header which is followed by the data of
+// levels 1 and up. Level 0 is the image itself.
+struct MipmapCacheHeader {
+    unsigned int Magic = MIPMAP_CACHE_MAGIC;
+    unsigned int Version = MIPMAP_CACHE_VERSION;
+    unsigned int Width = 0;
+    unsigned int Height = 0;
+    unsigned int BPP = 0;
+    unsigned int NumLevels = 0;
+    unsigned int Filter = 0;
+    unsigned int SRGB = 0;
+};
+
+
+static const std::vector<float>& GetSRGBToLinearTable()
+{
+    static const std::vector<float> Table = []() {
+        std::vector<float> t(256);
+
+        for (int i = 0 ; i < 256 ; i++) {
+            float c = i / 255.0f;
+            t[i] = (c <= 0.04045f) ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+        }
+
+        return t;
+    }();
+
+    return Table;
+}
+
+
+#define LINEAR_TO_SRGB_TABLE_SIZE 4096
+
+// sampled at the center of each bucket which keeps the error below one 8 bit step
+static const std::vector<unsigned char>& GetLinearToSRGBTable()
+{
+    static const std::vector<unsigned char> Table = []() {
+        std::vector<unsigned char> t(LINEAR_TO_SRGB_TABLE_SIZE);
+
+        for (int i = 0 ; i < LINEAR_TO_SRGB_TABLE_SIZE ; i++) {
+            float l = (i + 0.5f) / LINEAR_TO_SRGB_TABLE_SIZE;
+            float c = (l <= 0.0031308f) ? l * 12.92f : 1.055f * powf(l, 1.0f / 2.4f) - 0.055f;
+            t[i] = (unsigned char)std::min((int)(c * 255.0f + 0.5f), 255);
+        }
+
+        return t;
+    }();
+
+    return Table;
+}
+
+
+// zeroth order modified Bessel function of the first kind
+static float BesselI0(float x)
+{
+    float Sum = 1.0f;
+    float Term = 1.0f;
+
+    for (int k = 1 ; k < 20 ; k++) {
+        Term *= (x / (2.0f * k)) * (x / (2.0f * k));
+        Sum += Term;
+    }
+
+    return Sum;
+}
+
+
+// The destination texel x covers the source texels 2x and 2x+1 so the taps are
+// the same for every texel. Tap t reads the source texel 2x + 1 - Radius + t.
+static void CalcMipmapFilterTaps(MIPMAP_FILTER Filter, std::vector<float>& Taps)
+{
+    if (Filter == MIPMAP_FILTER_BOX) {
+        Taps.assign(2, 0.5f);
+        return;
+    }
+
+    int Radius = MIPMAP_KAISER_RADIUS;
+    Taps.resize(Radius * 2);
+
+    float Sum = 0.0f;
+
+    for (int t = 0 ; t < Radius * 2 ; t++) {
+        // distance from the center in source texels
+        float d = t - Radius + 0.5f;
+
+        // sinc with the cutoff of the half resolution
+        float x = 3.14159265f * d * 0.5f;
+        float Sinc = sinf(x) / x;
+
+        float r = d / Radius;
+        float Window = BesselI0(MIPMAP_KAISER_ALPHA * sqrtf(std::max(1.0f - r * r, 0.0f))) / BesselI0(MIPMAP_KAISER_ALPHA);
+
+        Taps[t] = Sinc * Window;
+        Sum += Taps[t];
+    }
+
+    for (int t = 0 ; t < Radius * 2 ; t++) {
+        Taps[t] /= Sum;
+    }
+}
+
+
+void MipmapGenerator::Generate(int BPP, bool SRGB, std::vector<TextureMipLevel>& Levels, int NumThreads) const
+{
+    Levels.resize(1);
+
+    int NumLevels = 1 + (int)floorf(log2f((float)std::max(Levels[0].Width, Levels[0].Height)));
+
+    // the number of leading channels that are sRGB
+    int NumSRGBChannels = (SRGB && (BPP >= 3)) ? 3 : 0;
+
+    const std::vector<float>& ToLinear = GetSRGBToLinearTable();
+    const std::vector<unsigned char>& ToSRGB = GetLinearToSRGBTable();
+
+    std::vector<float> Taps;
+    CalcMipmapFilterTaps(m_filter, Taps);
+    int NumTaps = (int)Taps.size();
+    int Radius = NumTaps / 2;
+
+    // The chain is filtered in float so that the rounding errors don't accumulate
+    int SrcWidth = Levels[0].Width;
+    int SrcHeight = Levels[0].Height;
+    int SrcRowSize = SrcWidth * BPP;
+    std::vector<float> Src((size_t)SrcHeight * SrcRowSize);
+
+    ParallelFor(SrcHeight, [&](int y) {
+        const unsigned char* pSrc = &Levels[0].Data[(size_t)y * SrcRowSize];
+        float* pDst = &Src[(size_t)y * SrcRowSize];
+
+        for (int i = 0 ; i < SrcRowSize ; i++) {
+            pDst[i] = ((i % BPP) < NumSRGBChannels) ? ToLinear[pSrc[i]] : pSrc[i] / 255.0f;
+        }
+    }, NumThreads);
+
+    std::vector<float> Horz;
+    std::vector<float> Dst;
+
+    for (int Level = 1 ; Level < NumLevels ; Level++) {
+        int DstWidth = std::max(SrcWidth / 2, 1);
+        int DstHeight = std::max(SrcHeight / 2, 1);
+        int DstRowSize = DstWidth * BPP;
+
+        // horizontal pass - every source row is reduced to DstWidth texels
+        Horz.resize((size_t)SrcHeight * DstRowSize);
+
+        ParallelFor(SrcHeight, [&](int y) {
+            const float* pSrcRow = &Src[(size_t)y * SrcRowSize];
+            float* pDstRow = &Horz[(size_t)y * DstRowSize];
+
+            for (int x = 0 ; x < DstWidth ; x++) {
+                for (int c = 0 ; c < BPP ; c++) {
+                    float Sum = 0.0f;
+
+                    for (int t = 0 ; t < NumTaps ; t++) {
+                        int SrcX = std::min(std::max(x * 2 + 1 - Radius + t, 0), SrcWidth - 1);
+                        Sum += Taps[t] * pSrcRow[SrcX * BPP + c];
+                    }
+
+                    pDstRow[x * BPP + c] = Sum;
+                }
+            }
+        }, NumThreads);
+
+        // vertical pass - whole rows are accumulated which the compiler vectorizes
+        Dst.resize((size_t)DstHeight * DstRowSize);
+
+        TextureMipLevel Mip;
+        Mip.Width = DstWidth;
+        Mip.Height = DstHeight;
+        Mip.Data.resize((size_t)DstHeight * DstRowSize);
+
+        ParallelFor(DstHeight, [&](int y) {
+            float* pDstRow = &Dst[(size_t)y * DstRowSize];
+
+            for (int i = 0 ; i < DstRowSize ; i++) {
+                pDstRow[i] = 0.0f;
+            }
+
+            for (int t = 0 ; t < NumTaps ; t++) {
+                int SrcY = std::min(std::max(y * 2 + 1 - Radius + t, 0), SrcHeight - 1);
+                const float* pHorzRow = &Horz[(size_t)SrcY * DstRowSize];
+                float Weight = Taps[t];
+
+                for (int i = 0 ; i < DstRowSize ; i++) {
+                    pDstRow[i] += Weight * pHorzRow[i];
+                }
+            }
+
+            unsigned char* pMipRow = &Mip.Data[(size_t)y * DstRowSize];
+
+            // the negative lobes of the Kaiser filter can overshoot
+            for (int i = 0 ; i < DstRowSize ; i++) {
+                float v = std::min(std::max(pDstRow[i], 0.0f), 1.0f);
+                pDstRow[i] = v;
+
+                if ((i % BPP) < NumSRGBChannels) {
+                    pMipRow[i] = ToSRGB[std::min((int)(v * LINEAR_TO_SRGB_TABLE_SIZE), LINEAR_TO_SRGB_TABLE_SIZE - 1)];
+                } else {
+                    pMipRow[i] = (unsigned char)(v * 255.0f + 0.5f);
+                }
+            }
+        }, NumThreads);
+
+        Levels.push_back(std::move(Mip));
+
+        Src.swap(Dst);
+        SrcWidth = DstWidth;
+        SrcHeight = DstHeight;
+        SrcRowSize = DstRowSize;
+    }
+}
+
+
+static std::string GetMipmapCacheFileName(const std::string& Filename)
+{
+    return Filename + ".mips";
+}
+
+
+bool MipmapGenerator::LoadCache(const std::string& Filename, int BPP, bool SRGB, std::vector<TextureMipLevel>& Levels) const
+{
+    std::string CacheFilename = GetMipmapCacheFileName(Filename);
+
+    if (IsOlderThan(CacheFilename, Filename)) {
+        return false;
+    }
+
+    FILE* f = fopen(CacheFilename.c_str(), "rb");
+
+    if (!f) {
+        return false;
+    }
+
+    MipmapCacheHeader Header;
+
+    bool Success = (fread(&Header, sizeof(Header), 1, f) == 1) &&
+                   (Header.Magic == MIPMAP_CACHE_MAGIC) &&
+                   (Header.Version == MIPMAP_CACHE_VERSION) &&
+                   (Header.Width == (unsigned int)Levels[0].Width) &&
+                   (Header.Height == (unsigned int)Levels[0].Height) &&
+                   (Header.BPP == (unsigned int)BPP) &&
+                   (Header.Filter == (unsigned int)m_filter) &&
+                   (Header.SRGB == (unsigned int)SRGB) &&
+                   (Header.NumLevels == 1 + (unsigned int)floorf(log2f((float)std::max(Levels[0].Width, Levels[0].Height))));
+
+    Levels.resize(1);
+
+    for (int i = 1 ; Success && (i < (int)Header.NumLevels) ; i++) {
+        TextureMipLevel Mip;
+        Mip.Width = std::max(Levels[i - 1].Width / 2, 1);
+        Mip.Height = std::max(Levels[i - 1].Height / 2, 1);
+        Mip.Data.resize((size_t)Mip.Width * Mip.Height * BPP);
+
+        Success = (fread(Mip.Data.data(), Mip.Data.size(), 1, f) == 1);
+
+        Levels.push_back(std::move(Mip));
+    }
+
+    fclose(f);
+
+    if (!Success) {
+        Levels.resize(1);
+    }
+
+    return Success;
+}
+
+
+void MipmapGenerator::StoreCache(const std::string& Filename, int BPP, bool SRGB, const std::vector<TextureMipLevel>& Levels) const
+{
+    std::string CacheFilename = GetMipmapCacheFileName(Filename);
+
+    // Written under a temporary name so that an interrupted write never leaves a
+    // truncated cache behind. The name is unique to the thread because the async
+    // loader may store the same file from two threads.
+    char Suffix[32];
+    SNPRINTF(Suffix, sizeof(Suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+    std::string TempFilename = CacheFilename + Suffix;
+
+    FILE* f = fopen(TempFilename.c_str(), "wb");
+
+    if (!f) {
+        printf("Error opening '%s'\n", TempFilename.c_str());
+        return;
+    }
+
+    MipmapCacheHeader Header;
+    Header.Width = Levels[0].Width;
+    Header.Height = Levels[0].Height;
+    Header.BPP = BPP;
+    Header.NumLevels = (unsigned int)Levels.size();
+    Header.Filter = m_filter;
+    Header.SRGB = SRGB;
+
+    bool Success = (fwrite(&Header, sizeof(Header), 1, f) == 1);
+
+    for (int i = 1 ; Success && (i < (int)Levels.size()) ; i++) {
+        Success = (fwrite(Levels[i].Data.data(), Levels[i].Data.size(), 1, f) == 1);
+    }
+
+    Success = (fclose(f) == 0) && Success;
+
+    if (Success) {
+        remove(CacheFilename.c_str());
+        Success = (rename(TempFilename.c_str(), CacheFilename.c_str()) == 0);
+    }
+
+    if (!Success) {
+        printf("Error writing '%s'\n", CacheFilename.c_str());
+        remove(TempFilename.c_str());
+    }
+}
+
+
+void MipmapGenerator::GenerateCached(const std::string& Filename, int BPP, bool SRGB, std::vector<TextureMipLevel>& Levels, int NumThreads) const
+{
+    if (m_cache && LoadCache(Filename, BPP, SRGB, Levels)) {
+        return;
+    }
+
+    Generate(BPP, SRGB, Levels, NumThreads);
+
+    if (m_cache) {
+        StoreCache(Filename, BPP, SRGB, Levels);
+    }
+}
+
+
+AsyncTextureLoader& GetTextureLoader()
+{
+    static AsyncTextureLoader Loader;
+
+    return Loader;
+}
+
+
+AsyncTextureLoader::~AsyncTextureLoader()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_decodeCond.notify_all();
+
+    for (int i = 0 ; i < (int)m_threads.size() ; i++) {
+        m_threads[i].join();
+    }
+
+    for (int i = 0 ; i < (int)m_decodeQueue.size() ; i++) {
+        delete m_decodeQueue[i];
+    }
+
+    for (int i = 0 ; i < (int)m_uploadQueue.size() ; i++) {
+        delete m_uploadQueue[i];
+    }
+}
+
+
+void AsyncTextureLoader::StartThreads()
+{
+    // one core is left for the GL thread
+    int NumThreads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        m_threads.push_back(std::thread(&AsyncTextureLoader::WorkerThread, this));
+    }
+}
+
+
+void AsyncTextureLoader::LoadAsync(Texture* pTexture)
+{
+    if (m_threads.empty()) {
+        StartThreads();
+    }
+
+    Job* pJob = new Job;
+    pJob->pTexture = pTexture;
+    pJob->GenerateMipmaps = GetMipmapGenerator().IsEnabled();
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_decodeQueue.push_back(pJob);
+        m_numPending++;
+    }
+
+    m_decodeCond.notify_one();
+}
+
+
+int AsyncTextureLoader::GetNumPending()
+{
+    std::lock_guard<std::mutex> Lock(m_mutex);
+
+    return m_numPending;
+}
+
+
+void AsyncTextureLoader::WorkerThread()
+{
+    // Flip like Texture::Load(). The per thread flag is not affected by the
+    // global one that the synchronous loaders change on the GL thread.
+    stbi_set_flip_vertically_on_load_thread(1);
+
+    for (;;) {
+        Job* pJob = NULL;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_mutex);
+
+            m_decodeCond.wait(Lock, [this]() { return m_quit || !m_decodeQueue.empty(); });
+
+            if (m_quit) {
+                return;
+            }
+
+            pJob = m_decodeQueue.front();
+            m_decodeQueue.pop_front();
+        }
+
+        DecodeJob(pJob);
+
+        {
+            std::lock_guard<std::mutex> Lock(m_mutex);
+            m_uploadQueue.push_back(pJob);
+        }
+
+        m_uploadCond.notify_all();
+    }
+}
+
+
+void AsyncTextureLoader::DecodeJob(Job* pJob)
+{
+    const char* pFilename = pJob->pTexture->m_fileName.c_str();
+
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    // the container already has the whole mip chain
+    if (ReadCompressedTexture(pJob->pTexture->m_fileName, pJob->CompressedFormat, pJob->Levels)) {
+        pJob->GenerateMipmaps = true;
+        pJob->NumLevels = (int)pJob->Levels.size();
+
+        for (int i = 0 ; i < pJob->NumLevels ; i++) {
+            pJob->CompressedSize += pJob->Levels[i].Data.size();
+        }
+
+        pJob->LoadTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+        return;
+    }
+
+    int Width = 0;
+    int Height = 0;
+    int BPP = 0;
+
+    unsigned char* pImageData = stbi_load(pFilename, &Width, &Height, &BPP, 0);
+
+    if (!pImageData) {
+        printf("Can't load texture from '%s' - %s\n", pFilename, stbi_failure_reason());
+        pJob->Failed = true;
+        return;
+    }
+
+    pJob->BPP = BPP;
+    pJob->NumLevels = 1 + (int)floorf(log2f((float)std::max(Width, Height)));
+    pJob->Levels.resize(1);
+    pJob->Levels[0].Width = Width;
+    pJob->Levels[0].Height = Height;
+    pJob->Levels[0].Data.assign(pImageData, pImageData + (size_t)Width * Height * BPP);
+
+    stbi_image_free(pImageData);
+
+    // the textures are already decoded in parallel so each one is filtered by a single thread
+    if (pJob->GenerateMipmaps) {
+        GetMipmapGenerator().GenerateCached(pJob->pTexture->m_fileName, BPP, pJob->pTexture->m_srgb, pJob->Levels, 1);
+    }
+
+    pJob->LoadTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+}
+
+
+void AsyncTextureLoader::Update(float BudgetMs)
+{
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    while (UploadNextLevel()) {
+        float ElapsedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+
+        if (ElapsedMs >= BudgetMs) {
+            break;
+        }
+    }
+}
+
+
+void AsyncTextureLoader::Finish()
+{
+    for (;;) {
+        while (UploadNextLevel()) {
+        }
+
+        std::unique_lock<std::mutex> Lock(m_mutex);
+
+        if (m_numPending == 0) {
+            break;
+        }
+
+        m_uploadCond.wait(Lock, [this]() { return !m_uploadQueue.empty(); });
+    }
+}
+
+
+// Called only on the GL thread. This is the only place where jobs are removed
+// from the upload queue so the front job stays valid while it is uploaded.
+bool AsyncTextureLoader::UploadNextLevel()
+{
+    Job* pJob = NULL;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+
+        if (m_uploadQueue.empty()) {
+            return false;
+        }
+
+        pJob = m_uploadQueue.front();
+    }
+
+    if (pJob->Failed) {
+        exit(0);
+    }
+
+    UploadLevel(pJob);
+
+    if (pJob->NextLevel == (int)pJob->Levels.size()) {
+        CompleteJob(pJob);
+
+        {
+            std::lock_guard<std::mutex> Lock(m_mutex);
+            m_uploadQueue.pop_front();
+            m_numPending--;
+        }
+
+        delete pJob;
+    }
+
+    return true;
+}
+
+
+void AsyncTextureLoader::UploadLevel(Job* pJob)
+{
+    GLenum InternalFormat = pJob->CompressedFormat;
+    GLenum Format = 0;
+
+    if (InternalFormat == 0) {
+        GetTextureFormats(pJob->BPP, InternalFormat, Format);
+    }
+
+    TextureMipLevel& Level = pJob->Levels[pJob->NextLevel];
+
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    // the rows of the small mip levels are not 4 byte aligned
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (pJob->CompressedFormat != 0) {
+        if (pJob->TextureObj == 0) {
+            if (IsGLVersionHigher(4, 5)) {
+                glCreateTextures(GL_TEXTURE_2D, 1, &pJob->TextureObj);
+                glTextureStorage2D(pJob->TextureObj, pJob->NumLevels, InternalFormat, pJob->Levels[0].Width, pJob->Levels[0].Height);
+            } else {
+                glGenTextures(1, &pJob->TextureObj);
+            }
+        }
+
+        UploadCompressedLevel(pJob->TextureObj, InternalFormat, pJob->NextLevel, Level);
+    } else if (IsGLVersionHigher(4, 5)) {
+        if (pJob->TextureObj == 0) {
+            glCreateTextures(GL_TEXTURE_2D, 1, &pJob->TextureObj);
+            glTextureStorage2D(pJob->TextureObj, pJob->NumLevels, InternalFormat, pJob->Levels[0].Width, pJob->Levels[0].Height);
+        }
+
+        glTextureSubImage2D(pJob->TextureObj, pJob->NextLevel, 0, 0, Level.Width, Level.Height, Format, GL_UNSIGNED_BYTE, Level.Data.data());
+    } else {
+        if (pJob->TextureObj == 0) {
+            glGenTextures(1, &pJob->TextureObj);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, pJob->TextureObj);
+        glTexImage2D(GL_TEXTURE_2D, pJob->NextLevel, InternalFormat, Level.Width, Level.Height, 0, Format, GL_UNSIGNED_BYTE, Level.Data.data());
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // the size of level 0 is still needed in CompleteJob
+    std::vector<unsigned char>().swap(Level.Data);
+
+    pJob->NextLevel++;
+    pJob->LoadTimeMs += std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+}
+
+
+void AsyncTextureLoader::CompleteJob(Job* pJob)
+{
+    GLuint TextureObj = pJob->TextureObj;
+    int MaxLevel = pJob->GenerateMipmaps ? pJob->NumLevels - 1 : 1000;
+
+    if (IsGLVersionHigher(4, 5)) {
+        glTextureParameteri(TextureObj, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTextureParameteri(TextureObj, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTextureParameteri(TextureObj, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTextureParameteri(TextureObj, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        if (!pJob->GenerateMipmaps) {
+            glGenerateTextureMipmap(TextureObj);
+        }
+    } else {
+        glBindTexture(GL_TEXTURE_2D, TextureObj);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, MaxLevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        if (!pJob->GenerateMipmaps) {
+            glGenerateMipmap(GL_TEXTURE_2D);
+        }
+
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    Texture* pTexture = pJob->pTexture;
+    pTexture->m_imageWidth = pJob->Levels[0].Width;
+    pTexture->m_imageHeight = pJob->Levels[0].Height;
+    pTexture->m_imageBPP = pJob->BPP;
+    pTexture->m_loadTimeMs = pJob->LoadTimeMs;
+    pTexture->m_compressedSize = pJob->CompressedSize;
+    pTexture->m_textureObj = TextureObj;
+}
+
+
+GLuint AsyncTextureLoader::GetPlaceholderTexture()
+{
+    static GLuint Placeholder = 0;
+
+    if (Placeholder == 0) {
+        unsigned char Grey[4] = { 128, 128, 128, 255 };
+
+        glGenTextures(1, &Placeholder);
+        glBindTexture(GL_TEXTURE_2D, Placeholder);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, Grey);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    return Placeholder;
+}
+
+
+TextureRegistry& GetTextureRegistry()
+{
+    static TextureRegistry Registry;
+
+    return Registry;
+}
+
+
+static std::string GetCanonicalPath(const std::string& Filename)
+{
+    std::string Path = Filename;
+
+#ifdef _WIN32
+    char FullPath[_MAX_PATH];
+
+    if (_fullpath(FullPath, Filename.c_str(), _MAX_PATH)) {
+        Path = FullPath;
+    }
+
+    // the file system is not case sensitive
+    for (int i = 0 ; i < (int)Path.length() ; i++) {
+        Path[i] = (Path[i] == '\\') ? '/' : (char)tolower(Path[i]);
+    }
+#else
+    char* pFullPath = realpath(Filename.c_str(), NULL);
+
+    if (pFullPath) {
+        Path = pFullPath;
+        free(pFullPath);
+    }
+#endif
+
+    return Path;
+}
+
+
+Texture* TextureRegistry::FindTexture(const std::string& Key)
+{
+    std::map<std::string, Entry>::iterator it = m_entries.find(Key);
+
+    if (it == m_entries.end()) {
+        return NULL;
+    }
+
+    it->second.RefCount++;
+    it->second.NumShared++;
+
+    return it->second.pTexture;
+}
+
+
+Texture* TextureRegistry::AddTexture(const std::string& Key, Texture* pTexture)
+{
+    Entry& e = m_entries[Key];
+    e.pTexture = pTexture;
+    e.RefCount = 1;
+
+    m_keys[pTexture] = Key;
+
+    return pTexture;
+}
+
+
+Texture* TextureRegistry::AcquireFile(const std::string& Filename, bool SRGB)
+{
+    // the same image may be used both as color and as data
+    std::string Key = GetCanonicalPath(Filename) + (SRGB ? ":srgb" : "");
+
+    Texture* pTexture = FindTexture(Key);
+
+    if (!pTexture) {
+        pTexture = AddTexture(Key, new Texture(GL_TEXTURE_2D, Filename));
+        pTexture->SetSRGB(SRGB);
+        pTexture->LoadAsync();
+    }
+
+    return pTexture;
+}
+
+
+Texture* TextureRegistry::AcquireEmbedded(unsigned int BufferSize, const void* pData, bool SRGB)
+{
+    char Key[64];
+    SNPRINTF(Key, sizeof(Key), "embedded:%u:%016llx%s", BufferSize, ArtifactCache::HashData(pData, BufferSize), SRGB ? ":srgb" : "");
+
+    Texture* pTexture = FindTexture(Key);
+
+    if (!pTexture) {
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+        pTexture = AddTexture(Key, new Texture(GL_TEXTURE_2D));
+        pTexture->SetSRGB(SRGB);
+        pTexture->Load(BufferSize, (void*)pData);
+
+        pTexture->m_loadTimeMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+    }
+
+    return pTexture;
+}
+
+
+void TextureRegistry::Release(Texture* pTexture)
+{
+    if (!pTexture) {
+        return;
+    }
+
+    std::map<const Texture*, std::string>::iterator it = m_keys.find(pTexture);
+
+    if (it == m_keys.end()) {
+        printf("%s:%d - texture %p was not acquired from the registry\n", __FILE__, __LINE__, pTexture);
+        exit(0);
+    }
+
+    Entry& e = m_entries[it->second];
+
+    e.RefCount--;
+
+    if (e.RefCount > 0) {
+        return;
+    }
+
+    // the async loader still holds a pointer to a pending texture
+    if (!pTexture->IsLoaded()) {
+        GetTextureLoader().Finish();
+    }
+
+    if (pTexture->m_textureObj != 0) {
+        glDeleteTextures(1, &pTexture->m_textureObj);
+    }
+
+    delete pTexture;
+
+    m_entries.erase(it->second);
+    m_keys.erase(it);
+}
+
+
+void TextureRegistry::PrintStats() const
+{
+    int NumShared = 0;
+    size_t SavedBytes = 0;
+    float SavedMs = 0.0f;
+
+    for (std::map<std::string, Entry>::const_iterator it = m_entries.begin() ; it != m_entries.end() ; it++) {
+        const Entry& e = it->second;
+        NumShared += e.NumShared;
+        SavedBytes += e.NumShared * e.pTexture->GetSizeInBytes();
+        SavedMs += e.NumShared * e.pTexture->GetLoadTimeMs();
+    }
+
+    printf("Texture registry: %d textures, %d shared references, saved %.1f MB of VRAM and %.1f ms of loading\n",
+           (int)m_entries.size(), NumShared, (float)SavedBytes / (1024.0f * 1024.0f), SavedMs);
 }
@@ -0,0 +1,1005 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <limits.h>
+#include <algorithm>
+#include <chrono>
+
+#include "ogldev_util.h"
+#include "ogldev_texture.h"
+#include "ogldev_texture_compressor.h"
+#include "3rdparty/stb_image.h"
+
+
+// The weight of the second endpoint for every BC1 index (4 color mode)
+static const float BC1Weights[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+
+// BC7 4 bit index weights (out of 64)
+static const int BC7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+
+static inline int ClampInt(int x, int Min, int Max)
+{
+    return std::min(std::max(x, Min), Max);
+}
+
+
+static inline float ClampFloat(float x, float Min, float Max)
+{
+    return std::min(std::max(x, Min), Max);
+}
+
+
+struct BitWriter {
+    unsigned char* pData = NULL;
+    int Pos = 0;
+
+    void Write(unsigned int Value, int NumBits)
+    {
+        for (int i = 0 ; i < NumBits ; i++) {
+            if ((Value >> i) & 1) {
+                pData[Pos >> 3] |= (unsigned char)(1 << (Pos & 7));
+            }
+            Pos++;
+        }
+    }
+};
+
+
+struct BitReader {
+    const unsigned char* pData = NULL;
+    int Pos = 0;
+
+    unsigned int Read(int NumBits)
+    {
+        unsigned int Value = 0;
+
+        for (int i = 0 ; i < NumBits ; i++) {
+            Value |= ((pData[Pos >> 3] >> (Pos & 7)) & 1) << i;
+            Pos++;
+        }
+
+        return Value;
+    }
+};
+
+
+// Copies a 4x4 block of RGBA pixels. The last row/column is repeated
+// for the blocks that cross the edge of the image.
+static void GetBlockPixels(const unsigned char* pRGBA, int Width, int Height, int BlockX, int BlockY, unsigned char* pPixels)
+{
+    for (int y = 0 ; y < 4 ; y++) {
+        int SrcY = std::min(BlockY * 4 + y, Height - 1);
+
+        for (int x = 0 ; x < 4 ; x++) {
+            int SrcX = std::min(BlockX * 4 + x, Width - 1);
+            memcpy(&pPixels[(y * 4 + x) * 4], &pRGBA[((size_t)SrcY * Width + SrcX) * 4], 4);
+        }
+    }
+}
+
+
+// Mean of the pixels and the direction of their largest variance (power iteration
+// on the covariance matrix) over the first NumChannels channels
+static void CalcPrincipalAxis(const unsigned char* pPixels, int NumChannels, float* pMean, float* pAxis)
+{
+    for (int c = 0 ; c < NumChannels ; c++) {
+        pMean[c] = 0.0f;
+
+        for (int i = 0 ; i < 16 ; i++) {
+            pMean[c] += pPixels[i * 4 + c];
+        }
+
+        pMean[c] /= 16.0f;
+    }
+
+    float Cov[4][4] = {};
+
+    for (int i = 0 ; i < 16 ; i++) {
+        float d[4];
+
+        for (int c = 0 ; c < NumChannels ; c++) {
+            d[c] = pPixels[i * 4 + c] - pMean[c];
+        }
+
+        for (int r = 0 ; r < NumChannels ; r++) {
+            for (int c = 0 ; c < NumChannels ; c++) {
+                Cov[r][c] += d[r] * d[c];
+            }
+        }
+    }
+
+    // start from the row of the channel with the largest variance
+    int MaxRow = 0;
+
+    for (int c = 1 ; c < NumChannels ; c++) {
+        if (Cov[c][c] > Cov[MaxRow][MaxRow]) {
+            MaxRow = c;
+        }
+    }
+
+    for (int c = 0 ; c < NumChannels ; c++) {
+        pAxis[c] = Cov[MaxRow][c];
+    }
+
+    for (int Iter = 0 ; Iter < 8 ; Iter++) {
+        float v[4] = {};
+        float Length = 0.0f;
+
+        for (int r = 0 ; r < NumChannels ; r++) {
+            for (int c = 0 ; c < NumChannels ; c++) {
+                v[r] += Cov[r][c] * pAxis[c];
+            }
+
+            Length += v[r] * v[r];
+        }
+
+        if (Length < 1e-12f) {
+            break;
+        }
+
+        Length = sqrtf(Length);
+
+        for (int c = 0 ; c < NumChannels ; c++) {
+            pAxis[c] = v[c] / Length;
+        }
+    }
+
+    float Length = 0.0f;
+
+    for (int c = 0 ; c < NumChannels ; c++) {
+        Length += pAxis[c] * pAxis[c];
+    }
+
+    // all the pixels are the same
+    if (Length < 1e-12f) {
+        for (int c = 0 ; c < NumChannels ; c++) {
+            pAxis[c] = (c == 0) ? 1.0f : 0.0f;
+        }
+    }
+}
+
+
+// The endpoints that span the pixels along the principal axis
+static void CalcAxisEndpoints(const unsigned char* pPixels, int NumChannels, float* pEnd0, float* pEnd1)
+{
+    float Mean[4];
+    float Axis[4];
+    CalcPrincipalAxis(pPixels, NumChannels, Mean, Axis);
+
+    float MinT = FLT_MAX;
+    float MaxT = -FLT_MAX;
+
+    for (int i = 0 ; i < 16 ; i++) {
+        float t = 0.0f;
+
+        for (int c = 0 ; c < NumChannels ; c++) {
+            t += (pPixels[i * 4 + c] - Mean[c]) * Axis[c];
+        }
+
+        MinT = std::min(MinT, t);
+        MaxT = std::max(MaxT, t);
+    }
+
+    for (int c = 0 ; c < NumChannels ; c++) {
+        pEnd0[c] = ClampFloat(Mean[c] + MinT * Axis[c], 0.0f, 255.0f);
+        pEnd1[c] = ClampFloat(Mean[c] + MaxT * Axis[c], 0.0f, 255.0f);
+    }
+}
+
+
+// Least squares fit of the two endpoints to the pixels given the weight of the
+// second endpoint in every pixel. Fails if all the pixels use the same weight.
+static bool RefineEndpoints(const unsigned char* pPixels, int NumChannels, const float* pWeights, float* pEnd0, float* pEnd1)
+{
+    float AA = 0.0f;
+    float AB = 0.0f;
+    float BB = 0.0f;
+    float AX[4] = {};
+    float BX[4] = {};
+
+    for (int i = 0 ; i < 16 ; i++) {
+        float b = pWeights[i];
+        float a = 1.0f - b;
+
+        AA += a * a;
+        AB += a * b;
+        BB += b * b;
+
+        for (int c = 0 ; c < NumChannels ; c++) {
+            AX[c] += a * pPixels[i * 4 + c];
+            BX[c] += b * pPixels[i * 4 + c];
+        }
+    }
+
+    float Det = AA * BB - AB * AB;
+
+    if (fabsf(Det) < 1e-6f) {
+        return false;
+    }
+
+    for (int c = 0 ; c < NumChannels ; c++) {
+        pEnd0[c] = ClampFloat((AX[c] * BB - BX[c] * AB) / Det, 0.0f, 255.0f);
+        pEnd1[c] = ClampFloat((BX[c] * AA - AX[c] * AB) / Det, 0.0f, 255.0f);
+    }
+
+    return true;
+}
+
+
+static unsigned short PackRGB565(const float* pColor)
+{
+    int r = ClampInt((int)(pColor[0] * 31.0f / 255.0f + 0.5f), 0, 31);
+    int g = ClampInt((int)(pColor[1] * 63.0f / 255.0f + 0.5f), 0, 63);
+    int b = ClampInt((int)(pColor[2] * 31.0f / 255.0f + 0.5f), 0, 31);
+
+    return (unsigned short)((r << 11) | (g << 5) | b);
+}
+
+
+static void UnpackRGB565(unsigned short Color, int* pColor)
+{
+    int r = (Color >> 11) & 31;
+    int g = (Color >> 5) & 63;
+    int b = Color & 31;
+
+    pColor[0] = (r << 3) | (r >> 2);
+    pColor[1] = (g << 2) | (g >> 4);
+    pColor[2] = (b << 3) | (b >> 2);
+}
+
+
+// The color block of BC3 always uses four colors. In BC1 the order of the
+// endpoints selects between four colors and three colors plus black.
+static void GetBC1Palette(unsigned short Color0, unsigned short Color1, bool ForceFourColors, int Palette[4][3])
+{
+    UnpackRGB565(Color0, Palette[0]);
+    UnpackRGB565(Color1, Palette[1]);
+
+    for (int c = 0 ; c < 3 ; c++) {
+        if (ForceFourColors || (Color0 > Color1)) {
+            Palette[2][c] = (2 * Palette[0][c] + Palette[1][c]) / 3;
+            Palette[3][c] = (Palette[0][c] + 2 * Palette[1][c]) / 3;
+        } else {
+            Palette[2][c] = (Palette[0][c] + Palette[1][c]) / 2;
+            Palette[3][c] = 0;
+        }
+    }
+}
+
+
+static int FindBC1Indices(const unsigned char* pPixels, const int Palette[4][3], int* pIndices)
+{
+    int Error = 0;
+
+    for (int i = 0 ; i < 16 ; i++) {
+        int BestDist = INT_MAX;
+
+        for (int j = 0 ; j < 4 ; j++) {
+            int dr = pPixels[i * 4] - Palette[j][0];
+            int dg = pPixels[i * 4 + 1] - Palette[j][1];
+            int db = pPixels[i * 4 + 2] - Palette[j][2];
+            int Dist = dr * dr + dg * dg + db * db;
+
+            if (Dist < BestDist) {
+                BestDist = Dist;
+                pIndices[i] = j;
+            }
+        }
+
+        Error += BestDist;
+    }
+
+    return Error;
+}
+
+
+static void CompressBC1Block(const unsigned char* pPixels, unsigned char* pBlock)
+{
+    float End0[4];
+    float End1[4];
+    CalcAxisEndpoints(pPixels, 3, End0, End1);
+
+    unsigned short BestColor0 = 0;
+    unsigned short BestColor1 = 0;
+    int BestIndices[16] = {};
+    int BestError = INT_MAX;
+
+    for (int Iter = 0 ; Iter < 3 ; Iter++) {
+        unsigned short Color0 = PackRGB565(End0);
+        unsigned short Color1 = PackRGB565(End1);
+
+        // the larger endpoint goes first to select the four color mode
+        if (Color0 < Color1) {
+            std::swap(Color0, Color1);
+        }
+
+        int Palette[4][3];
+        GetBC1Palette(Color0, Color1, true, Palette);
+
+        int Indices[16];
+        int Error = FindBC1Indices(pPixels, Palette, Indices);
+
+        if (Error >= BestError) {
+            break;
+        }
+
+        BestError = Error;
+        BestColor0 = Color0;
+        BestColor1 = Color1;
+        memcpy(BestIndices, Indices, sizeof(Indices));
+
+        if ((Error == 0) || (Color0 == Color1)) {
+            break;
+        }
+
+        float Weights[16];
+
+        for (int i = 0 ; i < 16 ; i++) {
+            Weights[i] = BC1Weights[Indices[i]];
+        }
+
+        if (!RefineEndpoints(pPixels, 3, Weights, End0, End1)) {
+            break;
+        }
+    }
+
+    unsigned int PackedIndices = 0;
+
+    // equal endpoints would select the three color mode where index 3 is black
+    if (BestColor0 != BestColor1) {
+        for (int i = 0 ; i < 16 ; i++) {
+            PackedIndices |= (unsigned int)BestIndices[i] << (i * 2);
+        }
+    }
+
+    pBlock[0] = (unsigned char)(BestColor0 & 0xFF);
+    pBlock[1] = (unsigned char)(BestColor0 >> 8);
+    pBlock[2] = (unsigned char)(BestColor1 & 0xFF);
+    pBlock[3] = (unsigned char)(BestColor1 >> 8);
+
+    for (int i = 0 ; i < 4 ; i++) {
+        pBlock[4 + i] = (unsigned char)(PackedIndices >> (i * 8));
+    }
+}
+
+
+static void DecompressBC1Block(const unsigned char* pBlock, bool ForceFourColors, unsigned char* pPixels)
+{
+    unsigned short Color0 = (unsigned short)(pBlock[0] | (pBlock[1] << 8));
+    unsigned short Color1 = (unsigned short)(pBlock[2] | (pBlock[3] << 8));
+
+    int Palette[4][3];
+    GetBC1Palette(Color0, Color1, ForceFourColors, Palette);
+
+    unsigned int Indices = pBlock[4] | (pBlock[5] << 8) | (pBlock[6] << 16) | ((unsigned int)pBlock[7] << 24);
+
+    for (int i = 0 ; i < 16 ; i++) {
+        int Index = (Indices >> (i * 2)) & 3;
+
+        for (int c = 0 ; c < 3 ; c++) {
+            pPixels[i * 4 + c] = (unsigned char)Palette[Index][c];
+        }
+    }
+}
+
+
+// Eight interpolated values when the first endpoint is larger, otherwise six
+// values plus 0 and 255
+static void GetBC4Palette(int Value0, int Value1, int* pPalette)
+{
+    pPalette[0] = Value0;
+    pPalette[1] = Value1;
+
+    if (Value0 > Value1) {
+        for (int i = 2 ; i < 8 ; i++) {
+            pPalette[i] = ((8 - i) * Value0 + (i - 1) * Value1 + 3) / 7;
+        }
+    } else {
+        for (int i = 2 ; i < 6 ; i++) {
+            pPalette[i] = ((6 - i) * Value0 + (i - 1) * Value1 + 2) / 5;
+        }
+
+        pPalette[6] = 0;
+        pPalette[7] = 255;
+    }
+}
+
+
+static int FindBC4Indices(const unsigned char* pPixels, int Channel, const int* pPalette, int* pIndices)
+{
+    int Error = 0;
+
+    for (int i = 0 ; i < 16 ; i++) {
+        int BestDist = INT_MAX;
+
+        for (int j = 0 ; j < 8 ; j++) {
+            int d = pPixels[i * 4 + Channel] - pPalette[j];
+
+            if (d * d < BestDist) {
+                BestDist = d * d;
+                pIndices[i] = j;
+            }
+        }
+
+        Error += BestDist;
+    }
+
+    return Error;
+}
+
+
+// A single channel block. The endpoints start at the range of the block and
+// are pulled inwards by up to two steps which often lands the interpolated
+// values closer to the pixels.
+static void CompressBC4Block(const unsigned char* pPixels, int Channel, unsigned char* pBlock)
+{
+    int MinValue = 255;
+    int MaxValue = 0;
+
+    for (int i = 0 ; i < 16 ; i++) {
+        MinValue = std::min(MinValue, (int)pPixels[i * 4 + Channel]);
+        MaxValue = std::max(MaxValue, (int)pPixels[i * 4 + Channel]);
+    }
+
+    int BestValue0 = MaxValue;
+    int BestValue1 = MinValue;
+    int BestIndices[16] = {};
+
+    if (MaxValue > MinValue) {
+        int BestError = INT_MAX;
+
+        for (int d0 = 0 ; d0 <= 2 ; d0++) {
+            for (int d1 = 0 ; d1 <= 2 ; d1++) {
+                int Value0 = MaxValue - d0;
+                int Value1 = MinValue + d1;
+
+                if (Value0 <= Value1) {
+                    continue;
+                }
+
+                int Palette[8];
+                GetBC4Palette(Value0, Value1, Palette);
+
+                int Indices[16];
+                int Error = FindBC4Indices(pPixels, Channel, Palette, Indices);
+
+                if (Error < BestError) {
+                    BestError = Error;
+                    BestValue0 = Value0;
+                    BestValue1 = Value1;
+                    memcpy(BestIndices, Indices, sizeof(Indices));
+                }
+            }
+        }
+    }
+
+    pBlock[0] = (unsigned char)BestValue0;
+    pBlock[1] = (unsigned char)BestValue1;
+
+    unsigned long long PackedIndices = 0;
+
+    for (int i = 0 ; i < 16 ; i++) {
+        PackedIndices |= (unsigned long long)BestIndices[i] << (i * 3);
+    }
+
+    for (int i = 0 ; i < 6 ; i++) {
+        pBlock[2 + i] = (unsigned char)(PackedIndices >> (i * 8));
+    }
+}
+
+
+static void DecompressBC4Block(const unsigned char* pBlock, int Channel, unsigned char* pPixels)
+{
+    int Palette[8];
+    GetBC4Palette(pBlock[0], pBlock[1], Palette);
+
+    unsigned long long Indices = 0;
+
+    for (int i = 0 ; i < 6 ; i++) {
+        Indices |= (unsigned long long)pBlock[2 + i] << (i * 8);
+    }
+
+    for (int i = 0 ; i < 16 ; i++) {
+        pPixels[i * 4 + Channel] = (unsigned char)Palette[(Indices >> (i * 3)) & 7];
+    }
+}
+
+
+// 7 bit endpoint plus a p-bit which is shared by the channels of the endpoint
+static void QuantizeBC7Endpoint(const float* pEnd, int* pValues)
+{
+    float BestError = FLT_MAX;
+
+    for (int p = 0 ; p < 2 ; p++) {
+        int Values[4];
+        float Error = 0.0f;
+
+        for (int c = 0 ; c < 4 ; c++) {
+            int q = ClampInt((int)((pEnd[c] - p) / 2.0f + 0.5f), 0, 127);
+            Values[c] = (q << 1) | p;
+
+            float d = Values[c] - pEnd[c];
+            Error += d * d;
+        }
+
+        if (Error < BestError) {
+            BestError = Error;
+            memcpy(pValues, Values, sizeof(Values));
+        }
+    }
+}
+
+
+static int FindBC7Indices(const unsigned char* pPixels, const int* pEnd0, const int* pEnd1, int* pIndices)
+{
+    int Palette[16][4];
+
+    for (int j = 0 ; j < 16 ; j++) {
+        for (int c = 0 ; c < 4 ; c++) {
+            Palette[j][c] = ((64 - BC7Weights4[j]) * pEnd0[c] + BC7Weights4[j] * pEnd1[c] + 32) >> 6;
+        }
+    }
+
+    int Error = 0;
+
+    for (int i = 0 ; i < 16 ; i++) {
+        int BestDist = INT_MAX;
+
+        for (int j = 0 ; j < 16 ; j++) {
+            int Dist = 0;
+
+            for (int c = 0 ; c < 4 ; c++) {
+                int d = pPixels[i * 4 + c] - Palette[j][c];
+                Dist += d * d;
+            }
+
+            if (Dist < BestDist) {
+                BestDist = Dist;
+                pIndices[i] = j;
+            }
+        }
+
+        Error += BestDist;
+    }
+
+    return Error;
+}
+
+
+// BC7 mode 6: a single subset with RGBA endpoints and 4 bit indices
+static void CompressBC7Block(const unsigned char* pPixels, unsigned char* pBlock)
+{
+    float End0[4];
+    float End1[4];
+    CalcAxisEndpoints(pPixels, 4, End0, End1);
+
+    int BestEnd0[4] = {};
+    int BestEnd1[4] = {};
+    int BestIndices[16] = {};
+    int BestError = INT_MAX;
+
+    for (int Iter = 0 ; Iter < 3 ; Iter++) {
+        int Quantized0[4];
+        int Quantized1[4];
+        QuantizeBC7Endpoint(End0, Quantized0);
+        QuantizeBC7Endpoint(End1, Quantized1);
+
+        int Indices[16];
+        int Error = FindBC7Indices(pPixels, Quantized0, Quantized1, Indices);
+
+        if (Error >= BestError) {
+            break;
+        }
+
+        BestError = Error;
+        memcpy(BestEnd0, Quantized0, sizeof(Quantized0));
+        memcpy(BestEnd1, Quantized1, sizeof(Quantized1));
+        memcpy(BestIndices, Indices, sizeof(Indices));
+
+        if (Error == 0) {
+            break;
+        }
+
+        float Weights[16];
+
+        for (int i = 0 ; i < 16 ; i++) {
+            Weights[i] = BC7Weights4[Indices[i]] / 64.0f;
+        }
+
+        if (!RefineEndpoints(pPixels, 4, Weights, End0, End1)) {
+            break;
+        }
+    }
+
+    // the most significant bit of the index of the first pixel is implicitly zero
+    if (BestIndices[0] >= 8) {
+        for (int c = 0 ; c < 4 ; c++) {
+            std::swap(BestEnd0[c], BestEnd1[c]);
+        }
+
+        for (int i = 0 ; i < 16 ; i++) {
+            BestIndices[i] = 15 - BestIndices[i];
+        }
+    }
+
+    memset(pBlock, 0, 16);
+
+    BitWriter Writer;
+    Writer.pData = pBlock;
+    Writer.Write(1 << 6, 7);    // mode 6
+
+    for (int c = 0 ; c < 4 ; c++) {
+        Writer.Write(BestEnd0[c] >> 1, 7);
+        Writer.Write(BestEnd1[c] >> 1, 7);
+    }
+
+    Writer.Write(BestEnd0[0] & 1, 1);
+    Writer.Write(BestEnd1[0] & 1, 1);
+
+    Writer.Write(BestIndices[0], 3);
+
+    for (int i = 1 ; i < 16 ; i++) {
+        Writer.Write(BestIndices[i], 4);
+    }
+}
+
+
+static void DecompressBC7Block(const unsigned char* pBlock, unsigned char* pPixels)
+{
+    BitReader Reader;
+    Reader.pData = pBlock;
+
+    if (Reader.Read(7) != (1 << 6)) {
+        // only mode 6 is supported - magenta marks the other modes
+        for (int i = 0 ; i < 16 ; i++) {
+            pPixels[i * 4] = 255;
+            pPixels[i * 4 + 1] = 0;
+            pPixels[i * 4 + 2] = 255;
+            pPixels[i * 4 + 3] = 255;
+        }
+
+        return;
+    }
+
+    int End0[4];
+    int End1[4];
+
+    for (int c = 0 ; c < 4 ; c++) {
+        End0[c] = Reader.Read(7) << 1;
+        End1[c] = Reader.Read(7) << 1;
+    }
+
+    int PBit0 = Reader.Read(1);
+    int PBit1 = Reader.Read(1);
+
+    for (int c = 0 ; c < 4 ; c++) {
+        End0[c] |= PBit0;
+        End1[c] |= PBit1;
+    }
+
+    for (int i = 0 ; i < 16 ; i++) {
+        int Weight = BC7Weights4[Reader.Read((i == 0) ? 3 : 4)];
+
+        for (int c = 0 ; c < 4 ; c++) {
+            pPixels[i * 4 + c] = (unsigned char)(((64 - Weight) * End0[c] + Weight * End1[c] + 32) >> 6);
+        }
+    }
+}
+
+
+void TextureCompressor::CompressBlock(const unsigned char* pPixels, unsigned char* pBlock) const
+{
+    switch (m_format) {
+    case BLOCK_FORMAT_BC1:
+        CompressBC1Block(pPixels, pBlock);
+        break;
+
+    case BLOCK_FORMAT_BC3:
+        CompressBC4Block(pPixels, 3, pBlock);
+        CompressBC1Block(pPixels, pBlock + 8);
+        break;
+
+    case BLOCK_FORMAT_BC4:
+        CompressBC4Block(pPixels, 0, pBlock);
+        break;
+
+    case BLOCK_FORMAT_BC5:
+        CompressBC4Block(pPixels, 0, pBlock);
+        CompressBC4Block(pPixels, 1, pBlock + 8);
+        break;
+
+    case BLOCK_FORMAT_BC7:
+        CompressBC7Block(pPixels, pBlock);
+        break;
+
+    default:
+        NOT_IMPLEMENTED;
+    }
+}
+
+
+// The channels that the format doesn't store are decoded like GL does (zero
+// for the missing colors and one for the missing alpha)
+void TextureCompressor::DecompressBlock(const unsigned char* pBlock, unsigned char* pPixels) const
+{
+    for (int i = 0 ; i < 16 ; i++) {
+        pPixels[i * 4] = 0;
+        pPixels[i * 4 + 1] = 0;
+        pPixels[i * 4 + 2] = 0;
+        pPixels[i * 4 + 3] = 255;
+    }
+
+    switch (m_format) {
+    case BLOCK_FORMAT_BC1:
+        DecompressBC1Block(pBlock, false, pPixels);
+        break;
+
+    case BLOCK_FORMAT_BC3:
+        DecompressBC4Block(pBlock, 3, pPixels);
+        DecompressBC1Block(pBlock + 8, true, pPixels);
+        break;
+
+    case BLOCK_FORMAT_BC4:
+        DecompressBC4Block(pBlock, 0, pPixels);
+        break;
+
+    case BLOCK_FORMAT_BC5:
+        DecompressBC4Block(pBlock, 0, pPixels);
+        DecompressBC4Block(pBlock + 8, 1, pPixels);
+        break;
+
+    case BLOCK_FORMAT_BC7:
+        DecompressBC7Block(pBlock, pPixels);
+        break;
+
+    default:
+        NOT_IMPLEMENTED;
+    }
+}
+
+
+void TextureCompressor::CompressLevel(const unsigned char* pRGBA, int Width, int Height, std::vector<unsigned char>& Blocks) const
+{
+    int NumBlocksX = (Width + 3) / 4;
+    int NumBlocksY = (Height + 3) / 4;
+    int BlockSize = GetBlockSizeInBytes(m_format);
+
+    Blocks.resize((size_t)NumBlocksX * NumBlocksY * BlockSize);
+
+    // a row of blocks per item
+    ParallelFor(NumBlocksY, [&](int BlockY) {
+        unsigned char Pixels[16 * 4];
+
+        for (int BlockX = 0 ; BlockX < NumBlocksX ; BlockX++) {
+            GetBlockPixels(pRGBA, Width, Height, BlockX, BlockY, Pixels);
+            CompressBlock(Pixels, &Blocks[((size_t)BlockY * NumBlocksX + BlockX) * BlockSize]);
+        }
+    }, m_numThreads);
+}
+
+
+void TextureCompressor::DecompressLevel(const unsigned char* pBlocks, int Width, int Height, std::vector<unsigned char>& RGBA) const
+{
+    int NumBlocksX = (Width + 3) / 4;
+    int NumBlocksY = (Height + 3) / 4;
+    int BlockSize = GetBlockSizeInBytes(m_format);
+
+    RGBA.resize((size_t)Width * Height * 4);
+
+    for (int BlockY = 0 ; BlockY < NumBlocksY ; BlockY++) {
+        for (int BlockX = 0 ; BlockX < NumBlocksX ; BlockX++) {
+            unsigned char Pixels[16 * 4];
+            DecompressBlock(&pBlocks[((size_t)BlockY * NumBlocksX + BlockX) * BlockSize], Pixels);
+
+            for (int y = 0 ; y < 4 ; y++) {
+                for (int x = 0 ; x < 4 ; x++) {
+                    int DstX = BlockX * 4 + x;
+                    int DstY = BlockY * 4 + y;
+
+                    if ((DstX < Width) && (DstY < Height)) {
+                        memcpy(&RGBA[((size_t)DstY * Width + DstX) * 4], &Pixels[(y * 4 + x) * 4], 4);
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+float TextureCompressor::CalcPSNR(const unsigned char* pRGBA0, const unsigned char* pRGBA1, int NumPixels) const
+{
+    int NumChannels = 4;
+
+    switch (m_format) {
+    case BLOCK_FORMAT_BC1:
+        NumChannels = 3;
+        break;
+
+    case BLOCK_FORMAT_BC4:
+        NumChannels = 1;
+        break;
+
+    case BLOCK_FORMAT_BC5:
+        NumChannels = 2;
+        break;
+
+    default:
+        break;
+    }
+
+    double SquaredError = 0.0;
+
+    for (int i = 0 ; i < NumPixels ; i++) {
+        for (int c = 0 ; c < NumChannels ; c++) {
+            double d = (double)pRGBA0[i * 4 + c] - (double)pRGBA1[i * 4 + c];
+            SquaredError += d * d;
+        }
+    }
+
+    double MSE = SquaredError / ((double)NumPixels * NumChannels);
+
+    if (MSE == 0.0) {
+        return INFINITY;
+    }
+
+    return (float)(10.0 * log10(255.0 * 255.0 / MSE));
+}
+
+
+BLOCK_FORMAT TextureCompressor::GetDefaultFormat(int BPP)
+{
+    switch (BPP) {
+    case 1:
+        return BLOCK_FORMAT_BC4;
+
+    case 2:
+        return BLOCK_FORMAT_BC5;
+
+    case 3:
+        return BLOCK_FORMAT_BC1;
+
+    default:
+        return BLOCK_FORMAT_BC3;
+    }
+}
+
+
+const char* TextureCompressor::GetFormatName(BLOCK_FORMAT Format)
+{
+    static const char* Names[BLOCK_FORMAT_COUNT] = { "BC1", "BC3", "BC4", "BC5", "BC7" };
+
+    return ((Format >= 0) && (Format < BLOCK_FORMAT_COUNT)) ? Names[Format] : "unknown";
+}
+
+
+// Same layout that the texture gets when the image is uploaded as is:
+// GL_RED and GL_RG leave blue at zero and alpha at one.
+static void ExpandToRGBA(const unsigned char* pImageData, int NumPixels, int BPP, std::vector<unsigned char>& RGBA)
+{
+    RGBA.resize((size_t)NumPixels * 4);
+
+    for (int i = 0 ; i < NumPixels ; i++) {
+        unsigned char* p = &RGBA[(size_t)i * 4];
+        const unsigned char* pSrc = &pImageData[(size_t)i * BPP];
+
+        p[0] = pSrc[0];
+        p[1] = (BPP > 1) ? pSrc[1] : 0;
+        p[2] = (BPP > 2) ? pSrc[2] : 0;
+        p[3] = (BPP > 3) ? pSrc[3] : 255;
+    }
+}
+
+
+bool TextureCompressor::CompressFile(const std::string& Filename, bool Verify)
+{
+    std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+    // Flip like Texture::Load() so that the container can replace the image
+    stbi_set_flip_vertically_on_load(1);
+
+    int Width = 0;
+    int Height = 0;
+    int BPP = 0;
+
+    unsigned char* pImageData = stbi_load(Filename.c_str(), &Width, &Height, &BPP, 0);
+
+    if (!pImageData) {
+        printf("Can't load texture from '%s' - %s\n", Filename.c_str(), stbi_failure_reason());
+        return false;
+    }
+
+    // The mip chain is built like the one of Texture::Load() so that the
+    // container matches the uncompressed path. Only RGB images are sRGB.
+    std::vector<TextureMipLevel> Levels(1);
+    Levels[0].Width = Width;
+    Levels[0].Height = Height;
+    ExpandToRGBA(pImageData, Width * Height, BPP, Levels[0].Data);
+
+    stbi_image_free(pImageData);
+
+    GetMipmapGenerator().Generate(4, m_srgb && (BPP >= 3), Levels, m_numThreads);
+
+    std::string ContainerFilename = GetCompressedTextureFileName(Filename);
+
+    FILE* f = fopen(ContainerFilename.c_str(), "wb");
+
+    if (!f) {
+        printf("Error opening '%s'\n", ContainerFilename.c_str());
+        return false;
+    }
+
+    CompressedTextureHeader Header;
+    Header.Format = m_format;
+    Header.Width = Width;
+    Header.Height = Height;
+    Header.NumLevels = (unsigned int)Levels.size();
+
+    bool Success = (fwrite(&Header, sizeof(Header), 1, f) == 1);
+
+    size_t CompressedSize = 0;
+
+    for (int i = 0 ; Success && (i < (int)Header.NumLevels) ; i++) {
+        const std::vector<unsigned char>& Level = Levels[i].Data;
+        int LevelWidth = Levels[i].Width;
+        int LevelHeight = Levels[i].Height;
+
+        std::vector<unsigned char> Blocks;
+        CompressLevel(Level.data(), LevelWidth, LevelHeight, Blocks);
+
+        CompressedLevelHeader LevelHeader;
+        LevelHeader.Width = LevelWidth;
+        LevelHeader.Height = LevelHeight;
+        LevelHeader.Size = (unsigned int)Blocks.size();
+
+        Success = (fwrite(&LevelHeader, sizeof(LevelHeader), 1, f) == 1) &&
+                  (fwrite(Blocks.data(), Blocks.size(), 1, f) == 1);
+
+        CompressedSize += Blocks.size();
+
+        if (Verify) {
+            std::vector<unsigned char> Decoded;
+            DecompressLevel(Blocks.data(), LevelWidth, LevelHeight, Decoded);
+
+            printf("    level %d %dx%d PSNR %.2f dB\n", i, LevelWidth, LevelHeight,
+                   CalcPSNR(Level.data(), Decoded.data(), LevelWidth * LevelHeight));
+        }
+    }
+
+    fclose(f);
+
+    if (!Success) {
+        printf("Error writing '%s'\n", ContainerFilename.c_str());
+        remove(ContainerFilename.c_str());
+        return false;
+    }
+
+    float ElapsedMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - Start).count();
+
+    size_t UncompressedSize = (size_t)Width * Height * BPP;
+    UncompressedSize += UncompressedSize / 3;
+
+    printf("%s: %dx%d %s, %d levels, %.1f KB instead of %.1f KB (%.1f ms)\n", ContainerFilename.c_str(), Width, Height,
+           GetFormatName(m_format), Header.NumLevels, CompressedSize / 1024.0f, UncompressedSize / 1024.0f, ElapsedMs);
+
+    return true;
+}
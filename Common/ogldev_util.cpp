@@ -19,10 +19,15 @@
 
 #include <iostream>
 #include <fstream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 #ifdef _WIN32
 #include <Windows.h>
 #else
 #include <sys/time.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #endif
 
 #ifndef VULKAN
@@ -244,6 +249,222 @@ long long GetCurrentTimeMillis()
 #endif
 }
 
+
+bool MappedFile::Open(const char* pFilename)
+{
+    Close();
+
+#ifdef _WIN32
+    HANDLE File = CreateFileA(pFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+
+    if (File == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    LARGE_INTEGER Size;
+
+    if (!GetFileSizeEx(File, &Size) || (Size.QuadPart == 0)) {
+        CloseHandle(File);
+        return false;
+    }
+
+    HANDLE Mapping = CreateFileMappingA(File, NULL, PAGE_READONLY, 0, 0, NULL);
+
+    if (!Mapping) {
+        CloseHandle(File);
+        return false;
+    }
+
+    m_pData = (const unsigned char*)MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+
+    if (!m_pData) {
+        CloseHandle(Mapping);
+        CloseHandle(File);
+        return false;
+    }
+
+    m_fileHandle = File;
+    m_mappingHandle = Mapping;
+    m_size = (size_t)Size.QuadPart;
+#else
+    int fd = open(pFilename, O_RDONLY);
+
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+
+    if ((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+        close(fd);
+        return false;
+    }
+
+    void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping stays valid after the descriptor is closed
+    close(fd);
+
+    if (p == MAP_FAILED) {
+        return false;
+    }
+
+    m_pData = (const unsigned char*)p;
+    m_size = (size_t)st.st_size;
+#endif
+
+    return true;
+}
+
+
+void MappedFile::Close()
+{
+    if (!m_pData) {
+        return;
+    }
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_pData);
+    CloseHandle(m_mappingHandle);
+    CloseHandle(m_fileHandle);
+    m_fileHandle = NULL;
+    m_mappingHandle = NULL;
+#else
+    munmap((void*)m_pData, m_size);
+#endif
+
+    m_pData = NULL;
+    m_size = 0;
+}
+
+
+void ParallelFor(int Count, const std::function<void(int)>& Func, int NumThreads)
+{
+    if (NumThreads <= 0) {
+        NumThreads = (int)std::thread::hardware_concurrency();
+    }
+
+    NumThreads = std::max(std::min(NumThreads, Count), 1);
+
+    std::atomic<int> NextItem(0);
+
+    auto Worker = [&]() {
+        for (;;) {
+            int i = NextItem++;
+
+            if (i >= Count) {
+                break;
+            }
+
+            Func(i);
+        }
+    };
+
+    // the calling thread is one of the workers
+    std::vector<std::thread> Threads;
+
+    for (int i = 1 ; i < NumThreads ; i++) {
+        Threads.push_back(std::thread(Worker));
+    }
+
+    Worker();
+
+    for (int i = 0 ; i < (int)Threads.size() ; i++) {
+        Threads[i].join();
+    }
+}
+
+
+void ThreadPool::Start(int NumThreads)
+{
+    Stop();
+
+    if (NumThreads <= 0) {
+        NumThreads = (int)std::thread::hardware_concurrency();
+    }
+
+    m_numThreads = std::max(NumThreads, 1);
+    m_quit = false;
+    m_generation = 0;
+
+    for (int i = 1 ; i < m_numThreads ; i++) {
+        m_workers.push_back(std::thread(&ThreadPool::WorkerThread, this, i));
+    }
+}
+
+
+void ThreadPool::Stop()
+{
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_quit = true;
+    }
+
+    m_startCond.notify_all();
+
+    for (unsigned int i = 0 ; i < m_workers.size() ; i++) {
+        m_workers[i].join();
+    }
+
+    m_workers.clear();
+    m_numThreads = 1;
+}
+
+
+void ThreadPool::Run(const std::function<void(int)>& Job)
+{
+    if (m_numThreads == 1) {
+        Job(0);
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_pJob = &Job;
+        m_jobsRemaining = m_numThreads - 1;
+        m_generation++;
+    }
+
+    m_startCond.notify_all();
+
+    Job(0);
+
+    std::unique_lock<std::mutex> Lock(m_mutex);
+    m_doneCond.wait(Lock, [this] { return m_jobsRemaining == 0; });
+    m_pJob = NULL;
+}
+
+
+void ThreadPool::WorkerThread(int ThreadIndex)
+{
+    int LastGeneration = 0;
+
+    for (;;) {
+        const std::function<void(int)>* pJob = NULL;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_mutex);
+            m_startCond.wait(Lock, [&] { return m_quit || (m_generation != LastGeneration); });
+
+            if (m_quit) {
+                return;
+            }
+
+            LastGeneration = m_generation;
+            pJob = m_pJob;
+        }
+
+        (*pJob)(ThreadIndex);
+
+        {
+            std::lock_guard<std::mutex> Lock(m_mutex);
+            m_jobsRemaining--;
+        }
+
+        m_doneCond.notify_one();
+    }
+}
+
 #ifndef VULKAN
 
 #define EXIT_ON_GL_ERROR
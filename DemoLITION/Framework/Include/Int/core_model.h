@@ -112,6 +112,7 @@ private:
     virtual void ReserveSpace(uint NumVertices, uint NumIndices);
     virtual void InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh);
     virtual void InitSingleMeshOpt(uint MeshIndex, const aiMesh* paiMesh);
+    virtual void CompactMeshes();
     virtual void PopulateBuffers();
     virtual void PopulateBuffersNonDSA();
     virtual void PopulateBuffersDSA();
@@ -122,12 +123,17 @@ private:
         BasicMeshEntry()
         {
             NumIndices = 0;
+            NumVertices = 0;
             BaseVertex = 0;
             BaseIndex = 0;
             MaterialIndex = INVALID_MATERIAL;
         }
 
+        // there are no LODs (see CompactMeshArrays)
+        uint GetTotalIndices() const { return NumIndices; }
+
         uint NumIndices;
+        uint NumVertices;
         uint BaseVertex;
         uint BaseIndex;
         uint MaterialIndex;
@@ -261,16 +267,15 @@ private:
     void LoadMeshBones(uint MeshIndex, const aiMesh* paiMesh);
     void LoadSingleBone(uint MeshIndex, const aiBone* pBone);
     int GetBoneId(const aiBone* pBone);
-    void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    const aiNodeAnim* FindNodeAnim(const aiAnimation& Animation, const string& NodeName);
-    void ReadNodeHierarchy(float AnimationTime, const aiNode* pNode, const Matrix4f& ParentTransform, const aiAnimation& Animation);
+    void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim, uint& Cursor);
+    void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim, uint& Cursor);
+    void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim, uint& Cursor);
+    const aiNodeAnim* FindNodeAnim(const aiAnimation& Animation, const string& NodeName, uint& ChannelIndex);
+    void ReadNodeHierarchy(float AnimationTime, const aiNode* pNode, const Matrix4f& ParentTransform, const aiAnimation& Animation,
+                           vector<uint>& Cursors);
     void ReadNodeHierarchyBlended(float StartAnimationTimeTicksm, float EndAnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform,
-                                  const aiAnimation& StartAnimation, const aiAnimation& EndAnimation, float BlendFactor);
+                                  const aiAnimation& StartAnimation, const aiAnimation& EndAnimation, float BlendFactor,
+                                  vector<uint>& StartCursors, vector<uint>& EndCursors);
     void MarkRequiredNodesForBone(const aiBone* pBone);
     void InitializeRequiredNodeMap(const aiNode* pNode);
     float CalcAnimationTimeTicks(float TimeInSeconds, unsigned int AnimationIndex);
@@ -281,7 +286,9 @@ private:
         aiVector3D Translation;
     };
 
-    void CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim);
+    void CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint* pCursors);
+
+    vector<uint>& GetAnimationCursors(uint AnimationIndex);
 
     GLuint m_boneBuffer = 0;
 
@@ -312,5 +319,8 @@ private:
     };
 
     map<string,NodeInfo> m_requiredNodeMap;
+
+    // the last key of every track of every animation [animation][channel * 3 + track]
+    vector<vector<uint>> m_animationCursors;
 };
 
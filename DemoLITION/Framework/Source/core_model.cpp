@@ -70,6 +70,13 @@ void CoreModel::Clear()
         glDeleteVertexArrays(1, &m_VAO);
         m_VAO = 0;
     }
+
+    for (unsigned int i = 0 ; i < m_Materials.size() ; i++) {
+        GetTextureRegistry().Release(m_Materials[i].pDiffuse);
+        m_Materials[i].pDiffuse = NULL;
+        GetTextureRegistry().Release(m_Materials[i].pSpecularExponent);
+        m_Materials[i].pSpecularExponent = NULL;
+    }
 }
 
 
@@ -118,6 +125,10 @@ bool CoreModel::LoadAssimpModel(const string& Filename, int WindowWidth, int Win
     // Make sure the VAO is not changed from the outside
     glBindVertexArray(0);
 
+    GetTextureLoader().Finish();
+
+    GetTextureRegistry().PrintStats();
+
     return Ret;
 }
 
@@ -168,6 +179,7 @@ void CoreModel::CountVerticesAndIndices(const aiScene* pScene, unsigned int& Num
     for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
         m_Meshes[i].MaterialIndex = pScene->mMeshes[i]->mMaterialIndex;
         m_Meshes[i].NumIndices = pScene->mMeshes[i]->mNumFaces * 3;
+        m_Meshes[i].NumVertices = pScene->mMeshes[i]->mNumVertices;
         m_Meshes[i].BaseVertex = NumVertices;
         m_Meshes[i].BaseIndex = NumIndices;
 
@@ -177,10 +189,14 @@ void CoreModel::CountVerticesAndIndices(const aiScene* pScene, unsigned int& Num
 }
 
 
+// The arrays are allocated in full (rather than reserved) because each mesh
+// is written directly into its own range by InitAllMeshes.
 void CoreModel::ReserveSpace(unsigned int NumVertices, unsigned int NumIndices)
 {
-    m_Vertices.reserve(NumVertices);
-    m_Indices.reserve(NumIndices);
+    m_Vertices.clear();
+    m_Vertices.resize(NumVertices);
+    m_Indices.clear();
+    m_Indices.resize(NumIndices);
     //m_Bones.resize(NumVertices); // TODO: only if there are any bones
     InitializeRequiredNodeMap(m_pScene->mRootNode);	
 }
@@ -188,14 +204,36 @@ void CoreModel::ReserveSpace(unsigned int NumVertices, unsigned int NumIndices)
 
 void CoreModel::InitAllMeshes(const aiScene* pScene)
 {
+    // The bones are shared by all the meshes so they are loaded serially
+    // (this also keeps the bone ids in the same order on every load)
     for (unsigned int i = 0 ; i < m_Meshes.size() ; i++) {
         const aiMesh* paiMesh = pScene->mMeshes[i];
+        printf("Mesh %d %s\n", i, paiMesh->mName.C_Str());
+        LoadMeshBones(i, paiMesh);
+    }
+
+    // The vertices and indices of every mesh go into the range that
+    // CountVerticesAndIndices assigned to it so the meshes are converted in parallel
+    ParallelFor((int)m_Meshes.size(), [&](int i) {
+        const aiMesh* paiMesh = pScene->mMeshes[i];
 #ifdef USE_MESH_OPTIMIZER
         InitSingleMeshOpt(i, paiMesh);
 #else
         InitSingleMesh(i, paiMesh);
 #endif
-    }
+    });
+
+#ifdef USE_MESH_OPTIMIZER
+    CompactMeshes();
+#endif
+}
+
+
+// The optimized meshes are smaller than their ranges so after the parallel
+// optimization this moves them together and trims the arrays
+void CoreModel::CompactMeshes()
+{
+    CompactMeshArrays(m_Meshes, m_Vertices, m_Indices);
 }
 
 
@@ -244,10 +282,11 @@ void CoreModel::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
 {
     const aiVector3D Zero3D(0.0f, 0.0f, 0.0f);
 
-    printf("Mesh %d %s\n", MeshIndex, paiMesh->mName.C_Str());
     // Populate the vertex attribute vectors
     Vertex v;
 
+    Vertex* pVertices = m_Vertices.data() + m_Meshes[MeshIndex].BaseVertex;
+
     for (unsigned int i = 0 ; i < paiMesh->mNumVertices ; i++) {
         const aiVector3D& pPos      = paiMesh->mVertices[i];
         // printf("%d: ", i); Vector3f v(pPos.x, pPos.y, pPos.z); v.Print();
@@ -270,9 +309,11 @@ void CoreModel::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
         const aiVector3D& pBitangent = paiMesh->mBitangents[i];
         v.Bitangent = Vector3f(pBitangent.x, pBitangent.y, pBitangent.z);
 
-        m_Vertices.push_back(v);
+        pVertices[i] = v;
     }
 
+    uint* pIndices = m_Indices.data() + m_Meshes[MeshIndex].BaseIndex;
+
     // Populate the index buffer
     for (unsigned int i = 0 ; i < paiMesh->mNumFaces ; i++) {
         const aiFace& Face = paiMesh->mFaces[i];
@@ -281,12 +322,10 @@ void CoreModel::InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh)
      /*   printf("%d: %d\n", i * 3, Face.mIndices[0]);
         printf("%d: %d\n", i * 3 + 1, Face.mIndices[1]);
         printf("%d: %d\n", i * 3 + 2, Face.mIndices[2]);*/
-        m_Indices.push_back(Face.mIndices[0]);
-        m_Indices.push_back(Face.mIndices[1]);
-        m_Indices.push_back(Face.mIndices[2]);
+        pIndices[i * 3 + 0] = Face.mIndices[0];
+        pIndices[i * 3 + 1] = Face.mIndices[1];
+        pIndices[i * 3 + 2] = Face.mIndices[2];
     }
-
-    LoadMeshBones(MeshIndex, paiMesh);
 }
 
 
@@ -320,9 +359,6 @@ void CoreModel::InitSingleMeshOpt(uint MeshIndex, const aiMesh* paiMesh)
         Vertices[i] = v;
     }
 
-    m_Meshes[MeshIndex].BaseVertex = (uint)m_Vertices.size();
-    m_Meshes[MeshIndex].BaseIndex = (uint)m_Indices.size();
-
     int NumIndices = paiMesh->mNumFaces * 3;
 
     std::vector<uint> Indices;
@@ -346,7 +382,7 @@ void CoreModel::OptimizeMesh(int MeshIndex, std::vector<uint>&Indices, std::vect
     size_t NumVertices = Vertices.size();
 
     // Create a remap table
-    std::vector<unsigned int> remap(NumIndices);
+    std::vector<unsigned int> remap(NumVertices);
     size_t OptVertexCount = meshopt_generateVertexRemap(remap.data(),    // dst addr
                                                         Indices.data(),  // src indices
                                                         NumIndices,      // ...and size
@@ -382,21 +418,17 @@ void CoreModel::OptimizeMesh(int MeshIndex, std::vector<uint>&Indices, std::vect
     size_t OptIndexCount = meshopt_simplify(SimplifiedIndices.data(), OptIndices.data(), NumIndices,
                                             &OptVertices[0].Position.x, OptVertexCount, sizeof(Vertex), TargetIndexCount, TargetError);
 
-    static int num_indices = 0;
-    num_indices += (int)NumIndices;
-    static int opt_indices = 0;
-    opt_indices += (int)OptIndexCount;
-    printf("Num indices %d\n", num_indices);
     //printf("Target num indices %d\n", TargetIndexCount);
-    printf("Optimized number of indices %d\n", opt_indices);
     SimplifiedIndices.resize(OptIndexCount);
     
-    // Concatenate the local arrays into the class attributes arrays
-    m_Indices.insert(m_Indices.end(), SimplifiedIndices.begin(), SimplifiedIndices.end());
+    // Copy the local arrays to the start of the range of the mesh. The optimized mesh
+    // is never larger than the original so it fits. CompactMeshes closes the gaps.
+    std::copy(SimplifiedIndices.begin(), SimplifiedIndices.end(), m_Indices.begin() + m_Meshes[MeshIndex].BaseIndex);
 
-    m_Vertices.insert(m_Vertices.end(), OptVertices.begin(), OptVertices.end());
+    std::copy(OptVertices.begin(), OptVertices.end(), m_Vertices.begin() + m_Meshes[MeshIndex].BaseVertex);
 
     m_Meshes[MeshIndex].NumIndices = (uint)OptIndexCount;
+    m_Meshes[MeshIndex].NumVertices = (uint)OptVertexCount;
 }
 
 
@@ -453,9 +485,8 @@ void CoreModel::LoadDiffuseTexture(const string& Dir, const aiMaterial* pMateria
 void CoreModel::LoadDiffuseTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded diffuse texture type '%s'\n", paiTexture->achFormatHint);
-    m_Materials[MaterialIndex].pDiffuse = new Texture(GL_TEXTURE_2D);
     int buffer_size = paiTexture->mWidth;
-    m_Materials[MaterialIndex].pDiffuse->Load(buffer_size, paiTexture->pcData);
+    m_Materials[MaterialIndex].pDiffuse = GetTextureRegistry().AcquireEmbedded(buffer_size, paiTexture->pcData, true);
 }
 
 
@@ -475,15 +506,9 @@ void CoreModel::LoadDiffuseTextureFromFile(const string& Dir, const aiString& Pa
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pDiffuse = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+    m_Materials[MaterialIndex].pDiffuse = GetTextureRegistry().AcquireFile(FullPath, true);
 
-    if (!m_Materials[MaterialIndex].pDiffuse->Load()) {
-        printf("Error loading diffuse texture '%s'\n", FullPath.c_str());
-        exit(0);
-    }
-    else {
-        printf("Loaded diffuse texture '%s' at index %d\n", FullPath.c_str(), MaterialIndex);
-    }
+    printf("Queued diffuse texture '%s' at index %d\n", FullPath.c_str(), MaterialIndex);
 }
 
 
@@ -510,9 +535,8 @@ void CoreModel::LoadSpecularTexture(const string& Dir, const aiMaterial* pMateri
 void CoreModel::LoadSpecularTextureEmbedded(const aiTexture* paiTexture, int MaterialIndex)
 {
     printf("Embeddeded specular texture type '%s'\n", paiTexture->achFormatHint);
-    m_Materials[MaterialIndex].pSpecularExponent = new Texture(GL_TEXTURE_2D);
     int buffer_size = paiTexture->mWidth;
-    m_Materials[MaterialIndex].pSpecularExponent->Load(buffer_size, paiTexture->pcData);
+    m_Materials[MaterialIndex].pSpecularExponent = GetTextureRegistry().AcquireEmbedded(buffer_size, paiTexture->pcData);
 }
 
 
@@ -528,15 +552,9 @@ void CoreModel::LoadSpecularTextureFromFile(const string& Dir, const aiString& P
 
     string FullPath = Dir + "/" + p;
 
-    m_Materials[MaterialIndex].pSpecularExponent = new Texture(GL_TEXTURE_2D, FullPath.c_str());
+    m_Materials[MaterialIndex].pSpecularExponent = GetTextureRegistry().AcquireFile(FullPath);
 
-    if (!m_Materials[MaterialIndex].pSpecularExponent->Load()) {
-        printf("Error loading specular texture '%s'\n", FullPath.c_str());
-        exit(0);
-    }
-    else {
-        printf("Loaded specular texture '%s'\n", FullPath.c_str());
-    }
+    printf("Queued specular texture '%s'\n", FullPath.c_str());
 }
 
 void CoreModel::LoadColors(const aiMaterial* pMaterial, int index)
@@ -1188,20 +1206,52 @@ int CoreModel::GetBoneId(const aiBone* pBone)
 }
 
 
-uint CoreModel::FindPosition(float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+static const int KEY_CURSOR_MAX_STEPS = 4;
+
+
+// Returns the key that starts the segment which contains AnimationTimeTicks. When
+// the animation plays forward the time is usually still inside the segment of the
+// previous frame or in one of the next few so the search starts at the cursor.
+// A jump backwards (including the loop back to the start of the clip) or a jump
+// far ahead falls back to a binary search.
+template<typename KeyType>
+static uint FindKey(float AnimationTimeTicks, const KeyType* pKeys, uint NumKeys, uint& Cursor)
 {
-    for (uint i = 0 ; i < pNodeAnim->mNumPositionKeys - 1 ; i++) {
-        float t = (float)pNodeAnim->mPositionKeys[i + 1].mTime;
-        if (AnimationTimeTicks < t) {
-            return i;
+    uint LastSegment = NumKeys - 2;
+    uint i = std::min(Cursor, LastSegment);
+
+    if ((i == 0) || ((float)pKeys[i].mTime <= AnimationTimeTicks)) {
+        for (int Step = 0 ; Step < KEY_CURSOR_MAX_STEPS ; Step++) {
+            if ((i == LastSegment) || (AnimationTimeTicks < (float)pKeys[i + 1].mTime)) {
+                Cursor = i;
+                return i;
+            }
+
+            i++;
         }
     }
 
-    return 0;
+    // the first segment that ends after AnimationTimeTicks
+    uint Low = 0;
+    uint High = LastSegment;
+
+    while (Low < High) {
+        uint Mid = (Low + High) / 2;
+
+        if (AnimationTimeTicks < (float)pKeys[Mid + 1].mTime) {
+            High = Mid;
+        } else {
+            Low = Mid + 1;
+        }
+    }
+
+    Cursor = Low;
+
+    return Low;
 }
 
 
-void CoreModel::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+void CoreModel::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint& Cursor)
 {
     // we need at least two values to interpolate...
     if (pNodeAnim->mNumPositionKeys == 1) {
@@ -1209,7 +1259,7 @@ void CoreModel::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTic
         return;
     }
 
-    uint PositionIndex = FindPosition(AnimationTimeTicks, pNodeAnim);
+    uint PositionIndex = FindKey(AnimationTimeTicks, pNodeAnim->mPositionKeys, pNodeAnim->mNumPositionKeys, Cursor);
     uint NextPositionIndex = PositionIndex + 1;
     assert(NextPositionIndex < pNodeAnim->mNumPositionKeys);
     float t1 = (float)pNodeAnim->mPositionKeys[PositionIndex].mTime;
@@ -1218,7 +1268,8 @@ void CoreModel::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTic
     } else {
         float t2 = (float)pNodeAnim->mPositionKeys[NextPositionIndex].mTime;
         float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - t1) / DeltaTime;
+        // past the last key the last value is held
+        float Factor = std::min((AnimationTimeTicks - t1) / DeltaTime, 1.0f);
         assert(Factor >= 0.0f && Factor <= 1.0f);
         const aiVector3D& Start = pNodeAnim->mPositionKeys[PositionIndex].mValue;
         const aiVector3D& End = pNodeAnim->mPositionKeys[NextPositionIndex].mValue;
@@ -1228,22 +1279,7 @@ void CoreModel::CalcInterpolatedPosition(aiVector3D& Out, float AnimationTimeTic
 }
 
 
-uint CoreModel::FindRotation(float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
-{
-    assert(pNodeAnim->mNumRotationKeys > 0);
-
-    for (uint i = 0 ; i < pNodeAnim->mNumRotationKeys - 1 ; i++) {
-        float t = (float)pNodeAnim->mRotationKeys[i + 1].mTime;
-        if (AnimationTimeTicks < t) {
-            return i;
-        }
-    }
-
-    return 0;
-}
-
-
-void CoreModel::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+void CoreModel::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint& Cursor)
 {
     // we need at least two values to interpolate...
     if (pNodeAnim->mNumRotationKeys == 1) {
@@ -1251,7 +1287,7 @@ void CoreModel::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeT
         return;
     }
 
-    uint RotationIndex = FindRotation(AnimationTimeTicks, pNodeAnim);
+    uint RotationIndex = FindKey(AnimationTimeTicks, pNodeAnim->mRotationKeys, pNodeAnim->mNumRotationKeys, Cursor);
     uint NextRotationIndex = RotationIndex + 1;
     assert(NextRotationIndex < pNodeAnim->mNumRotationKeys);
     float t1 = (float)pNodeAnim->mRotationKeys[RotationIndex].mTime;
@@ -1260,7 +1296,8 @@ void CoreModel::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeT
     } else {
         float t2 = (float)pNodeAnim->mRotationKeys[NextRotationIndex].mTime;
         float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - t1) / DeltaTime;
+        // past the last key the last value is held
+        float Factor = std::min((AnimationTimeTicks - t1) / DeltaTime, 1.0f);
         assert(Factor >= 0.0f && Factor <= 1.0f);
         const aiQuaternion& StartRotationQ = pNodeAnim->mRotationKeys[RotationIndex].mValue;
         const aiQuaternion& EndRotationQ   = pNodeAnim->mRotationKeys[NextRotationIndex].mValue;
@@ -1271,22 +1308,7 @@ void CoreModel::CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTimeT
 }
 
 
-uint CoreModel::FindScaling(float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
-{
-    assert(pNodeAnim->mNumScalingKeys > 0);
-
-    for (uint i = 0 ; i < pNodeAnim->mNumScalingKeys - 1 ; i++) {
-        float t = (float)pNodeAnim->mScalingKeys[i + 1].mTime;
-        if (AnimationTimeTicks < t) {
-            return i;
-        }
-    }
-
-    return 0;
-}
-
-
-void CoreModel::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+void CoreModel::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint& Cursor)
 {
     // we need at least two values to interpolate...
     if (pNodeAnim->mNumScalingKeys == 1) {
@@ -1294,7 +1316,7 @@ void CoreModel::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTick
         return;
     }
 
-    uint ScalingIndex = FindScaling(AnimationTimeTicks, pNodeAnim);
+    uint ScalingIndex = FindKey(AnimationTimeTicks, pNodeAnim->mScalingKeys, pNodeAnim->mNumScalingKeys, Cursor);
     uint NextScalingIndex = ScalingIndex + 1;
     assert(NextScalingIndex < pNodeAnim->mNumScalingKeys);
     float t1 = (float)pNodeAnim->mScalingKeys[ScalingIndex].mTime;
@@ -1303,7 +1325,7 @@ void CoreModel::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTick
     } else {
         float t2 = (float)pNodeAnim->mScalingKeys[NextScalingIndex].mTime;
         float DeltaTime = t2 - t1;
-        float Factor = (AnimationTimeTicks - (float)t1) / DeltaTime;
+        float Factor = std::min((AnimationTimeTicks - (float)t1) / DeltaTime, 1.0f);
         assert(Factor >= 0.0f && Factor <= 1.0f);
         const aiVector3D& Start = pNodeAnim->mScalingKeys[ScalingIndex].mValue;
         const aiVector3D& End   = pNodeAnim->mScalingKeys[NextScalingIndex].mValue;
@@ -1313,17 +1335,19 @@ void CoreModel::CalcInterpolatedScaling(aiVector3D& Out, float AnimationTimeTick
 }
 
 
-void CoreModel::ReadNodeHierarchy(float AnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform, const aiAnimation& Animation)
+void CoreModel::ReadNodeHierarchy(float AnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform, const aiAnimation& Animation,
+                                    vector<uint>& Cursors)
 {
     string NodeName(pNode->mName.data);
 
     Matrix4f NodeTransformation(pNode->mTransformation);
 
-    const aiNodeAnim* pNodeAnim = FindNodeAnim(Animation, NodeName);
+    uint ChannelIndex = 0;
+    const aiNodeAnim* pNodeAnim = FindNodeAnim(Animation, NodeName, ChannelIndex);
 
     if (pNodeAnim) {
         LocalTransform Transform;
-        CalcLocalTransform(Transform, AnimationTimeTicks, pNodeAnim);
+        CalcLocalTransform(Transform, AnimationTimeTicks, pNodeAnim, &Cursors[ChannelIndex * 3]);
 
         Matrix4f ScalingM;
         ScalingM.InitScaleTransform(Transform.Scaling.x, Transform.Scaling.y, Transform.Scaling.z);
@@ -1357,30 +1381,33 @@ void CoreModel::ReadNodeHierarchy(float AnimationTimeTicks, const aiNode* pNode,
         }
 
         if (it->second.isRequired) {
-            ReadNodeHierarchy(AnimationTimeTicks, pNode->mChildren[i], GlobalTransformation, Animation);
+            ReadNodeHierarchy(AnimationTimeTicks, pNode->mChildren[i], GlobalTransformation, Animation, Cursors);
         }
     }
 }
 
 
 void CoreModel::ReadNodeHierarchyBlended(float StartAnimationTimeTicks, float EndAnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform,
-                                           const aiAnimation& StartAnimation, const aiAnimation& EndAnimation, float BlendFactor)
+                                           const aiAnimation& StartAnimation, const aiAnimation& EndAnimation, float BlendFactor,
+                                           vector<uint>& StartCursors, vector<uint>& EndCursors)
 {
     string NodeName(pNode->mName.data);
 
     Matrix4f NodeTransformation(pNode->mTransformation);
 
-    const aiNodeAnim* pStartNodeAnim = FindNodeAnim(StartAnimation, NodeName);
+    uint StartChannelIndex = 0;
+    const aiNodeAnim* pStartNodeAnim = FindNodeAnim(StartAnimation, NodeName, StartChannelIndex);
 
     LocalTransform StartTransform;
 
     if (pStartNodeAnim) {
-        CalcLocalTransform(StartTransform, StartAnimationTimeTicks, pStartNodeAnim);
+        CalcLocalTransform(StartTransform, StartAnimationTimeTicks, pStartNodeAnim, &StartCursors[StartChannelIndex * 3]);
     }
 
     LocalTransform EndTransform;
 
-    const aiNodeAnim* pEndNodeAnim = FindNodeAnim(EndAnimation, NodeName);
+    uint EndChannelIndex = 0;
+    const aiNodeAnim* pEndNodeAnim = FindNodeAnim(EndAnimation, NodeName, EndChannelIndex);
 
     if ((pStartNodeAnim && !pEndNodeAnim) || (!pStartNodeAnim && pEndNodeAnim)) {
         printf("On the node %s there is an animation node for only one of the start/end animations.\n", NodeName.c_str());
@@ -1389,7 +1416,7 @@ void CoreModel::ReadNodeHierarchyBlended(float StartAnimationTimeTicks, float En
     }
 
     if (pEndNodeAnim) {
-        CalcLocalTransform(EndTransform, EndAnimationTimeTicks, pEndNodeAnim);
+        CalcLocalTransform(EndTransform, EndAnimationTimeTicks, pEndNodeAnim, &EndCursors[EndChannelIndex * 3]);
     }
 
     if (pStartNodeAnim && pEndNodeAnim) {
@@ -1437,17 +1464,37 @@ void CoreModel::ReadNodeHierarchyBlended(float StartAnimationTimeTicks, float En
 
         if (it->second.isRequired) {
             ReadNodeHierarchyBlended(StartAnimationTimeTicks, EndAnimationTimeTicks,
-                                     pNode->mChildren[i], GlobalTransformation, StartAnimation, EndAnimation, BlendFactor);
+                                     pNode->mChildren[i], GlobalTransformation, StartAnimation, EndAnimation, BlendFactor,
+                                     StartCursors, EndCursors);
         }
     }
 }
 
 
-void CoreModel::CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim)
+// pCursors points to the scaling, rotation and position cursors of the channel
+void CoreModel::CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint* pCursors)
+{
+    CalcInterpolatedScaling(Transform.Scaling, AnimationTimeTicks, pNodeAnim, pCursors[0]);
+    CalcInterpolatedRotation(Transform.Rotation, AnimationTimeTicks, pNodeAnim, pCursors[1]);
+    CalcInterpolatedPosition(Transform.Translation, AnimationTimeTicks, pNodeAnim, pCursors[2]);
+}
+
+
+vector<uint>& CoreModel::GetAnimationCursors(uint AnimationIndex)
 {
-    CalcInterpolatedScaling(Transform.Scaling, AnimationTimeTicks, pNodeAnim);
-    CalcInterpolatedRotation(Transform.Rotation, AnimationTimeTicks, pNodeAnim);
-    CalcInterpolatedPosition(Transform.Translation, AnimationTimeTicks, pNodeAnim);
+    if (m_animationCursors.size() != m_pScene->mNumAnimations) {
+        m_animationCursors.resize(m_pScene->mNumAnimations);
+    }
+
+    vector<uint>& Keys = m_animationCursors[AnimationIndex];
+
+    uint NumCursors = m_pScene->mAnimations[AnimationIndex]->mNumChannels * 3;
+
+    if (Keys.size() != NumCursors) {
+        Keys.assign(NumCursors, 0);
+    }
+
+    return Keys;
 }
 
 
@@ -1464,7 +1511,7 @@ void CoreModel::GetBoneTransforms(float TimeInSeconds, vector<Matrix4f>& Transfo
     float AnimationTimeTicks = CalcAnimationTimeTicks(TimeInSeconds, AnimationIndex);
     const aiAnimation& Animation = *m_pScene->mAnimations[AnimationIndex];
 
-    ReadNodeHierarchy(AnimationTimeTicks, m_pScene->mRootNode, Identity, Animation);
+    ReadNodeHierarchy(AnimationTimeTicks, m_pScene->mRootNode, Identity, Animation, GetAnimationCursors(AnimationIndex));
     Transforms.resize(m_BoneInfo.size());
 
     for (uint i = 0 ; i < m_BoneInfo.size() ; i++) {
@@ -1503,7 +1550,12 @@ void CoreModel::GetBoneTransformsBlended(float TimeInSeconds,
     Matrix4f Identity;
     Identity.InitIdentity();
 
-    ReadNodeHierarchyBlended(StartAnimationTimeTicks, EndAnimationTimeTicks, m_pScene->mRootNode, Identity, StartAnimation, EndAnimation, BlendFactor);
+    // the first call sizes the outer vector so the second one doesn't invalidate StartCursors
+    vector<uint>& StartCursors = GetAnimationCursors(StartAnimIndex);
+    vector<uint>& EndCursors = GetAnimationCursors(EndAnimIndex);
+
+    ReadNodeHierarchyBlended(StartAnimationTimeTicks, EndAnimationTimeTicks, m_pScene->mRootNode, Identity, StartAnimation, EndAnimation, BlendFactor,
+                             StartCursors, EndCursors);
 
     BlendedTransforms.resize(m_BoneInfo.size());
 
@@ -1526,12 +1578,13 @@ float CoreModel::CalcAnimationTimeTicks(float TimeInSeconds, unsigned int Animat
 
 
 const aiNodeAnim* CoreModel::FindNodeAnim(const aiAnimation&
-                                            Animation, const string& NodeName)
+                                            Animation, const string& NodeName, uint& ChannelIndex)
 {
     for (uint i = 0 ; i < Animation.mNumChannels ; i++) {
         const aiNodeAnim* pNodeAnim = Animation.mChannels[i];
 
         if (string(pNodeAnim->mNodeName.data) == NodeName) {
+            ChannelIndex = i;
             return pNodeAnim;
         }
     }
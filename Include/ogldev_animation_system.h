@@ -0,0 +1,136 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OGLDEV_ANIMATION_SYSTEM_H
+#define OGLDEV_ANIMATION_SYSTEM_H
+
+#include <vector>
+#include <atomic>
+#include <memory>
+
+#include "ogldev_skinned_mesh.h"
+
+struct AnimationInstance {
+    SkinnedMesh* pMesh = NULL;
+    float AnimationTimeSec = 0.0f;
+    unsigned int AnimationIndex = 0;
+
+    // when BlendFactor is not zero AnimationIndex is blended into EndAnimationIndex
+    unsigned int EndAnimationIndex = 0;
+    float BlendFactor = 0.0f;
+
+    // selects the LOD tier of the instance (see AnimationSystem::SetLODDistances)
+    float DistanceToCamera = 0.0f;
+};
+
+
+// Evaluates the bone palettes of a batch of animated instances on a pool of
+// worker threads. Every worker starts with a contiguous range of the instances
+// and when it runs out it steals instances from the ranges of the other
+// workers. The palettes are written back to back into one buffer which the
+// renderer reads after Update() returns (see PhongRenderer::RenderAnimation).
+//
+// Instance i of the batch is expected to be the same character in every frame
+// because the keyframe cursors of slot i are kept between the updates.
+//
+// Distant instances use a lower LOD tier. Tier N evaluates the skeleton only
+// every 2^N updates and the palette is interpolated between the evaluations.
+// The last tier also evaluates the reduced skeleton of the mesh (see
+// SkinnedMesh::SetReducedSkeletonDepth).
+class AnimationSystem {
+ public:
+
+    static const int ANIMATION_LOD_TIERS = 4;
+
+    AnimationSystem();
+
+    // zero threads means one per core (the calling thread is one of them)
+    void InitAnimationSystem(int NumThreads = 0);
+
+    void Update(const std::vector<AnimationInstance>& Instances);
+
+    const Matrix4f* GetPalette(unsigned int InstanceIndex) const { return &m_palettes[m_paletteOffsets[InstanceIndex]]; }
+
+    unsigned int GetPaletteSize(unsigned int InstanceIndex) const
+    {
+        return m_paletteOffsets[InstanceIndex + 1] - m_paletteOffsets[InstanceIndex];
+    }
+
+    // all the palettes of the last update back to back
+    const std::vector<Matrix4f>& GetPalettes() const { return m_palettes; }
+
+    int GetNumThreads() const { return m_pool.GetNumThreads(); }
+
+    float GetLastUpdateMs() const { return m_lastUpdateMs; }
+
+    // The distances from the camera where tiers 1, 2 and 3 start. By default
+    // everything is in tier 0 and updated in every frame.
+    void SetLODDistances(float Tier1, float Tier2, float Tier3);
+
+    // number of bones whose channels were sampled by the last update
+    unsigned int GetLastNumEvaluatedBones() const { return m_lastNumEvaluatedBones; }
+
+    unsigned int GetLastNumInstancesInTier(int Tier) const { return m_lastNumInstancesInTier[Tier]; }
+
+ private:
+
+    void EvaluateInstance(int InstanceIndex);
+
+    int GetLODTier(float DistanceToCamera) const;
+
+    void RunWorker(int WorkerIndex);
+
+    // the range of instances [Next, End) that a worker owns in the current update.
+    // Other workers take from it with the same atomic counter when they steal.
+    struct alignas(64) WorkerRange {
+        std::atomic<int> Next { 0 };
+        int End = 0;
+    };
+
+    // What slot i of the batch keeps between the updates. Between two evaluations
+    // of the skeleton Palette moves towards Target by a step in every update.
+    struct InstanceState {
+        SkinnedMesh::AnimationCursors Cursors;
+        std::vector<Matrix4f> Palette;      // the palette of the last update
+        std::vector<Matrix4f> Target;
+        int StepsLeft = 0;                  // updates until Palette reaches Target
+        int Tier = -1;                      // -1 until the first evaluation
+        bool Restarted = false;             // the last evaluation started a new animation
+        const SkinnedMesh* pMesh = NULL;
+        unsigned int AnimationIndex = 0;
+        unsigned int EndAnimationIndex = 0;
+        float LastAnimationTimeSec = 0.0f;
+        unsigned int NumEvaluatedBones = 0;  // in the last update
+    };
+
+    const std::vector<AnimationInstance>* m_pInstances = NULL;
+    std::vector<unsigned int> m_paletteOffsets;
+    std::vector<Matrix4f> m_palettes;
+    std::vector<InstanceState> m_states;
+    float m_lastUpdateMs = 0.0f;
+
+    float m_lodDistances[ANIMATION_LOD_TIERS - 1];
+    unsigned int m_lastNumEvaluatedBones = 0;
+    unsigned int m_lastNumInstancesInTier[ANIMATION_LOD_TIERS] = {};
+
+    ThreadPool m_pool;
+    std::unique_ptr<WorkerRange[]> m_ranges;   // one per thread of the pool
+};
+
+#endif
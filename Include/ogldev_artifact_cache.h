@@ -0,0 +1,111 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OGLDEV_ARTIFACT_CACHE_H
+#define OGLDEV_ARTIFACT_CACHE_H
+
+#include <vector>
+#include <string>
+#include <functional>
+
+// Identifies the output of a generator - the name of the generator and
+// everything that affects its result (parameters, seed, input data) are
+// hashed together.
+class ArtifactKey {
+ public:
+    ArtifactKey(const char* pGenerator);
+
+    ArtifactKey& Add(const void* pData, size_t Size);
+
+    ArtifactKey& Add(int x) { return Add(&x, sizeof(x)); }
+
+    ArtifactKey& Add(unsigned int x) { return Add(&x, sizeof(x)); }
+
+    ArtifactKey& Add(float x) { return Add(&x, sizeof(x)); }
+
+    ArtifactKey& Add(const char* pStr);
+
+    unsigned long long GetHash() const { return m_hash; }
+
+    const char* GetGenerator() const { return m_generator.c_str(); }
+
+ private:
+    std::string m_generator;
+    unsigned long long m_hash = 0;
+};
+
+
+// Content addressed cache for procedurally generated data. Every artifact
+// is a single file in the cache directory named after its key. The file
+// starts with an ArtifactHeader which is followed by the raw data. The
+// header records how long the generator took so that a hit can report the
+// time it saved.
+class ArtifactCache {
+ public:
+
+    ArtifactCache(const char* pCacheDir = "artifact_cache");
+
+    // Loads the artifact into Data or, if it is not in the cache, calls
+    // Generate to create it and stores the result. ExpectedSize (when not
+    // zero) rejects a cached artifact of the wrong size.
+    void GetArtifact(const ArtifactKey& Key, std::vector<unsigned char>& Data,
+                     const std::function<void(std::vector<unsigned char>& Data)>& Generate, size_t ExpectedSize = 0);
+
+    bool Load(const ArtifactKey& Key, std::vector<unsigned char>& Data, float& GenerationMs);
+
+    bool Store(const ArtifactKey& Key, const std::vector<unsigned char>& Data, float GenerationMs);
+
+    // A disabled cache always calls the generator and writes nothing. Used
+    // when the inputs are random and the artifacts would never be reused.
+    void Enable(bool Enable) { m_enabled = Enable; }
+
+    void PrintStats() const;
+
+    // 64 bit FNV-1a. Inline so that users of the hash alone (e.g. the
+    // texture cache) don't have to link the cache.
+    static unsigned long long HashData(const void* pData, size_t Size, unsigned long long Hash = 14695981039346656037ULL)
+    {
+        const unsigned char* p = (const unsigned char*)pData;
+
+        for (size_t i = 0 ; i < Size ; i++) {
+            Hash ^= p[i];
+            Hash *= 1099511628211ULL;
+        }
+
+        return Hash;
+    }
+
+ private:
+
+    std::string GetArtifactPath(const ArtifactKey& Key) const;
+
+    std::string m_cacheDir;
+    bool m_enabled = true;
+    int m_numHits = 0;
+    int m_numMisses = 0;
+    float m_timeSavedMs = 0.0f;
+    size_t m_bytesLoaded = 0;
+    size_t m_bytesStored = 0;
+};
+
+
+// the cache shared by all the generators of the application
+ArtifactCache& GetArtifactCache();
+
+#endif
@@ -21,6 +21,7 @@
 
 #include <map>
 #include <vector>
+#include <algorithm>
 #include <GL/glew.h>
 
 #include <assimp/Importer.hpp>      // C++ importer interface
@@ -38,6 +39,36 @@
 
 //#define USE_MESH_OPTIMIZER
 
+// Max number of levels of detail per mesh (including the full mesh). The
+// simplified LODs are generated only when USE_MESH_OPTIMIZER is defined.
+#define MESH_MAX_LODS 5
+
+// Fraction of the screen height covered by the bounding sphere of the model
+// below which the first simplified LOD is used. The threshold of each LOD
+// shrinks with the square root of its triangle ratio which keeps the number
+// of triangles per pixel about the same.
+#define MESH_LOD_FULL_DETAIL_SIZE 0.5f
+
+// max deviation of a simplified LOD relative to the extents of the mesh
+#define MESH_LOD_MAX_ERROR 0.02f
+
+// see BasicMesh::SetVertexFormat
+enum VERTEX_FORMAT {
+    VERTEX_FORMAT_FLOAT,                // 32 bit floats
+    VERTEX_FORMAT_QUANTIZED,            // 16 bit unorm positions in the bounding box of the model
+    VERTEX_FORMAT_QUANTIZED_HALF,       // half float positions
+};
+
+// limits of a meshlet (see EnableMeshlets)
+#define MESHLET_MAX_VERTICES  64
+#define MESHLET_MAX_TRIANGLES 124
+#define MESHLET_CONE_WEIGHT   0.25f
+
+// Save the final buffers of a model next to it (see MESH_CACHE_EXT) and map them
+// on later loads instead of going through Assimp
+#define USE_MESH_CACHE
+#define MESH_CACHE_EXT ".ogldevmesh"
+
 class BasicMesh : public MeshCommon
 {
 public:
@@ -49,10 +80,52 @@ public:
 
     void Render(IRenderCallbacks* pRenderCallbacks = NULL);
 
+    // renders the LOD that matches the size of the model on the screen
+    void Render(const Matrix4f& WVP, IRenderCallbacks* pRenderCallbacks = NULL);
+
     void Render(uint DrawIndex, uint PrimID);
 
+    // every instance is drawn with the LOD that matches its own WVP
     void Render(uint NumInstances, const Matrix4f* WVPMats, const Matrix4f* WorldMats);
 
+    // LOD i (i > 0) keeps about Ratios[i - 1] of the triangles of the full mesh.
+    // Must be called before LoadMesh.
+    void SetLODRatios(const std::vector<float>& Ratios);
+
+    uint GetNumLODs() const { return m_numLODs; }
+
+    uint SelectLOD(const Matrix4f& WVP) const;
+
+    // Must be called before LoadMesh. The triangles of the full LOD of every mesh
+    // are grouped into small clusters (meshlets) and Render(WVP) draws only the
+    // meshlets that are inside the frustum and not facing away from the camera.
+    // The triangles are reordered so the PrimID of Render(DrawIndex, PrimID)
+    // no longer matches the Assimp faces.
+    void EnableMeshlets(bool Enable) { m_meshletsEnabled = Enable; }
+
+    // Must be called before LoadMesh. The quantized formats store the texture
+    // coordinates as half floats and the normal as an octahedral 2x16 bit snorm.
+    // The vertex shader must decode them, see GetVertexDecode. Only the lighting,
+    // skinning and shadow passes of PhongRenderer do that so the instanced and
+    // the picking Render reject these formats.
+    void SetVertexFormat(VERTEX_FORMAT Format) { m_vertexFormat = Format; }
+
+    // Position = PosOffset + Position attribute * PosScale. The normal attribute
+    // is octahedral encoded when OctNormals is set.
+    void GetVertexDecode(Vector3f& PosOffset, Vector3f& PosScale, bool& OctNormals) const
+    {
+        PosOffset = m_posOffset;
+        PosScale = m_posScale;
+        OctNormals = (m_vertexFormat != VERTEX_FORMAT_FLOAT);
+    }
+
+    // meshlets drawn by the last Render(WVP) call
+    void GetMeshletStats(uint& NumVisible, uint& NumTotal) const
+    {
+        NumVisible = m_numVisibleMeshlets;
+        NumTotal = (uint)m_meshlets.size();
+    }
+
     const Material& GetMaterial();
 
     PBRMaterial& GetPBRMaterial() { return m_Materials[0].PBRmaterial; };
@@ -65,27 +138,98 @@ protected:
     virtual void ReserveSpace(uint NumVertices, uint NumIndices);
     virtual void InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh);
     virtual void InitSingleMeshOpt(uint MeshIndex, const aiMesh* paiMesh);
+    virtual void CompactMeshes();
     virtual void PopulateBuffers();
-    virtual void PopulateBuffersNonDSA();
-    virtual void PopulateBuffersDSA();
+    virtual void PopulateBuffersNonDSA(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices);
+    virtual void PopulateBuffersDSA(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices);
+
+    // The mesh cache holds only the geometry and the materials. Classes that
+    // need the aiScene after loading (e.g. for animation) must disable it.
+    virtual bool IsMeshCacheSupported() const { return true; }
+
+    // A class with its own vertex type caches it through these. The data of
+    // SaveMeshCacheExtra is stored as is and passed back to LoadMeshCacheExtra
+    // before anything else is loaded. Returning false rejects the cache.
+    virtual uint GetCacheVertexSize() const { return sizeof(Vertex); }
+    virtual const void* GetCacheVertices(uint& NumVertices) const;
+    virtual void PopulateCachedBuffers(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices);
+    virtual void SaveMeshCacheExtra(vector<unsigned char>& /*Data*/) const {}
+    virtual bool LoadMeshCacheExtra(const unsigned char* /*pData*/, long long Size) { return Size == 0; }
+
+    // the meshlet bounds are calculated in the bind pose (and m_Vertices) so
+    // they don't fit animated meshes
+    virtual bool AreMeshletsSupported() const { return true; }
 
     struct BasicMeshEntry {
         BasicMeshEntry()
         {
             NumIndices = 0;
+            NumVertices = 0;
             BaseVertex = 0;
             BaseIndex = 0;
             MaterialIndex = INVALID_MATERIAL;
+            NumLODs = 1;
+            ZERO_MEM(LODFirstIndex);
+            ZERO_MEM(LODNumIndices);
+            FirstMeshlet = 0;
+            NumMeshlets = 0;
         }
 
-        uint NumIndices;
+        // all the LODs of the mesh are in the index buffer one after the other
+        uint GetTotalIndices() const
+        {
+            return (NumLODs > 1) ? LODFirstIndex[NumLODs - 1] + LODNumIndices[NumLODs - 1] : NumIndices;
+        }
+
+        uint NumIndices;    // of the full mesh (LOD 0)
+        uint NumVertices;
         uint BaseVertex;
         uint BaseIndex;
         uint MaterialIndex;
+        uint NumLODs;
+        uint LODFirstIndex[MESH_MAX_LODS];    // relative to BaseIndex
+        uint LODNumIndices[MESH_MAX_LODS];
+        uint FirstMeshlet;
+        uint NumMeshlets;
     };
 
+    void GetLODRange(const BasicMeshEntry& Mesh, uint LOD, uint& BaseIndex, uint& NumIndices) const;
+
+    // Appends the simplified LODs of the mesh after its full index list (which
+    // is already at BaseIndex) using the ratios from SetLODRatios
+    void GenerateLODs(uint MeshIndex, const float* pPositions, size_t NumVertices, size_t VertexStride);
+
     std::vector<BasicMeshEntry> m_Meshes;
 
+    // The bounding sphere of all the meshes is used for LOD selection. It is
+    // centered on the bounding box which is good enough for this purpose.
+    template<typename VertexType>
+    void CalcBoundingSphere(const std::vector<VertexType>& Vertices, uint NumVertices)
+    {
+        if (NumVertices == 0) {
+            return;
+        }
+
+        Vector3f Min = Vertices[0].Position;
+        Vector3f Max = Vertices[0].Position;
+
+        for (uint i = 1 ; i < NumVertices ; i++) {
+            const Vector3f& Pos = Vertices[i].Position;
+            Min = Vector3f(std::min(Min.x, Pos.x), std::min(Min.y, Pos.y), std::min(Min.z, Pos.z));
+            Max = Vector3f(std::max(Max.x, Pos.x), std::max(Max.y, Pos.y), std::max(Max.z, Pos.z));
+        }
+
+        m_boundingCenter = (Min + Max) / 2.0f;
+        m_boundingRadius = 0.0f;
+
+        for (uint i = 0 ; i < NumVertices ; i++) {
+            m_boundingRadius = std::max(m_boundingRadius, (Vertices[i].Position - m_boundingCenter).Length());
+        }
+    }
+
+    // frees everything that Assimp loaded, m_pScene is NULL afterwards
+    void FreeScene();
+
     const aiScene* m_pScene;
 
     Matrix4f m_GlobalInverseTransform;
@@ -104,6 +248,33 @@ protected:
 
     GLuint m_Buffers[NUM_BUFFERS] = { 0 };
 
+    // The quantized layout of BasicMesh. SkinnedMesh appends the bone data.
+    struct QuantizedVertex {
+        unsigned short Position[4];     // unorm16 or half, [3] is padding
+        unsigned short TexCoords[2];    // half
+        short Normal[2];                // octahedral snorm16
+    };
+
+    // sets m_posOffset/m_posScale for the bounding box of the vertices
+    void CalcPositionDecode(const float* pPositions, uint NumVertices, size_t VertexStride);
+
+    void QuantizeVertex(const Vector3f& Pos, const Vector2f& TexCoords, const Vector3f& Normal, QuantizedVertex& Vertex) const;
+
+    // the attributes of QuantizedVertex at the start of a vertex of size Stride
+    void SetupQuantizedAttribs(GLsizei Stride);
+
+    // exits if the vertices are quantized, for the draws whose shaders can't decode them
+    void CheckFloatVertexFormat(const char* pCaller) const;
+
+    VERTEX_FORMAT m_vertexFormat = VERTEX_FORMAT_FLOAT;
+    Vector3f m_posOffset = Vector3f(0.0f, 0.0f, 0.0f);
+    Vector3f m_posScale = Vector3f(1.0f, 1.0f, 1.0f);
+
+    std::vector<float> m_lodRatios = { 0.5f, 0.25f, 0.125f };
+    uint m_numLODs = 1;
+    Vector3f m_boundingCenter = Vector3f(0.0f, 0.0f, 0.0f);
+    float m_boundingRadius = 0.0f;
+
 private:
     struct Vertex {
         Vector3f Position;
@@ -128,11 +299,109 @@ private:
 
     void LoadColors(const aiMaterial* pMaterial, int index);
 
+    void RenderLOD(uint LOD, IRenderCallbacks* pRenderCallbacks, bool UseVisibleMeshlets = false);
+
+    // The bounds of a cluster of triangles of the full LOD. The triangles of a
+    // meshlet are a single range of the index buffer.
+    struct Meshlet {
+        uint FirstIndex;    // relative to the BaseIndex of the mesh
+        uint NumIndices;
+        float Center[3];
+        float Radius;
+        float ConeApex[3];
+        float ConeAxis[3];
+        float ConeCutoff;
+    };
+
+    void BuildMeshlets();
+    void BuildMeshMeshlets(uint MeshIndex, std::vector<Meshlet>& Meshlets);
+
+    // fills the multi draw lists with the ranges of the visible meshlets
+    void CullMeshlets(const Matrix4f& WVP);
+
+    void PopulateQuantizedBuffers(const Vertex* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices);
+
+    // The mesh cache file is a MeshCacheHeader followed by the vertices, the
+    // indices, a MeshCacheEntry per mesh, a MeshCacheMaterial per material and
+    // the data of the derived class at the offsets in the header. Everything is
+    // in the final in-memory layout so the vertices and indices are uploaded
+    // straight from the mapping.
+    struct MeshCacheHeader {
+        char Magic[4];
+        uint Version;
+        uint Flags;
+        uint VertexSize;
+        uint NumVertices;
+        uint NumIndices;
+        uint NumMeshes;
+        uint NumMaterials;
+        uint NumLODs;
+        float LODRatios[MESH_MAX_LODS];
+        float BoundingCenter[3];
+        float BoundingRadius;
+        long long SourceSize;
+        long long SourceModTime;
+        long long VerticesOffset;
+        long long IndicesOffset;
+        long long MeshesOffset;
+        long long MaterialsOffset;
+        uint NumMeshlets;
+        long long MeshletsOffset;
+        long long ExtraOffset;
+        long long ExtraSize;
+    };
+
+    struct MeshCacheEntry {
+        uint NumIndices;
+        uint NumVertices;
+        uint BaseVertex;
+        uint BaseIndex;
+        uint MaterialIndex;
+        uint NumLODs;
+        uint LODFirstIndex[MESH_MAX_LODS];
+        uint LODNumIndices[MESH_MAX_LODS];
+        uint FirstMeshlet;
+        uint NumMeshlets;
+    };
+
+    struct MeshCacheMaterial {
+        Vector3f AmbientColor;
+        Vector3f DiffuseColor;
+        Vector3f SpecularColor;
+        char DiffuseTexture[256];
+        char SpecularTexture[256];
+    };
+
+    bool LoadMeshCache(const string& Filename);
+    void SaveMeshCache(const string& Filename);
+    bool GetSourceFileInfo(const string& Filename, long long& Size, long long& ModTime);
+    uint GetMeshCacheFlags() const;
+    Texture* LoadCachedTexture(const char* pFilename, bool SRGB = false);
+
     std::vector<Material> m_Materials;
     
     // Temporary space for vertex stuff before we load them into the GPU
     vector<Vertex> m_Vertices;
 
+    // instance matrices grouped by LOD
+    vector<Matrix4f> m_lodWVPMats;
+    vector<Matrix4f> m_lodWorldMats;
+    vector<uint> m_instanceLODs;
+
+    bool m_meshletsEnabled = false;
+    vector<Meshlet> m_meshlets;
+    uint m_numVisibleMeshlets = 0;
+
+    // glMultiDrawElementsBaseVertex lists of the visible meshlets. The draws of
+    // mesh i are at [m_meshDrawStart[i], m_meshDrawStart[i + 1]).
+    vector<GLsizei> m_drawCounts;
+    vector<void*> m_drawOffsets;
+    vector<GLint> m_drawBaseVertices;
+    vector<uint> m_meshDrawStart;
+
+    // when loaded from the mesh cache this maps the cache file (and m_pScene is NULL)
+    MappedFile m_MeshCache;
+
     Assimp::Importer m_Importer;
 };
 
@@ -30,6 +30,8 @@ public:
 
     void Init(int Width, int Height);
 
+    void Destroy();
+
     void BindForWriting();
 
     void UnbindWriting();
@@ -842,8 +842,32 @@ public:
         return Inside;
     }
 
+    // Uses the same planes as IsPointInsideViewFrustum. The box is outside
+    // only if it is completely on the outer side of one of them.
+    bool IsBoxInsideViewFrustum(const Vector3f& Min, const Vector3f& Max) const
+    {
+        bool Inside =
+            IsBoxInsidePlane(m_leftClipPlane, Min, Max, 1.0f) &&
+            IsBoxInsidePlane(m_rightClipPlane, Min, Max, -1.0f) &&
+            IsBoxInsidePlane(m_nearClipPlane, Min, Max, 1.0f) &&
+            IsBoxInsidePlane(m_farClipPlane, Min, Max, -1.0f);
+
+        return Inside;
+    }
+
 private:
 
+    static bool IsBoxInsidePlane(const Vector4f& Plane, const Vector3f& Min, const Vector3f& Max, float Sign)
+    {
+        // the corner which is farthest along the inner side of the plane
+        Vector4f Corner(Plane.x * Sign >= 0.0f ? Max.x : Min.x,
+                        Plane.y * Sign >= 0.0f ? Max.y : Min.y,
+                        Plane.z * Sign >= 0.0f ? Max.z : Min.z,
+                        1.0f);
+
+        return Plane.Dot(Corner) * Sign >= 0.0f;
+    }
+
     Vector4f m_leftClipPlane;
     Vector4f m_rightClipPlane;
     Vector4f m_bottomClipPlane;
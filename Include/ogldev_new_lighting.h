@@ -150,6 +150,9 @@ public:
     void SetPBR(bool IsPBR);
     void SetPBRMaterial(const PBRMaterial& Material);
     void SetClipPlane(const Vector3f& Normal, const Vector3f& PointOnPlane);
+    // The decode stays in the program so it must be set before every draw,
+    // including the float meshes (see BasicMesh::GetVertexDecode)
+    void SetVertexDecode(const Vector3f& PosOffset, const Vector3f& PosScale, bool OctNormals);
     //    void SetPBRLight(const PBRLight& Light);
     void SetWireframeWidth(float Width);
     void SetWireframeColor(const Vector4f& Color);
@@ -196,6 +199,9 @@ private:
     GLuint FogTimeLoc = INVALID_UNIFORM_LOCATION;
     GLuint IsPBRLoc = INVALID_UNIFORM_LOCATION;
     GLuint ClipPlaneLoc = INVALID_UNIFORM_LOCATION;
+    GLuint PosOffsetLoc = INVALID_UNIFORM_LOCATION;
+    GLuint PosScaleLoc = INVALID_UNIFORM_LOCATION;
+    GLuint OctNormalsLoc = INVALID_UNIFORM_LOCATION;
     GLuint WireframeWidthLoc = INVALID_UNIFORM_LOCATION;
     GLuint WireframeColorLoc = INVALID_UNIFORM_LOCATION;
 
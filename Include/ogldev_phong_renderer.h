@@ -86,6 +86,9 @@ class PhongRenderer {
 
     void RenderAnimation(SkinnedMesh* pMesh, float AnimationTimeSec, int AnimationIndex = 0);
 
+    // the bone palette was already evaluated, e.g. by AnimationSystem
+    void RenderAnimation(SkinnedMesh* pMesh, const Matrix4f* pBoneTransforms, uint NumBones);
+
     void RenderAnimationBlended(SkinnedMesh* pMesh,
                                 float AnimationTimeSec,
                                 int StartAnimIndex,
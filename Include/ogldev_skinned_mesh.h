@@ -30,6 +30,13 @@
 #include "ogldev_material.h"
 #include "ogldev_basic_mesh.h"
 
+// see SkinnedMesh::SetBoneWeightFormat
+enum BONE_WEIGHT_FORMAT {
+    BONE_WEIGHT_FORMAT_FLOAT,           // 32 bit bone indices and float weights
+    BONE_WEIGHT_FORMAT_UNORM8,          // 8 bit unorm weights
+    BONE_WEIGHT_FORMAT_UNORM16,         // 16 bit unorm weights
+};
+
 class SkinnedMesh : public BasicMesh
 {
 public:
@@ -42,6 +49,60 @@ public:
         return (uint)m_BoneNameToIndexMap.size();
     }
 
+    uint NumAnimations() const;
+
+    float GetAnimationDurationSec(unsigned int AnimationIndex) const;
+
+    // Must be called before LoadMesh. The animations are resampled at this rate
+    // into compact quantized clips which are sampled instead of the Assimp keys.
+    // Zero (the default) samples the keys directly.
+    void SetAnimationBakeRate(float SamplesPerSecond) { m_bakeSampleRate = SamplesPerSecond; }
+
+    // Must be called before LoadMesh. The packed formats (the default is UNORM8) store the
+    // bone indices in 8 bits (16 when there are more than 256 bones) and the weights are
+    // rounded so that they add up to exactly 1. The quantized vertex formats always pack
+    // the influences, with 8 bit weights unless UNORM16 is selected.
+    void SetBoneWeightFormat(BONE_WEIGHT_FORMAT Format) { m_boneWeightFormat = Format; }
+
+    // Must be called before LoadMesh. Keeps a copy of the bind pose for CalcSkinnedVertices.
+    void EnableCPUSkinning(bool Enable) { m_cpuSkinning = Enable; }
+
+    uint GetNumSkinnedVertices() const { return (uint)m_SkinnedVertices.size(); }
+
+    // Applies a bone palette (see GetBoneTransforms) to the vertices on the CPU, for
+    // picking, physics etc. The vertices are in the order of the vertex buffer and
+    // Stride is the distance in bytes between two of them in the output, which can
+    // be a mapped GL buffer. pNormals can be NULL. Large meshes are split between
+    // NumThreads threads (zero means one per core).
+    void CalcSkinnedVertices(const Matrix4f* pBoneTransforms, void* pPositions, void* pNormals, uint Stride, int NumThreads = 0) const;
+
+    // Same as above into a GL buffer of GetNumSkinnedVertices() interleaved positions
+    // and normals (6 floats per vertex).
+    void CalcSkinnedVerticesToBuffer(const Matrix4f* pBoneTransforms, GLuint Buffer, int NumThreads = 0) const;
+
+    // Frees the Assimp scene once the animations were baked. The mesh can still
+    // be rendered and animated but GetLeadingVertex is no longer available.
+    void ReleaseScene();
+
+    // The key that was sampled last by every track (scaling, rotation and position)
+    // of every channel of every animation. Sampling a time that is close to the
+    // previous one continues the search from there instead of from the first key.
+    // Each animated instance of the mesh should have its own cursors.
+    struct AnimationCursors {
+        vector<vector<uint>> Keys;  // [animation][channel * 3 + track]
+        vector<Matrix4f> NodeTransforms;  // scratch for the global transformations of the skeleton
+        uint NumEvaluatedBones = 0;       // bones whose channels were sampled by the last evaluation
+    };
+
+    // The reduced skeleton is evaluated by the farthest animation LOD (see AnimationSystem).
+    // Its frozen bones are not sampled and keep their bind pose relative to their parent.
+    // By default the leaf bones are frozen. This freezes the bones that are more than
+    // MaxDepth bones below the root bone instead.
+    void SetReducedSkeletonDepth(uint MaxDepth);
+
+    // Freezes the listed bones and everything below them instead of using the depth
+    void SetReducedSkeletonMask(const vector<string>& FrozenBones);
+
     // This is the main function to drive the animation. It receives the animation time
     // in seconds and a reference to a vector of transformation matrices (one matrix per bone).
     // It calculates the current transformation for each bone according to the current time
@@ -50,55 +111,118 @@ public:
     // is an optional param which selects one of the animations.
     void GetBoneTransforms(float AnimationTimeSec, vector<Matrix4f>& Transforms, unsigned int AnimationIndex = 0);
 
+    // same as above with the cursors of a specific instance (the one above uses the cursors of the mesh)
+    void GetBoneTransforms(float AnimationTimeSec, vector<Matrix4f>& Transforms, AnimationCursors& Cursors, unsigned int AnimationIndex = 0);
+
+    // Same as above with the output in an array of NumBones() matrices. Only the cursors
+    // and the output are written so instances with their own cursors can be evaluated
+    // on different threads (see AnimationSystem).
+    // When Reduced is set the frozen bones of the reduced skeleton are not sampled.
+    void GetBoneTransforms(float AnimationTimeSec, Matrix4f* pTransforms, AnimationCursors& Cursors, unsigned int AnimationIndex,
+                           bool Reduced = false);
+
     // Same as above but this one blends two animations together based on a blending factor
     void GetBoneTransformsBlended(float AnimationTimeSec,
                                   vector<Matrix4f>& Transforms,
                                   unsigned int StartAnimIndex,
                                   unsigned int EndAnimIndex,
                                   float BlendFactor);
+
+    void GetBoneTransformsBlended(float AnimationTimeSec,
+                                  vector<Matrix4f>& Transforms,
+                                  AnimationCursors& Cursors,
+                                  unsigned int StartAnimIndex,
+                                  unsigned int EndAnimIndex,
+                                  float BlendFactor);
+
+    void GetBoneTransformsBlended(float AnimationTimeSec,
+                                  Matrix4f* pTransforms,
+                                  AnimationCursors& Cursors,
+                                  unsigned int StartAnimIndex,
+                                  unsigned int EndAnimIndex,
+                                  float BlendFactor,
+                                  bool Reduced = false);
+
+    static const int MAX_NUM_BONES_PER_VERTEX = 4;
+
 private:
-    #define MAX_NUM_BONES_PER_VERTEX 4
 
     virtual void ReserveSpace(unsigned int NumVertices, unsigned int NumIndices);
 
     virtual void InitSingleMesh(uint MeshIndex, const aiMesh* paiMesh);
 
+    // The keys of the animations are sampled from the aiScene so only meshes
+    // with baked animations are cached. The bones, the skeleton and the clips
+    // are stored after the vertices (see SaveMeshCacheExtra).
+    virtual bool IsMeshCacheSupported() const { return m_bakeSampleRate > 0.0f; }
+
+    virtual uint GetCacheVertexSize() const { return sizeof(SkinnedVertex); }
+    virtual const void* GetCacheVertices(uint& NumVertices) const;
+    virtual void PopulateCachedBuffers(const void* pVertices, uint NumVertices, const uint* pIndices, uint NumIndices);
+    virtual void SaveMeshCacheExtra(vector<unsigned char>& Data) const;
+    virtual bool LoadMeshCacheExtra(const unsigned char* pData, long long Size);
+
+    virtual bool AreMeshletsSupported() const { return false; }
+
     struct VertexBoneData
     {
+        // sorted from the largest weight down, the unused slots have a zero weight
         uint BoneIDs[MAX_NUM_BONES_PER_VERTEX] = { 0 };
         float Weights[MAX_NUM_BONES_PER_VERTEX] = { 0.0f };
-        int index = 0;  // slot for the next update
 
         VertexBoneData()
         {
         }
 
+        // When all the slots are taken the smallest weight is dropped (see Normalize)
         void AddBoneData(uint BoneID, float Weight)
         {
-            for (int i = 0; i < index; i++) {
-                if (BoneIDs[i] == BoneID) {
+            for (int i = 0; i < MAX_NUM_BONES_PER_VERTEX; i++) {
+                if ((Weights[i] > 0.0f) && (BoneIDs[i] == BoneID)) {
                     //  printf("bone %d already found at index %d old weight %f new weight %f\n", BoneID, i, Weights[i], Weight);
                     return;
                 }
             }
 
             // The iClone 7 Raptoid Mascot (https://sketchfab.com/3d-models/iclone-7-raptoid-mascot-free-download-56a3e10a73924843949ae7a9800c97c7)
-            // has a problem of zero weights causing an overflow and the assertion below. This fixes it.
+            // has zero weights which would take the slots of the real ones. This fixes it.
             if (Weight == 0.0f) {
                 return;
             }
 
-            // printf("Adding bone %d weight %f at index %i\n", BoneID, Weight, index);
+            int Slot = MAX_NUM_BONES_PER_VERTEX;
+
+            while ((Slot > 0) && (Weights[Slot - 1] < Weight)) {
+                Slot--;
+            }
 
-            if (index == MAX_NUM_BONES_PER_VERTEX) {
+            if (Slot == MAX_NUM_BONES_PER_VERTEX) {
                 return;
-                assert(0);
             }
 
-            BoneIDs[index] = BoneID;
-            Weights[index] = Weight;
+            for (int i = MAX_NUM_BONES_PER_VERTEX - 1 ; i > Slot ; i--) {
+                BoneIDs[i] = BoneIDs[i - 1];
+                Weights[i] = Weights[i - 1];
+            }
 
-            index++;
+            BoneIDs[Slot] = BoneID;
+            Weights[Slot] = Weight;
+        }
+
+        // the weights add up to 1 again after influences were dropped
+        void Normalize()
+        {
+            float Sum = 0.0f;
+
+            for (int i = 0 ; i < MAX_NUM_BONES_PER_VERTEX ; i++) {
+                Sum += Weights[i];
+            }
+
+            if (Sum > 0.0f) {
+                for (int i = 0 ; i < MAX_NUM_BONES_PER_VERTEX ; i++) {
+                    Weights[i] /= Sum;
+                }
+            }
         }
     };
 
@@ -110,25 +234,49 @@ private:
     };
 
     virtual void InitSingleMeshOpt(uint MeshIndex, const aiMesh* paiMesh);
+    virtual void CompactMeshes();
     void OptimizeMesh(int MeshIndex, std::vector<uint>& Indices, std::vector<SkinnedVertex>& Vertices);
 
     virtual void PopulateBuffers();
     void PopulateBuffersNonDSA();
     void PopulateBuffersDSA();
+    void PopulatePackedBuffers();
+    void SetupFloatAttribs(GLsizei Stride);
+
+    static const uint CPU_SKINNING_BLOCK_SIZE = 8;
+
+    // the bind pose of CPU_SKINNING_BLOCK_SIZE vertices, one array per attribute
+    struct alignas(16) CPUSkinningBlock {
+        float PosX[CPU_SKINNING_BLOCK_SIZE];
+        float PosY[CPU_SKINNING_BLOCK_SIZE];
+        float PosZ[CPU_SKINNING_BLOCK_SIZE];
+        float NormalX[CPU_SKINNING_BLOCK_SIZE];
+        float NormalY[CPU_SKINNING_BLOCK_SIZE];
+        float NormalZ[CPU_SKINNING_BLOCK_SIZE];
+        uint BoneIDs[MAX_NUM_BONES_PER_VERTEX][CPU_SKINNING_BLOCK_SIZE];
+        float Weights[MAX_NUM_BONES_PER_VERTEX][CPU_SKINNING_BLOCK_SIZE];
+    };
 
+    void PrepareCPUSkinning();
+    void SkinBlocks(const Matrix4f* pBoneTransforms, uint StartBlock, uint EndBlock,
+                    unsigned char* pPositions, unsigned char* pNormals, uint Stride) const;
+
+    void RegisterBones(const aiScene* pScene);
     void LoadMeshBones(uint MeshIndex, const aiMesh* paiMesh, vector<SkinnedVertex>& SkinnedVertices, int BaseVertex);
     void LoadSingleBone(uint MeshIndex, const aiBone* pBone, vector<SkinnedVertex>& SkinnedVertices, int BaseVertex);
     int GetBoneId(const aiBone* pBone);
-    void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindScaling(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindRotation(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    uint FindPosition(float AnimationTime, const aiNodeAnim* pNodeAnim);
-    const aiNodeAnim* FindNodeAnim(const aiAnimation& Animation, const string& NodeName);
-    void ReadNodeHierarchy(float AnimationTime, const aiNode* pNode, const Matrix4f& ParentTransform, const aiAnimation& Animation);
-    void ReadNodeHierarchyBlended(float StartAnimationTimeTicksm, float EndAnimationTimeTicks, const aiNode* pNode, const Matrix4f& ParentTransform,
-                                  const aiAnimation& StartAnimation, const aiAnimation& EndAnimation, float BlendFactor);
+    void CalcInterpolatedScaling(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim, uint& Cursor);
+    void CalcInterpolatedRotation(aiQuaternion& Out, float AnimationTime, const aiNodeAnim* pNodeAnim, uint& Cursor);
+    void CalcInterpolatedPosition(aiVector3D& Out, float AnimationTime, const aiNodeAnim* pNodeAnim, uint& Cursor);
+    void BuildSkeleton(const aiScene* pScene);
+    void AddSkeletonNode(const aiNode* pNode, int Parent);
+    void UpdateReducedSkeleton();
+    uint EvaluateSkeleton(float AnimationTimeTicks, uint AnimationIndex, vector<uint>& Cursors,
+                          vector<Matrix4f>& NodeTransforms, Matrix4f* pTransforms, bool Reduced);
+    uint EvaluateSkeletonBlended(float StartAnimationTimeTicks, float EndAnimationTimeTicks,
+                                 uint StartAnimIndex, uint EndAnimIndex, float BlendFactor,
+                                 vector<uint>& StartCursors, vector<uint>& EndCursors,
+                                 vector<Matrix4f>& NodeTransforms, Matrix4f* pTransforms, bool Reduced);
     void MarkRequiredNodesForBone(const aiBone* pBone);
     void InitializeRequiredNodeMap(const aiNode* pNode);
     float CalcAnimationTimeTicks(float TimeInSeconds, unsigned int AnimationIndex);
@@ -139,7 +287,65 @@ private:
         aiVector3D Translation;
     };
 
-    void CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim);
+    void CalcLocalTransform(LocalTransform& Transform, float AnimationTimeTicks, const aiNodeAnim* pNodeAnim, uint* pCursors);
+
+    void GetAnimationTiming(unsigned int AnimationIndex, float& TicksPerSecond, float& Duration) const;
+
+    // where a baked clip is sampled in the current frame
+    struct BakedFrame {
+        uint Sample0 = 0;
+        uint Sample1 = 0;
+        float Factor = 0.0f;
+    };
+
+    // 16 bit unorm samples in the range of every track, [sample][track][xyz]
+    struct QuantizedVectorTracks {
+        uint NumTracks = 0;
+        vector<aiVector3D> Min;
+        vector<aiVector3D> Step;    // the value of one unit of the samples
+        vector<unsigned short> Samples;
+
+        void AddTrack(const vector<aiVector3D>& Values);
+        void Encode(uint Sample, uint Track, const aiVector3D& Value);
+        aiVector3D Decode(uint Sample, uint Track) const;
+    };
+
+    // An animation resampled at a fixed rate. Every channel has up to three
+    // tracks and a track that doesn't change is stripped and replaced by a
+    // constant. The samples of all the tracks of a frame are next to each other.
+    struct BakedClip {
+        float TicksPerSecond = 0.0f;
+        float Duration = 0.0f;      // in ticks, the mDuration of the animation
+        float SamplesPerTick = 0.0f;
+        uint NumSamples = 0;
+
+        struct ChannelTracks {
+            int Rotation = -1;      // track index or -1 when the constant is used
+            int Position = -1;
+            int Scaling = -1;
+            aiQuaternion ConstRotation;
+            aiVector3D ConstPosition;
+            aiVector3D ConstScaling;
+        };
+
+        vector<ChannelTracks> Tracks;   // one per channel of the animation
+
+        uint NumRotationTracks = 0;
+        vector<unsigned short> Rotations;   // smallest three, [sample][track][3]
+        QuantizedVectorTracks Positions;
+        QuantizedVectorTracks Scalings;
+
+        void CalcFrame(float AnimationTimeTicks, BakedFrame& Frame) const;
+        void Sample(uint ChannelIndex, const BakedFrame& Frame, LocalTransform& Transform) const;
+        size_t GetSizeInBytes() const;
+    };
+
+    void BakeClips(const aiScene* pScene);
+    void BakeClip(const aiAnimation* pAnimation, BakedClip& Clip);
+    void CalcChannelTransform(uint AnimationIndex, int ChannelIndex, float AnimationTimeTicks, const BakedFrame& Frame,
+                              vector<uint>& Cursors, LocalTransform& Transform);
+
+    vector<uint>& GetAnimationCursors(AnimationCursors& Cursors, uint AnimationIndex);
 
     vector<SkinnedVertex> m_SkinnedVertices;
 
@@ -150,12 +356,10 @@ private:
     struct BoneInfo
     {
         Matrix4f OffsetMatrix;
-        Matrix4f FinalTransformation;
 
         BoneInfo(const Matrix4f& Offset)
         {
             OffsetMatrix = Offset;
-            FinalTransformation.SetZero();
         }
     };
 
@@ -172,6 +376,33 @@ private:
     };
 
     map<string,NodeInfo> m_requiredNodeMap;
+
+    // the required nodes of the hierarchy, every node comes after its parent
+    struct SkeletonNode {
+        string Name;
+        int Parent = -1;            // index in m_skeleton
+        int BoneIndex = -1;         // index in m_BoneInfo
+        int BoneDepth = -1;         // number of bones above this one, -1 above the root bone
+        Matrix4f Transformation;    // relative to the parent when the node is not animated
+    };
+
+    vector<SkeletonNode> m_skeleton;
+
+    vector<vector<int>> m_nodeChannels;  // [animation][skeleton node] channel that animates the node or -1
+
+    int m_reducedSkeletonDepth = -1;         // -1 freezes the leaf bones
+    vector<string> m_reducedSkeletonMask;
+    vector<char> m_frozenNodes;              // [skeleton node] not sampled by the reduced skeleton
+
+    BONE_WEIGHT_FORMAT m_boneWeightFormat = BONE_WEIGHT_FORMAT_UNORM8;
+
+    bool m_cpuSkinning = false;
+    vector<CPUSkinningBlock> m_skinningBlocks;
+
+    float m_bakeSampleRate = 0.0f;
+    vector<BakedClip> m_bakedClips;     // one per animation when baking is enabled
+
+    AnimationCursors m_cursors;
 };
 
 
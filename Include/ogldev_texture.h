@@ -20,9 +20,29 @@
 #define TEXTURE_H
 
 #include <string>
+#include <vector>
+#include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 #include <GL/glew.h>
 
+
+struct TextureMipLevel {
+    int Width = 0;
+    int Height = 0;
+    std::vector<unsigned char> Data;
+};
+
+
+// Reads the block compressed container that tools/texture_compressor wrote
+// next to the image (see ogldev_texture_compressor.h). Fails when there is no
+// container or when it is older than the image.
+bool ReadCompressedTexture(const std::string& Filename, GLenum& InternalFormat, std::vector<TextureMipLevel>& Levels);
+
+
 class Texture
 {
 public:
@@ -30,9 +50,24 @@ public:
 
     Texture(GLenum TextureTarget);
 
-    // Should be called once to load the texture
+    // Should be called once to load the texture. The block compressed container
+    // of the file is loaded instead of the file when it is up to date.
     bool Load();
 
+    // Queues the file for decoding on the threads of the texture loader (see
+    // GetTextureLoader). Bind() binds a placeholder until the upload is done.
+    // The texture must not be deleted while it is pending.
+    void LoadAsync();
+
+    bool IsLoaded() const { return m_textureObj != 0; }
+
+    // Must be called before the texture is loaded. The color channels of sRGB
+    // textures are filtered in linear space when the mipmaps are generated on
+    // the CPU. Textures are linear by default (normal maps, specular etc).
+    void SetSRGB(bool SRGB) { m_srgb = SRGB; }
+
+    bool IsSRGB() const { return m_srgb; }
+
     void Load(unsigned int BufferSize, void* pImageData);
 
     void Load(const std::string& Filename);
@@ -52,21 +87,206 @@ public:
 
     GLuint GetTexture() const { return m_textureObj; }
 
+    // empty for textures that were not loaded from a file
+    const std::string& GetFileName() const { return m_fileName; }
+
+    // decoding and upload time of the last load
+    float GetLoadTimeMs() const { return m_loadTimeMs; }
+
+    // size of the GL texture including its mip chain
+    size_t GetSizeInBytes() const;
+
 private:
+    friend class AsyncTextureLoader;
+    friend class TextureRegistry;
+
     void LoadInternal(const void* pImageData);
     void LoadInternalNonDSA(const void* pImageData);
     void LoadInternalDSA(const void* pImageData);    
 
+    // uploads the mip chain of MipmapGenerator instead of calling glGenerateMipmap
+    void LoadInternalMipmapped(const unsigned char* pImageData);
+
+    bool LoadCompressed();
+
     void BindInternalNonDSA(GLenum TextureUnit);
     void BindInternalDSA(GLenum TextureUnit);
 
     std::string m_fileName;
     GLenum m_textureTarget;
-    GLuint m_textureObj;
+    GLuint m_textureObj = 0;
     int m_imageWidth = 0;
     int m_imageHeight = 0;
     int m_imageBPP = 0;
+    float m_loadTimeMs = 0.0f;
+    size_t m_compressedSize = 0;   // zero unless the texture was loaded from a container
+    bool m_srgb = false;
 };
 
 
+enum MIPMAP_FILTER {
+    MIPMAP_FILTER_BOX,      // 2x2 average
+    MIPMAP_FILTER_KAISER    // Kaiser windowed sinc, sharper than the box
+};
+
+
+// Generates the mip chain of an 8 bit image on the CPU. Every level is
+// filtered separably from the previous one and the rows of a level are
+// filtered in parallel. When the image is sRGB the color channels of RGB and
+// RGBA images are filtered in linear space. Alpha and the channels of one and
+// two channel images are filtered as is. When the cache is enabled the chain
+// of an image that was loaded from a file is cached next to it (<image>.mips)
+// so that the next load skips the filtering.
+class MipmapGenerator
+{
+public:
+    MipmapGenerator() {}
+
+    // when disabled the textures call glGenerateMipmap
+    void Enable(bool Enable) { m_enabled = Enable; }
+
+    bool IsEnabled() const { return m_enabled; }
+
+    void SetFilter(MIPMAP_FILTER Filter) { m_filter = Filter; }
+
+    // disabled by default
+    void EnableCache(bool Enable) { m_cache = Enable; }
+
+    // Levels[0] must hold the image. NumThreads zero means one per core.
+    void Generate(int BPP, bool SRGB, std::vector<TextureMipLevel>& Levels, int NumThreads = 0) const;
+
+    // loads the chain from the cache of the file or generates it and updates the cache
+    void GenerateCached(const std::string& Filename, int BPP, bool SRGB, std::vector<TextureMipLevel>& Levels, int NumThreads = 0) const;
+
+private:
+    bool LoadCache(const std::string& Filename, int BPP, bool SRGB, std::vector<TextureMipLevel>& Levels) const;
+
+    void StoreCache(const std::string& Filename, int BPP, bool SRGB, const std::vector<TextureMipLevel>& Levels) const;
+
+    bool m_enabled = true;
+    MIPMAP_FILTER m_filter = MIPMAP_FILTER_BOX;
+    bool m_cache = false;
+};
+
+
+MipmapGenerator& GetMipmapGenerator();
+
+
+// Decodes textures (and calculates their mipmaps) on worker threads. The GL
+// thread uploads the results one mip level at a time, either in Update()
+// with a time budget per frame or in Finish() which blocks until all the
+// queued textures are ready.
+class AsyncTextureLoader
+{
+public:
+    AsyncTextureLoader() {}
+
+    ~AsyncTextureLoader();
+
+    void LoadAsync(Texture* pTexture);
+
+    // uploads decoded mip levels until BudgetMs is spent (at least one level per call)
+    void Update(float BudgetMs);
+
+    // waits for all the queued textures and uploads them
+    void Finish();
+
+    int GetNumPending();
+
+    // When streaming is enabled the textures of a model are left pending after it
+    // is loaded and the application must call Update() every frame. Otherwise
+    // the model waits for them in Finish().
+    void EnableStreaming(bool Enable) { m_streaming = Enable; }
+
+    bool IsStreaming() const { return m_streaming; }
+
+    // when disabled the mipmaps are generated by the GPU after the upload
+    void EnableCPUMipmaps(bool Enable) { GetMipmapGenerator().Enable(Enable); }
+
+    // 1x1 grey texture which is bound instead of a texture that is still loading
+    static GLuint GetPlaceholderTexture();
+
+private:
+    struct Job {
+        Texture* pTexture = NULL;
+        bool GenerateMipmaps = true;
+        bool Failed = false;
+        int BPP = 0;
+        GLenum CompressedFormat = 0;    // when the levels were read from a container
+        size_t CompressedSize = 0;
+        std::vector<TextureMipLevel> Levels;
+        int NumLevels = 0;      // in the GL texture
+        int NextLevel = 0;      // to upload
+        GLuint TextureObj = 0;
+        float LoadTimeMs = 0.0f;
+    };
+
+    void StartThreads();
+
+    void WorkerThread();
+
+    void DecodeJob(Job* pJob);
+
+    bool UploadNextLevel();
+
+    void UploadLevel(Job* pJob);
+
+    void CompleteJob(Job* pJob);
+
+    std::vector<std::thread> m_threads;
+    std::mutex m_mutex;
+    std::condition_variable m_decodeCond;
+    std::condition_variable m_uploadCond;
+    std::deque<Job*> m_decodeQueue;
+    std::deque<Job*> m_uploadQueue;
+    int m_numPending = 0;
+    bool m_quit = false;
+    bool m_streaming = false;
+};
+
+
+// the loader shared by all the textures of the application
+AsyncTextureLoader& GetTextureLoader();
+
+
+// Textures that are loaded by the models are shared through this registry.
+// A file is keyed by its canonical path and an embedded texture by a hash of
+// its data, so a texture that is referenced by several materials or models is
+// decoded and uploaded once. Every Acquire call must be matched by Release().
+class TextureRegistry
+{
+public:
+    TextureRegistry() {}
+
+    // The file is loaded with the async loader the first time it is requested.
+    // Color textures should be acquired as sRGB (see Texture::SetSRGB).
+    Texture* AcquireFile(const std::string& Filename, bool SRGB = false);
+
+    Texture* AcquireEmbedded(unsigned int BufferSize, const void* pData, bool SRGB = false);
+
+    // the texture is deleted when the last reference is released
+    void Release(Texture* pTexture);
+
+    // VRAM and load time that were saved by sharing the textures
+    void PrintStats() const;
+
+private:
+    struct Entry {
+        Texture* pTexture = NULL;
+        int RefCount = 0;
+        int NumShared = 0;  // requests that were served by the existing texture
+    };
+
+    Texture* FindTexture(const std::string& Key);
+
+    Texture* AddTexture(const std::string& Key, Texture* pTexture);
+
+    std::map<std::string, Entry> m_entries;
+    std::map<const Texture*, std::string> m_keys;
+};
+
+
+TextureRegistry& GetTextureRegistry();
+
+
 #endif  /* TEXTURE_H */
@@ -0,0 +1,140 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OGLDEV_TEXTURE_COMPRESSOR_H
+#define OGLDEV_TEXTURE_COMPRESSOR_H
+
+#include <string>
+#include <vector>
+
+#include <GL/glew.h>
+
+enum BLOCK_FORMAT {
+    BLOCK_FORMAT_BC1,   // RGB, 8 bytes per block
+    BLOCK_FORMAT_BC3,   // RGBA, 16 bytes per block
+    BLOCK_FORMAT_BC4,   // R, 8 bytes per block
+    BLOCK_FORMAT_BC5,   // RG, 16 bytes per block
+    BLOCK_FORMAT_BC7,   // RGBA, 16 bytes per block
+    BLOCK_FORMAT_COUNT
+};
+
+
+#define COMPRESSED_TEXTURE_MAGIC   0x4354474F  // "OGTC"
+#define COMPRESSED_TEXTURE_VERSION 1
+
+// The container starts with this header. It is followed by NumLevels pairs
+// of CompressedLevelHeader and the blocks of the level, from the largest
+// level to 1x1. The image is stored flipped vertically just like
+// Texture::Load() uploads it.
+struct CompressedTextureHeader {
+    unsigned int Magic = COMPRESSED_TEXTURE_MAGIC;
+    unsigned int Version = COMPRESSED_TEXTURE_VERSION;
+    unsigned int Format = 0;    // BLOCK_FORMAT
+    unsigned int Width = 0;
+    unsigned int Height = 0;
+    unsigned int NumLevels = 0;
+};
+
+
+struct CompressedLevelHeader {
+    unsigned int Width = 0;
+    unsigned int Height = 0;
+    unsigned int Size = 0;      // in bytes
+};
+
+
+// the container is written next to the source image
+inline std::string GetCompressedTextureFileName(const std::string& Filename)
+{
+    return Filename + ".ogtc";
+}
+
+
+inline int GetBlockSizeInBytes(BLOCK_FORMAT Format)
+{
+    return ((Format == BLOCK_FORMAT_BC1) || (Format == BLOCK_FORMAT_BC4)) ? 8 : 16;
+}
+
+
+inline GLenum GetBlockFormatGL(BLOCK_FORMAT Format)
+{
+    switch (Format) {
+    case BLOCK_FORMAT_BC1:
+        return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+
+    case BLOCK_FORMAT_BC3:
+        return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+
+    case BLOCK_FORMAT_BC4:
+        return GL_COMPRESSED_RED_RGTC1;
+
+    case BLOCK_FORMAT_BC5:
+        return GL_COMPRESSED_RG_RGTC2;
+
+    case BLOCK_FORMAT_BC7:
+        return GL_COMPRESSED_RGBA_BPTC_UNORM;
+
+    default:
+        return 0;
+    }
+}
+
+
+// CPU encoder for the BCn formats. The blocks of a level are compressed in
+// parallel (see ParallelFor). The images are always passed as RGBA8 and only
+// the channels that the format keeps are encoded. The decoder is used to
+// measure the quality of the encoder without a GPU - for BC7 it only
+// understands mode 6 which is the only mode that the encoder writes.
+class TextureCompressor {
+ public:
+    TextureCompressor(BLOCK_FORMAT Format) { m_format = Format; }
+
+    // Loads the image, compresses its mip chain and writes the container
+    // next to it. When Verify is set every level is decoded back and its
+    // PSNR against the source is printed.
+    bool CompressFile(const std::string& Filename, bool Verify);
+
+    void CompressLevel(const unsigned char* pRGBA, int Width, int Height, std::vector<unsigned char>& Blocks) const;
+
+    void DecompressLevel(const unsigned char* pBlocks, int Width, int Height, std::vector<unsigned char>& RGBA) const;
+
+    // over the channels that the format keeps
+    float CalcPSNR(const unsigned char* pRGBA0, const unsigned char* pRGBA1, int NumPixels) const;
+
+    // picks the format from the number of channels of the image
+    static BLOCK_FORMAT GetDefaultFormat(int BPP);
+
+    static const char* GetFormatName(BLOCK_FORMAT Format);
+
+    void SetNumThreads(int NumThreads) { m_numThreads = NumThreads; }
+
+    // The mips of RGB images are filtered in linear space (see MipmapGenerator)
+    void SetSRGB(bool SRGB) { m_srgb = SRGB; }
+
+ private:
+    void CompressBlock(const unsigned char* pPixels, unsigned char* pBlock) const;
+
+    void DecompressBlock(const unsigned char* pBlock, unsigned char* pPixels) const;
+
+    BLOCK_FORMAT m_format = BLOCK_FORMAT_BC1;
+    int m_numThreads = 0;
+    bool m_srgb = false;
+};
+
+#endif
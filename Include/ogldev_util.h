@@ -27,6 +27,11 @@
 #include <stdio.h>
 #include <string>
 #include <vector>
+#include <algorithm>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 #include <string.h>
 #include <assert.h>
 #include <time.h>
@@ -80,6 +85,106 @@ void OgldevFileError(const char* pFileName, uint line, const char* pFileError);
 
 long long GetCurrentTimeMillis();
 
+// Read only memory mapping of a whole file. The OS pages the file in on demand
+// so the data can be handed to OpenGL without being copied first.
+class MappedFile {
+ public:
+    MappedFile() {}
+
+    ~MappedFile() { Close(); }
+
+    bool Open(const char* pFilename);
+
+    void Close();
+
+    bool IsOpen() const { return m_pData != NULL; }
+
+    const unsigned char* GetData() const { return m_pData; }
+
+    size_t GetSize() const { return m_size; }
+
+ private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    const unsigned char* m_pData = NULL;
+    size_t m_size = 0;
+#ifdef _WIN32
+    void* m_fileHandle = NULL;
+    void* m_mappingHandle = NULL;
+#endif
+};
+
+// Calls Func(i) for every i in [0, Count) from NumThreads threads (zero means one per core).
+// The items are handed out one at a time so that uneven items are balanced between the threads.
+void ParallelFor(int Count, const std::function<void(int)>& Func, int NumThreads = 0);
+
+// The meshes of a model are converted in parallel and each one is written at the
+// start of the range that was reserved for it. When they come out smaller (e.g.
+// after optimization) this moves them together and trims the arrays. MeshType
+// needs BaseVertex, BaseIndex, NumVertices and GetTotalIndices().
+template<typename MeshType, typename VertexType>
+void CompactMeshArrays(std::vector<MeshType>& Meshes, std::vector<VertexType>& Vertices, std::vector<uint>& Indices)
+{
+    uint NumVertices = 0;
+    uint NumIndices = 0;
+
+    for (uint i = 0 ; i < Meshes.size() ; i++) {
+        MeshType& Mesh = Meshes[i];
+        uint TotalIndices = Mesh.GetTotalIndices();
+
+        std::copy(Vertices.begin() + Mesh.BaseVertex, Vertices.begin() + Mesh.BaseVertex + Mesh.NumVertices,
+                  Vertices.begin() + NumVertices);
+        std::copy(Indices.begin() + Mesh.BaseIndex, Indices.begin() + Mesh.BaseIndex + TotalIndices,
+                  Indices.begin() + NumIndices);
+
+        Mesh.BaseVertex = NumVertices;
+        Mesh.BaseIndex = NumIndices;
+
+        NumVertices += Mesh.NumVertices;
+        NumIndices += TotalIndices;
+    }
+
+    Vertices.resize(NumVertices);
+    Indices.resize(NumIndices);
+}
+
+// Persistent worker threads for work that is split the same way over and over
+// (e.g. in every frame) where starting threads in each call would cost too much.
+// Run calls Job(ThreadIndex) once on every thread of the pool and returns when
+// all of them are done. The calling thread runs index zero.
+class ThreadPool {
+ public:
+    ThreadPool() {}
+
+    ~ThreadPool() { Stop(); }
+
+    // zero threads means one per core (the calling thread is one of them)
+    void Start(int NumThreads);
+
+    void Stop();
+
+    int GetNumThreads() const { return m_numThreads; }
+
+    void Run(const std::function<void(int ThreadIndex)>& Job);
+
+ private:
+    ThreadPool(const ThreadPool&);
+    ThreadPool& operator=(const ThreadPool&);
+
+    void WorkerThread(int ThreadIndex);
+
+    std::vector<std::thread> m_workers;
+    int m_numThreads = 1;
+    std::mutex m_mutex;
+    std::condition_variable m_startCond;
+    std::condition_variable m_doneCond;
+    const std::function<void(int)>* m_pJob = NULL;
+    int m_generation = 0;
+    int m_jobsRemaining = 0;
+    bool m_quit = false;
+};
+
 
 #define ASSIMP_LOAD_FLAGS (aiProcess_Triangulate | aiProcess_GenSmoothNormals |  aiProcess_JoinIdenticalVertices )
 
@@ -18,6 +18,7 @@ SOURCES="terrain_demo4.cpp \
 	$OGLDEV_DIR/Common/ogldev_stb_image.cpp \
 	$OGLDEV_DIR/Common/technique.cpp \
 	$OGLDEV_DIR/Common/ogldev_texture.cpp \
+	$OGLDEV_DIR/Common/ogldev_artifact_cache.cpp \
 	$OGLDEV_DIR/Common/3rdparty/stb_image.cpp \
 	$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW/imgui.cpp \
 	$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW/imgui_draw.cpp \
@@ -57,6 +57,8 @@ class BaseTerrain
 
     int GetSize() const { return m_terrainSize; }
 
+    const Array2D<float>& GetHeightMap() const { return m_heightMap; }
+
     void SetTexture(Texture* pTexture) { m_pTextures[0] = pTexture; }
 
     void SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height);
@@ -38,6 +38,7 @@
 #include "texture_config.h"
 #include "midpoint_disp_terrain.h"
 #include "texture_generator.h"
+#include "ogldev_artifact_cache.h"
 
 #define WINDOW_WIDTH  1920
 #define WINDOW_HEIGHT 1080
@@ -292,6 +293,8 @@ private:
 
         Texture* pTexture = TexGen.GenerateTexture(TextureSize, &m_terrain, MinHeight, MaxHeight);
         m_terrain.SetTexture(pTexture);
+
+        GetArtifactCache().PrintStats();
     }
 
 
@@ -371,13 +374,27 @@ int main(int argc, char** argv)
 {
 #ifdef _WIN64
     int Seed = GetCurrentProcessId();
-    srand(Seed);
-    printf("random seed %d\n", Seed);
-   // srand(0);
 #else
-    srand(getpid());
+    int Seed = getpid();
 #endif
 
+    bool FixedSeed = false;
+
+    for (int i = 1 ; i < argc ; i++) {
+        if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+            // a fixed seed lets the artifact cache reuse the texture of a previous run
+            Seed = atoi(argv[++i]);
+            FixedSeed = true;
+        }
+    }
+
+    printf("random seed %d\n", Seed);
+
+    // the texture of a random terrain is never generated again
+    GetArtifactCache().Enable(FixedSeed);
+
+    srand(Seed);
+
     app = new TerrainDemo4();
 
     app->Init();
@@ -19,10 +19,12 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "texture_generator.h"
 #include "terrain.h"
 #include "ogldev_stb_image.h"
+#include "ogldev_artifact_cache.h"
 
 #include "3rdparty/stb_image_write.h"
 
@@ -53,7 +55,38 @@ Texture* TextureGenerator::GenerateTexture(int TextureSize, BaseTerrain* pTerrai
 
     int BPP = 3;
     int TextureBytes = TextureSize * TextureSize * BPP;
-    unsigned char* pTextureData = (unsigned char*)malloc(TextureBytes);
+
+    // the texture is a function of the heightmap, the tiles and the height range
+    const Array2D<float>& HeightMap = pTerrain->GetHeightMap();
+
+    ArtifactKey Key("splat_texture");
+    Key.Add(TextureSize).Add(MinHeight).Add(MaxHeight).Add(pTerrain->GetSize());
+    Key.Add(HeightMap.GetBaseAddr(), HeightMap.GetSizeInBytes());
+
+    for (int Tile = 0 ; Tile < m_numTextureTiles ; Tile++) {
+        const STBImage& Image = m_textureTiles[Tile].Image;
+        Key.Add(Image.m_width).Add(Image.m_height).Add(Image.m_bpp);
+        Key.Add(Image.m_imageData, (size_t)Image.m_width * Image.m_height * Image.m_bpp);
+    }
+
+    std::vector<unsigned char> TextureData;
+
+    GetArtifactCache().GetArtifact(Key, TextureData, [&](std::vector<unsigned char>& Data) {
+        Data.resize(TextureBytes);
+        GenerateTextureData(TextureSize, pTerrain, &Data[0]);
+        stbi_write_png("texture.png", TextureSize, TextureSize, BPP, &Data[0], TextureSize * BPP);
+    }, TextureBytes);
+
+    Texture* pTexture = new Texture(GL_TEXTURE_2D);
+
+    pTexture->LoadRaw(TextureSize, TextureSize, BPP, &TextureData[0]);
+
+    return pTexture;
+}
+
+
+void TextureGenerator::GenerateTextureData(int TextureSize, BaseTerrain* pTerrain, unsigned char* pTextureData)
+{
     unsigned char* p = pTextureData;
 
     float HeightMapToTextureRatio = (float)pTerrain->GetSize() / (float)TextureSize;
@@ -92,16 +125,6 @@ Texture* TextureGenerator::GenerateTexture(int TextureSize, BaseTerrain* pTerrai
             p += 3;
         }
     }
-
-    Texture* pTexture = new Texture(GL_TEXTURE_2D);
-
-    stbi_write_png("texture.png", TextureSize, TextureSize, BPP, pTextureData, TextureSize * BPP);
-
-    pTexture->LoadRaw(TextureSize, TextureSize, BPP, pTextureData);
-
-    free(pTextureData);
-
-    return pTexture;
 }
 
 
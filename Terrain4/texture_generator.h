@@ -52,6 +52,8 @@ class TextureGenerator {
 
  private:
 
+    void GenerateTextureData(int TextureSize, BaseTerrain* pTerrain, unsigned char* pTextureData);
+
     void CalculateTextureRegions(float MinHeight, float MaxHeight);
 
     float RegionPercent(int Tile, float Height);
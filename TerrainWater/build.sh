@@ -5,13 +5,23 @@ CC=g++
 CPPFLAGS=`pkg-config --cflags glew glfw3 assimp`
 CPPFLAGS="$CPPFLAGS -I$OGLDEV_DIR/Include -I$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW -ggdb3"
 LDFLAGS=`pkg-config --libs glew glfw3 assimp`
-LDFLAGS="$LDFLAGS -lX11 -ldl -lmeshoptimizer"
+LDFLAGS="$LDFLAGS -lX11 -ldl -lmeshoptimizer -lpthread"
 SOURCES="terrain_water.cpp \
 	geomip_grid.cpp \
 	terrain_technique.cpp \
 	midpoint_disp_terrain.cpp \
 	terrain.cpp \
 	lod_manager.cpp \
+	horizon_culling.cpp \
+	cdlod_grid.cpp \
+	cdlod_technique.cpp \
+	tile_generator.cpp \
+	streaming_terrain.cpp \
+	tiled_midpoint_disp.cpp \
+	tiled_height_map.cpp \
+	tiled_fault_formation.cpp \
+	ocean_fft.cpp \
+	terrain_normal_baker.cpp \
     simple_water.cpp \
     simple_water_technique.cpp
     triangle_list.cpp \
@@ -30,6 +40,7 @@ SOURCES="terrain_water.cpp \
 	$OGLDEV_DIR/Common/ogldev_guitex_technique.cpp \
 	$OGLDEV_DIR/Common/ogldev_screen_quad.cpp \
 	$OGLDEV_DIR/Common/ogldev_framebuffer.cpp \
+	$OGLDEV_DIR/Common/ogldev_artifact_cache.cpp \
 	$OGLDEV_DIR/Common/3rdparty/stb_image.cpp \
 	$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW/imgui.cpp \
 	$OGLDEV_DIR/Common/3rdparty/ImGui/GLFW/imgui_draw.cpp \
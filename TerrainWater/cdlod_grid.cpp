@@ -0,0 +1,410 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <vector>
+
+#include "ogldev_math_3d.h"
+#include "demo_config.h"
+#include "texture_config.h"
+#include "cdlod_grid.h"
+#include "terrain.h"
+
+// fraction of the range of a lod after which its nodes start to morph
+#define MORPH_START_RATIO 0.7f
+
+
+CDLODGrid::~CDLODGrid()
+{
+    Destroy();
+}
+
+
+void CDLODGrid::Destroy()
+{
+    if (m_vao > 0) {
+        glDeleteVertexArrays(1, &m_vao);
+        m_vao = 0;
+    }
+
+    if (m_vb > 0) {
+        glDeleteBuffers(1, &m_vb);
+        m_vb = 0;
+    }
+
+    if (m_ib > 0) {
+        glDeleteBuffers(1, &m_ib);
+        m_ib = 0;
+    }
+
+    if (m_instanceBuffer > 0) {
+        glDeleteBuffers(1, &m_instanceBuffer);
+        m_instanceBuffer = 0;
+    }
+
+    if (m_heightMap > 0) {
+        glDeleteTextures(1, &m_heightMap);
+        m_heightMap = 0;
+    }
+
+    m_nodes.clear();
+}
+
+
+void CDLODGrid::CreateCDLODGrid(int TerrainSize, int LeafNodeSize, const BaseTerrain* pTerrain)
+{
+    if ((LeafNodeSize < 2) || (LeafNodeSize % 2 != 0)) {
+        printf("The leaf node size must be an even number of at least 2 (%d)\n", LeafNodeSize);
+        exit(0);
+    }
+
+    m_terrainSize = TerrainSize;
+    m_leafNodeSize = LeafNodeSize;
+    m_worldScale = pTerrain->GetWorldScale();
+
+    // The root covers the smallest power of two number of leaves which
+    // contains the entire terrain. Nodes beyond the edge are not created.
+    int RootSize = LeafNodeSize;
+    m_numLods = 1;
+
+    while (RootSize < TerrainSize - 1) {
+        RootSize *= 2;
+        m_numLods++;
+    }
+
+    if (m_numLods > CDLOD_MAX_LODS) {
+        printf("Too many CDLOD levels (%d) - increase the leaf node size\n", m_numLods);
+        exit(0);
+    }
+
+    m_nodes.clear();
+    CreateNode(pTerrain, 0, 0, RootSize, m_numLods - 1);
+
+    CalcLodRanges();
+
+    CreateGLState();
+
+    PopulateGridBuffers();
+
+    CreateHeightMapTexture(pTerrain);
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    printf("CDLOD: %d levels, %zu nodes\n", m_numLods, m_nodes.size());
+}
+
+
+int CDLODGrid::CreateNode(const BaseTerrain* pTerrain, int X, int Z, int Size, int Lod)
+{
+    int NodeIndex = (int)m_nodes.size();
+    m_nodes.push_back(Node());
+
+    Node n;
+    n.X = X;
+    n.Z = Z;
+    n.Size = Size;
+    n.Lod = Lod;
+
+    if (Lod == 0) {
+        int EndX = std::min(X + Size, m_terrainSize - 1);
+        int EndZ = std::min(Z + Size, m_terrainSize - 1);
+
+        n.MinHeight = pTerrain->GetHeight(X, Z);
+        n.MaxHeight = n.MinHeight;
+
+        for (int z = Z ; z <= EndZ ; z++) {
+            for (int x = X ; x <= EndX ; x++) {
+                float Height = pTerrain->GetHeight(x, z);
+                n.MinHeight = std::min(n.MinHeight, Height);
+                n.MaxHeight = std::max(n.MaxHeight, Height);
+            }
+        }
+    } else {
+        int HalfSize = Size / 2;
+        bool First = true;
+
+        for (int i = 0 ; i < 4 ; i++) {
+            int ChildX = X + (i % 2) * HalfSize;
+            int ChildZ = Z + (i / 2) * HalfSize;
+
+            if ((ChildX >= m_terrainSize - 1) || (ChildZ >= m_terrainSize - 1)) {
+                continue;
+            }
+
+            n.Children[i] = CreateNode(pTerrain, ChildX, ChildZ, HalfSize, Lod - 1);
+
+            const Node& Child = m_nodes[n.Children[i]];
+
+            if (First) {
+                n.MinHeight = Child.MinHeight;
+                n.MaxHeight = Child.MaxHeight;
+                First = false;
+            } else {
+                n.MinHeight = std::min(n.MinHeight, Child.MinHeight);
+                n.MaxHeight = std::max(n.MaxHeight, Child.MaxHeight);
+            }
+        }
+    }
+
+    m_nodes[NodeIndex] = n;
+
+    return NodeIndex;
+}
+
+
+void CDLODGrid::CalcLodRanges()
+{
+    m_lodRanges.resize(m_numLods);
+
+    // The top level reaches the far clipping plane and every level below it
+    // covers half the distance of its parent. A node must fit inside the
+    // range of the level above it or the morph would not complete before
+    // the switch, so the ranges never go below twice the node diagonal.
+    float Range = Z_FAR;
+
+    for (int Lod = m_numLods - 1 ; Lod >= 0 ; Lod--) {
+        float NodeSize = (float)(m_leafNodeSize << Lod) * m_worldScale;
+        float MinRange = 2.0f * sqrtf(2.0f) * NodeSize;
+
+        m_lodRanges[Lod].Range = std::max(Range, MinRange);
+        Range /= 2.0f;
+    }
+
+    for (int Lod = 1 ; Lod < m_numLods ; Lod++) {
+        m_lodRanges[Lod].Range = std::max(m_lodRanges[Lod].Range, m_lodRanges[Lod - 1].Range);
+    }
+
+    float PrevRange = 0.0f;
+
+    for (int Lod = 0 ; Lod < m_numLods ; Lod++) {
+        float LodRange = m_lodRanges[Lod].Range;
+        m_lodRanges[Lod].MorphEnd = LodRange;
+        m_lodRanges[Lod].MorphStart = PrevRange + (LodRange - PrevRange) * MORPH_START_RATIO;
+        PrevRange = LodRange;
+    }
+}
+
+
+void CDLODGrid::CreateGLState()
+{
+    glGenVertexArrays(1, &m_vao);
+
+    glBindVertexArray(m_vao);
+
+    glGenBuffers(1, &m_vb);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+
+    glGenBuffers(1, &m_ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+
+    int GRID_POS_LOC = 0;
+    int NODE_INSTANCE_LOC = 3;
+
+    glEnableVertexAttribArray(GRID_POS_LOC);
+    glVertexAttribPointer(GRID_POS_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(Vector2f), (const void*)0);
+
+    glGenBuffers(1, &m_instanceBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(NodeInstance) * m_nodes.size(), NULL, GL_STREAM_DRAW);
+
+    glEnableVertexAttribArray(NODE_INSTANCE_LOC);
+    glVertexAttribPointer(NODE_INSTANCE_LOC, 4, GL_FLOAT, GL_FALSE, sizeof(NodeInstance), (const void*)0);
+    glVertexAttribDivisor(NODE_INSTANCE_LOC, 1);
+}
+
+
+void CDLODGrid::PopulateGridBuffers()
+{
+    int NumVerticesPerSide = m_leafNodeSize + 1;
+
+    std::vector<Vector2f> Vertices(NumVerticesPerSide * NumVerticesPerSide);
+
+    int Index = 0;
+
+    for (int z = 0 ; z < NumVerticesPerSide ; z++) {
+        for (int x = 0 ; x < NumVerticesPerSide ; x++) {
+            Vertices[Index++] = Vector2f((float)x, (float)z);
+        }
+    }
+
+    std::vector<uint> Indices;
+    Indices.reserve(m_leafNodeSize * m_leafNodeSize * 6);
+
+    // same winding as TriangleList
+    for (int z = 0 ; z < m_leafNodeSize ; z++) {
+        for (int x = 0 ; x < m_leafNodeSize ; x++) {
+            uint IndexBottomLeft = z * NumVerticesPerSide + x;
+            uint IndexTopLeft = (z + 1) * NumVerticesPerSide + x;
+            uint IndexTopRight = (z + 1) * NumVerticesPerSide + x + 1;
+            uint IndexBottomRight = z * NumVerticesPerSide + x + 1;
+
+            Indices.push_back(IndexBottomLeft);
+            Indices.push_back(IndexTopLeft);
+            Indices.push_back(IndexTopRight);
+
+            Indices.push_back(IndexBottomLeft);
+            Indices.push_back(IndexTopRight);
+            Indices.push_back(IndexBottomRight);
+        }
+    }
+
+    m_numIndices = (int)Indices.size();
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_vb);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices[0]) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
+
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+}
+
+
+void CDLODGrid::CreateHeightMapTexture(const BaseTerrain* pTerrain)
+{
+    std::vector<float> Heights(m_terrainSize * m_terrainSize);
+
+    for (int z = 0 ; z < m_terrainSize ; z++) {
+        for (int x = 0 ; x < m_terrainSize ; x++) {
+            Heights[z * m_terrainSize + x] = pTerrain->GetHeight(x, z);
+        }
+    }
+
+    glGenTextures(1, &m_heightMap);
+    glBindTexture(GL_TEXTURE_2D, m_heightMap);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, m_terrainSize, m_terrainSize, 0, GL_RED, GL_FLOAT, &Heights[0]);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void CDLODGrid::GetNodeBox(const Node& n, Vector3f& Min, Vector3f& Max) const
+{
+    float MaxCoord = (float)(m_terrainSize - 1);
+
+    Min = Vector3f((float)n.X * m_worldScale, n.MinHeight, (float)n.Z * m_worldScale);
+    Max = Vector3f(std::min((float)(n.X + n.Size), MaxCoord) * m_worldScale,
+                   n.MaxHeight,
+                   std::min((float)(n.Z + n.Size), MaxCoord) * m_worldScale);
+}
+
+
+bool CDLODGrid::IsNodeInRange(const Node& n, const Vector3f& CameraPos, float Range) const
+{
+    Vector3f Min, Max;
+    GetNodeBox(n, Min, Max);
+
+    // distance from the camera to the closest point of the box
+    float dx = std::max(std::max(Min.x - CameraPos.x, 0.0f), CameraPos.x - Max.x);
+    float dy = std::max(std::max(Min.y - CameraPos.y, 0.0f), CameraPos.y - Max.y);
+    float dz = std::max(std::max(Min.z - CameraPos.z, 0.0f), CameraPos.z - Max.z);
+
+    return (dx * dx + dy * dy + dz * dz) <= Range * Range;
+}
+
+
+void CDLODGrid::AddSelectedNode(const Node& n)
+{
+    NodeInstance Instance;
+    Instance.OffsetX = (float)n.X;
+    Instance.OffsetZ = (float)n.Z;
+    Instance.Scale = (float)(1 << n.Lod);
+    Instance.Lod = (float)n.Lod;
+    m_selectedNodes.push_back(Instance);
+}
+
+
+// Returns true if the area of the node has been handled (either selected
+// or culled) and false if it is out of the range of its level. In the
+// second case the parent takes care of it.
+bool CDLODGrid::SelectNode(int NodeIndex, const Vector3f& CameraPos, const FrustumCulling& FC)
+{
+    const Node& n = m_nodes[NodeIndex];
+
+    if (!IsNodeInRange(n, CameraPos, m_lodRanges[n.Lod].Range)) {
+        return false;
+    }
+
+    Vector3f Min, Max;
+    GetNodeBox(n, Min, Max);
+
+    if (!FC.IsBoxInsideViewFrustum(Min, Max)) {
+        return true;
+    }
+
+    if ((n.Lod == 0) || !IsNodeInRange(n, CameraPos, m_lodRanges[n.Lod - 1].Range)) {
+        AddSelectedNode(n);
+        return true;
+    }
+
+    for (int i = 0 ; i < 4 ; i++) {
+        int ChildIndex = n.Children[i];
+
+        if (ChildIndex == -1) {
+            continue;
+        }
+
+        // A child which is out of its own range is drawn at its own level
+        // but it is beyond the morph end of that level so it is fully
+        // morphed into the grid of this node.
+        if (!SelectNode(ChildIndex, CameraPos, FC)) {
+            Vector3f ChildMin, ChildMax;
+            GetNodeBox(m_nodes[ChildIndex], ChildMin, ChildMax);
+
+            if (FC.IsBoxInsideViewFrustum(ChildMin, ChildMax)) {
+                AddSelectedNode(m_nodes[ChildIndex]);
+            }
+        }
+    }
+
+    return true;
+}
+
+
+void CDLODGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+{
+    FrustumCulling fc(ViewProj);
+
+    m_selectedNodes.clear();
+
+    if (!m_nodes.empty()) {
+        SelectNode(0, CameraPos, fc);
+    }
+
+    if (m_selectedNodes.empty()) {
+        return;
+    }
+
+    glBindVertexArray(m_vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(NodeInstance) * m_selectedNodes.size(), &m_selectedNodes[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    glActiveTexture(HEIGHT_MAP_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_heightMap);
+
+    glDrawElementsInstanced(GL_TRIANGLES, m_numIndices, GL_UNSIGNED_INT, NULL, (GLsizei)m_selectedNodes.size());
+
+    glBindVertexArray(0);
+}
@@ -0,0 +1,119 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef CDLOD_GRID_H
+#define CDLOD_GRID_H
+
+#include <GL/glew.h>
+#include <vector>
+
+#include "ogldev_math_3d.h"
+#include "cdlod_technique.h"
+
+class BaseTerrain;
+
+// Continuous distance-dependent LOD. The terrain is covered by a quadtree
+// whose leaves are LeafNodeSize x LeafNodeSize quads. Every frame the tree
+// is traversed and the nodes are selected by distance ranges that double
+// with each level. All the selected nodes are drawn using a single grid
+// mesh and one instanced draw call. The per instance data is the offset
+// and the scale of the node and the vertex shader morphs the vertices of
+// a node into the grid of its parent when it approaches the end of its range.
+class CDLODGrid {
+ public:
+    CDLODGrid() {}
+
+    ~CDLODGrid();
+
+    void CreateCDLODGrid(int TerrainSize, int LeafNodeSize, const BaseTerrain* pTerrain);
+
+    void Destroy();
+
+    // CDLODTechnique must be enabled by the caller
+    void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
+    int GetNumLods() const { return m_numLods; }
+
+    float GetMorphStart(int Lod) const { return m_lodRanges[Lod].MorphStart; }
+
+    float GetMorphEnd(int Lod) const { return m_lodRanges[Lod].MorphEnd; }
+
+    // number of nodes drawn by the last call to Render
+    int GetNumSelectedNodes() const { return (int)m_selectedNodes.size(); }
+
+ private:
+
+    struct Node {
+        int X = 0;                  // in heightmap samples
+        int Z = 0;
+        int Size = 0;
+        int Lod = 0;                // 0 is the finest level
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        int Children[4] = { -1, -1, -1, -1 };
+    };
+
+    struct LodRange {
+        float Range = 0.0f;
+        float MorphStart = 0.0f;
+        float MorphEnd = 0.0f;
+    };
+
+    struct NodeInstance {
+        float OffsetX = 0.0f;
+        float OffsetZ = 0.0f;
+        float Scale = 1.0f;
+        float Lod = 0.0f;
+    };
+
+    void CreateGLState();
+
+    void CreateHeightMapTexture(const BaseTerrain* pTerrain);
+
+    void PopulateGridBuffers();
+
+    int CreateNode(const BaseTerrain* pTerrain, int X, int Z, int Size, int Lod);
+
+    void CalcLodRanges();
+
+    bool SelectNode(int NodeIndex, const Vector3f& CameraPos, const FrustumCulling& FC);
+
+    void AddSelectedNode(const Node& n);
+
+    void GetNodeBox(const Node& n, Vector3f& Min, Vector3f& Max) const;
+
+    bool IsNodeInRange(const Node& n, const Vector3f& CameraPos, float Range) const;
+
+    int m_terrainSize = 0;
+    int m_leafNodeSize = 0;
+    int m_numLods = 0;
+    float m_worldScale = 1.0f;
+    GLuint m_vao = 0;
+    GLuint m_vb = 0;
+    GLuint m_ib = 0;
+    GLuint m_instanceBuffer = 0;
+    GLuint m_heightMap = 0;
+    int m_numIndices = 0;
+
+    std::vector<Node> m_nodes;
+    std::vector<LodRange> m_lodRanges;
+    std::vector<NodeInstance> m_selectedNodes;
+};
+
+#endif
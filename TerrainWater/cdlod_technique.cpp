@@ -0,0 +1,87 @@
+/*
+    Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ogldev_util.h"
+#include "cdlod_technique.h"
+#include "texture_config.h"
+
+
+CDLODTechnique::CDLODTechnique() : TerrainTechnique("cdlod_terrain.vs")
+{
+}
+
+bool CDLODTechnique::Init()
+{
+    if (!TerrainTechnique::Init()) {
+        return false;
+    }
+
+    m_heightMapLoc = GetUniformLocation("gHeightMap");
+    m_cameraPosLoc = GetUniformLocation("gCameraPos");
+    m_worldScaleLoc = GetUniformLocation("gWorldScale");
+    m_textureScaleLoc = GetUniformLocation("gTextureScale");
+
+    if (m_heightMapLoc == INVALID_UNIFORM_LOCATION ||
+        m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
+        m_worldScaleLoc == INVALID_UNIFORM_LOCATION ||
+        m_textureScaleLoc == INVALID_UNIFORM_LOCATION) {
+        return false;
+    }
+
+    for (int i = 0 ; i < CDLOD_MAX_LODS ; i++) {
+        char Name[128];
+        SNPRINTF(Name, sizeof(Name), "gMorphConsts[%d]", i);
+        m_morphConstsLoc[i] = GetUniformLocation(Name);
+
+        if (m_morphConstsLoc[i] == INVALID_UNIFORM_LOCATION) {
+            return false;
+        }
+    }
+
+    Enable();
+
+    glUniform1i(m_heightMapLoc, HEIGHT_MAP_TEXTURE_UNIT_INDEX);
+
+    glUseProgram(0);
+
+    return true;
+}
+
+
+void CDLODTechnique::SetCameraPos(const Vector3f& CameraPos)
+{
+    glUniform3f(m_cameraPosLoc, CameraPos.x, CameraPos.y, CameraPos.z);
+}
+
+
+void CDLODTechnique::SetWorldScale(float WorldScale)
+{
+    glUniform1f(m_worldScaleLoc, WorldScale);
+}
+
+
+void CDLODTechnique::SetTextureScale(float TextureScale)
+{
+    glUniform1f(m_textureScaleLoc, TextureScale);
+}
+
+
+void CDLODTechnique::SetMorphConsts(int Lod, float MorphStart, float MorphEnd)
+{
+    assert(Lod < CDLOD_MAX_LODS);
+    glUniform2f(m_morphConstsLoc[Lod], MorphStart, MorphEnd);
+}
@@ -0,0 +1,50 @@
+/*
+    Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CDLOD_TECHNIQUE_H
+#define CDLOD_TECHNIQUE_H
+
+#include "terrain_technique.h"
+
+// must match the size of gMorphConsts in cdlod_terrain.vs
+#define CDLOD_MAX_LODS 16
+
+class CDLODTechnique : public TerrainTechnique
+{
+public:
+
+    CDLODTechnique();
+
+    virtual bool Init();
+
+    void SetCameraPos(const Vector3f& CameraPos);
+
+    void SetWorldScale(float WorldScale);
+
+    void SetTextureScale(float TextureScale);
+
+    void SetMorphConsts(int Lod, float MorphStart, float MorphEnd);
+
+private:
+    GLuint m_heightMapLoc = -1;
+    GLuint m_cameraPosLoc = -1;
+    GLuint m_worldScaleLoc = -1;
+    GLuint m_textureScaleLoc = -1;
+    GLuint m_morphConstsLoc[CDLOD_MAX_LODS];
+};
+
+#endif  /* CDLOD_TECHNIQUE_H */
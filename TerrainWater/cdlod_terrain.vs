@@ -0,0 +1,92 @@
+/*
+    Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#version 330
+
+layout (location = 0) in vec2 GridPos;        // vertex of the shared grid mesh in [0, GridSize]
+layout (location = 3) in vec4 NodeInstance;   // x/z offset in the heightmap, scale, lod
+
+uniform mat4 gVP;
+uniform float gMinHeight;
+uniform float gMaxHeight;
+uniform vec4 gClipPlane;
+uniform sampler2D gHeightMap;
+uniform vec3 gCameraPos;
+uniform float gWorldScale;
+uniform float gTextureScale;
+uniform vec2 gMorphConsts[16];                // morph start/end distance per lod
+
+out vec4 Color;
+out vec2 Tex;
+out vec3 WorldPos;
+out vec3 Normal;
+
+float GetHeight(vec2 HeightMapPos)
+{
+    ivec2 Size = textureSize(gHeightMap, 0);
+    ivec2 Coords = clamp(ivec2(HeightMapPos + 0.5), ivec2(0), Size - 1);
+    return texelFetch(gHeightMap, Coords, 0).r;
+}
+
+
+void main()
+{
+    vec2 NodeOffset = NodeInstance.xy;
+    float Scale = NodeInstance.z;
+    int Lod = int(NodeInstance.w);
+
+    vec2 HeightMapPos = NodeOffset + GridPos * Scale;
+
+    vec3 Pos = vec3(HeightMapPos.x * gWorldScale, GetHeight(HeightMapPos), HeightMapPos.y * gWorldScale);
+
+    // Towards the end of its range every odd vertex slides onto its even
+    // neighbor so the node turns into the mesh of the next (coarser) lod.
+    vec2 MorphConsts = gMorphConsts[Lod];
+    float MorphK = clamp((distance(Pos, gCameraPos) - MorphConsts.x) / (MorphConsts.y - MorphConsts.x), 0.0, 1.0);
+    vec2 MorphTarget = HeightMapPos - fract(GridPos * 0.5) * 2.0 * Scale;
+
+    HeightMapPos = mix(HeightMapPos, MorphTarget, MorphK);
+
+    // nodes on the far edges of the quadtree may stick out of the heightmap
+    HeightMapPos = min(HeightMapPos, vec2(textureSize(gHeightMap, 0) - 1));
+    Pos.x = HeightMapPos.x * gWorldScale;
+    Pos.z = HeightMapPos.y * gWorldScale;
+    Pos.y = mix(Pos.y, GetHeight(MorphTarget), MorphK);
+
+    gl_Position = gVP * vec4(Pos, 1.0);
+
+    float DeltaHeight = gMaxHeight - gMinHeight;
+
+    float HeightRatio = (Pos.y - gMinHeight) / DeltaHeight;
+
+    float c = HeightRatio * 0.8 + 0.2;
+
+    Color = vec4(c, c, c, 1.0);
+
+    Tex = gTextureScale * HeightMapPos / vec2(textureSize(gHeightMap, 0));
+
+    WorldPos = Pos;
+
+    float HeightLeft  = GetHeight(HeightMapPos - vec2(1.0, 0.0));
+    float HeightRight = GetHeight(HeightMapPos + vec2(1.0, 0.0));
+    float HeightDown  = GetHeight(HeightMapPos - vec2(0.0, 1.0));
+    float HeightUp    = GetHeight(HeightMapPos + vec2(0.0, 1.0));
+
+    Normal = vec3(HeightLeft - HeightRight, 2.0 * gWorldScale, HeightDown - HeightUp);
+
+    gl_ClipDistance[0] = dot(vec4(Pos, 1.0), gClipPlane);
+}
@@ -23,9 +23,15 @@
 #include "ogldev_math_3d.h"
 #include "geomip_grid.h"
 #include "terrain.h"
+#include "../Common/3rdparty/meshoptimizer/src/meshoptimizer.h"
 
 int gShowPoints = 0;
 
+#define PRIMITIVE_RESTART_INDEX 0xFFFFFFFF
+
+// the size of the post transform cache which is used for the ACMR report
+#define VERTEX_CACHE_SIZE 16
+
 
 GeomipGrid::GeomipGrid()
 {
@@ -91,6 +97,9 @@ void GeomipGrid::CreateGeomipGrid(int Width, int Depth, int PatchSize, const Bas
     m_worldScale = pTerrain->GetWorldScale();
     m_maxLOD = m_lodManager.InitLodManager(PatchSize, m_numPatchesX, m_numPatchesZ, m_worldScale);
     m_lodInfo.resize(m_maxLOD + 1);
+    m_stripLodInfo.resize(m_maxLOD + 1);
+
+    m_horizonCulling.InitHorizonCulling(PatchSize, m_numPatchesX, m_numPatchesZ, m_worldScale, pTerrain);
 
     CreateGLState();
 
@@ -151,9 +160,87 @@ void GeomipGrid::PopulateBuffers(const BaseTerrain* pTerrain)
 
     CalcNormals(Vertices, Indices);
 
+    std::vector<unsigned int> StripIndices;
+    OptimizeIndices(Indices, StripIndices);
+
+    Indices.resize(NumIndices);
+    Indices.insert(Indices.end(), StripIndices.begin(), StripIndices.end());
+
+    for (int lod = 0 ; lod <= m_maxLOD ; lod++) {
+        for (int l = 0 ; l < LEFT ; l++) {
+            for (int r = 0 ; r < RIGHT ; r++) {
+                for (int t = 0 ; t < TOP ; t++) {
+                    for (int b = 0 ; b < BOTTOM ; b++) {
+                        m_stripLodInfo[lod].info[l][r][t][b].Start += NumIndices;
+                    }
+                }
+            }
+        }
+    }
+
     glBufferData(GL_ARRAY_BUFFER, sizeof(Vertices[0]) * Vertices.size(), &Vertices[0], GL_STATIC_DRAW);
 
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * NumIndices, &Indices[0], GL_STATIC_DRAW);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+}
+
+
+// Reorders the triangles of every LOD/stitching permutation for the post
+// transform cache and builds a triangle strip version of it. The vertex
+// buffer is the shared grid of the entire terrain which every patch
+// addresses using a base vertex so the vertices themselves cannot be
+// reordered per patch.
+void GeomipGrid::OptimizeIndices(std::vector<uint>& Indices, std::vector<uint>& StripIndices)
+{
+    // the highest index used by a patch is its top right corner
+    size_t VertexCount = (m_patchSize - 1) * m_width + m_patchSize;
+
+    for (int lod = 0 ; lod <= m_maxLOD ; lod++) {
+        float AcmrBefore = 0.0f;
+        float AcmrList = 0.0f;
+        float AcmrStrip = 0.0f;
+        int NumListIndices = 0;
+        int NumStripIndices = 0;
+
+        for (int l = 0 ; l < LEFT ; l++) {
+            for (int r = 0 ; r < RIGHT ; r++) {
+                for (int t = 0 ; t < TOP ; t++) {
+                    for (int b = 0 ; b < BOTTOM ; b++) {
+                        const SingleLodInfo& ListInfo = m_lodInfo[lod].info[l][r][t][b];
+                        unsigned int* pList = &Indices[ListInfo.Start];
+                        size_t Count = ListInfo.Count;
+
+                        AcmrBefore += meshopt_analyzeVertexCache(pList, Count, VertexCount, VERTEX_CACHE_SIZE, 0, 0).acmr;
+
+                        std::vector<unsigned int> StripOrder(pList, pList + Count);
+
+                        meshopt_optimizeVertexCache(pList, pList, Count, VertexCount);
+                        AcmrList += meshopt_analyzeVertexCache(pList, Count, VertexCount, VERTEX_CACHE_SIZE, 0, 0).acmr;
+
+                        meshopt_optimizeVertexCacheStrip(&StripOrder[0], &StripOrder[0], Count, VertexCount);
+                        std::vector<unsigned int> Strip(meshopt_stripifyBound(Count));
+                        size_t StripCount = meshopt_stripify(&Strip[0], &StripOrder[0], Count, VertexCount, PRIMITIVE_RESTART_INDEX);
+
+                        std::vector<unsigned int> Unstripped(meshopt_unstripifyBound(StripCount));
+                        size_t UnstrippedCount = meshopt_unstripify(&Unstripped[0], &Strip[0], StripCount, PRIMITIVE_RESTART_INDEX);
+                        AcmrStrip += meshopt_analyzeVertexCache(&Unstripped[0], UnstrippedCount, VertexCount, VERTEX_CACHE_SIZE, 0, 0).acmr;
+
+                        m_stripLodInfo[lod].info[l][r][t][b].Start = (int)StripIndices.size();
+                        m_stripLodInfo[lod].info[l][r][t][b].Count = (int)StripCount;
+                        StripIndices.insert(StripIndices.end(), Strip.begin(), Strip.begin() + StripCount);
+
+                        NumListIndices += (int)Count;
+                        NumStripIndices += (int)StripCount;
+                    }
+                }
+            }
+        }
+
+        int NumPermutations = LEFT * RIGHT * TOP * BOTTOM;
+
+        printf("LOD %d: ACMR %.3f --> %.3f (list) %.3f (strip), indices %d (list) --> %d (strip, %.1f%%)\n",
+               lod, AcmrBefore / NumPermutations, AcmrList / NumPermutations, AcmrStrip / NumPermutations,
+               NumListIndices, NumStripIndices, 100.0f * (float)NumStripIndices / (float)NumListIndices);
+    }
 }
 
 
@@ -375,14 +462,50 @@ void GeomipGrid::CalcNormals(std::vector<Vertex>& Vertices, std::vector<uint>& I
 }
 
 
-void GeomipGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+void GeomipGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool WaterPass)
+{
+    RenderPatches(CameraPos, ViewProj, WaterPass, NULL);
+}
+
+
+void GeomipGrid::RenderClipped(const Vector3f& CameraPos, const Matrix4f& ViewProj, const ClipPass& Pass)
 {
-    m_lodManager.Update(CameraPos);
+    RenderPatches(CameraPos, ViewProj, true, &Pass);
+}
+
+
+void GeomipGrid::RenderPatches(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool WaterPass, const ClipPass* pClipPass)
+{
+    int LodBias = m_lodBias + (pClipPass ? pClipPass->LodBias : 0);
+
+    m_lodManager.Update(CameraPos, LodBias);
+
+    // The horizon is built from the whole terrain but the water passes clip
+    // away the part on the other side of the water plane (and the reflection
+    // camera is below it), so it may not act as an occluder there.
+    bool HorizonCulling = m_horizonCullingEnabled && !WaterPass;
+
+    if (HorizonCulling) {
+        m_horizonCulling.Update(CameraPos);
+    }
 
     FrustumCulling fc(ViewProj);
 
+    m_cullingStats = CullingStats();
+    m_cullingStats.NumPatches = m_numPatchesX * m_numPatchesZ;
+
     glBindVertexArray(m_vao);
 
+    GLenum PrimType = GL_TRIANGLES;
+    const std::vector<LodInfo>* pLodInfo = &m_lodInfo;
+
+    if (m_triangleStrips) {
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(PRIMITIVE_RESTART_INDEX);
+        PrimType = GL_TRIANGLE_STRIP;
+        pLodInfo = &m_stripLodInfo;
+    }
+
     if (gShowPoints > 0) {
         glDrawElementsBaseVertex(GL_POINTS, m_lodInfo[0].info[0][0][0][0].Count, GL_UNSIGNED_INT, (void*)0, 0);
     }
@@ -397,7 +520,18 @@ void GeomipGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
                 int x = PatchX * (m_patchSize - 1);
                 int z = PatchZ * (m_patchSize - 1);
             
+                if (pClipPass && IsPatchClipped(PatchX, PatchZ, *pClipPass)) {
+                    m_cullingStats.NumClipCulled++;
+                    continue;
+                }
+
                 if (!IsPatchInsideViewFrustum_WorldSpace(x, z, fc)) {
+                    m_cullingStats.NumFrustumCulled++;
+                    continue;
+                }
+
+                if (HorizonCulling && m_horizonCulling.IsPatchOccluded(PatchX, PatchZ)) {
+                    m_cullingStats.NumHorizonCulled++;
                     continue;
                 }
 
@@ -408,22 +542,41 @@ void GeomipGrid::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
                 int T = plod.Top;
                 int B = plod.Bottom;
 
-                size_t BaseIndex = sizeof(unsigned int) * m_lodInfo[C].info[L][R][T][B].Start;
+                const SingleLodInfo& Info = (*pLodInfo)[C].info[L][R][T][B];
+
+                size_t BaseIndex = sizeof(unsigned int) * Info.Start;
 
                 int BaseVertex = z * m_width + x;
 
-                glDrawElementsBaseVertex(GL_TRIANGLES, m_lodInfo[C].info[L][R][T][B].Count, 
-                                         GL_UNSIGNED_INT, (void*)BaseIndex, BaseVertex);
+                glDrawElementsBaseVertex(PrimType, Info.Count, GL_UNSIGNED_INT, (void*)BaseIndex, BaseVertex);
             }
 
             //printf("\n");
         }
     }
 
+    if (m_triangleStrips) {
+        glDisable(GL_PRIMITIVE_RESTART);
+    }
+
     glBindVertexArray(0);
 }
 
 
+bool GeomipGrid::IsPatchClipped(int PatchX, int PatchZ, const ClipPass& Pass) const
+{
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+    m_horizonCulling.GetPatchHeightRange(PatchX, PatchZ, MinHeight, MaxHeight);
+
+    if (Pass.KeepAbove) {
+        return MaxHeight < Pass.ClipHeight;
+    } else {
+        return MinHeight > Pass.ClipHeight;
+    }
+}
+
+
 bool GeomipGrid::IsPatchInsideViewFrustum_ViewSpace(int X, int Z, const Matrix4f& ViewProj)
 {
     int x0 = X;
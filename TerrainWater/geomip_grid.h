@@ -25,6 +25,7 @@
 
 #include "ogldev_math_3d.h"
 #include "lod_manager.h"
+#include "horizon_culling.h"
 
 // this header is included by terrain.h so we have a forward 
 // declaration for BaseTerrain.
@@ -40,7 +41,41 @@ class GeomipGrid {
 
     void Destroy();
 
-    void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+    // WaterPass is set for the reflection and refraction passes, see RenderPatches
+    void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool WaterPass = false);
+
+    // The water reflection and refraction passes clip the terrain at the
+    // water plane. Patches that lie entirely on the clipped side are skipped
+    // and the rest are drawn LodBias levels coarser than usual.
+    struct ClipPass {
+        float ClipHeight = 0.0f;
+        bool KeepAbove = true;
+        int LodBias = 0;
+    };
+
+    void RenderClipped(const Vector3f& CameraPos, const Matrix4f& ViewProj, const ClipPass& Pass);
+
+    void EnableHorizonCulling(bool Enable) { m_horizonCullingEnabled = Enable; }
+
+    bool IsHorizonCullingEnabled() const { return m_horizonCullingEnabled; }
+
+    // render the patches as triangle strips with primitive restart instead of triangle lists
+    void EnableTriangleStrips(bool Enable) { m_triangleStrips = Enable; }
+
+    bool IsTriangleStripsEnabled() const { return m_triangleStrips; }
+
+    // moves every patch LodBias levels towards the coarsest LOD
+    void SetLodBias(int LodBias) { m_lodBias = LodBias; }
+
+    struct CullingStats {
+        int NumPatches = 0;
+        int NumFrustumCulled = 0;
+        int NumHorizonCulled = 0;
+        int NumClipCulled = 0;
+    };
+
+    // stats of the last call to Render
+    const CullingStats& GetCullingStats() const { return m_cullingStats; }
 
  private:
 
@@ -53,6 +88,10 @@ class GeomipGrid {
     };
 
     void CreateGLState();
+
+    void RenderPatches(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool WaterPass, const ClipPass* pClipPass);
+
+    bool IsPatchClipped(int PatchX, int PatchZ, const ClipPass& Pass) const;
 	
     void PopulateBuffers(const BaseTerrain* pTerrain);
     
@@ -65,6 +104,8 @@ class GeomipGrid {
     int InitIndicesLODSingle(int Index, std::vector<uint>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom);
     
     void CalcNormals(std::vector<Vertex>& Vertices, std::vector<uint>& Indices);
+
+    void OptimizeIndices(std::vector<uint>& Indices, std::vector<uint>& StripIndices);
     
     uint AddTriangle(uint Index, std::vector<uint>& Indices, uint v1, uint v2, uint v3);
     
@@ -100,9 +141,15 @@ class GeomipGrid {
     };
 	
     std::vector<LodInfo> m_lodInfo;
+    std::vector<LodInfo> m_stripLodInfo;    // the strips are stored after the triangle lists
+    bool m_triangleStrips = false;
     int m_numPatchesX = 0;
     int m_numPatchesZ = 0;
     LodManager m_lodManager;
+    int m_lodBias = 0;
+    HorizonCulling m_horizonCulling;
+    bool m_horizonCullingEnabled = true;
+    CullingStats m_cullingStats;
     const BaseTerrain* m_pTerrain = NULL;
 };
 
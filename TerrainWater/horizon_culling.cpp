@@ -0,0 +1,307 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "horizon_culling.h"
+#include "terrain.h"
+
+#define HORIZON_BINS 2048
+
+static const float BinsPerRadian = (float)HORIZON_BINS / (2.0f * (float)M_PI);
+
+
+// The heap keeps the occluder with the smallest max distance at the front
+bool HorizonCulling::OccluderFartherThan(const Occluder& a, const Occluder& b)
+{
+    return a.MaxDist > b.MaxDist;
+}
+
+
+void HorizonCulling::InitHorizonCulling(int PatchSize, int NumPatchesX, int NumPatchesZ, float WorldScale, const BaseTerrain* pTerrain)
+{
+    m_patchSize = PatchSize;
+    m_numPatchesX = NumPatchesX;
+    m_numPatchesZ = NumPatchesZ;
+    m_worldScale = WorldScale;
+    m_pTerrain = pTerrain;
+
+    m_occluded.InitArray2D(NumPatchesX, NumPatchesZ, (char)0);
+    m_horizon.resize(HORIZON_BINS);
+    m_sortedPatches.resize(NumPatchesX * NumPatchesZ);
+    m_pendingOccluders.reserve(NumPatchesX * NumPatchesZ * OCCLUDER_CELLS * OCCLUDER_CELLS);
+
+    CalcHeightRanges();
+}
+
+
+void HorizonCulling::CalcHeightRanges()
+{
+    int CellSize = (m_patchSize - 1) / OCCLUDER_CELLS;
+
+    if (CellSize < 1) {
+        printf("%s: patch size %d is too small for %d occluder cells\n", __FUNCTION__, m_patchSize, OCCLUDER_CELLS);
+        exit(0);
+    }
+
+    HeightRange Zero;
+    m_patchHeights.InitArray2D(m_numPatchesX, m_numPatchesZ, Zero);
+    m_cellHeights.InitArray2D(m_numPatchesX * OCCLUDER_CELLS, m_numPatchesZ * OCCLUDER_CELLS, Zero);
+
+    for (int CellZ = 0 ; CellZ < m_numPatchesZ * OCCLUDER_CELLS ; CellZ++) {
+        for (int CellX = 0 ; CellX < m_numPatchesX * OCCLUDER_CELLS ; CellX++) {
+            int x0 = CellX * CellSize;
+            int z0 = CellZ * CellSize;
+
+            HeightRange Range;
+            Range.Min = Range.Max = m_pTerrain->GetHeight(x0, z0);
+
+            // the cell includes its far border so neighboring cells overlap by one vertex
+            for (int z = z0 ; z <= z0 + CellSize ; z++) {
+                for (int x = x0 ; x <= x0 + CellSize ; x++) {
+                    float Height = m_pTerrain->GetHeight(x, z);
+                    Range.Min = std::min(Range.Min, Height);
+                    Range.Max = std::max(Range.Max, Height);
+                }
+            }
+
+            m_cellHeights.Set(CellX, CellZ, Range);
+
+            HeightRange* pPatchRange = m_patchHeights.GetAddr(CellX / OCCLUDER_CELLS, CellZ / OCCLUDER_CELLS);
+
+            if ((CellX % OCCLUDER_CELLS == 0) && (CellZ % OCCLUDER_CELLS == 0)) {
+                *pPatchRange = Range;
+            } else {
+                pPatchRange->Min = std::min(pPatchRange->Min, Range.Min);
+                pPatchRange->Max = std::max(pPatchRange->Max, Range.Max);
+            }
+        }
+    }
+}
+
+
+void HorizonCulling::Update(const Vector3f& CameraPos)
+{
+    m_numOccluded = 0;
+
+    for (int i = 0 ; i < m_occluded.GetSize() ; i++) {
+        m_occluded.Set(i, 0);
+    }
+
+    // The horizon is only meaningful when looking from above the surface
+    // (e.g. the mirrored camera of the water reflection pass may be underground).
+    float HeightMapX = CameraPos.x / m_worldScale;
+    float HeightMapZ = CameraPos.z / m_worldScale;
+    float TerrainEnd = (float)(m_pTerrain->GetSize() - 1);
+
+    if ((HeightMapX >= 0.0f) && (HeightMapX <= TerrainEnd) && (HeightMapZ >= 0.0f) && (HeightMapZ <= TerrainEnd)) {
+        if (CameraPos.y < m_pTerrain->GetHeightInterpolated(HeightMapX, HeightMapZ)) {
+            return;
+        }
+    }
+
+    std::fill(m_horizon.begin(), m_horizon.end(), -FLT_MAX);
+
+    float PatchWorldSize = (m_patchSize - 1) * m_worldScale;
+
+    int Index = 0;
+
+    for (int PatchZ = 0 ; PatchZ < m_numPatchesZ ; PatchZ++) {
+        for (int PatchX = 0 ; PatchX < m_numPatchesX ; PatchX++) {
+            float x0 = PatchX * PatchWorldSize;
+            float z0 = PatchZ * PatchWorldSize;
+            float MaxDist = 0.0f;
+            PatchDist& pd = m_sortedPatches[Index++];
+            CalcRectDistances(CameraPos, x0, z0, x0 + PatchWorldSize, z0 + PatchWorldSize, pd.MinDist, MaxDist);
+            pd.PatchX = PatchX;
+            pd.PatchZ = PatchZ;
+        }
+    }
+
+    std::sort(m_sortedPatches.begin(), m_sortedPatches.end(),
+              [](const PatchDist& a, const PatchDist& b) { return a.MinDist < b.MinDist; });
+
+    m_pendingOccluders.clear();
+
+    for (int i = 0 ; i < (int)m_sortedPatches.size() ; i++) {
+        const PatchDist& pd = m_sortedPatches[i];
+
+        // An occluder can only hide what lies entirely behind it so it is
+        // written into the horizon once we have passed its far end.
+        while (!m_pendingOccluders.empty() && (m_pendingOccluders.front().MaxDist <= pd.MinDist)) {
+            RasterizeOccluder(m_pendingOccluders.front());
+            std::pop_heap(m_pendingOccluders.begin(), m_pendingOccluders.end(), OccluderFartherThan);
+            m_pendingOccluders.pop_back();
+        }
+
+        if (pd.MinDist > 0.0f) {
+            float x0 = pd.PatchX * PatchWorldSize;
+            float z0 = pd.PatchZ * PatchWorldSize;
+            float x1 = x0 + PatchWorldSize;
+            float z1 = z0 + PatchWorldSize;
+
+            float MinDist = 0.0f, MaxDist = 0.0f;
+            CalcRectDistances(CameraPos, x0, z0, x1, z1, MinDist, MaxDist);
+
+            // the steepest slope any point of the patch can have as seen from the camera
+            float DeltaHeight = m_patchHeights.Get(pd.PatchX, pd.PatchZ).Max - CameraPos.y;
+            float MaxSlope = DeltaHeight / (DeltaHeight > 0.0f ? MinDist : MaxDist);
+
+            float AngleStart = 0.0f, AngleEnd = 0.0f;
+            CalcRectAngles(CameraPos, x0, z0, x1, z1, AngleStart, AngleEnd);
+
+            if (IsRangeBelowHorizon(AngleStart, AngleEnd, MaxSlope)) {
+                // an occluded patch is below the horizon so it cannot raise it either
+                m_occluded.Set(pd.PatchX, pd.PatchZ, 1);
+                m_numOccluded++;
+                continue;
+            }
+        }
+
+        AddPatchOccluders(CameraPos, pd.PatchX, pd.PatchZ);
+    }
+}
+
+
+void HorizonCulling::AddPatchOccluders(const Vector3f& CameraPos, int PatchX, int PatchZ)
+{
+    float CellWorldSize = (m_patchSize - 1) / OCCLUDER_CELLS * m_worldScale;
+
+    for (int j = 0 ; j < OCCLUDER_CELLS ; j++) {
+        for (int i = 0 ; i < OCCLUDER_CELLS ; i++) {
+            int CellX = PatchX * OCCLUDER_CELLS + i;
+            int CellZ = PatchZ * OCCLUDER_CELLS + j;
+
+            float x0 = CellX * CellWorldSize;
+            float z0 = CellZ * CellWorldSize;
+            float x1 = x0 + CellWorldSize;
+            float z1 = z0 + CellWorldSize;
+
+            Occluder occ;
+            CalcRectDistances(CameraPos, x0, z0, x1, z1, occ.MinDist, occ.MaxDist);
+
+            // the cell under the camera covers all directions
+            if (occ.MinDist <= 0.0f) {
+                continue;
+            }
+
+            // The surface crosses every direction the cell covers somewhere inside
+            // the cell, so the horizon there is at least as high as the lowest slope
+            // the cell can produce.
+            float DeltaHeight = m_cellHeights.Get(CellX, CellZ).Min - CameraPos.y;
+            occ.Slope = DeltaHeight / (DeltaHeight > 0.0f ? occ.MaxDist : occ.MinDist);
+
+            CalcRectAngles(CameraPos, x0, z0, x1, z1, occ.AngleStart, occ.AngleEnd);
+
+            m_pendingOccluders.push_back(occ);
+            std::push_heap(m_pendingOccluders.begin(), m_pendingOccluders.end(), OccluderFartherThan);
+        }
+    }
+}
+
+
+void HorizonCulling::CalcRectDistances(const Vector3f& CameraPos, float x0, float z0, float x1, float z1, float& MinDist, float& MaxDist) const
+{
+    float dx = std::max(std::max(x0 - CameraPos.x, CameraPos.x - x1), 0.0f);
+    float dz = std::max(std::max(z0 - CameraPos.z, CameraPos.z - z1), 0.0f);
+    MinDist = sqrtf(dx * dx + dz * dz);
+
+    float FarX = std::max(fabsf(x0 - CameraPos.x), fabsf(x1 - CameraPos.x));
+    float FarZ = std::max(fabsf(z0 - CameraPos.z), fabsf(z1 - CameraPos.z));
+    MaxDist = sqrtf(FarX * FarX + FarZ * FarZ);
+}
+
+
+void HorizonCulling::CalcRectAngles(const Vector3f& CameraPos, float x0, float z0, float x1, float z1, float& AngleStart, float& AngleEnd) const
+{
+    // the camera is outside the rectangle so it covers less than half a circle
+    // around the angle of its center
+    float CenterAngle = atan2f((z0 + z1) * 0.5f - CameraPos.z, (x0 + x1) * 0.5f - CameraPos.x);
+
+    float Corners[4][2] = { { x0, z0 }, { x1, z0 }, { x0, z1 }, { x1, z1 } };
+
+    float MinDelta = 0.0f;
+    float MaxDelta = 0.0f;
+
+    for (int i = 0 ; i < 4 ; i++) {
+        float Angle = atan2f(Corners[i][1] - CameraPos.z, Corners[i][0] - CameraPos.x);
+        float Delta = Angle - CenterAngle;
+
+        if (Delta > (float)M_PI) {
+            Delta -= 2.0f * (float)M_PI;
+        } else if (Delta < -(float)M_PI) {
+            Delta += 2.0f * (float)M_PI;
+        }
+
+        MinDelta = std::min(MinDelta, Delta);
+        MaxDelta = std::max(MaxDelta, Delta);
+    }
+
+    AngleStart = CenterAngle + MinDelta;
+    AngleEnd = CenterAngle + MaxDelta;
+}
+
+
+int HorizonCulling::AngleToBin(float Angle) const
+{
+    int Bin = (int)floorf(Angle * BinsPerRadian) % HORIZON_BINS;
+
+    if (Bin < 0) {
+        Bin += HORIZON_BINS;
+    }
+
+    return Bin;
+}
+
+
+bool HorizonCulling::IsRangeBelowHorizon(float AngleStart, float AngleEnd, float Slope) const
+{
+    // every bin the patch touches, even partially, must hide it
+    int NumBins = (int)floorf(AngleEnd * BinsPerRadian) - (int)floorf(AngleStart * BinsPerRadian) + 1;
+    int Bin = AngleToBin(AngleStart);
+
+    for (int i = 0 ; i < NumBins ; i++) {
+        if (m_horizon[Bin] < Slope) {
+            return false;
+        }
+
+        Bin = (Bin + 1) % HORIZON_BINS;
+    }
+
+    return true;
+}
+
+
+void HorizonCulling::RasterizeOccluder(const Occluder& occ)
+{
+    // only bins which are completely covered by the occluder are raised
+    int FirstBin = (int)ceilf(occ.AngleStart * BinsPerRadian);
+    int LastBin = (int)floorf(occ.AngleEnd * BinsPerRadian) - 1;
+
+    for (int b = FirstBin ; b <= LastBin ; b++) {
+        int Bin = b % HORIZON_BINS;
+
+        if (Bin < 0) {
+            Bin += HORIZON_BINS;
+        }
+
+        m_horizon[Bin] = std::max(m_horizon[Bin], occ.Slope);
+    }
+}
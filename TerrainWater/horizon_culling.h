@@ -0,0 +1,114 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef HORIZON_CULLING_H
+#define HORIZON_CULLING_H
+
+#include <vector>
+
+#include "ogldev_math_3d.h"
+#include "ogldev_array_2d.h"
+
+class BaseTerrain;
+
+// CPU occlusion culling for heightfield patches. The terrain around the
+// camera is swept front to back and its silhouette is accumulated into a
+// 1D horizon buffer indexed by azimuth. Each entry holds the highest
+// elevation slope ((height - camera height) / distance) seen so far in
+// that direction. A patch whose highest possible slope stays below the
+// horizon in every direction it covers cannot be seen and is culled.
+class HorizonCulling {
+ public:
+
+    HorizonCulling() {}
+
+    void InitHorizonCulling(int PatchSize, int NumPatchesX, int NumPatchesZ, float WorldScale, const BaseTerrain* pTerrain);
+
+    void Update(const Vector3f& CameraPos);
+
+    bool IsPatchOccluded(int PatchX, int PatchZ) const { return m_occluded.Get(PatchX, PatchZ) != 0; }
+
+    int GetNumOccluded() const { return m_numOccluded; }
+
+    // the lowest and the highest vertex of the patch
+    void GetPatchHeightRange(int PatchX, int PatchZ, float& MinHeight, float& MaxHeight) const
+    {
+        const HeightRange& Range = m_patchHeights.Get(PatchX, PatchZ);
+        MinHeight = Range.Min;
+        MaxHeight = Range.Max;
+    }
+
+ private:
+
+    // Each patch is split into OCCLUDER_CELLS x OCCLUDER_CELLS cells when it is
+    // written into the horizon so that a ridge is not diluted by the lowest
+    // point of the whole patch.
+    static const int OCCLUDER_CELLS = 4;
+
+    struct HeightRange {
+        float Min = 0.0f;
+        float Max = 0.0f;
+    };
+
+    struct Occluder {
+        float MinDist = 0.0f;
+        float MaxDist = 0.0f;
+        float Slope = 0.0f;
+        float AngleStart = 0.0f;
+        float AngleEnd = 0.0f;
+    };
+
+    struct PatchDist {
+        float MinDist = 0.0f;
+        int PatchX = 0;
+        int PatchZ = 0;
+    };
+
+    static bool OccluderFartherThan(const Occluder& a, const Occluder& b);
+
+    void CalcHeightRanges();
+
+    void CalcRectDistances(const Vector3f& CameraPos, float x0, float z0, float x1, float z1, float& MinDist, float& MaxDist) const;
+
+    void CalcRectAngles(const Vector3f& CameraPos, float x0, float z0, float x1, float z1, float& AngleStart, float& AngleEnd) const;
+
+    bool IsRangeBelowHorizon(float AngleStart, float AngleEnd, float Slope) const;
+
+    void RasterizeOccluder(const Occluder& occ);
+
+    void AddPatchOccluders(const Vector3f& CameraPos, int PatchX, int PatchZ);
+
+    int AngleToBin(float Angle) const;
+
+    int m_patchSize = 0;
+    int m_numPatchesX = 0;
+    int m_numPatchesZ = 0;
+    float m_worldScale = 1.0f;
+    const BaseTerrain* m_pTerrain = NULL;
+
+    Array2D<HeightRange> m_patchHeights;
+    Array2D<HeightRange> m_cellHeights;
+    Array2D<char> m_occluded;
+    std::vector<float> m_horizon;
+    std::vector<PatchDist> m_sortedPatches;
+    std::vector<Occluder> m_pendingOccluders;
+    int m_numOccluded = 0;
+};
+
+#endif
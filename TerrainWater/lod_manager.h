@@ -11,7 +11,8 @@ class LodManager {
 
     int InitLodManager(int PatchSize, int NumPatchesX, int NumPatchesZ, float WorldScale);
 
-    void Update(const Vector3f& CameraPos);
+    // LodBias moves every patch that many levels towards the coarsest LOD
+    void Update(const Vector3f& CameraPos, int LodBias = 0);
 
     struct PatchLod {
         int Core   = 0;
@@ -28,7 +29,7 @@ class LodManager {
  private:
     void CalcLodRegions();
     void CalcMaxLOD();
-    void UpdateLodMapPass1(const Vector3f& CameraPos);
+    void UpdateLodMapPass1(const Vector3f& CameraPos, int LodBias);
     void UpdateLodMapPass2(const Vector3f& CameraPos);
 
     int DistanceToLod(float Distance);
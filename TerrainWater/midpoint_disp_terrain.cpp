@@ -16,9 +16,15 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <thread>
+#include <string.h>
+
 #include "midpoint_disp_terrain.h"
+#include "tiled_midpoint_disp.h"
+#include "ogldev_artifact_cache.h"
 
-void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchSize, float Roughness, float MinHeight, float MaxHeight)
+void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchSize, float Roughness, float MinHeight, float MaxHeight,
+                                                     unsigned int Seed)
 {
     if (Roughness < 0.0f) {
         printf("%s: roughness must be positive - %f\n", __FUNCTION__, Roughness);
@@ -30,16 +36,63 @@ void MidpointDispTerrain::CreateMidpointDisplacement(int TerrainSize, int PatchS
 
     SetMinMaxHeight(MinHeight, MaxHeight);
 
-    m_heightMap.InitArray2D(TerrainSize, TerrainSize, 0.0f);
+    ArtifactKey Key("midpoint_disp");
+    Key.Add(TerrainSize).Add(Roughness).Add(MinHeight).Add(MaxHeight).Add(Seed);
+
+    size_t Size = (size_t)TerrainSize * TerrainSize * sizeof(float);
+
+    std::vector<unsigned char> Heights;
+
+    srand(Seed);
+
+    GetArtifactCache().GetArtifact(Key, Heights, [&](std::vector<unsigned char>& Data) {
+        m_heightMap.InitArray2D(TerrainSize, TerrainSize, 0.0f);
+
+        CreateMidpointDisplacementF32(Roughness);
 
-    CreateMidpointDisplacementF32(Roughness);
+        m_heightMap.Normalize(MinHeight, MaxHeight);
 
-    m_heightMap.Normalize(MinHeight, MaxHeight);
+        Data.resize(Size);
+        memcpy(&Data[0], m_heightMap.GetBaseAddr(), Size);
+    }, Size);
+
+    // the generator used the sequence only on a miss so restart it for the
+    // rest of the program to see the same numbers either way
+    srand(Seed);
+
+    // on a hit the heightmap still needs to be filled from the cached data
+    m_heightMap.InitArray2D(TerrainSize, TerrainSize);
+    memcpy(m_heightMap.GetBaseAddr(), &Heights[0], Size);
 
     Finalize();    
 }
 
 
+void MidpointDispTerrain::CreateMidpointDisplacementTiled(const char* pFilename, int NumTilesPerSide, int TileSize, int PatchSize,
+                                                          float Roughness, float MinHeight, float MaxHeight)
+{
+    m_terrainSize = NumTilesPerSide * TileSize + 1;
+    m_patchSize = PatchSize;
+
+    SetMinMaxHeight(MinHeight, MaxHeight);
+
+    TiledMidpointDisp Generator;
+
+    int NumThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    if (!Generator.CreateTiledMidpointDisplacement(pFilename, NumTilesPerSide, TileSize, Roughness,
+                                                   MinHeight, MaxHeight, (unsigned int)rand(), NumThreads)) {
+        exit(0);
+    }
+
+    if (!TiledHeightMapFile::Load(pFilename, m_heightMap)) {
+        exit(0);
+    }
+
+    Finalize();
+}
+
+
 void MidpointDispTerrain::CreateMidpointDisplacementF32(float Roughness)
 {
     int RectSize = CalcNextPowerOfTwo(m_terrainSize);
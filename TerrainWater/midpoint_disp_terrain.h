@@ -27,7 +27,12 @@ class MidpointDispTerrain : public BaseTerrain {
  public:
     MidpointDispTerrain() {}
 
-    void CreateMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight);
+    // the heightmap is taken from the artifact cache when it was already generated with the same parameters and seed
+    void CreateMidpointDisplacement(int Size, int PatchSize, float Roughness, float MinHeight, float MaxHeight, unsigned int Seed);
+
+    // generates the heightmap tile by tile into pFilename using TiledMidpointDisp and loads it
+    void CreateMidpointDisplacementTiled(const char* pFilename, int NumTilesPerSide, int TileSize, int PatchSize,
+                                         float Roughness, float MinHeight, float MaxHeight);
 
  private:
     void CreateMidpointDisplacementF32(float Roughness);
@@ -0,0 +1,547 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <random>
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCEAN_FFT_USE_SSE
+#include <emmintrin.h>
+#endif
+
+#include "ogldev_util.h"
+#include "ocean_fft.h"
+
+#define GRAVITY 9.81f
+
+// the three complex fields that go through the inverse FFT
+#define FIELD_HEIGHT_SLOPE_X    0
+#define FIELD_DISPLACEMENT_XZ   1
+#define FIELD_SLOPE_Z           2
+#define NUM_FIELDS              3
+
+
+static bool IsPowerOfTwo(int x)
+{
+    return (x > 0) && ((x & (x - 1)) == 0);
+}
+
+
+OceanFFT::~OceanFFT()
+{
+    Destroy();
+}
+
+
+bool OceanFFT::InitOcean(const OceanParams& Params, int NumThreads)
+{
+    if (!IsPowerOfTwo(Params.GridSize) || (Params.GridSize < 4)) {
+        printf("%s:%d: ocean grid size must be a power of two (%d)\n", __FILE__, __LINE__, Params.GridSize);
+        return false;
+    }
+
+    if (Params.PatchSize <= 0.0f) {
+        printf("%s:%d: invalid ocean patch size %f\n", __FILE__, __LINE__, Params.PatchSize);
+        return false;
+    }
+
+    Destroy();
+
+    m_params = Params;
+
+    InitSpectrum();
+    InitFFT();
+
+    int N = m_params.GridSize;
+
+    for (int i = 0 ; i < 2 ; i++) {
+        m_fields[i].Displacement.resize(N * N);
+        m_fields[i].Normals.resize(N * N);
+    }
+
+    m_simQuit = false;
+    m_stepDone = true;
+    m_stepRequested = false;
+
+    // the calling thread takes part in every ParallelFor so it counts as one of the threads
+    m_pool.Start(std::max(NumThreads, 1));
+
+    printf("Ocean FFT: grid %dx%d, patch size %.1f, %d threads\n", N, N, m_params.PatchSize, m_pool.GetNumThreads());
+
+    return true;
+}
+
+
+void OceanFFT::Destroy()
+{
+    // the simulation thread is stopped first because a step in progress still needs the workers
+    {
+        std::lock_guard<std::mutex> Lock(m_simMutex);
+        m_simQuit = true;
+    }
+
+    m_simCond.notify_all();
+
+    if (m_simThread.joinable()) {
+        m_simThread.join();
+    }
+
+    m_pool.Stop();
+}
+
+
+// Phillips spectrum
+static float Phillips(float kx, float kz, const Vector2f& WindDir, float WindSpeed, float Amplitude)
+{
+    float k2 = kx * kx + kz * kz;
+
+    if (k2 < 1e-12f) {
+        return 0.0f;
+    }
+
+    float L = WindSpeed * WindSpeed / GRAVITY;   // largest wave arising from the wind
+    float k = sqrtf(k2);
+    float KDotW = (kx * WindDir.x + kz * WindDir.y) / k;
+    float P = Amplitude * expf(-1.0f / (k2 * L * L)) / (k2 * k2) * KDotW * KDotW;
+
+    // waves moving against the wind are damped
+    if (KDotW < 0.0f) {
+        P *= 0.07f;
+    }
+
+    // suppress the very small waves
+    float l = L * 0.001f;
+    P *= expf(-k2 * l * l);
+
+    return P;
+}
+
+
+void OceanFFT::InitSpectrum()
+{
+    int N = m_params.GridSize;
+
+    m_h0Real.resize(N * N);
+    m_h0Imag.resize(N * N);
+    m_h0ConjRealNeg.resize(N * N);
+    m_h0ConjImagNeg.resize(N * N);
+    m_omega.resize(N * N);
+    m_kx.resize(N * N);
+    m_kz.resize(N * N);
+
+    Vector2f WindDir = m_params.WindDir;
+    WindDir.Normalize();
+
+    std::mt19937 Generator(m_params.Seed);
+    std::normal_distribution<float> Gaussian(0.0f, 1.0f);
+
+    // h0(k) is needed at both k and -k so it is calculated for the whole grid first
+    std::vector<float> h0Real(N * N), h0Imag(N * N);
+
+    float dk = 2.0f * (float)M_PI / m_params.PatchSize;
+
+    for (int z = 0 ; z < N ; z++) {
+        for (int x = 0 ; x < N ; x++) {
+            int Index = z * N + x;
+            float kx = 2.0f * (float)M_PI * (float)(x - N / 2) / m_params.PatchSize;
+            float kz = 2.0f * (float)M_PI * (float)(z - N / 2) / m_params.PatchSize;
+
+            m_kx[Index] = kx;
+            m_kz[Index] = kz;
+            m_omega[Index] = sqrtf(GRAVITY * sqrtf(kx * kx + kz * kz));
+
+            // The derivatives at the Nyquist frequency do not have a matching -k
+            // so the row and the column at -N/2 are left out. Multiplying by dk
+            // makes the wave heights independent of the grid resolution.
+            float Scale = 0.0f;
+
+            if ((x > 0) && (z > 0)) {
+                Scale = sqrtf(Phillips(kx, kz, WindDir, m_params.WindSpeed, m_params.Amplitude) * 0.5f) * dk;
+            }
+
+            float GaussReal = Gaussian(Generator);
+            float GaussImag = Gaussian(Generator);
+            h0Real[Index] = GaussReal * Scale;
+            h0Imag[Index] = GaussImag * Scale;
+        }
+    }
+
+    for (int z = 0 ; z < N ; z++) {
+        for (int x = 0 ; x < N ; x++) {
+            int Index = z * N + x;
+            // -k wraps around the grid; the row and the column at -N/2 map to themselves
+            int NegX = (N - x) % N;
+            int NegZ = (N - z) % N;
+            int NegIndex = NegZ * N + NegX;
+
+            m_h0Real[Index] = h0Real[Index];
+            m_h0Imag[Index] = h0Imag[Index];
+            m_h0ConjRealNeg[Index] = h0Real[NegIndex];
+            m_h0ConjImagNeg[Index] = -h0Imag[NegIndex];
+        }
+    }
+}
+
+
+void OceanFFT::InitFFT()
+{
+    int N = m_params.GridSize;
+
+    int LogN = 0;
+
+    while ((1 << LogN) < N) {
+        LogN++;
+    }
+
+    m_bitReverse.resize(N);
+
+    for (int i = 0 ; i < N ; i++) {
+        int r = 0;
+
+        for (int b = 0 ; b < LogN ; b++) {
+            if (i & (1 << b)) {
+                r |= 1 << (LogN - 1 - b);
+            }
+        }
+
+        m_bitReverse[i] = r;
+    }
+
+    // e^(2*pi*i*k/N) - positive exponent for the inverse transform
+    m_twiddleReal.resize(N / 2);
+    m_twiddleImag.resize(N / 2);
+
+    for (int k = 0 ; k < N / 2 ; k++) {
+        double Angle = 2.0 * M_PI * (double)k / (double)N;
+        m_twiddleReal[k] = (float)cos(Angle);
+        m_twiddleImag[k] = (float)sin(Angle);
+    }
+
+    for (int i = 0 ; i < NUM_FIELDS ; i++) {
+        m_real[i].resize(N * N);
+        m_imag[i].resize(N * N);
+    }
+
+    m_tempReal.resize(N * N);
+    m_tempImag.resize(N * N);
+}
+
+
+// h(k, t) = h0(k) * e^(i*w*t) + conj(h0(-k)) * e^(-i*w*t)
+void OceanFFT::CalcSpectrum(float Time, int StartRow, int EndRow)
+{
+    int N = m_params.GridSize;
+
+    float* pHSxReal = &m_real[FIELD_HEIGHT_SLOPE_X][0];
+    float* pHSxImag = &m_imag[FIELD_HEIGHT_SLOPE_X][0];
+    float* pDReal = &m_real[FIELD_DISPLACEMENT_XZ][0];
+    float* pDImag = &m_imag[FIELD_DISPLACEMENT_XZ][0];
+    float* pSzReal = &m_real[FIELD_SLOPE_Z][0];
+    float* pSzImag = &m_imag[FIELD_SLOPE_Z][0];
+
+    for (int Index = StartRow * N ; Index < EndRow * N ; Index++) {
+        float WT = m_omega[Index] * Time;
+        float c = cosf(WT);
+        float s = sinf(WT);
+
+        float hReal = (m_h0Real[Index] + m_h0ConjRealNeg[Index]) * c - (m_h0Imag[Index] - m_h0ConjImagNeg[Index]) * s;
+        float hImag = (m_h0Imag[Index] + m_h0ConjImagNeg[Index]) * c + (m_h0Real[Index] - m_h0ConjRealNeg[Index]) * s;
+
+        float kx = m_kx[Index];
+        float kz = m_kz[Index];
+        float k = sqrtf(kx * kx + kz * kz);
+        float kxNorm = (k > 1e-6f) ? kx / k : 0.0f;
+        float kzNorm = (k > 1e-6f) ? kz / k : 0.0f;
+
+        // The spatial fields are real so two of them can share one complex
+        // transform - A + i*B goes in and the real and the imaginary parts
+        // come out.
+        //   slope x = i*kx*h
+        //   displacement x = -i*kx/k*h, displacement z = -i*kz/k*h
+        //   slope z = i*kz*h
+        float SxReal = -kx * hImag;
+        float SxImag = kx * hReal;
+        pHSxReal[Index] = hReal - SxImag;
+        pHSxImag[Index] = hImag + SxReal;
+
+        float DxReal = kxNorm * hImag;
+        float DxImag = -kxNorm * hReal;
+        float DzReal = kzNorm * hImag;
+        float DzImag = -kzNorm * hReal;
+        pDReal[Index] = DxReal - DzImag;
+        pDImag[Index] = DxImag + DzReal;
+
+        pSzReal[Index] = -kz * hImag;
+        pSzImag[Index] = kz * hReal;
+    }
+}
+
+
+// In place radix-2 inverse FFT of the columns [StartCol, EndCol) of an NxN
+// row major grid. Every butterfly works on two whole rows so consecutive
+// columns are processed together.
+void OceanFFT::FFTColumns(float* pReal, float* pImag, int StartCol, int EndCol) const
+{
+    int N = m_params.GridSize;
+
+    for (int Row = 0 ; Row < N ; Row++) {
+        int RevRow = m_bitReverse[Row];
+
+        if (RevRow > Row) {
+            float* pReal0 = pReal + Row * N;
+            float* pImag0 = pImag + Row * N;
+            float* pReal1 = pReal + RevRow * N;
+            float* pImag1 = pImag + RevRow * N;
+
+            for (int Col = StartCol ; Col < EndCol ; Col++) {
+                float t = pReal0[Col]; pReal0[Col] = pReal1[Col]; pReal1[Col] = t;
+                t = pImag0[Col]; pImag0[Col] = pImag1[Col]; pImag1[Col] = t;
+            }
+        }
+    }
+
+    for (int Half = 1 ; Half < N ; Half *= 2) {
+        int TwiddleStep = N / (2 * Half);
+
+        for (int Block = 0 ; Block < N ; Block += 2 * Half) {
+            for (int j = 0 ; j < Half ; j++) {
+                float wReal = m_twiddleReal[j * TwiddleStep];
+                float wImag = m_twiddleImag[j * TwiddleStep];
+
+                float* pReal0 = pReal + (Block + j) * N;
+                float* pImag0 = pImag + (Block + j) * N;
+                float* pReal1 = pReal + (Block + j + Half) * N;
+                float* pImag1 = pImag + (Block + j + Half) * N;
+
+                int Col = StartCol;
+
+#ifdef OCEAN_FFT_USE_SSE
+                __m128 wr = _mm_set1_ps(wReal);
+                __m128 wi = _mm_set1_ps(wImag);
+
+                for ( ; Col + 4 <= EndCol ; Col += 4) {
+                    __m128 ar = _mm_loadu_ps(pReal0 + Col);
+                    __m128 ai = _mm_loadu_ps(pImag0 + Col);
+                    __m128 br = _mm_loadu_ps(pReal1 + Col);
+                    __m128 bi = _mm_loadu_ps(pImag1 + Col);
+
+                    __m128 tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+                    __m128 ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+
+                    _mm_storeu_ps(pReal1 + Col, _mm_sub_ps(ar, tr));
+                    _mm_storeu_ps(pImag1 + Col, _mm_sub_ps(ai, ti));
+                    _mm_storeu_ps(pReal0 + Col, _mm_add_ps(ar, tr));
+                    _mm_storeu_ps(pImag0 + Col, _mm_add_ps(ai, ti));
+                }
+#endif
+
+                for ( ; Col < EndCol ; Col++) {
+                    float tr = pReal1[Col] * wReal - pImag1[Col] * wImag;
+                    float ti = pReal1[Col] * wImag + pImag1[Col] * wReal;
+
+                    pReal1[Col] = pReal0[Col] - tr;
+                    pImag1[Col] = pImag0[Col] - ti;
+                    pReal0[Col] += tr;
+                    pImag0[Col] += ti;
+                }
+            }
+        }
+    }
+}
+
+
+void OceanFFT::Transpose(const float* pSrc, float* pDst, int StartRow, int EndRow) const
+{
+    int N = m_params.GridSize;
+
+    // small tiles keep both the source rows and the destination rows in the cache
+    const int TILE = 16;
+
+    for (int RowTile = StartRow ; RowTile < EndRow ; RowTile += TILE) {
+        int RowEnd = std::min(RowTile + TILE, EndRow);
+
+        for (int ColTile = 0 ; ColTile < N ; ColTile += TILE) {
+            int ColEnd = std::min(ColTile + TILE, N);
+
+            for (int Row = RowTile ; Row < RowEnd ; Row++) {
+                for (int Col = ColTile ; Col < ColEnd ; Col++) {
+                    pDst[Row * N + Col] = pSrc[Col * N + Row];
+                }
+            }
+        }
+    }
+}
+
+
+// Columns first, then a transpose and the columns again. The result is left
+// transposed - element (x, z) ends up at x * N + z.
+void OceanFFT::InverseFFT2D(std::vector<float>& Real, std::vector<float>& Imag)
+{
+    int N = m_params.GridSize;
+
+    float* pReal = &Real[0];
+    float* pImag = &Imag[0];
+    float* pTempReal = &m_tempReal[0];
+    float* pTempImag = &m_tempImag[0];
+
+    std::function<void(int, int)> ColumnsPass = [&](int Start, int End) {
+        FFTColumns(pReal, pImag, Start, End);
+    };
+
+    ParallelFor(N, ColumnsPass);
+
+    std::function<void(int, int)> TransposePass = [&](int Start, int End) {
+        Transpose(pReal, pTempReal, Start, End);
+        Transpose(pImag, pTempImag, Start, End);
+    };
+
+    ParallelFor(N, TransposePass);
+
+    std::function<void(int, int)> SecondColumnsPass = [&](int Start, int End) {
+        FFTColumns(pTempReal, pTempImag, Start, End);
+    };
+
+    ParallelFor(N, SecondColumnsPass);
+
+    Real.swap(m_tempReal);
+    Imag.swap(m_tempImag);
+}
+
+
+void OceanFFT::Simulate(float Time, OceanFields& Fields)
+{
+    long long StartTime = GetCurrentTimeMillis();
+
+    int N = m_params.GridSize;
+
+    std::function<void(int, int)> SpectrumPass = [&](int Start, int End) {
+        CalcSpectrum(Time, Start, End);
+    };
+
+    ParallelFor(N, SpectrumPass);
+
+    for (int i = 0 ; i < NUM_FIELDS ; i++) {
+        InverseFFT2D(m_real[i], m_imag[i]);
+    }
+
+    const float* pHeight = &m_real[FIELD_HEIGHT_SLOPE_X][0];
+    const float* pSlopeX = &m_imag[FIELD_HEIGHT_SLOPE_X][0];
+    const float* pDispX = &m_real[FIELD_DISPLACEMENT_XZ][0];
+    const float* pDispZ = &m_imag[FIELD_DISPLACEMENT_XZ][0];
+    const float* pSlopeZ = &m_real[FIELD_SLOPE_Z][0];
+    float Lambda = m_params.Choppiness;
+
+    std::function<void(int, int)> PackPass = [&](int Start, int End) {
+        for (int z = Start ; z < End ; z++) {
+            for (int x = 0 ; x < N ; x++) {
+                // the spectrum is centered on k = 0 which flips the sign of every other sample
+                float Sign = ((x + z) & 1) ? -1.0f : 1.0f;
+                int Src = x * N + z;
+                int Dst = z * N + x;
+
+                Fields.Displacement[Dst] = Vector4f(Lambda * pDispX[Src] * Sign, pHeight[Src] * Sign, Lambda * pDispZ[Src] * Sign, 0.0f);
+
+                Vector3f Normal(-pSlopeX[Src] * Sign, 1.0f, -pSlopeZ[Src] * Sign);
+                Normal.Normalize();
+                Fields.Normals[Dst] = Vector4f(Normal, 0.0f);
+            }
+        }
+    };
+
+    ParallelFor(N, PackPass);
+
+    Fields.Time = Time;
+
+    m_lastStepMs = (float)(GetCurrentTimeMillis() - StartTime);
+}
+
+
+// every thread of the pool gets a contiguous chunk of the items
+void OceanFFT::ParallelFor(int NumItems, const std::function<void(int, int)>& Func)
+{
+    int NumThreads = m_pool.GetNumThreads();
+
+    m_pool.Run([&](int ThreadIndex) {
+        int Start = NumItems * ThreadIndex / NumThreads;
+        int End = NumItems * (ThreadIndex + 1) / NumThreads;
+
+        if (Start < End) {
+            Func(Start, End);
+        }
+    });
+}
+
+
+void OceanFFT::StartSimulationThread()
+{
+    if (m_simThread.joinable()) {
+        return;
+    }
+
+    // the first step is done synchronously so that there is always something to render
+    Simulate(0.0f, m_fields[m_readyBuffer]);
+
+    m_simThread = std::thread(&OceanFFT::SimulationThread, this);
+}
+
+
+void OceanFFT::RequestStep(float Time)
+{
+    if (!m_stepDone) {
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> Lock(m_simMutex);
+        m_stepDone = false;
+        m_stepRequested = true;
+        m_requestedTime = Time;
+    }
+
+    m_simCond.notify_one();
+}
+
+
+void OceanFFT::SimulationThread()
+{
+    for (;;) {
+        float Time = 0.0f;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_simMutex);
+            m_simCond.wait(Lock, [this] { return m_simQuit || m_stepRequested; });
+
+            if (m_simQuit) {
+                return;
+            }
+
+            m_stepRequested = false;
+            Time = m_requestedTime;
+        }
+
+        Simulate(Time, m_fields[m_writeBuffer]);
+
+        std::swap(m_readyBuffer, m_writeBuffer);
+
+        m_stepDone = true;
+    }
+}
@@ -0,0 +1,147 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef OCEAN_FFT_H
+#define OCEAN_FFT_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include "ogldev_math_3d.h"
+#include "ogldev_util.h"
+
+// Tessendorf style spectral ocean on the CPU. The Phillips spectrum is
+// animated in the frequency domain and the height, the horizontal
+// displacement and the slopes are brought to the spatial domain using a
+// radix-2 FFT. The FFT runs on all the columns together so the butterflies
+// are done four columns at a time with SSE and the columns are split
+// between a pool of worker threads.
+//
+// The simulation can run on its own thread. The results are double
+// buffered so the render thread reads one set while the next step is
+// written into the other one.
+class OceanFFT {
+ public:
+
+    struct OceanParams {
+        int GridSize = 256;                 // power of two
+        float PatchSize = 500.0f;           // world units covered by one tile of the fields
+        float WindSpeed = 25.0f;
+        Vector2f WindDir = Vector2f(1.0f, 1.0f);
+        float Amplitude = 0.0005f;
+        float Choppiness = 1.5f;
+        unsigned int Seed = 1;
+    };
+
+    // GridSize x GridSize samples of each field
+    struct OceanFields {
+        std::vector<Vector4f> Displacement;    // xyz - displacement
+        std::vector<Vector4f> Normals;         // xyz - normal
+        float Time = 0.0f;
+    };
+
+    OceanFFT() {}
+
+    ~OceanFFT();
+
+    bool InitOcean(const OceanParams& Params, int NumThreads);
+
+    void Destroy();
+
+    int GetGridSize() const { return m_params.GridSize; }
+
+    float GetPatchSize() const { return m_params.PatchSize; }
+
+    // runs a single step on the calling thread (and the worker threads)
+    void Simulate(float Time, OceanFields& Fields);
+
+    // asynchronous interface for the render thread
+    void StartSimulationThread();
+
+    bool IsStepDone() const { return m_stepDone; }
+
+    // Starts the next step in the background. The ready fields may only be
+    // read while IsStepDone() is true, i.e. before the next call to RequestStep.
+    void RequestStep(float Time);
+
+    const OceanFields& GetReadyFields() const { return m_fields[m_readyBuffer]; }
+
+    // can be read at any time
+    float GetLastStepMs() const { return m_lastStepMs.load(); }
+
+ private:
+
+    void InitSpectrum();
+
+    void InitFFT();
+
+    void CalcSpectrum(float Time, int StartRow, int EndRow);
+
+    void FFTColumns(float* pReal, float* pImag, int StartCol, int EndCol) const;
+
+    void Transpose(const float* pSrc, float* pDst, int StartRow, int EndRow) const;
+
+    void InverseFFT2D(std::vector<float>& Real, std::vector<float>& Imag);
+
+    void ParallelFor(int NumItems, const std::function<void(int, int)>& Func);
+
+    void SimulationThread();
+
+    OceanParams m_params;
+
+    // initial spectrum h0(k) and conj(h0(-k))
+    std::vector<float> m_h0Real;
+    std::vector<float> m_h0Imag;
+    std::vector<float> m_h0ConjRealNeg;
+    std::vector<float> m_h0ConjImagNeg;
+    std::vector<float> m_omega;
+    std::vector<float> m_kx;
+    std::vector<float> m_kz;
+
+    // three complex fields - (height, slope x), (displacement x, displacement z), (slope z, unused)
+    std::vector<float> m_real[3];
+    std::vector<float> m_imag[3];
+    std::vector<float> m_tempReal;
+    std::vector<float> m_tempImag;
+
+    std::vector<int> m_bitReverse;
+    std::vector<float> m_twiddleReal;
+    std::vector<float> m_twiddleImag;
+
+    ThreadPool m_pool;
+
+    // simulation thread
+    std::thread m_simThread;
+    std::mutex m_simMutex;
+    std::condition_variable m_simCond;
+    OceanFields m_fields[2];
+    int m_readyBuffer = 0;
+    int m_writeBuffer = 1;
+    bool m_stepRequested = false;
+    bool m_simQuit = false;
+    float m_requestedTime = 0.0f;
+    std::atomic<bool> m_stepDone { true };
+    std::atomic<float> m_lastStepMs { 0.0f };      // written by the simulation thread
+};
+
+#endif
@@ -15,9 +15,19 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <thread>
+#include <algorithm>
+
+#include "ogldev_util.h"
 #include "simple_water.h"
 #include "texture_config.h"
 
+#define WATER_FBO_SIZE      1000
+
+#define OCEAN_GRID_SIZE     256         // FFT resolution
+#define OCEAN_PATCH_SIZE    1024.0f     // world units covered by one repetition of the ocean
+#define OCEAN_MESH_SIZE     513         // vertices per side of the displaced water grid
+
 SimpleWater::SimpleWater() : m_dudvMap(GL_TEXTURE_2D), m_normalMap(GL_TEXTURE_2D)
 {
 }
@@ -25,6 +35,10 @@ SimpleWater::SimpleWater() : m_dudvMap(GL_TEXTURE_2D), m_normalMap(GL_TEXTURE_2D
 
 SimpleWater::~SimpleWater()
 {
+    if (m_oceanInitialized) {
+        glDeleteTextures(2, m_oceanDisplacementMaps);
+        glDeleteTextures(2, m_oceanNormalMaps);
+    }
 }
 
 
@@ -43,14 +57,21 @@ void SimpleWater::Init(int Size, float WorldScale)
     m_waterTech.SetDepthMapTextureUnit(DEPTH_MAP_TEXTURE_UNIT_INDEX);
     m_waterTech.SetWaterHeight(m_waterHeight);
     m_waterTech.SetLightColor(Vector3f(1.0f, 1.0f, 1.0f));
+    m_waterTech.SetOceanDisplacementMapTextureUnit(OCEAN_DISPLACEMENT_TEXTURE_UNIT_INDEX);
+    m_waterTech.SetOceanNormalMapTextureUnit(OCEAN_NORMAL_MAP_TEXTURE_UNIT_INDEX);
+    m_waterTech.SetOceanPatchSize(0.0f);
 
     m_dudvMap.Load("../Content/waterDUDV.png");
     m_normalMap.Load("../Content/WaterNormalMap.png");
 
     m_water.CreateTriangleList(2, 2, Size * WorldScale);
 
-    m_reflectionFBO.Init(1000, 1000);
-    m_refractionFBO.Init(1000, 1000);
+    m_size = Size;
+    m_worldScale = WorldScale;
+
+    m_reflectionSize = WATER_FBO_SIZE;
+    m_reflectionFBO.Init(m_reflectionSize, m_reflectionSize);
+    m_refractionFBO.Init(WATER_FBO_SIZE, WATER_FBO_SIZE);
 }
 
 
@@ -75,13 +96,133 @@ void SimpleWater::Render(const Vector3f& CameraPos, const Matrix4f& VP, const Ve
     m_dudvMap.Bind(DUDV_TEXTURE_UNIT);
     m_normalMap.Bind(NORMAL_MAP_TEXTURE_UNIT);
 
+    if (m_oceanEnabled) {
+        UpdateOceanTextures();
+
+        glActiveTexture(OCEAN_DISPLACEMENT_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_oceanDisplacementMaps[m_oceanTexIndex]);
+        glActiveTexture(OCEAN_NORMAL_MAP_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_2D, m_oceanNormalMaps[m_oceanTexIndex]);
+
+        m_waterTech.SetOceanPatchSize(m_ocean.GetPatchSize());
+    } else {
+        m_waterTech.SetOceanPatchSize(0.0f);
+    }
+
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    m_water.Render();
+
+    if (m_oceanEnabled) {
+        m_oceanGrid.Render();
+    } else {
+        m_water.Render();
+    }
+
     glDisable(GL_BLEND);
 }
 
 
+void SimpleWater::EnableOcean(bool Enable)
+{
+    if (Enable && !m_oceanInitialized) {
+        InitOcean();
+    }
+
+    m_oceanEnabled = Enable;
+}
+
+
+void SimpleWater::InitOcean()
+{
+    OceanFFT::OceanParams Params;
+    Params.GridSize = OCEAN_GRID_SIZE;
+    Params.PatchSize = OCEAN_PATCH_SIZE;
+
+    // one core is left for the render thread
+    int NumThreads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+
+    if (!m_ocean.InitOcean(Params, NumThreads)) {
+        printf("Error initializing the FFT ocean\n");
+        exit(0);
+    }
+
+    m_oceanGrid.CreateTriangleList(OCEAN_MESH_SIZE, OCEAN_MESH_SIZE, m_size * m_worldScale / (float)(OCEAN_MESH_SIZE - 1));
+
+    glGenTextures(2, m_oceanDisplacementMaps);
+    glGenTextures(2, m_oceanNormalMaps);
+
+    int N = m_ocean.GetGridSize();
+
+    for (int i = 0 ; i < 2 ; i++) {
+        // the vertex shader samples the displacement at mip 0 only while the
+        // normal map gets its mip chain on every upload
+        glBindTexture(GL_TEXTURE_2D, m_oceanDisplacementMaps[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, N, N, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+        glBindTexture(GL_TEXTURE_2D, m_oceanNormalMaps[i]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, N, N, 0, GL_RGBA, GL_FLOAT, NULL);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_oceanStartTime = GetCurrentTimeMillis();
+    m_ocean.StartSimulationThread();
+    m_oceanTexIndex = 1;    // the first upload goes into pair 0
+    m_oceanInitialized = true;
+}
+
+
+// The simulation runs on its own thread. When a step is done its fields are
+// uploaded into the texture pair that is not in use and the next step is
+// started right away so that it overlaps with the rendering of this frame.
+void SimpleWater::UpdateOceanTextures()
+{
+    if (!m_ocean.IsStepDone()) {
+        return;
+    }
+
+    const OceanFFT::OceanFields& Fields = m_ocean.GetReadyFields();
+    int N = m_ocean.GetGridSize();
+    int UploadIndex = 1 - m_oceanTexIndex;
+
+    glBindTexture(GL_TEXTURE_2D, m_oceanDisplacementMaps[UploadIndex]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N, N, GL_RGBA, GL_FLOAT, &Fields.Displacement[0]);
+
+    glBindTexture(GL_TEXTURE_2D, m_oceanNormalMaps[UploadIndex]);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, N, N, GL_RGBA, GL_FLOAT, &Fields.Normals[0]);
+    glGenerateMipmap(GL_TEXTURE_2D);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_oceanTexIndex = UploadIndex;
+
+    float Time = (float)(GetCurrentTimeMillis() - m_oceanStartTime) / 1000.0f;
+    m_ocean.RequestStep(Time);
+}
+
+
+void SimpleWater::SetReflectionScale(float Scale)
+{
+    int Size = std::max((int)((float)WATER_FBO_SIZE * Scale), 1);
+
+    if (Size == m_reflectionSize) {
+        return;
+    }
+
+    m_reflectionFBO.Destroy();
+    m_reflectionFBO.Init(Size, Size);
+    m_reflectionSize = Size;
+}
+
+
 void SimpleWater::StartReflectionPass()
 {
     m_reflectionFBO.BindForWriting();
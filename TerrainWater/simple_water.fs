@@ -5,6 +5,7 @@ layout(location = 0) out vec4 FragColor;
 in vec2 oTex;
 in vec4 ClipSpaceCoords;
 in vec3 oVertexToCamera;
+in vec2 oOceanTex;
 
 uniform sampler2D gReflectionTexture;
 uniform sampler2D gRefractionTexture;
@@ -14,10 +15,13 @@ uniform sampler2D gDepthMap;
 uniform float gDUDVOffset = 0.0;
 uniform vec3 gLightColor;
 uniform vec3 gReversedLightDir;
+uniform sampler2D gOceanNormalMap;
+uniform float gOceanPatchSize = 0.0;
 
 const float WaveLength = 0.02;
 const float Shininess = 20.0;
 const float Reflectivity = 1.6;
+const float OceanDistortion = 4.0;
 
 void main()
 {
@@ -36,16 +40,25 @@ void main()
 
     vec2 dudv1 = texture(gDUDVMapTexture, vec2(oTex.x + gDUDVOffset, oTex.y)).rg * 0.1;
     dudv1 = oTex + vec2(dudv1.x, dudv1.y + gDUDVOffset);
-    vec2 dudv = (texture(gDUDVMapTexture, dudv1).rg * 2.0 - 1) * WaveLength * clamp(FloorToWaterSurface / 20.0, 0.0, 1.0);
-    ReflectionTexCoords = clamp(ReflectionTexCoords + dudv, 0.001, 0.999);
-    RefractionTexCoords = clamp(RefractionTexCoords + dudv, 0.001, 0.999);
-    vec4 reflectionColor = texture(gReflectionTexture, ReflectionTexCoords);
-    vec4 refractionColor = texture(gRefractionTexture, RefractionTexCoords);
+    vec2 Distortion = texture(gDUDVMapTexture, dudv1).rg * 2.0 - 1;
 
     vec4 NormalColor = texture(gNormalMap, dudv1);
     vec3 Normal = vec3(NormalColor.r * 2.0 - 1.0, NormalColor.b * 4.0, NormalColor.g * 2.0 - 1.0);
+
+    // the FFT ocean provides the normal and the distortion follows its slope
+    if (gOceanPatchSize > 0.0) {
+        Normal = texture(gOceanNormalMap, oOceanTex).xyz;
+        Distortion = Normal.xz * OceanDistortion;
+    }
+
     Normal = normalize(Normal);
 
+    vec2 dudv = Distortion * WaveLength * clamp(FloorToWaterSurface / 20.0, 0.0, 1.0);
+    ReflectionTexCoords = clamp(ReflectionTexCoords + dudv, 0.001, 0.999);
+    RefractionTexCoords = clamp(RefractionTexCoords + dudv, 0.001, 0.999);
+    vec4 reflectionColor = texture(gReflectionTexture, ReflectionTexCoords);
+    vec4 refractionColor = texture(gRefractionTexture, RefractionTexCoords);
+
     vec3 ViewVector = normalize(oVertexToCamera);
     float refractiveFactor = dot(ViewVector, Normal);
    // refractiveFactor = pow(refractiveFactor, 10.0);
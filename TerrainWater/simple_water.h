@@ -22,6 +22,7 @@
 #include "ogldev_framebuffer.h"
 #include "simple_water_technique.h"
 #include "triangle_list.h"
+#include "ocean_fft.h"
 
 class SimpleWater {
  public:
@@ -40,6 +41,9 @@ class SimpleWater {
 
     GLuint GetDUDVTexture() { return m_dudvMap.GetTexture(); }
 
+    // renders the reflection into a smaller framebuffer - 1.0 is full size
+    void SetReflectionScale(float Scale);
+
     void StartReflectionPass();
     void EndReflectionPass();
 
@@ -50,14 +54,39 @@ class SimpleWater {
 
     GLuint GetRefractionTexture() const { return m_refractionFBO.GetTexture(); }
 
+    // replaces the flat quad with a grid displaced by the FFT ocean
+    void EnableOcean(bool Enable);
+
+    bool IsOceanEnabled() const { return m_oceanEnabled; }
+
+    float GetOceanStepMs() const { return m_ocean.GetLastStepMs(); }
+
  private:
+
+    void InitOcean();
+
+    void UpdateOceanTextures();
+
     TriangleList m_water;
     SimpleWaterTechnique m_waterTech;
     float m_waterHeight = 0.0f;
     Framebuffer m_reflectionFBO;
+    int m_reflectionSize = 0;
     Framebuffer m_refractionFBO;
     Texture m_dudvMap;
     Texture m_normalMap;
+    int m_size = 0;
+    float m_worldScale = 1.0f;
+
+    OceanFFT m_ocean;
+    TriangleList m_oceanGrid;
+    bool m_oceanEnabled = false;
+    bool m_oceanInitialized = false;
+    long long m_oceanStartTime = 0;
+    // the fields are uploaded into one pair of textures while the other pair is rendered
+    GLuint m_oceanDisplacementMaps[2] = { 0, 0 };
+    GLuint m_oceanNormalMaps[2] = { 0, 0 };
+    int m_oceanTexIndex = 0;
 };
 
 #endif
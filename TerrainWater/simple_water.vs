@@ -6,8 +6,11 @@ layout (location = 1) in vec2 TexCoord;
 uniform mat4 gVP;
 uniform float gHeight = 0.0f;
 uniform vec3 gCameraPos;
+uniform sampler2D gOceanDisplacementMap;
+uniform float gOceanPatchSize = 0.0;     // zero when the FFT ocean is disabled
 
 out vec2 oTex;
+out vec2 oOceanTex;
 out vec4 ClipSpaceCoords;
 out vec3 oVertexToCamera;
 
@@ -16,6 +19,14 @@ const float Tiling = 6.0;
 void main()
 {
     vec3 NewPosition = (Position + vec3(0.0, gHeight, 0.0));
+
+    if (gOceanPatchSize > 0.0) {
+        oOceanTex = Position.xz / gOceanPatchSize;
+        NewPosition += textureLod(gOceanDisplacementMap, oOceanTex, 0.0).xyz;
+    } else {
+        oOceanTex = vec2(0.0);
+    }
+
     ClipSpaceCoords = gVP * vec4(NewPosition, 1.0);
     gl_Position = ClipSpaceCoords;
     oTex = TexCoord * Tiling;
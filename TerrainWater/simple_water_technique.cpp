@@ -53,6 +53,9 @@ bool SimpleWaterTechnique::Init()
     m_cameraPosLoc = GetUniformLocation("gCameraPos");
     m_lightColorLoc = GetUniformLocation("gLightColor");
     m_reversedLightDirLoc = GetUniformLocation("gReversedLightDir");
+    m_oceanDisplacementMapTexUnitLoc = GetUniformLocation("gOceanDisplacementMap");
+    m_oceanNormalMapTexUnitLoc = GetUniformLocation("gOceanNormalMap");
+    m_oceanPatchSizeLoc = GetUniformLocation("gOceanPatchSize");
 
     if (m_VPLoc == INVALID_UNIFORM_LOCATION ||
         m_heightLoc == INVALID_UNIFORM_LOCATION ||
@@ -64,7 +67,10 @@ bool SimpleWaterTechnique::Init()
         m_dudvOffsetLoc == INVALID_UNIFORM_LOCATION ||
         m_cameraPosLoc == INVALID_UNIFORM_LOCATION ||
         m_lightColorLoc == INVALID_UNIFORM_LOCATION ||
-        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION) {
+        m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION ||
+        m_oceanDisplacementMapTexUnitLoc == INVALID_UNIFORM_LOCATION ||
+        m_oceanNormalMapTexUnitLoc == INVALID_UNIFORM_LOCATION ||
+        m_oceanPatchSizeLoc == INVALID_UNIFORM_LOCATION) {
         return false;
     }
 
@@ -139,3 +145,20 @@ void SimpleWaterTechnique::SetLightDir(const Vector3f& LightDir)
     glUniform3f(m_reversedLightDirLoc, ReversedLightDir.x, ReversedLightDir.y, ReversedLightDir.z);
 }
 
+
+void SimpleWaterTechnique::SetOceanDisplacementMapTextureUnit(unsigned int TextureUnit)
+{
+    glUniform1i(m_oceanDisplacementMapTexUnitLoc, TextureUnit);
+}
+
+
+void SimpleWaterTechnique::SetOceanNormalMapTextureUnit(unsigned int TextureUnit)
+{
+    glUniform1i(m_oceanNormalMapTexUnitLoc, TextureUnit);
+}
+
+
+void SimpleWaterTechnique::SetOceanPatchSize(float PatchSize)
+{
+    glUniform1f(m_oceanPatchSizeLoc, PatchSize);
+}
@@ -40,6 +40,9 @@ public:
     void SetCameraPos(const Vector3f& CameraPos);
     void SetLightColor(const Vector3f& LightColor);
     void SetLightDir(const Vector3f& LightDir);
+    void SetOceanDisplacementMapTextureUnit(unsigned int TextureUnit);
+    void SetOceanNormalMapTextureUnit(unsigned int TextureUnit);
+    void SetOceanPatchSize(float PatchSize);
 
 private:
     GLuint m_VPLoc = -1;
@@ -53,6 +56,9 @@ private:
     GLuint m_cameraPosLoc = -1;    
     GLuint m_lightColorLoc = -1;
     GLuint m_reversedLightDirLoc = -1;
+    GLuint m_oceanDisplacementMapTexUnitLoc = -1;
+    GLuint m_oceanNormalMapTexUnitLoc = -1;
+    GLuint m_oceanPatchSizeLoc = -1;
 };
 
 #endif  /* SIMPLE_WATER_TECHNIQUE_H */
@@ -0,0 +1,684 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+#include "ogldev_util.h"
+#include "streaming_terrain.h"
+
+// don't stall the frame when many tiles complete together
+#define MAX_UPLOADS_PER_FRAME 4
+
+// a tile switches to the next LOD every time the distance doubles
+#define LOD_BASE_DISTANCE_IN_TILES 1.5f
+
+
+static double GetTimeMs()
+{
+    std::chrono::duration<double, std::milli> t = std::chrono::steady_clock::now().time_since_epoch();
+    return t.count();
+}
+
+
+StreamingTerrain::~StreamingTerrain()
+{
+    Destroy();
+}
+
+
+void StreamingTerrain::InitStreamingTerrain(int TileSize, float WorldScale, float TextureScale, int TextureSize,
+                                            float MinHeight, float MaxHeight, int ViewRadius, size_t MemoryBudget, int NumThreads)
+{
+    if ((TileSize < 4) || ((TileSize & (TileSize - 1)) != 0)) {
+        printf("The tile size must be a power of two of at least 4 (%d)\n", TileSize);
+        exit(0);
+    }
+
+    m_tileSize = TileSize;
+    m_worldScale = WorldScale;
+    m_textureScale = TextureScale;
+    m_textureSize = TextureSize;
+    m_viewRadius = ViewRadius;
+    m_memoryBudget = MemoryBudget;
+    m_stats.BudgetBytes = MemoryBudget;
+
+    m_maxLOD = (int)log2f((float)TileSize) - 1;
+
+    m_generator.InitTileGenerator(TileSize, MinHeight, MaxHeight, 1);
+
+    CreateIndexBuffer();
+
+    m_quit = false;
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        m_threads.push_back(std::thread(&StreamingTerrain::WorkerThread, this));
+    }
+
+    m_numThreadsRunning = NumThreads;
+
+    printf("Streaming terrain: tile size %d, %d threads, budget %zu MB, %zu bytes per tile\n",
+           TileSize, NumThreads, MemoryBudget / (1024 * 1024), GetTileBytes());
+}
+
+
+void StreamingTerrain::Destroy()
+{
+    if (m_numThreadsRunning > 0) {
+        {
+            std::lock_guard<std::mutex> Lock(m_mutex);
+            m_quit = true;
+        }
+
+        m_requestCond.notify_all();
+
+        for (int i = 0 ; i < (int)m_threads.size() ; i++) {
+            m_threads[i].join();
+        }
+
+        m_threads.clear();
+        m_numThreadsRunning = 0;
+    }
+
+    for (int i = 0 ; i < (int)m_generated.size() ; i++) {
+        delete m_generated[i];
+    }
+
+    m_generated.clear();
+    m_requests.clear();
+    m_pending.clear();
+    m_tiles.clear();
+    m_lru.clear();
+    m_freeSlots.clear();
+
+    for (int i = 0 ; i < (int)m_slots.size() ; i++) {
+        glDeleteVertexArrays(1, &m_slots[i].VAO);
+        glDeleteBuffers(1, &m_slots[i].VB);
+    }
+
+    m_slots.clear();
+
+    if (m_ib > 0) {
+        glDeleteBuffers(1, &m_ib);
+        m_ib = 0;
+    }
+
+    m_stats = ResidencyStats();
+    m_totalGenerationMs = 0.0;
+    m_totalLatencyMs = 0.0;
+}
+
+
+void StreamingTerrain::WorkerThread()
+{
+    while (true) {
+        TileRequest Request;
+
+        {
+            std::unique_lock<std::mutex> Lock(m_mutex);
+
+            m_requestCond.wait(Lock, [this] { return m_quit || !m_requests.empty(); });
+
+            if (m_quit) {
+                return;
+            }
+
+            Request = m_requests.front();
+            m_requests.pop_front();
+        }
+
+        GeneratedTile* pTile = new GeneratedTile;
+        pTile->Request = Request;
+
+        double Start = GetTimeMs();
+        m_generator.GenerateTile(Request.TileX, Request.TileZ, pTile->Heights);
+        pTile->GenerationMs = (float)(GetTimeMs() - Start);
+
+        std::lock_guard<std::mutex> Lock(m_mutex);
+        m_generated.push_back(pTile);
+    }
+}
+
+
+void StreamingTerrain::Update(const Vector3f& CameraPos)
+{
+    CollectGeneratedTiles();
+
+    RequestTiles(CameraPos);
+
+    EvictTiles(CameraPos);
+
+    CalcTileLods(CameraPos);
+
+    m_stats.NumResident = (int)m_tiles.size();
+    m_stats.NumPending = (int)m_pending.size();
+    m_stats.NumGPUSlots = (int)m_slots.size();
+    m_stats.ResidentBytes = m_tiles.size() * GetTileBytes();
+
+    if (m_stats.NumLoaded > 0) {
+        m_stats.AvgGenerationMs = (float)(m_totalGenerationMs / m_stats.NumLoaded);
+        m_stats.AvgLatencyMs = (float)(m_totalLatencyMs / m_stats.NumLoaded);
+    }
+}
+
+
+bool StreamingTerrain::IsTileInView(int TileX, int TileZ, const Vector3f& CameraPos) const
+{
+    float TileWorldSize = m_tileSize * m_worldScale;
+
+    float MinX = TileX * TileWorldSize;
+    float MinZ = TileZ * TileWorldSize;
+
+    // distance from the camera to the closest point of the tile
+    float dx = std::max(std::max(MinX - CameraPos.x, 0.0f), CameraPos.x - (MinX + TileWorldSize));
+    float dz = std::max(std::max(MinZ - CameraPos.z, 0.0f), CameraPos.z - (MinZ + TileWorldSize));
+
+    float ViewDistance = m_viewRadius * TileWorldSize;
+
+    return (dx * dx + dz * dz) <= ViewDistance * ViewDistance;
+}
+
+
+void StreamingTerrain::RequestTiles(const Vector3f& CameraPos)
+{
+    float TileWorldSize = m_tileSize * m_worldScale;
+
+    int CameraTileX = (int)floorf(CameraPos.x / TileWorldSize);
+    int CameraTileZ = (int)floorf(CameraPos.z / TileWorldSize);
+
+    struct Candidate {
+        int TileX;
+        int TileZ;
+        int DistSquared;
+    };
+
+    std::vector<Candidate> Missing;
+
+    for (int z = CameraTileZ - m_viewRadius ; z <= CameraTileZ + m_viewRadius ; z++) {
+        for (int x = CameraTileX - m_viewRadius ; x <= CameraTileX + m_viewRadius ; x++) {
+            if (!IsTileInView(x, z, CameraPos)) {
+                continue;
+            }
+
+            std::unordered_map<long long, Tile>::iterator it = m_tiles.find(MakeKey(x, z));
+
+            if (it != m_tiles.end()) {
+                // mark as recently used
+                m_lru.splice(m_lru.begin(), m_lru, it->second.LruPos);
+            } else {
+                int dx = x - CameraTileX;
+                int dz = z - CameraTileZ;
+                Missing.push_back({ x, z, dx * dx + dz * dz });
+            }
+        }
+    }
+
+    std::sort(Missing.begin(), Missing.end(), [](const Candidate& a, const Candidate& b) { return a.DistSquared < b.DistSquared; });
+
+    double Now = GetTimeMs();
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+
+        // Requests which were not picked up yet are rebuilt from scratch so
+        // that the order follows the camera and tiles which went out of view
+        // are dropped. The time of the original request is kept.
+        std::unordered_map<long long, double> QueuedTimes;
+
+        for (int i = 0 ; i < (int)m_requests.size() ; i++) {
+            long long Key = MakeKey(m_requests[i].TileX, m_requests[i].TileZ);
+            QueuedTimes[Key] = m_requests[i].RequestTime;
+            m_pending.erase(Key);
+        }
+
+        m_requests.clear();
+
+        for (int i = 0 ; i < (int)Missing.size() ; i++) {
+            long long Key = MakeKey(Missing[i].TileX, Missing[i].TileZ);
+
+            if (m_pending.count(Key) > 0) {
+                continue;   // being generated right now
+            }
+
+            TileRequest Request;
+            Request.TileX = Missing[i].TileX;
+            Request.TileZ = Missing[i].TileZ;
+
+            std::unordered_map<long long, double>::iterator it = QueuedTimes.find(Key);
+            Request.RequestTime = (it != QueuedTimes.end()) ? it->second : Now;
+
+            m_requests.push_back(Request);
+            m_pending.insert(Key);
+        }
+    }
+
+    if (!Missing.empty()) {
+        m_requestCond.notify_all();
+    }
+}
+
+
+void StreamingTerrain::CollectGeneratedTiles()
+{
+    std::vector<GeneratedTile*> Done;
+
+    {
+        std::lock_guard<std::mutex> Lock(m_mutex);
+
+        int NumUploads = std::min((int)m_generated.size(), MAX_UPLOADS_PER_FRAME);
+        Done.assign(m_generated.begin(), m_generated.begin() + NumUploads);
+        m_generated.erase(m_generated.begin(), m_generated.begin() + NumUploads);
+    }
+
+    double Now = GetTimeMs();
+
+    for (int i = 0 ; i < (int)Done.size() ; i++) {
+        GeneratedTile* pGenerated = Done[i];
+        long long Key = MakeKey(pGenerated->Request.TileX, pGenerated->Request.TileZ);
+
+        m_pending.erase(Key);
+
+        Tile& t = m_tiles[Key];
+        t.TileX = pGenerated->Request.TileX;
+        t.TileZ = pGenerated->Request.TileZ;
+        t.Heights.swap(pGenerated->Heights);
+
+        t.MinHeight = t.Heights[0];
+        t.MaxHeight = t.Heights[0];
+
+        for (int j = 0 ; j < (int)t.Heights.size() ; j++) {
+            t.MinHeight = std::min(t.MinHeight, t.Heights[j]);
+            t.MaxHeight = std::max(t.MaxHeight, t.Heights[j]);
+        }
+
+        t.Slot = AllocSlot();
+        UploadTile(t);
+
+        m_lru.push_front(Key);
+        t.LruPos = m_lru.begin();
+
+        m_stats.NumLoaded++;
+        m_totalGenerationMs += pGenerated->GenerationMs;
+        m_totalLatencyMs += Now - pGenerated->Request.RequestTime;
+        m_stats.MaxGenerationMs = std::max(m_stats.MaxGenerationMs, pGenerated->GenerationMs);
+
+        delete pGenerated;
+    }
+}
+
+
+int StreamingTerrain::AllocSlot()
+{
+    if (!m_freeSlots.empty()) {
+        int Slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+        return Slot;
+    }
+
+    GPUSlot Slot;
+
+    glGenVertexArrays(1, &Slot.VAO);
+    glBindVertexArray(Slot.VAO);
+
+    glGenBuffers(1, &Slot.VB);
+    glBindBuffer(GL_ARRAY_BUFFER, Slot.VB);
+
+    int NumVertices = (m_tileSize + 1) * (m_tileSize + 1);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * NumVertices, NULL, GL_DYNAMIC_DRAW);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+
+    int POS_LOC = 0;
+    int TEX_LOC = 1;
+    int NORMAL_LOC = 2;
+
+    size_t NumFloats = 0;
+
+    glEnableVertexAttribArray(POS_LOC);
+    glVertexAttribPointer(POS_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(NumFloats * sizeof(float)));
+    NumFloats += 3;
+
+    glEnableVertexAttribArray(TEX_LOC);
+    glVertexAttribPointer(TEX_LOC, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(NumFloats * sizeof(float)));
+    NumFloats += 2;
+
+    glEnableVertexAttribArray(NORMAL_LOC);
+    glVertexAttribPointer(NORMAL_LOC, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const void*)(NumFloats * sizeof(float)));
+    NumFloats += 3;
+
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+    m_slots.push_back(Slot);
+
+    return (int)m_slots.size() - 1;
+}
+
+
+void StreamingTerrain::UploadTile(Tile& t)
+{
+    int NumSamples = m_tileSize + 3;
+    int NumVerticesPerSide = m_tileSize + 1;
+
+    std::vector<Vertex> Vertices(NumVerticesPerSide * NumVerticesPerSide);
+
+    int Index = 0;
+
+    for (int z = 0 ; z < NumVerticesPerSide ; z++) {
+        for (int x = 0 ; x < NumVerticesPerSide ; x++) {
+            // skip the extra ring of samples
+            int h = (z + 1) * NumSamples + x + 1;
+
+            int GlobalX = t.TileX * m_tileSize + x;
+            int GlobalZ = t.TileZ * m_tileSize + z;
+
+            Vertex& v = Vertices[Index++];
+            v.Pos = Vector3f(GlobalX * m_worldScale, t.Heights[h], GlobalZ * m_worldScale);
+            v.Tex = Vector2f(m_textureScale * (float)GlobalX / (float)m_textureSize,
+                             m_textureScale * (float)GlobalZ / (float)m_textureSize);
+
+            // central differences using the neighbors which may be in the ring
+            float HeightLeft = t.Heights[h - 1];
+            float HeightRight = t.Heights[h + 1];
+            float HeightDown = t.Heights[h - NumSamples];
+            float HeightUp = t.Heights[h + NumSamples];
+
+            v.Normal = Vector3f(HeightLeft - HeightRight, 2.0f * m_worldScale, HeightDown - HeightUp);
+            v.Normal.Normalize();
+        }
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, m_slots[t.Slot].VB);
+    glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(Vertices[0]) * Vertices.size(), &Vertices[0]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+void StreamingTerrain::EvictTiles(const Vector3f& CameraPos)
+{
+    size_t TileBytes = GetTileBytes();
+
+    std::list<long long>::iterator it = m_lru.end();
+
+    // Walk from the least recently used tile. Tiles which are in view are
+    // never evicted even if the budget is too small to hold all of them.
+    while ((m_tiles.size() * TileBytes > m_memoryBudget) && (it != m_lru.begin())) {
+        --it;
+
+        Tile& t = m_tiles[*it];
+
+        if (IsTileInView(t.TileX, t.TileZ, CameraPos)) {
+            continue;
+        }
+
+        m_freeSlots.push_back(t.Slot);
+        m_tiles.erase(*it);
+        it = m_lru.erase(it);
+
+        m_stats.NumEvicted++;
+    }
+}
+
+
+size_t StreamingTerrain::GetTileBytes() const
+{
+    size_t NumSamples = m_tileSize + 3;
+    size_t NumVertices = (m_tileSize + 1) * (m_tileSize + 1);
+
+    return NumSamples * NumSamples * sizeof(float) + NumVertices * sizeof(Vertex);
+}
+
+
+int StreamingTerrain::GetTileLod(int TileX, int TileZ, int DefaultLod) const
+{
+    std::unordered_map<long long, Tile>::const_iterator it = m_tiles.find(MakeKey(TileX, TileZ));
+
+    if (it == m_tiles.end()) {
+        return DefaultLod;
+    }
+
+    return it->second.Lod;
+}
+
+
+void StreamingTerrain::CalcTileLods(const Vector3f& CameraPos)
+{
+    float TileWorldSize = m_tileSize * m_worldScale;
+    float BaseDistance = LOD_BASE_DISTANCE_IN_TILES * TileWorldSize;
+
+    for (std::unordered_map<long long, Tile>::iterator it = m_tiles.begin() ; it != m_tiles.end() ; it++) {
+        Tile& t = it->second;
+
+        float CenterX = (t.TileX + 0.5f) * TileWorldSize;
+        float CenterZ = (t.TileZ + 0.5f) * TileWorldSize;
+        float Distance = sqrtf((CenterX - CameraPos.x) * (CenterX - CameraPos.x) + (CenterZ - CameraPos.z) * (CenterZ - CameraPos.z));
+
+        int Lod = 0;
+
+        while ((Lod < m_maxLOD) && (Distance > BaseDistance * (float)(1 << Lod))) {
+            Lod++;
+        }
+
+        t.Lod = Lod;
+    }
+
+    // The stitching permutations only handle a neighbor which is one level
+    // coarser so the difference between adjacent tiles is clamped to one.
+    bool Changed = true;
+
+    for (int Pass = 0 ; Changed && (Pass < m_maxLOD) ; Pass++) {
+        Changed = false;
+
+        for (std::unordered_map<long long, Tile>::iterator it = m_tiles.begin() ; it != m_tiles.end() ; it++) {
+            Tile& t = it->second;
+
+            int MinNeighborLod = std::min(std::min(GetTileLod(t.TileX - 1, t.TileZ, t.Lod), GetTileLod(t.TileX + 1, t.TileZ, t.Lod)),
+                                          std::min(GetTileLod(t.TileX, t.TileZ - 1, t.Lod), GetTileLod(t.TileX, t.TileZ + 1, t.Lod)));
+
+            if (t.Lod > MinNeighborLod + 1) {
+                t.Lod = MinNeighborLod + 1;
+                Changed = true;
+            }
+        }
+    }
+}
+
+
+void StreamingTerrain::Render(const Vector3f& CameraPos, const Matrix4f& ViewProj)
+{
+    FrustumCulling fc(ViewProj);
+
+    float TileWorldSize = m_tileSize * m_worldScale;
+
+    m_stats.NumRendered = 0;
+
+    for (std::unordered_map<long long, Tile>::iterator it = m_tiles.begin() ; it != m_tiles.end() ; it++) {
+        const Tile& t = it->second;
+
+        if (!IsTileInView(t.TileX, t.TileZ, CameraPos)) {
+            continue;
+        }
+
+        Vector3f Min(t.TileX * TileWorldSize, t.MinHeight, t.TileZ * TileWorldSize);
+        Vector3f Max(Min.x + TileWorldSize, t.MaxHeight, Min.z + TileWorldSize);
+
+        if (!fc.IsBoxInsideViewFrustum(Min, Max)) {
+            continue;
+        }
+
+        int C = t.Lod;
+        int L = GetTileLod(t.TileX - 1, t.TileZ, C) > C ? 1 : 0;
+        int R = GetTileLod(t.TileX + 1, t.TileZ, C) > C ? 1 : 0;
+        int T = GetTileLod(t.TileX, t.TileZ + 1, C) > C ? 1 : 0;
+        int B = GetTileLod(t.TileX, t.TileZ - 1, C) > C ? 1 : 0;
+
+        const SingleLodInfo& Info = m_lodInfo[C].info[L][R][T][B];
+
+        glBindVertexArray(m_slots[t.Slot].VAO);
+        glDrawElements(GL_TRIANGLES, Info.Count, GL_UNSIGNED_INT, (void*)(sizeof(unsigned int) * Info.Start));
+
+        m_stats.NumRendered++;
+    }
+
+    glBindVertexArray(0);
+}
+
+
+bool StreamingTerrain::GetWorldHeight(float x, float z, float& Height) const
+{
+    float SampleX = x / m_worldScale;
+    float SampleZ = z / m_worldScale;
+
+    int TileX = (int)floorf(SampleX / m_tileSize);
+    int TileZ = (int)floorf(SampleZ / m_tileSize);
+
+    std::unordered_map<long long, Tile>::const_iterator it = m_tiles.find(MakeKey(TileX, TileZ));
+
+    if (it == m_tiles.end()) {
+        return false;
+    }
+
+    const std::vector<float>& Heights = it->second.Heights;
+    int NumSamples = m_tileSize + 3;
+
+    // local coordinates inside the tile including the extra ring
+    float LocalX = SampleX - TileX * m_tileSize + 1.0f;
+    float LocalZ = SampleZ - TileZ * m_tileSize + 1.0f;
+
+    int x0 = (int)LocalX;
+    int z0 = (int)LocalZ;
+    float FactorX = LocalX - x0;
+    float FactorZ = LocalZ - z0;
+
+    float X0Z0Height = Heights[z0 * NumSamples + x0];
+    float X1Z0Height = Heights[z0 * NumSamples + x0 + 1];
+    float X0Z1Height = Heights[(z0 + 1) * NumSamples + x0];
+    float X1Z1Height = Heights[(z0 + 1) * NumSamples + x0 + 1];
+
+    float InterpolatedBottom = (X1Z0Height - X0Z0Height) * FactorX + X0Z0Height;
+    float InterpolatedTop    = (X1Z1Height - X0Z1Height) * FactorX + X0Z1Height;
+
+    Height = (InterpolatedTop - InterpolatedBottom) * FactorZ + InterpolatedBottom;
+
+    return true;
+}
+
+
+void StreamingTerrain::CreateIndexBuffer()
+{
+    std::vector<uint> Indices;
+
+    m_lodInfo.resize(m_maxLOD + 1);
+
+    for (int lod = 0 ; lod <= m_maxLOD ; lod++) {
+        int FanStep = powi(2, lod + 1);
+        int EndPos = m_tileSize - FanStep;
+
+        for (int l = 0 ; l < 2 ; l++) {
+            for (int r = 0 ; r < 2 ; r++) {
+                for (int t = 0 ; t < 2 ; t++) {
+                    for (int b = 0 ; b < 2 ; b++) {
+                        SingleLodInfo& Info = m_lodInfo[lod].info[l][r][t][b];
+                        Info.Start = (int)Indices.size();
+
+                        for (int z = 0 ; z <= EndPos ; z += FanStep) {
+                            for (int x = 0 ; x <= EndPos ; x += FanStep) {
+                                int lLeft   = x == 0      ? lod + l : lod;
+                                int lRight  = x == EndPos ? lod + r : lod;
+                                int lBottom = z == 0      ? lod + b : lod;
+                                int lTop    = z == EndPos ? lod + t : lod;
+
+                                CreateTriangleFan(Indices, lod, lLeft, lRight, lTop, lBottom, x, z);
+                            }
+                        }
+
+                        Info.Count = (int)Indices.size() - Info.Start;
+                    }
+                }
+            }
+        }
+    }
+
+    glGenBuffers(1, &m_ib);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ib);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(Indices[0]) * Indices.size(), &Indices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+
+// Same fan layout as GeomipGrid::CreateTriangleFan. The tile vertices are
+// a (TileSize + 1) x (TileSize + 1) grid.
+void StreamingTerrain::CreateTriangleFan(std::vector<uint>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom, int x, int z)
+{
+    int Width = m_tileSize + 1;
+
+    int StepLeft   = powi(2, lodLeft);
+    int StepRight  = powi(2, lodRight);
+    int StepTop    = powi(2, lodTop);
+    int StepBottom = powi(2, lodBottom);
+    int StepCenter = powi(2, lodCore);
+
+    uint IndexCenter = (z + StepCenter) * Width + x + StepCenter;
+
+    // up
+    uint IndexTemp1 = z * Width + x;
+    uint IndexTemp2 = (z + StepLeft) * Width + x;
+    Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+
+    if (lodLeft == lodCore) {
+        IndexTemp1 = IndexTemp2;
+        IndexTemp2 += StepLeft * Width;
+        Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+    }
+
+    // right
+    IndexTemp1 = IndexTemp2;
+    IndexTemp2 += StepTop;
+    Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+
+    if (lodTop == lodCore) {
+        IndexTemp1 = IndexTemp2;
+        IndexTemp2 += StepTop;
+        Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+    }
+
+    // down
+    IndexTemp1 = IndexTemp2;
+    IndexTemp2 -= StepRight * Width;
+    Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+
+    if (lodRight == lodCore) {
+        IndexTemp1 = IndexTemp2;
+        IndexTemp2 -= StepRight * Width;
+        Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+    }
+
+    // left
+    IndexTemp1 = IndexTemp2;
+    IndexTemp2 -= StepBottom;
+    Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+
+    if (lodBottom == lodCore) {
+        IndexTemp1 = IndexTemp2;
+        IndexTemp2 -= StepBottom;
+        Indices.insert(Indices.end(), { IndexCenter, IndexTemp1, IndexTemp2 });
+    }
+}
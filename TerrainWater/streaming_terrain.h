@@ -0,0 +1,185 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef STREAMING_TERRAIN_H
+#define STREAMING_TERRAIN_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "ogldev_math_3d.h"
+#include "tile_generator.h"
+
+// An unbounded terrain made of square tiles. The tiles around the camera
+// are generated on background threads and kept in an LRU cache under a
+// memory budget. Each resident tile owns a slot from a pool of GPU
+// buffers which are recycled when the tile is evicted. All the tiles
+// share one index buffer with the geomipmapping LOD/stitching
+// permutations so adjacent tiles of different LODs don't crack.
+class StreamingTerrain {
+ public:
+    StreamingTerrain() {}
+
+    ~StreamingTerrain();
+
+    void InitStreamingTerrain(int TileSize, float WorldScale, float TextureScale, int TextureSize,
+                              float MinHeight, float MaxHeight, int ViewRadius, size_t MemoryBudget, int NumThreads);
+
+    // stops the workers and frees all the tiles. Can be initialized again.
+    void Destroy();
+
+    bool IsInitialized() const { return m_numThreadsRunning > 0; }
+
+    // requests the missing tiles around the camera, uploads the ones that
+    // finished and evicts what doesn't fit the budget. Call once per frame.
+    void Update(const Vector3f& CameraPos);
+
+    // TerrainTechnique must be enabled by the caller
+    void Render(const Vector3f& CameraPos, const Matrix4f& ViewProj);
+
+    // returns false if the tile under (x, z) is not resident
+    bool GetWorldHeight(float x, float z, float& Height) const;
+
+    struct ResidencyStats {
+        int NumResident = 0;
+        int NumPending = 0;
+        int NumRendered = 0;
+        int NumGPUSlots = 0;
+        long long NumLoaded = 0;
+        long long NumEvicted = 0;
+        size_t ResidentBytes = 0;
+        size_t BudgetBytes = 0;
+        float AvgGenerationMs = 0.0f;
+        float MaxGenerationMs = 0.0f;
+        float AvgLatencyMs = 0.0f;     // from the request until the tile is on the GPU
+    };
+
+    const ResidencyStats& GetStats() const { return m_stats; }
+
+ private:
+
+    struct Vertex {
+        Vector3f Pos;
+        Vector2f Tex;
+        Vector3f Normal;
+    };
+
+    struct TileRequest {
+        int TileX = 0;
+        int TileZ = 0;
+        double RequestTime = 0.0;
+    };
+
+    struct GeneratedTile {
+        TileRequest Request;
+        std::vector<float> Heights;
+        float GenerationMs = 0.0f;
+    };
+
+    struct Tile {
+        int TileX = 0;
+        int TileZ = 0;
+        std::vector<float> Heights;
+        float MinHeight = 0.0f;
+        float MaxHeight = 0.0f;
+        int Slot = -1;
+        int Lod = 0;
+        std::list<long long>::iterator LruPos;
+    };
+
+    struct GPUSlot {
+        GLuint VAO = 0;
+        GLuint VB = 0;
+    };
+
+    struct SingleLodInfo {
+        int Start = 0;
+        int Count = 0;
+    };
+
+    struct LodInfo {
+        SingleLodInfo info[2][2][2][2];     // left, right, top, bottom
+    };
+
+    static long long MakeKey(int TileX, int TileZ) { return (long long)(((unsigned long long)(unsigned int)TileX << 32) | (unsigned int)TileZ); }
+
+    void WorkerThread();
+
+    void RequestTiles(const Vector3f& CameraPos);
+
+    void CollectGeneratedTiles();
+
+    void UploadTile(Tile& t);
+
+    void EvictTiles(const Vector3f& CameraPos);
+
+    int AllocSlot();
+
+    void CreateIndexBuffer();
+
+    void CreateTriangleFan(std::vector<uint>& Indices, int lodCore, int lodLeft, int lodRight, int lodTop, int lodBottom, int x, int z);
+
+    void CalcTileLods(const Vector3f& CameraPos);
+
+    int GetTileLod(int TileX, int TileZ, int DefaultLod) const;
+
+    bool IsTileInView(int TileX, int TileZ, const Vector3f& CameraPos) const;
+
+    size_t GetTileBytes() const;
+
+    int m_tileSize = 0;
+    int m_maxLOD = 0;
+    float m_worldScale = 1.0f;
+    float m_textureScale = 1.0f;
+    int m_textureSize = 1;
+    int m_viewRadius = 0;
+    size_t m_memoryBudget = 0;
+
+    TileGenerator m_generator;
+
+    // owned by the render thread
+    std::unordered_map<long long, Tile> m_tiles;
+    std::list<long long> m_lru;                 // most recently used first
+    std::unordered_set<long long> m_pending;
+    std::vector<GPUSlot> m_slots;
+    std::vector<int> m_freeSlots;
+    GLuint m_ib = 0;
+    std::vector<LodInfo> m_lodInfo;
+    ResidencyStats m_stats;
+    double m_totalGenerationMs = 0.0;
+    double m_totalLatencyMs = 0.0;
+
+    // shared with the worker threads
+    std::vector<std::thread> m_threads;
+    int m_numThreadsRunning = 0;
+    std::mutex m_mutex;
+    std::condition_variable m_requestCond;
+    std::deque<TileRequest> m_requests;
+    std::vector<GeneratedTile*> m_generated;
+    bool m_quit = false;
+};
+
+#endif
@@ -23,14 +23,24 @@
 #include <sys/stat.h>
 #include <cerrno>
 #include <string.h>
+#include <algorithm>
+#include <thread>
 
 #include "demo_config.h"
 #include "terrain.h"
 #include "texture_config.h"
+#include "tiled_fault_formation.h"
 #include "3rdparty/stb_image_write.h"
 
 //#define DEBUG_PRINT
 
+#define STREAMING_TILE_SIZE     128
+#define STREAMING_VIEW_RADIUS   8                     // in tiles
+#define STREAMING_MEMORY_BUDGET (256 * 1024 * 1024)
+
+#define WATER_PASS_REFLECTION_SCALE 0.5f
+#define WATER_PASS_LOD_BIAS         1
+
 BaseTerrain::~BaseTerrain()
 {
     Destroy();
@@ -41,6 +51,8 @@ void BaseTerrain::Destroy()
 {
     m_heightMap.Destroy();
     m_geomipGrid.Destroy();
+    m_cdlodGrid.Destroy();
+    m_streamingTerrain.Destroy();
 }
 
 
@@ -50,6 +62,11 @@ void BaseTerrain::InitTerrain(float WorldScale, float TextureScale, const std::v
         printf("Error initializing tech\n");
         exit(0);
     }
+
+    if (!m_cdlodTech.Init()) {
+        printf("Error initializing CDLOD tech\n");
+        exit(0);
+    }
 	
     if (TextureFilenames.size() != ARRAY_SIZE_IN_ELEMENTS(m_pTextures)) {
         printf("%s:%d - number of provided textures (%zu) is not equal to the size of the texture array (%zu)\n",
@@ -81,7 +98,28 @@ void BaseTerrain::Finalize()
 {
     m_geomipGrid.CreateGeomipGrid(m_terrainSize, m_terrainSize, m_patchSize, this);
 
+    // the leaf nodes of the quadtree match the geomip patches
+    m_cdlodGrid.CreateCDLODGrid(m_terrainSize, m_patchSize - 1, this);
+
+    m_terrainTech.Enable();
+    m_terrainTech.SetNormalMapWorldScale(m_worldScale);
+
+    m_cdlodTech.Enable();
+    m_cdlodTech.SetWorldScale(m_worldScale);
+    m_cdlodTech.SetTextureScale(m_textureScale);
+    m_cdlodTech.SetNormalMapWorldScale(m_worldScale);
+
+    for (int Lod = 0 ; Lod < m_cdlodGrid.GetNumLods() ; Lod++) {
+        m_cdlodTech.SetMorphConsts(Lod, m_cdlodGrid.GetMorphStart(Lod), m_cdlodGrid.GetMorphEnd(Lod));
+    }
+
     m_water.Init(m_terrainSize, m_worldScale);
+
+    m_normalMapDirty = true;
+
+    if (m_normalMapEnabled) {
+        EnableNormalMap(true);
+    }
 }
 
 
@@ -165,8 +203,53 @@ void BaseTerrain::SaveToFile(const char* pFilename)
 }
 
 
+void BaseTerrain::CreateFaultFormationTiled(const char* pFilename, int NumTilesPerSide, int TileSize, int PatchSize,
+                                            int Iterations, float MinHeight, float MaxHeight, float Filter)
+{
+    m_terrainSize = NumTilesPerSide * TileSize + 1;
+    m_patchSize = PatchSize;
+
+    SetMinMaxHeight(MinHeight, MaxHeight);
+
+    TiledFaultFormation Generator;
+
+    int NumThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    if (!Generator.CreateTiledFaultFormation(pFilename, NumTilesPerSide, TileSize, Iterations,
+                                             MinHeight, MaxHeight, Filter, NumThreads)) {
+        exit(0);
+    }
+
+    if (!TiledHeightMapFile::Load(pFilename, m_heightMap)) {
+        exit(0);
+    }
+
+    Finalize();
+}
+
+
+void BaseTerrain::EnableStreaming(bool Enable)
+{
+    if (Enable && !m_streamingTerrain.IsInitialized()) {
+        int NumThreads = std::max((int)std::thread::hardware_concurrency() - 1, 1);
+
+        m_streamingTerrain.InitStreamingTerrain(STREAMING_TILE_SIZE, m_worldScale, m_textureScale, m_terrainSize,
+                                                m_minHeight, m_maxHeight, STREAMING_VIEW_RADIUS, STREAMING_MEMORY_BUDGET, NumThreads);
+    } else if (!Enable && m_streamingTerrain.IsInitialized()) {
+        // stop the workers and release the tiles and GPU buffers
+        m_streamingTerrain.Destroy();
+    }
+
+    m_streamingEnabled = Enable;
+}
+
+
 void BaseTerrain::Render(const BasicCamera& Camera)
 {
+    if (m_streamingEnabled) {
+        m_streamingTerrain.Update(Camera.GetPos());
+    }
+
     RenderTerrain(Camera);
  
     RenderWater(Camera);
@@ -180,7 +263,9 @@ void BaseTerrain::RenderTerrain(const BasicCamera& Camera)
     Matrix4f VP = Camera.GetViewProjMatrix();
     Matrix4f View = Camera.GetMatrix();
 
-    m_terrainTech.Enable();
+    TerrainTechnique& TerrainTech = GetTerrainTech();
+
+    TerrainTech.Enable();
 
     for (int i = 0; i < ARRAY_SIZE_IN_ELEMENTS(m_pTextures); i++) {
         if (m_pTextures[i]) {
@@ -188,12 +273,23 @@ void BaseTerrain::RenderTerrain(const BasicCamera& Camera)
         }
     }
 
-    m_terrainTech.SetLightDir(m_lightDir);
+    TerrainTech.SetLightDir(m_lightDir);
+
+    bool UseNormalMap = m_normalMapEnabled && !m_streamingEnabled;
+    TerrainTech.EnableNormalMap(UseNormalMap);
+
+    if (UseNormalMap) {
+        m_normalBaker.Bind(TERRAIN_NORMAL_MAP_TEXTURE_UNIT);
+    }
+
+    BeginWaterPassTimer();
 
     RenderTerrainReflectionPass(Camera);
 
     RenderTerrainRefractionPass(Camera);
 
+    EndWaterPassTimer();
+
     RenderTerrainDefaultPass(Camera);
 
     if (m_guiEnabled) {
@@ -223,12 +319,12 @@ void BaseTerrain::RenderTerrainReflectionPass(const BasicCamera& Camera)
 
     Vector3f PlaneNormal(0, 1.0f, 0.0f);
     Vector3f PointOnPlane(0.0f, m_water.GetWaterHeight() + 0.5f, 0.0f);
-    m_terrainTech.SetClipPlane(PlaneNormal, PointOnPlane);
+    GetTerrainTech().SetClipPlane(PlaneNormal, PointOnPlane);
 
-    m_terrainTech.SetVP(CameraUnderWater.GetViewProjMatrix());
-    m_geomipGrid.Render(CameraUnderWater.GetPos(), CameraUnderWater.GetViewProjMatrix());
+    GetTerrainTech().SetVP(CameraUnderWater.GetViewProjMatrix());
+    RenderWaterPassGrid(CameraUnderWater.GetPos(), CameraUnderWater.GetViewProjMatrix(), true);
     m_pSkydome->Render(CameraUnderWater);
-    m_terrainTech.Enable();
+    GetTerrainTech().Enable();
     m_water.EndReflectionPass();
 }
 
@@ -238,9 +334,9 @@ void BaseTerrain::RenderTerrainRefractionPass(const BasicCamera& Camera)
 
     Vector3f PlaneNormal(0, -1.0f, 0.0f);
     Vector3f PointOnPlane(0.0f, m_water.GetWaterHeight() + 0.5f, 0.0f);
-    m_terrainTech.SetClipPlane(PlaneNormal, PointOnPlane);
-    m_terrainTech.SetVP(Camera.GetViewProjMatrix());
-    m_geomipGrid.Render(Camera.GetPos(), Camera.GetViewProjMatrix());
+    GetTerrainTech().SetClipPlane(PlaneNormal, PointOnPlane);
+    GetTerrainTech().SetVP(Camera.GetViewProjMatrix());
+    RenderWaterPassGrid(Camera.GetPos(), Camera.GetViewProjMatrix(), false);
     m_water.EndRefractionPass();
 }
 
@@ -249,10 +345,125 @@ void BaseTerrain::RenderTerrainDefaultPass(const BasicCamera& Camera)
 {
     Vector3f PlaneNormal(0, 1.0f, 0.0f);
     Vector3f PointOnPlane(0.0f, 0.0f, 0.0f);
-    m_terrainTech.SetClipPlane(PlaneNormal, PointOnPlane);
+    GetTerrainTech().SetClipPlane(PlaneNormal, PointOnPlane);
 
-    m_terrainTech.SetVP(Camera.GetViewProjMatrix());
-    m_geomipGrid.Render(Camera.GetPos(), Camera.GetViewProjMatrix());
+    GetTerrainTech().SetVP(Camera.GetViewProjMatrix());
+    RenderTerrainGrid(Camera.GetPos(), Camera.GetViewProjMatrix());
+}
+
+
+TerrainTechnique& BaseTerrain::GetTerrainTech()
+{
+    // the streaming tiles use the same vertex layout as the geomip grid
+    if (m_cdlodEnabled && !m_streamingEnabled) {
+        return m_cdlodTech;
+    } else {
+        return m_terrainTech;
+    }
+}
+
+
+void BaseTerrain::RenderTerrainGrid(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool WaterPass)
+{
+    if (m_streamingEnabled) {
+        m_streamingTerrain.Render(CameraPos, ViewProj);
+    } else if (m_cdlodEnabled) {
+        m_cdlodTech.SetCameraPos(CameraPos);
+        m_cdlodGrid.Render(CameraPos, ViewProj);
+    } else {
+        m_geomipGrid.Render(CameraPos, ViewProj, WaterPass);
+    }
+}
+
+
+void BaseTerrain::EnableNormalMap(bool Enable)
+{
+    if (Enable && m_normalMapDirty) {
+        bool CalcAO = true;
+        int NumThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+        m_normalBaker.BakeNormalMap(this, CalcAO, NumThreads);
+        m_normalMapDirty = false;
+    }
+
+    m_normalMapEnabled = Enable;
+}
+
+
+void BaseTerrain::EnableFastWaterPasses(bool Enable)
+{
+    m_fastWaterPasses = Enable;
+
+    m_water.SetReflectionScale(Enable ? WATER_PASS_REFLECTION_SCALE : 1.0f);
+}
+
+
+// KeepAbove selects the side of the water plane that the pass keeps
+void BaseTerrain::RenderWaterPassGrid(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool KeepAbove)
+{
+    // the clipped render is only available for the geomip grid
+    bool GeomipGridActive = !m_streamingEnabled && !m_cdlodEnabled;
+
+    if (m_fastWaterPasses && GeomipGridActive) {
+        GeomipGrid::ClipPass Pass;
+        Pass.ClipHeight = m_water.GetWaterHeight() + 0.5f;     // same as the clip plane of the pass
+        Pass.KeepAbove = KeepAbove;
+        Pass.LodBias = WATER_PASS_LOD_BIAS;
+        m_geomipGrid.RenderClipped(CameraPos, ViewProj, Pass);
+    } else {
+        bool WaterPass = true;
+        RenderTerrainGrid(CameraPos, ViewProj, WaterPass);
+    }
+
+    if (GeomipGridActive) {
+        const GeomipGrid::CullingStats& Stats = m_geomipGrid.GetCullingStats();
+        m_waterPassStats.NumDrawn += Stats.NumPatches - Stats.NumFrustumCulled - Stats.NumHorizonCulled - Stats.NumClipCulled;
+        m_waterPassStats.NumClipCulled += Stats.NumClipCulled;
+    }
+}
+
+
+// The GPU time of the water passes is read one frame later so that
+// waiting for the query does not stall the pipeline.
+void BaseTerrain::BeginWaterPassTimer()
+{
+    if (m_waterPassQueries[0] == 0) {
+        glGenQueries(2, m_waterPassQueries);
+    }
+
+    m_waterPassStats.NumDrawn = 0;
+    m_waterPassStats.NumClipCulled = 0;
+
+    int PrevIndex = 1 - m_waterPassQueryIndex;
+
+    if (m_waterPassQueryPending[PrevIndex]) {
+        GLint Available = 0;
+        glGetQueryObjectiv(m_waterPassQueries[PrevIndex], GL_QUERY_RESULT_AVAILABLE, &Available);
+
+        if (Available) {
+            GLuint64 TimeNs = 0;
+            glGetQueryObjectui64v(m_waterPassQueries[PrevIndex], GL_QUERY_RESULT, &TimeNs);
+            m_waterPassStats.GPUTimeMs = (float)((double)TimeNs / 1000000.0);
+            m_waterPassQueryPending[PrevIndex] = false;
+        }
+    }
+
+    // skip the measurement if the query from two frames ago is still in flight
+    if (!m_waterPassQueryPending[m_waterPassQueryIndex]) {
+        glBeginQuery(GL_TIME_ELAPSED, m_waterPassQueries[m_waterPassQueryIndex]);
+        m_waterPassQueryPending[m_waterPassQueryIndex] = true;
+        m_waterPassQueryActive = true;
+    }
+}
+
+
+void BaseTerrain::EndWaterPassTimer()
+{
+    if (m_waterPassQueryActive) {
+        glEndQuery(GL_TIME_ELAPSED);
+        m_waterPassQueryActive = false;
+    }
+
+    m_waterPassQueryIndex = 1 - m_waterPassQueryIndex;
 }
 
 
@@ -269,12 +480,19 @@ void BaseTerrain::SetMinMaxHeight(float MinHeight, float MaxHeight)
 
     m_terrainTech.Enable();
     m_terrainTech.SetMinMaxHeight(MinHeight, MaxHeight);
+
+    m_cdlodTech.Enable();
+    m_cdlodTech.SetMinMaxHeight(MinHeight, MaxHeight);
 }
 
 
 void BaseTerrain::SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height)
 {
+    m_terrainTech.Enable();
     m_terrainTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height); 
+
+    m_cdlodTech.Enable();
+    m_cdlodTech.SetTextureHeights(Tex0Height, Tex1Height, Tex2Height, Tex3Height); 
 }
 
 
@@ -291,6 +509,18 @@ Vector3f BaseTerrain::ConstrainCameraPosToTerrain(const Vector3f& CameraPos)
 {
     Vector3f NewCameraPos = CameraPos;
 
+    // the streaming terrain has no edges. Until the tile under the camera
+    // arrives the height is left as is.
+    if (m_streamingEnabled) {
+        float Height = 0.0f;
+
+        if (m_streamingTerrain.GetWorldHeight(CameraPos.x, CameraPos.z, Height)) {
+            NewCameraPos.y = Height + m_cameraHeight;
+        }
+
+        return NewCameraPos;
+    }
+
     if (CameraPos.x < 0.0f) {
         NewCameraPos.x = 0.0f;
     }
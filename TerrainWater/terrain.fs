@@ -19,6 +19,10 @@ uniform float gHeight3 = 500.0;
 
 uniform vec3 gReversedLightDir;
 
+uniform sampler2D gNormalMap;
+uniform int gNormalMapEnabled = 0;
+uniform float gNormalMapWorldScale = 1.0;
+
 vec4 CalcTexColor()
 {
     vec4 TexColor;
@@ -57,11 +61,22 @@ void main()
 {
     vec4 TexColor = CalcTexColor();
 
-    vec3 Normal_ = normalize(Normal);
+    vec3 Normal_;
+    float AO = 1.0;
+
+    // the baked map has one texel per heightmap sample and doesn't depend on the LOD
+    if (gNormalMapEnabled != 0) {
+        vec2 NormalMapTex = (WorldPos.xz / gNormalMapWorldScale + 0.5) / vec2(textureSize(gNormalMap, 0));
+        vec4 NormalMapColor = texture(gNormalMap, NormalMapTex);
+        Normal_ = normalize(NormalMapColor.xyz * 2.0 - 1.0);
+        AO = NormalMapColor.a;
+    } else {
+        Normal_ = normalize(Normal);
+    }
 
     float Diffuse = dot(Normal_, gReversedLightDir);
 
     Diffuse = max(0.3f, Diffuse);
 
-    FragColor = Color * TexColor * Diffuse;
+    FragColor = Color * TexColor * Diffuse * AO;
 }
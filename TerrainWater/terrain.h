@@ -27,8 +27,12 @@
 
 #include "geomip_grid.h"
 #include "terrain_technique.h"
+#include "cdlod_grid.h"
+#include "cdlod_technique.h"
+#include "streaming_terrain.h"
 #include "ogldev_skydome.h"
 #include "simple_water.h"
+#include "terrain_normal_baker.h"
 
 class BaseTerrain
 {
@@ -47,6 +51,10 @@ class BaseTerrain
 
     void SaveToFile(const char* pFilename);
 
+    // generates the heightmap tile by tile into pFilename using TiledFaultFormation and loads it
+    void CreateFaultFormationTiled(const char* pFilename, int NumTilesPerSide, int TileSize, int PatchSize,
+                                   int Iterations, float MinHeight, float MaxHeight, float Filter);
+
 	float GetHeight(int x, int z) const { return m_heightMap.Get(x, z); }
 	
     float GetHeightInterpolated(float x, float z) const;
@@ -57,6 +65,8 @@ class BaseTerrain
 
     int GetSize() const { return m_terrainSize; }
 
+    const Array2D<float>& GetHeightMap() const { return m_heightMap; }
+
     void SetTexture(Texture* pTexture) { m_pTextures[0] = pTexture; }
 	
     void SetTextureHeights(float Tex0Height, float Tex1Height, float Tex2Height, float Tex3Height);
@@ -71,8 +81,52 @@ class BaseTerrain
 	
     void SetWaterHeight(float Height) { m_water.SetWaterHeight(Height); }
 
+    void EnableOcean(bool Enable) { m_water.EnableOcean(Enable); }
+
+    float GetOceanStepMs() const { return m_water.GetOceanStepMs(); }
+
+    // Renders the water reflection at a lower resolution and drops the
+    // geomip patches on the clipped side of the water plane from the
+    // reflection and refraction passes. The rest are drawn at a coarser LOD.
+    void EnableFastWaterPasses(bool Enable);
+
+    struct WaterPassStats {
+        int NumDrawn = 0;           // geomip patches drawn by both passes
+        int NumClipCulled = 0;
+        float GPUTimeMs = 0.0f;     // both passes including the skydome
+    };
+
+    const WaterPassStats& GetWaterPassStats() const { return m_waterPassStats; }
+
+    // Shade the terrain using a normal and AO map baked from the full
+    // resolution heightmap. The map is baked the first time it is enabled.
+    // Not used by the streaming terrain.
+    void EnableNormalMap(bool Enable);
+
+    void SetLodBias(int LodBias) { m_geomipGrid.SetLodBias(LodBias); }
+
     void ControlGUI(bool Enable) { m_guiEnabled = Enable; }
 
+    void EnableHorizonCulling(bool Enable) { m_geomipGrid.EnableHorizonCulling(Enable); }
+
+    void EnableTriangleStrips(bool Enable) { m_geomipGrid.EnableTriangleStrips(Enable); }
+
+    const GeomipGrid::CullingStats& GetCullingStats() const { return m_geomipGrid.GetCullingStats(); }
+
+    // switch between geomipmapping and the CDLOD quadtree
+    void EnableCDLOD(bool Enable) { m_cdlodEnabled = Enable; }
+
+    bool IsCDLODEnabled() const { return m_cdlodEnabled; }
+
+    int GetNumCDLODNodes() const { return m_cdlodGrid.GetNumSelectedNodes(); }
+
+    // replace the heightmap with an unbounded terrain which is streamed in tiles around the camera
+    void EnableStreaming(bool Enable);
+
+    bool IsStreamingEnabled() const { return m_streamingEnabled; }
+
+    const StreamingTerrain::ResidencyStats& GetStreamingStats() const { return m_streamingTerrain.GetStats(); }
+
  protected:
 
 	void LoadHeightMapFile(const char* pFilename);
@@ -96,15 +150,34 @@ private:
     void RenderTerrainRefractionPass(const BasicCamera& Camera);
     void RenderTerrainDefaultPass(const BasicCamera& Camera);
     void RenderWater(const BasicCamera& Camera);
+    void RenderTerrainGrid(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool WaterPass = false);
+    void RenderWaterPassGrid(const Vector3f& CameraPos, const Matrix4f& ViewProj, bool KeepAbove);
+    void BeginWaterPassTimer();
+    void EndWaterPassTimer();
+    TerrainTechnique& GetTerrainTech();
 
     GeomipGrid m_geomipGrid;
     float m_minHeight = 0.0f;
     float m_maxHeight = 0.0f;
     TerrainTechnique m_terrainTech;
+    CDLODGrid m_cdlodGrid;
+    CDLODTechnique m_cdlodTech;
+    bool m_cdlodEnabled = false;
+    StreamingTerrain m_streamingTerrain;
+    bool m_streamingEnabled = false;
     Vector3f m_lightDir;
     float m_cameraHeight = 2.0f;
     Skydome* m_pSkydome = NULL;		
     SimpleWater m_water;
+    TerrainNormalBaker m_normalBaker;
+    bool m_normalMapEnabled = false;
+    bool m_normalMapDirty = true;
+    bool m_fastWaterPasses = false;
+    WaterPassStats m_waterPassStats;
+    GLuint m_waterPassQueries[2] = { 0, 0 };
+    bool m_waterPassQueryPending[2] = { false, false };
+    int m_waterPassQueryIndex = 0;
+    bool m_waterPassQueryActive = false;
     GUITexture m_guiTexture1;
     GUITexture m_guiTexture2;
     bool m_guiEnabled = true;
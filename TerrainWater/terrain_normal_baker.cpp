@@ -0,0 +1,196 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <math.h>
+#include <thread>
+#include <algorithm>
+
+#include "ogldev_util.h"
+#include "ogldev_artifact_cache.h"
+#include "terrain.h"
+#include "terrain_normal_baker.h"
+
+#define AO_NUM_DIRECTIONS   8
+#define AO_NUM_STEPS        12
+#define AO_MAX_DISTANCE     64.0f       // in heightmap samples
+
+
+TerrainNormalBaker::~TerrainNormalBaker()
+{
+    if (m_texture != 0) {
+        glDeleteTextures(1, &m_texture);
+    }
+}
+
+
+void TerrainNormalBaker::BakeNormalMap(const BaseTerrain* pTerrain, bool CalcAO, int NumThreads)
+{
+    long long Start = GetCurrentTimeMillis();
+
+    m_pTerrain = pTerrain;
+    m_terrainSize = pTerrain->GetSize();
+    m_worldScale = pTerrain->GetWorldScale();
+    m_calcAO = CalcAO;
+    m_nextRow = 0;
+
+    NumThreads = std::max(NumThreads, 1);
+
+    // the bake depends only on the heights, the world scale and the AO settings
+    const Array2D<float>& HeightMap = pTerrain->GetHeightMap();
+
+    ArtifactKey Key("terrain_normal_map");
+    Key.Add(m_terrainSize).Add(m_worldScale).Add(m_calcAO ? 1 : 0);
+    Key.Add(AO_NUM_DIRECTIONS).Add(AO_NUM_STEPS).Add(AO_MAX_DISTANCE);
+    Key.Add(HeightMap.GetBaseAddr(), HeightMap.GetSizeInBytes());
+
+    size_t Size = (size_t)m_terrainSize * m_terrainSize * 4;
+
+    GetArtifactCache().GetArtifact(Key, m_texels, [&](std::vector<unsigned char>& Texels) {
+        Texels.resize(Size);
+
+        std::vector<std::thread> Threads;
+
+        for (int i = 0 ; i < NumThreads ; i++) {
+            Threads.push_back(std::thread(&TerrainNormalBaker::BakeRows, this, &Texels[0]));
+        }
+
+        for (int i = 0 ; i < NumThreads ; i++) {
+            Threads[i].join();
+        }
+    }, Size);
+
+    CreateTexture();
+
+    printf("Terrain normal map %dx%d (AO %s) ready in %lld ms\n", m_terrainSize, m_terrainSize,
+           m_calcAO ? "on" : "off", GetCurrentTimeMillis() - Start);
+
+    // the CPU copy is not needed once it is in the texture
+    m_texels.clear();
+    m_texels.shrink_to_fit();
+}
+
+
+void TerrainNormalBaker::BakeRows(unsigned char* pTexels)
+{
+    for (;;) {
+        int z = m_nextRow++;
+
+        if (z >= m_terrainSize) {
+            break;
+        }
+
+        unsigned char* pTexel = &pTexels[(size_t)z * m_terrainSize * 4];
+
+        for (int x = 0 ; x < m_terrainSize ; x++) {
+            Vector3f Normal = CalcNormal(x, z);
+            float AO = m_calcAO ? CalcAO(x, z) : 1.0f;
+
+            pTexel[0] = (unsigned char)((Normal.x * 0.5f + 0.5f) * 255.0f + 0.5f);
+            pTexel[1] = (unsigned char)((Normal.y * 0.5f + 0.5f) * 255.0f + 0.5f);
+            pTexel[2] = (unsigned char)((Normal.z * 0.5f + 0.5f) * 255.0f + 0.5f);
+            pTexel[3] = (unsigned char)(AO * 255.0f + 0.5f);
+            pTexel += 4;
+        }
+    }
+}
+
+
+float TerrainNormalBaker::GetHeightClamped(int x, int z) const
+{
+    x = std::min(std::max(x, 0), m_terrainSize - 1);
+    z = std::min(std::max(z, 0), m_terrainSize - 1);
+
+    return m_pTerrain->GetHeight(x, z);
+}
+
+
+// central differences - the same normal that the CDLOD vertex shader calculates
+Vector3f TerrainNormalBaker::CalcNormal(int x, int z) const
+{
+    float HeightLeft = GetHeightClamped(x - 1, z);
+    float HeightRight = GetHeightClamped(x + 1, z);
+    float HeightDown = GetHeightClamped(x, z - 1);
+    float HeightUp = GetHeightClamped(x, z + 1);
+
+    Vector3f Normal(HeightLeft - HeightRight, 2.0f * m_worldScale, HeightDown - HeightUp);
+    Normal.Normalize();
+
+    return Normal;
+}
+
+
+// Horizon based occlusion. In each direction the samples are spaced
+// exponentially up to AO_MAX_DISTANCE so that both nearby bumps and
+// distant ridges are found. The sine of the highest elevation angle is how
+// much of the sky is blocked in that direction.
+float TerrainNormalBaker::CalcAO(int x, int z) const
+{
+    float Height = m_pTerrain->GetHeight(x, z);
+    float Occlusion = 0.0f;
+
+    for (int Dir = 0 ; Dir < AO_NUM_DIRECTIONS ; Dir++) {
+        float Angle = 2.0f * (float)M_PI * (float)Dir / (float)AO_NUM_DIRECTIONS;
+        float DirX = cosf(Angle);
+        float DirZ = sinf(Angle);
+
+        float MaxTan = 0.0f;
+
+        for (int Step = 0 ; Step < AO_NUM_STEPS ; Step++) {
+            float Distance = powf(AO_MAX_DISTANCE, (float)Step / (float)(AO_NUM_STEPS - 1));
+            int SampleX = x + (int)roundf(DirX * Distance);
+            int SampleZ = z + (int)roundf(DirZ * Distance);
+
+            if ((SampleX < 0) || (SampleX >= m_terrainSize) || (SampleZ < 0) || (SampleZ >= m_terrainSize)) {
+                break;
+            }
+
+            float Tan = (m_pTerrain->GetHeight(SampleX, SampleZ) - Height) / (Distance * m_worldScale);
+            MaxTan = std::max(MaxTan, Tan);
+        }
+
+        Occlusion += MaxTan / sqrtf(1.0f + MaxTan * MaxTan);
+    }
+
+    return 1.0f - Occlusion / (float)AO_NUM_DIRECTIONS;
+}
+
+
+void TerrainNormalBaker::CreateTexture()
+{
+    if (m_texture == 0) {
+        glGenTextures(1, &m_texture);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, m_terrainSize, m_terrainSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, &m_texels[0]);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+
+void TerrainNormalBaker::Bind(GLenum TextureUnit)
+{
+    glActiveTexture(TextureUnit);
+    glBindTexture(GL_TEXTURE_2D, m_texture);
+}
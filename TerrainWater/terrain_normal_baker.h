@@ -0,0 +1,73 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TERRAIN_NORMAL_BAKER_H
+#define TERRAIN_NORMAL_BAKER_H
+
+#include <GL/glew.h>
+#include <vector>
+#include <atomic>
+
+#include "ogldev_math_3d.h"
+
+class BaseTerrain;
+
+// Bakes the shading of the full resolution heightmap into a texture with
+// one texel per heightmap sample. RGB holds the world space normal and A
+// the ambient occlusion. The occlusion is calculated by walking the
+// heightmap in several directions from every texel and averaging the
+// elevation of the horizon found in each one. Since the terrain shader
+// reads its lighting from this map the geometry can be rendered at a much
+// coarser LOD without looking flat shaded.
+class TerrainNormalBaker {
+ public:
+
+    TerrainNormalBaker() {}
+
+    ~TerrainNormalBaker();
+
+    // the rows are split between NumThreads threads
+    void BakeNormalMap(const BaseTerrain* pTerrain, bool CalcAO, int NumThreads);
+
+    void Bind(GLenum TextureUnit);
+
+    bool IsBaked() const { return m_texture != 0; }
+
+ private:
+
+    void BakeRows(unsigned char* pTexels);
+
+    Vector3f CalcNormal(int x, int z) const;
+
+    float CalcAO(int x, int z) const;
+
+    float GetHeightClamped(int x, int z) const;
+
+    void CreateTexture();
+
+    const BaseTerrain* m_pTerrain = NULL;
+    int m_terrainSize = 0;
+    float m_worldScale = 1.0f;
+    bool m_calcAO = true;
+    std::vector<unsigned char> m_texels;   // RGBA8
+    std::atomic<int> m_nextRow { 0 };
+    GLuint m_texture = 0;
+};
+
+#endif
@@ -20,8 +20,9 @@
 #include "texture_config.h"
 
 
-TerrainTechnique::TerrainTechnique()
+TerrainTechnique::TerrainTechnique(const char* pVSFilename)
 {
+    m_pVSFilename = pVSFilename;
 }
 
 bool TerrainTechnique::Init()
@@ -30,7 +31,7 @@ bool TerrainTechnique::Init()
         return false;
     }
 
-    if (!AddShader(GL_VERTEX_SHADER, "terrain.vs")) {
+    if (!AddShader(GL_VERTEX_SHADER, m_pVSFilename)) {
         return false;
     }
 
@@ -55,6 +56,9 @@ bool TerrainTechnique::Init()
     m_tex3HeightLoc = GetUniformLocation("gHeight3");
     m_reversedLightDirLoc = GetUniformLocation("gReversedLightDir");
     m_clipPlaneLoc = GetUniformLocation("gClipPlane");
+    m_normalMapUnitLoc = GetUniformLocation("gNormalMap");
+    m_normalMapEnabledLoc = GetUniformLocation("gNormalMapEnabled");
+    m_normalMapWorldScaleLoc = GetUniformLocation("gNormalMapWorldScale");
 
     if (m_VPLoc == INVALID_UNIFORM_LOCATION||
         m_minHeightLoc == INVALID_UNIFORM_LOCATION ||
@@ -68,7 +72,10 @@ bool TerrainTechnique::Init()
         m_tex2HeightLoc == INVALID_UNIFORM_LOCATION ||
         m_tex3HeightLoc == INVALID_UNIFORM_LOCATION ||
         m_reversedLightDirLoc == INVALID_UNIFORM_LOCATION ||
-        m_clipPlaneLoc == INVALID_UNIFORM_LOCATION) {
+        m_clipPlaneLoc == INVALID_UNIFORM_LOCATION ||
+        m_normalMapUnitLoc == INVALID_UNIFORM_LOCATION ||
+        m_normalMapEnabledLoc == INVALID_UNIFORM_LOCATION ||
+        m_normalMapWorldScaleLoc == INVALID_UNIFORM_LOCATION) {
         return false;
     }
 
@@ -78,6 +85,7 @@ bool TerrainTechnique::Init()
     glUniform1i(m_tex1UnitLoc, COLOR_TEXTURE_UNIT_INDEX_1);
     glUniform1i(m_tex2UnitLoc, COLOR_TEXTURE_UNIT_INDEX_2);
     glUniform1i(m_tex3UnitLoc, COLOR_TEXTURE_UNIT_INDEX_3);
+    glUniform1i(m_normalMapUnitLoc, TERRAIN_NORMAL_MAP_TEXTURE_UNIT_INDEX);
 
     glUseProgram(0);
 
@@ -121,3 +129,14 @@ void TerrainTechnique::SetClipPlane(const Vector3f& Normal, const Vector3f& Poin
     glUniform4f(m_clipPlaneLoc, Normal.x, Normal.y, Normal.z, d);
 }
 
+
+void TerrainTechnique::EnableNormalMap(bool Enable)
+{
+    glUniform1i(m_normalMapEnabledLoc, Enable ? 1 : 0);
+}
+
+
+void TerrainTechnique::SetNormalMapWorldScale(float WorldScale)
+{
+    glUniform1f(m_normalMapWorldScaleLoc, WorldScale);
+}
@@ -25,7 +25,7 @@ class TerrainTechnique : public Technique
 {
 public:
 
-    TerrainTechnique();
+    TerrainTechnique(const char* pVSFilename = "terrain.vs");
 
     virtual bool Init();
 
@@ -38,8 +38,14 @@ public:
     void SetLightDir(const Vector3f& Dir);
 
     void SetClipPlane(const Vector3f& Normal, const Vector3f& PointOnPlane);
+
+    // take the normal and the AO from the baked terrain normal map instead of the vertices
+    void EnableNormalMap(bool Enable);
+
+    void SetNormalMapWorldScale(float WorldScale);
 	
 private:
+    const char* m_pVSFilename = NULL;
     GLuint m_VPLoc = -1;
     GLuint m_minHeightLoc = -1;
     GLuint m_maxHeightLoc = -1;
@@ -53,6 +59,9 @@ private:
     GLuint m_tex3UnitLoc = -1;
     GLuint m_reversedLightDirLoc = -1;
     GLuint m_clipPlaneLoc = -1;
+    GLuint m_normalMapUnitLoc = -1;
+    GLuint m_normalMapEnabledLoc = -1;
+    GLuint m_normalMapWorldScaleLoc = -1;
 };
 
 #endif  /* TERRAIN_TECHNIQUE_H */
@@ -29,6 +29,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <thread>
 #include <GL/glew.h>
 
 #include "ogldev_util.h"
@@ -38,6 +39,8 @@
 #include "demo_config.h"
 #include "texture_config.h"
 #include "midpoint_disp_terrain.h"
+#include "ocean_fft.h"
+#include "ogldev_artifact_cache.h"
 
 static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 static void CursorPosCallback(GLFWwindow* window, double x, double y);
@@ -45,6 +48,10 @@ static void MouseButtonCallback(GLFWwindow* window, int Button, int Action, int
 
 static int g_seed = 0;
 
+static const int TILED_GENERATOR_TILE_SIZE = 256;
+
+static const int OCEAN_BENCHMARK_STEPS = 50;
+
 extern int gShowPoints;
 
 
@@ -62,6 +69,13 @@ public:
     }
 
 
+    // generate the heightmap out of core using TiledMidpointDisp
+    void UseTiledGenerator() { m_tiledGenerator = true; }
+
+    // generate the heightmap out of core using TiledFaultFormation
+    void UseTiledFaultFormation() { m_tiledFaultFormation = true; }
+
+
     void Init()
     {
         CreateWindow_(); // added '_' because of conflict with Windows.h
@@ -93,6 +107,60 @@ public:
 
                 m_terrain.SetWaterHeight(m_waterHeight);
 
+                if (ImGui::Checkbox("Horizon culling", &this->m_horizonCulling)) {
+                    m_terrain.EnableHorizonCulling(m_horizonCulling);
+                }
+
+                if (ImGui::Checkbox("Triangle strips", &this->m_triangleStrips)) {
+                    m_terrain.EnableTriangleStrips(m_triangleStrips);
+                }
+
+                if (ImGui::Checkbox("Streaming terrain", &this->m_streaming)) {
+                    m_terrain.EnableStreaming(m_streaming);
+                }
+
+                if (m_streaming) {
+                    const StreamingTerrain::ResidencyStats& Res = m_terrain.GetStreamingStats();
+                    ImGui::Text("Tiles: %d resident %d pending %d rendered, %d GPU slots", Res.NumResident, Res.NumPending, Res.NumRendered, Res.NumGPUSlots);
+                    ImGui::Text("Loaded %lld evicted %lld, %.1f / %.1f MB", Res.NumLoaded, Res.NumEvicted,
+                                (float)Res.ResidentBytes / (1024.0f * 1024.0f), (float)Res.BudgetBytes / (1024.0f * 1024.0f));
+                    ImGui::Text("Generation avg %.2f ms max %.2f ms, latency avg %.1f ms", Res.AvgGenerationMs, Res.MaxGenerationMs, Res.AvgLatencyMs);
+                }
+
+                if (ImGui::Checkbox("Baked normal map", &this->m_normalMap)) {
+                    m_terrain.EnableNormalMap(m_normalMap);
+                }
+
+                if (ImGui::SliderInt("LOD bias", &this->m_lodBias, 0, 3)) {
+                    m_terrain.SetLodBias(m_lodBias);
+                }
+
+                if (ImGui::Checkbox("Fast water passes", &this->m_fastWaterPasses)) {
+                    m_terrain.EnableFastWaterPasses(m_fastWaterPasses);
+                }
+
+                const BaseTerrain::WaterPassStats& WaterStats = m_terrain.GetWaterPassStats();
+                ImGui::Text("Water passes: %.2f ms GPU, %d patches drawn, %d clip culled", WaterStats.GPUTimeMs, WaterStats.NumDrawn, WaterStats.NumClipCulled);
+
+                if (ImGui::Checkbox("FFT ocean", &this->m_ocean)) {
+                    m_terrain.EnableOcean(m_ocean);
+                }
+
+                if (m_ocean) {
+                    ImGui::Text("Ocean step %.1f ms", m_terrain.GetOceanStepMs());
+                }
+
+                if (ImGui::Checkbox("CDLOD", &this->m_cdlod)) {
+                    m_terrain.EnableCDLOD(m_cdlod);
+                }
+
+                if (m_cdlod) {
+                    ImGui::Text("CDLOD nodes: %d (1 draw call)", m_terrain.GetNumCDLODNodes());
+                } else {
+                    const GeomipGrid::CullingStats& Stats = m_terrain.GetCullingStats();
+                    ImGui::Text("Patches: %d frustum culled %d horizon culled %d", Stats.NumPatches, Stats.NumFrustumCulled, Stats.NumHorizonCulled);
+                }
+
                 ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
                 ImGui::End();
 
@@ -137,7 +205,49 @@ public:
 
      //   m_terrain.SetLightDir(LightDir);
 
+        UpdateCameraPath();
+
         m_terrain.Render(*m_pGameCamera);
+
+        if (m_cameraPathState == CAMERA_PATH_PLAYING) {
+            const GeomipGrid::CullingStats& Stats = m_terrain.GetCullingStats();
+            m_pathPatches += Stats.NumPatches;
+            m_pathFrustumCulled += Stats.NumFrustumCulled;
+            m_pathHorizonCulled += Stats.NumHorizonCulled;
+            m_pathWaterPassMs += m_terrain.GetWaterPassStats().GPUTimeMs;
+        }
+    }
+
+
+    // Record the camera while the user flies around and play it back
+    // to measure how many patches are culled along the same path.
+    void UpdateCameraPath()
+    {
+        switch (m_cameraPathState) {
+        case CAMERA_PATH_RECORDING:
+            m_cameraPath.push_back(CameraPathPoint{ m_pGameCamera->GetPos(), m_pGameCamera->GetTarget() });
+            break;
+
+        case CAMERA_PATH_PLAYING:
+            if (m_cameraPathIndex < (int)m_cameraPath.size()) {
+                m_pGameCamera->SetPosition(m_cameraPath[m_cameraPathIndex].Pos);
+                m_pGameCamera->SetTarget(m_cameraPath[m_cameraPathIndex].Target);
+                m_cameraPathIndex++;
+            } else {
+                float NumPatches = (float)std::max(m_pathPatches, 1LL);
+                printf("Camera path of %zu frames: %.1f%% of patches frustum culled, %.1f%% horizon culled\n",
+                       m_cameraPath.size(),
+                       100.0f * (float)m_pathFrustumCulled / NumPatches,
+                       100.0f * (float)m_pathHorizonCulled / NumPatches);
+                printf("Water passes %.2f ms GPU per frame (fast water passes %s)\n",
+                       m_pathWaterPassMs / (float)m_cameraPath.size(), m_fastWaterPasses ? "on" : "off");
+                m_cameraPathState = CAMERA_PATH_IDLE;
+            }
+            break;
+
+        default:
+            break;
+        }
     }
 
 
@@ -192,6 +302,27 @@ public:
                 m_showGui = !m_showGui;
                 break;
 
+            case GLFW_KEY_K:
+                if (m_cameraPathState == CAMERA_PATH_RECORDING) {
+                    printf("Recorded a camera path of %zu frames\n", m_cameraPath.size());
+                    m_cameraPathState = CAMERA_PATH_IDLE;
+                } else {
+                    m_cameraPath.clear();
+                    m_cameraPathState = CAMERA_PATH_RECORDING;
+                }
+                break;
+
+            case GLFW_KEY_L:
+                if (m_cameraPath.size() > 0) {
+                    m_cameraPathIndex = 0;
+                    m_pathPatches = 0;
+                    m_pathFrustumCulled = 0;
+                    m_pathHorizonCulled = 0;
+                    m_pathWaterPassMs = 0.0f;
+                    m_cameraPathState = CAMERA_PATH_PLAYING;
+                }
+                break;
+
             case GLFW_KEY_0:
                 gShowPoints = 0;
                 break;
@@ -277,7 +408,17 @@ private:
 
         m_terrain.InitTerrain(WorldScale, TextureScale, TextureFilenames);
 
-        m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight);
+        int NumTilesPerSide = (m_terrainSize - 1) / TILED_GENERATOR_TILE_SIZE;
+
+        if (m_tiledFaultFormation) {
+            m_terrain.CreateFaultFormationTiled("heightmap_tiles.bin", NumTilesPerSide, TILED_GENERATOR_TILE_SIZE,
+                                                m_patchSize, m_faultIterations, m_minHeight, m_maxHeight, m_faultFilter);
+        } else if (m_tiledGenerator) {
+            m_terrain.CreateMidpointDisplacementTiled("heightmap_tiles.bin", NumTilesPerSide, TILED_GENERATOR_TILE_SIZE,
+                                                      m_patchSize, m_roughness, m_minHeight, m_maxHeight);
+        } else {
+            m_terrain.CreateMidpointDisplacement(m_terrainSize, m_patchSize, m_roughness, m_minHeight, m_maxHeight, g_seed);
+        }
 
         Vector3f LightDir(0.0f, -1.0f, -1.0f);
 
@@ -286,6 +427,8 @@ private:
         m_terrain.SetWaterHeight(m_waterHeight);
 
         m_terrain.ControlGUI(m_guiEnabled);
+
+        GetArtifactCache().PrintStats();
     }
 
 
@@ -324,14 +467,80 @@ private:
     float m_minHeight = 0.0f;
     float m_maxHeight = 556.0f;
     int m_patchSize = 33;
+    int m_faultIterations = 500;
+    float m_faultFilter = 0.5f;
     float m_counter = 0.0f;
     bool m_constrainCamera = false;	
     float m_waterHeight = m_maxHeight * 0.5f;
     bool m_guiEnabled = false;
+    bool m_horizonCulling = true;
+    bool m_triangleStrips = false;
+    bool m_cdlod = false;
+    bool m_streaming = false;
+    bool m_tiledGenerator = false;
+    bool m_tiledFaultFormation = false;
+    bool m_ocean = false;
+    bool m_fastWaterPasses = false;
+    bool m_normalMap = false;
+    int m_lodBias = 0;
+
+    enum CAMERA_PATH_STATE {
+        CAMERA_PATH_IDLE,
+        CAMERA_PATH_RECORDING,
+        CAMERA_PATH_PLAYING
+    };
+
+    struct CameraPathPoint {
+        Vector3f Pos;
+        Vector3f Target;
+    };
+
+    CAMERA_PATH_STATE m_cameraPathState = CAMERA_PATH_IDLE;
+    std::vector<CameraPathPoint> m_cameraPath;
+    int m_cameraPathIndex = 0;
+    long long m_pathPatches = 0;
+    long long m_pathFrustumCulled = 0;
+    long long m_pathHorizonCulled = 0;
+    float m_pathWaterPassMs = 0.0f;
 };
 
 TerrainWater* app = NULL;
 
+
+// Times the CPU ocean simulation without opening a window
+static void RunOceanBenchmark()
+{
+    int GridSizes[] = { 256, 512 };
+    int NumThreads = std::max((int)std::thread::hardware_concurrency(), 1);
+
+    for (int i = 0 ; i < (int)ARRAY_SIZE_IN_ELEMENTS(GridSizes) ; i++) {
+        OceanFFT Ocean;
+        OceanFFT::OceanParams Params;
+        Params.GridSize = GridSizes[i];
+
+        if (!Ocean.InitOcean(Params, NumThreads)) {
+            exit(0);
+        }
+
+        OceanFFT::OceanFields Fields;
+        Fields.Displacement.resize(Params.GridSize * Params.GridSize);
+        Fields.Normals.resize(Params.GridSize * Params.GridSize);
+
+        // warm up the caches and the worker threads
+        Ocean.Simulate(0.0f, Fields);
+
+        long long StartTime = GetCurrentTimeMillis();
+
+        for (int Step = 0 ; Step < OCEAN_BENCHMARK_STEPS ; Step++) {
+            Ocean.Simulate((float)Step / 60.0f, Fields);
+        }
+
+        float TotalMs = (float)(GetCurrentTimeMillis() - StartTime);
+
+        printf("Ocean %dx%d: %.2f ms per step\n", Params.GridSize, Params.GridSize, TotalMs / (float)OCEAN_BENCHMARK_STEPS);
+    }
+}
+
 static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
     app->KeyboardCB(key, action);
@@ -361,12 +570,33 @@ int main(int argc, char** argv)
 #else
     g_seed = getpid();
 #endif
-    printf("random seed %d\n", g_seed);
 
-    srand(g_seed);
+    bool FixedSeed = false;
 
     app = new TerrainWater();
 
+    for (int i = 1 ; i < argc ; i++) {
+        if (strcmp(argv[i], "--ocean-benchmark") == 0) {
+            RunOceanBenchmark();
+            return 0;
+        } else if (strcmp(argv[i], "--tiled") == 0) {
+            app->UseTiledGenerator();
+        } else if (strcmp(argv[i], "--tiled-fault") == 0) {
+            app->UseTiledFaultFormation();
+        } else if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc)) {
+            // a fixed seed lets the artifact cache reuse the terrain of a previous run
+            g_seed = atoi(argv[++i]);
+            FixedSeed = true;
+        }
+    }
+
+    printf("random seed %d\n", g_seed);
+
+    // the terrain of a random seed is never generated again
+    GetArtifactCache().Enable(FixedSeed);
+
+    srand(g_seed);
+
     app->Init();
 
     glClearColor(135.0f / 255.0f, 206.0f / 255.0f, 235.0f / 255.0f, 0.0f);
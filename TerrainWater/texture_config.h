@@ -26,6 +26,20 @@
 #define SKYDOME_TEXTURE_UNIT          GL_TEXTURE9
 #define SKYDOME_TEXTURE_UNIT_INDEX    9
 
+// CDLOD terrain shader
+#define HEIGHT_MAP_TEXTURE_UNIT       GL_TEXTURE10
+#define HEIGHT_MAP_TEXTURE_UNIT_INDEX 10
+
+// FFT ocean
+#define OCEAN_DISPLACEMENT_TEXTURE_UNIT       GL_TEXTURE11
+#define OCEAN_DISPLACEMENT_TEXTURE_UNIT_INDEX 11
+#define OCEAN_NORMAL_MAP_TEXTURE_UNIT         GL_TEXTURE12
+#define OCEAN_NORMAL_MAP_TEXTURE_UNIT_INDEX   12
+
+// baked terrain normals and ambient occlusion
+#define TERRAIN_NORMAL_MAP_TEXTURE_UNIT       GL_TEXTURE13
+#define TERRAIN_NORMAL_MAP_TEXTURE_UNIT_INDEX 13
+
 
 
 #endif
@@ -0,0 +1,118 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <math.h>
+
+#include "tile_generator.h"
+
+#define NUM_OCTAVES    6
+#define BASE_FREQUENCY (1.0f / 256.0f)   // in samples
+#define LACUNARITY     2.0f
+#define GAIN           0.5f
+
+
+void TileGenerator::InitTileGenerator(int TileSize, float MinHeight, float MaxHeight, unsigned int Seed)
+{
+    m_tileSize = TileSize;
+    m_minHeight = MinHeight;
+    m_maxHeight = MaxHeight;
+    m_seed = Seed;
+}
+
+
+void TileGenerator::GenerateTile(int TileX, int TileZ, std::vector<float>& Heights) const
+{
+    int NumSamples = m_tileSize + 3;
+
+    Heights.resize(NumSamples * NumSamples);
+
+    int StartX = TileX * m_tileSize - 1;
+    int StartZ = TileZ * m_tileSize - 1;
+
+    for (int z = 0 ; z < NumSamples ; z++) {
+        for (int x = 0 ; x < NumSamples ; x++) {
+            Heights[z * NumSamples + x] = GetHeight((float)(StartX + x), (float)(StartZ + z));
+        }
+    }
+}
+
+
+// fractal sum of value noise octaves remapped to the height range
+float TileGenerator::GetHeight(float x, float z) const
+{
+    float Sum = 0.0f;
+    float Amplitude = 1.0f;
+    float Frequency = BASE_FREQUENCY;
+    float TotalAmplitude = 0.0f;
+
+    for (int i = 0 ; i < NUM_OCTAVES ; i++) {
+        Sum += ValueNoise(x * Frequency, z * Frequency) * Amplitude;
+        TotalAmplitude += Amplitude;
+        Amplitude *= GAIN;
+        Frequency *= LACUNARITY;
+    }
+
+    float f = Sum / TotalAmplitude;     // [0, 1]
+
+    // flatten the valleys and sharpen the peaks a bit
+    f = f * f * (3.0f - 2.0f * f);
+
+    return m_minHeight + f * (m_maxHeight - m_minHeight);
+}
+
+
+float TileGenerator::ValueNoise(float x, float z) const
+{
+    float fx = floorf(x);
+    float fz = floorf(z);
+
+    int ix = (int)fx;
+    int iz = (int)fz;
+
+    float tx = x - fx;
+    float tz = z - fz;
+
+    // smoothstep between the lattice values
+    tx = tx * tx * (3.0f - 2.0f * tx);
+    tz = tz * tz * (3.0f - 2.0f * tz);
+
+    float v00 = Hash(ix, iz);
+    float v10 = Hash(ix + 1, iz);
+    float v01 = Hash(ix, iz + 1);
+    float v11 = Hash(ix + 1, iz + 1);
+
+    float Bottom = v00 + (v10 - v00) * tx;
+    float Top = v01 + (v11 - v01) * tx;
+
+    return Bottom + (Top - Bottom) * tz;
+}
+
+
+// integer hash of the lattice point into [0, 1]
+float TileGenerator::Hash(int x, int z) const
+{
+    unsigned int h = m_seed;
+    h ^= (unsigned int)x * 0x27d4eb2dU;
+    h = (h ^ (h >> 15)) * 0x85ebca6bU;
+    h ^= (unsigned int)z * 0x165667b1U;
+    h = (h ^ (h >> 13)) * 0xc2b2ae35U;
+    h ^= h >> 16;
+
+    return (float)(h & 0xffffff) / (float)0xffffff;
+}
@@ -0,0 +1,55 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TILE_GENERATOR_H
+#define TILE_GENERATOR_H
+
+#include <vector>
+
+// Procedural heights for an unbounded terrain. Every sample is a pure
+// function of its global coordinates so tiles can be generated in any
+// order, on any thread, and the shared edges of adjacent tiles match.
+class TileGenerator {
+ public:
+
+    TileGenerator() {}
+
+    void InitTileGenerator(int TileSize, float MinHeight, float MaxHeight, unsigned int Seed);
+
+    // Heights has (TileSize + 3) x (TileSize + 3) samples. The tile covers
+    // TileSize + 1 of them and there is an extra ring around it for the normals.
+    void GenerateTile(int TileX, int TileZ, std::vector<float>& Heights) const;
+
+    float GetHeight(float x, float z) const;
+
+    int GetTileSize() const { return m_tileSize; }
+
+ private:
+
+    float ValueNoise(float x, float z) const;
+
+    float Hash(int x, int z) const;
+
+    int m_tileSize = 0;
+    float m_minHeight = 0.0f;
+    float m_maxHeight = 0.0f;
+    unsigned int m_seed = 0;
+};
+
+#endif
@@ -0,0 +1,218 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+#include "ogldev_util.h"
+#include "tiled_fault_formation.h"
+
+// the weight of a sample beyond the border of a tile
+static const float FIR_FILTER_TOLERANCE = 0.0001f;
+
+
+bool TiledFaultFormation::CreateTiledFaultFormation(const char* pFilename, int NumTilesPerSide, int TileSize, int Iterations,
+                                                    float MinHeight, float MaxHeight, float Filter, int NumThreads)
+{
+    if ((Filter < 0.0f) || (Filter >= 1.0f)) {
+        printf("%s: the filter must be in [0, 1) - %f\n", __FUNCTION__, Filter);
+        return false;
+    }
+
+    if ((TileSize < 1) || (NumTilesPerSide < 1)) {
+        printf("%s: invalid tile size (%d) or number of tiles (%d)\n", __FUNCTION__, TileSize, NumTilesPerSide);
+        return false;
+    }
+
+    m_terrainSize = NumTilesPerSide * TileSize + 1;
+    m_tileSize = TileSize;
+    m_numTilesPerSide = NumTilesPerSide;
+    m_filter = Filter;
+    m_border = (Filter > 0.0f) ? (int)ceilf(logf(FIR_FILTER_TOLERANCE) / logf(Filter)) : 0;
+    m_border = std::min(m_border, m_terrainSize);
+
+    long long Start = GetCurrentTimeMillis();
+
+    NumThreads = std::max(NumThreads, 1);
+
+    if (!m_file.Create(pFilename, NumTilesPerSide, TileSize, NumThreads)) {
+        return false;
+    }
+
+    GenerateFaults(Iterations, MinHeight, MaxHeight);
+
+    m_nextTile = 0;
+
+    std::vector<std::thread> Threads;
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        Threads.push_back(std::thread(&TiledFaultFormation::ProcessTiles, this, i));
+    }
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        Threads[i].join();
+    }
+
+    if (!m_file.Finish(MinHeight, MaxHeight)) {
+        printf("%s: error writing '%s'\n", __FUNCTION__, pFilename);
+        return false;
+    }
+
+    int WindowSize = TileSize + 1 + 2 * m_border;
+    size_t WindowBytes = (size_t)WindowSize * WindowSize * sizeof(float);
+    size_t TileBytes = (size_t)(TileSize + 1) * (TileSize + 1) * sizeof(float);
+    size_t FaultBytes = m_faults.size() * sizeof(Fault);
+
+    printf("Tiled fault formation: %dx%d samples, %d tiles, %d faults, border %d, %d threads, %lld ms\n",
+           m_terrainSize, m_terrainSize, NumTilesPerSide * NumTilesPerSide, Iterations, m_border, NumThreads,
+           GetCurrentTimeMillis() - Start);
+    printf("Working memory %zu KB (full heightmap %zu KB)\n",
+           (FaultBytes + NumThreads * (WindowBytes + TileBytes)) / 1024,
+           (size_t)m_terrainSize * m_terrainSize * sizeof(float) / 1024);
+
+    return true;
+}
+
+
+// Same sequence of random points and heights as FaultFormationTerrain
+void TiledFaultFormation::GenerateFaults(int Iterations, float MinHeight, float MaxHeight)
+{
+    float DeltaHeight = MaxHeight - MinHeight;
+
+    m_faults.resize(Iterations);
+
+    for (int CurIter = 0 ; CurIter < Iterations ; CurIter++) {
+        float IterationRatio = ((float)CurIter / (float)Iterations);
+
+        int x1 = rand() % m_terrainSize;
+        int z1 = rand() % m_terrainSize;
+        int x2, z2;
+
+        do {
+            x2 = rand() % m_terrainSize;
+            z2 = rand() % m_terrainSize;
+        } while ((x1 == x2) && (z1 == z2));
+
+        Fault& f = m_faults[CurIter];
+        f.x = x1;
+        f.z = z1;
+        f.DirX = x2 - x1;
+        f.DirZ = z2 - z1;
+        f.Height = MaxHeight - IterationRatio * DeltaHeight;
+    }
+}
+
+
+void TiledFaultFormation::ProcessTiles(int ThreadIndex)
+{
+    int NumTiles = m_numTilesPerSide * m_numTilesPerSide;
+    int LastSample = m_terrainSize - 1;
+
+    std::vector<float> Window;
+    std::vector<float> Tile((m_tileSize + 1) * (m_tileSize + 1));
+
+    for (int TileIndex = m_nextTile++ ; TileIndex < NumTiles ; TileIndex = m_nextTile++) {
+        int TileX0 = (TileIndex % m_numTilesPerSide) * m_tileSize;
+        int TileZ0 = (TileIndex / m_numTilesPerSide) * m_tileSize;
+
+        // the border stops at the edges of the terrain just like the filter
+        int X0 = std::max(TileX0 - m_border, 0);
+        int Z0 = std::max(TileZ0 - m_border, 0);
+        int X1 = std::min(TileX0 + m_tileSize + m_border, LastSample);
+        int Z1 = std::min(TileZ0 + m_tileSize + m_border, LastSample);
+
+        int Width = X1 - X0 + 1;
+        int Depth = Z1 - Z0 + 1;
+
+        Window.assign(Width * Depth, 0.0f);
+
+        // The cross product grows by DirZ with every step along x. Its terms
+        // reach the square of the terrain size so they don't fit in an int.
+        for (int i = 0 ; i < (int)m_faults.size() ; i++) {
+            const Fault& f = m_faults[i];
+
+            for (int z = Z0 ; z <= Z1 ; z++) {
+                long long CrossProduct = (long long)(X0 - f.x) * f.DirZ - (long long)f.DirX * (z - f.z);
+                float* pRow = &Window[(z - Z0) * Width];
+
+                for (int x = 0 ; x < Width ; x++) {
+                    if (CrossProduct > 0) {
+                        pRow[x] += f.Height;
+                    }
+
+                    CrossProduct += f.DirZ;
+                }
+            }
+        }
+
+        ApplyFIRFilter(Window, Width, Depth);
+
+        int Index = 0;
+
+        for (int z = TileZ0 ; z <= TileZ0 + m_tileSize ; z++) {
+            for (int x = TileX0 ; x <= TileX0 + m_tileSize ; x++) {
+                Tile[Index++] = Window[(z - Z0) * Width + (x - X0)];
+            }
+        }
+
+        m_file.WriteTile(TileIndex, Tile, ThreadIndex);
+    }
+}
+
+
+// the four passes of FaultFormationTerrain::ApplyFIRFilter on the window
+void TiledFaultFormation::ApplyFIRFilter(std::vector<float>& Heights, int Width, int Depth) const
+{
+    float Filter = m_filter;
+
+    // left to right and right to left
+    for (int z = 0 ; z < Depth ; z++) {
+        float* pRow = &Heights[z * Width];
+
+        float PrevVal = pRow[0];
+
+        for (int x = 1 ; x < Width ; x++) {
+            PrevVal = pRow[x] = Filter * PrevVal + (1 - Filter) * pRow[x];
+        }
+
+        PrevVal = pRow[Width - 1];
+
+        for (int x = Width - 2 ; x >= 0 ; x--) {
+            PrevVal = pRow[x] = Filter * PrevVal + (1 - Filter) * pRow[x];
+        }
+    }
+
+    // bottom to top and top to bottom
+    for (int x = 0 ; x < Width ; x++) {
+        float PrevVal = Heights[x];
+
+        for (int z = 1 ; z < Depth ; z++) {
+            float& Val = Heights[z * Width + x];
+            PrevVal = Val = Filter * PrevVal + (1 - Filter) * Val;
+        }
+
+        PrevVal = Heights[(Depth - 1) * Width + x];
+
+        for (int z = Depth - 2 ; z >= 0 ; z--) {
+            float& Val = Heights[z * Width + x];
+            PrevVal = Val = Filter * PrevVal + (1 - Filter) * Val;
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TILED_FAULT_FORMATION_H
+#define TILED_FAULT_FORMATION_H
+
+#include <vector>
+#include <atomic>
+
+#include "tiled_height_map.h"
+
+// Fault formation (see Terrain2) for heightmaps which don't fit in memory.
+// Every fault is a line between two random points which raises the side on
+// its right. The faults themselves are tiny so they are all generated up
+// front and a sample is just the sum of the faults it is on the right of.
+// The FIR filter is not local since it runs across entire rows and columns,
+// but the weight of a sample drops by Filter at every step. Each tile is
+// filtered together with a border which is wide enough for that weight to
+// fade out and the border is then cropped. The tiles are written to disk
+// (see TiledHeightMapFile) so the memory use depends only on the tile size,
+// the filter and the number of threads.
+class TiledFaultFormation {
+ public:
+
+    TiledFaultFormation() {}
+
+    bool CreateTiledFaultFormation(const char* pFilename, int NumTilesPerSide, int TileSize, int Iterations,
+                                   float MinHeight, float MaxHeight, float Filter, int NumThreads);
+
+ private:
+
+    struct Fault {
+        int x = 0;
+        int z = 0;
+        int DirX = 0;
+        int DirZ = 0;
+        float Height = 0.0f;
+    };
+
+    void GenerateFaults(int Iterations, float MinHeight, float MaxHeight);
+
+    void ProcessTiles(int ThreadIndex);
+
+    void ApplyFIRFilter(std::vector<float>& Heights, int Width, int Depth) const;
+
+    int m_terrainSize = 0;
+    int m_tileSize = 0;
+    int m_numTilesPerSide = 0;
+    int m_border = 0;
+    float m_filter = 0.0f;
+    std::vector<Fault> m_faults;
+
+    TiledHeightMapFile m_file;
+    std::atomic<int> m_nextTile;
+};
+
+#endif
@@ -0,0 +1,207 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+
+#include "tiled_height_map.h"
+
+#ifdef _WIN32
+#define FSEEK64 _fseeki64
+#else
+#define FSEEK64 fseeko
+#endif
+
+#define TILED_HEIGHT_MAP_VERSION 1
+
+struct TiledHeightMapHeader {
+    char Magic[4] = { 'O', 'G', 'H', 'T' };
+    int Version = TILED_HEIGHT_MAP_VERSION;
+    int TerrainSize = 0;
+    int TileSize = 0;
+    int NumTilesPerSide = 0;
+    float MinHeight = 0.0f;
+    float MaxHeight = 0.0f;
+};
+
+
+static long long GetTileOffset(int TileIndex, int TileSize)
+{
+    long long TileBytes = (long long)(TileSize + 1) * (TileSize + 1) * sizeof(float);
+
+    return (long long)sizeof(TiledHeightMapHeader) + TileIndex * TileBytes;
+}
+
+
+TiledHeightMapFile::~TiledHeightMapFile()
+{
+    if (m_pFile) {
+        fclose(m_pFile);
+    }
+}
+
+
+bool TiledHeightMapFile::Create(const char* pFilename, int NumTilesPerSide, int TileSize, int NumThreads)
+{
+    m_pFile = fopen(pFilename, "wb+");
+
+    if (!m_pFile) {
+        printf("%s: error opening '%s'\n", __FUNCTION__, pFilename);
+        return false;
+    }
+
+    m_tileSize = TileSize;
+    m_numTilesPerSide = NumTilesPerSide;
+    m_writeError = false;
+    m_threadMin.assign(NumThreads, FLT_MAX);
+    m_threadMax.assign(NumThreads, -FLT_MAX);
+
+    // the height range is written by Finish
+    TiledHeightMapHeader Header;
+    Header.TerrainSize = NumTilesPerSide * TileSize + 1;
+    Header.TileSize = TileSize;
+    Header.NumTilesPerSide = NumTilesPerSide;
+
+    if (fwrite(&Header, sizeof(Header), 1, m_pFile) != 1) {
+        m_writeError = true;
+    }
+
+    return true;
+}
+
+
+void TiledHeightMapFile::WriteTile(int TileIndex, const std::vector<float>& Tile, int ThreadIndex)
+{
+    for (int i = 0 ; i < (int)Tile.size() ; i++) {
+        m_threadMin[ThreadIndex] = std::min(m_threadMin[ThreadIndex], Tile[i]);
+        m_threadMax[ThreadIndex] = std::max(m_threadMax[ThreadIndex], Tile[i]);
+    }
+
+    std::lock_guard<std::mutex> Lock(m_fileMutex);
+
+    if ((FSEEK64(m_pFile, GetTileOffset(TileIndex, m_tileSize), SEEK_SET) != 0) ||
+        (fwrite(&Tile[0], sizeof(float), Tile.size(), m_pFile) != Tile.size())) {
+        m_writeError = true;
+    }
+}
+
+
+bool TiledHeightMapFile::Finish(float MinHeight, float MaxHeight)
+{
+    bool Success = !m_writeError && Normalize(MinHeight, MaxHeight);
+
+    Success = (fclose(m_pFile) == 0) && Success;
+    m_pFile = NULL;
+
+    return Success;
+}
+
+
+// Remaps the file to [MinHeight, MaxHeight] one tile at a time
+bool TiledHeightMapFile::Normalize(float MinHeight, float MaxHeight)
+{
+    float Min = *std::min_element(m_threadMin.begin(), m_threadMin.end());
+    float Max = *std::max_element(m_threadMax.begin(), m_threadMax.end());
+
+    float MinMaxDelta = Max - Min;
+    float MinMaxRange = MaxHeight - MinHeight;
+
+    int NumTiles = m_numTilesPerSide * m_numTilesPerSide;
+    std::vector<float> Tile((m_tileSize + 1) * (m_tileSize + 1));
+
+    for (int TileIndex = 0 ; TileIndex < NumTiles ; TileIndex++) {
+        long long Offset = GetTileOffset(TileIndex, m_tileSize);
+
+        if ((FSEEK64(m_pFile, Offset, SEEK_SET) != 0) ||
+            (fread(&Tile[0], sizeof(float), Tile.size(), m_pFile) != Tile.size())) {
+            return false;
+        }
+
+        if (MinMaxDelta > 0.0f) {
+            for (int i = 0 ; i < (int)Tile.size() ; i++) {
+                Tile[i] = ((Tile[i] - Min) / MinMaxDelta) * MinMaxRange + MinHeight;
+            }
+        }
+
+        if ((FSEEK64(m_pFile, Offset, SEEK_SET) != 0) ||
+            (fwrite(&Tile[0], sizeof(float), Tile.size(), m_pFile) != Tile.size())) {
+            return false;
+        }
+    }
+
+    TiledHeightMapHeader Header;
+    Header.TerrainSize = m_numTilesPerSide * m_tileSize + 1;
+    Header.TileSize = m_tileSize;
+    Header.NumTilesPerSide = m_numTilesPerSide;
+    Header.MinHeight = MinHeight;
+    Header.MaxHeight = MaxHeight;
+
+    if ((FSEEK64(m_pFile, 0, SEEK_SET) != 0) || (fwrite(&Header, sizeof(Header), 1, m_pFile) != 1)) {
+        return false;
+    }
+
+    return true;
+}
+
+
+bool TiledHeightMapFile::Load(const char* pFilename, Array2D<float>& HeightMap)
+{
+    FILE* f = fopen(pFilename, "rb");
+
+    if (!f) {
+        printf("%s: error opening '%s'\n", __FUNCTION__, pFilename);
+        return false;
+    }
+
+    TiledHeightMapHeader Header;
+
+    if ((fread(&Header, sizeof(Header), 1, f) != 1) ||
+        (memcmp(Header.Magic, "OGHT", 4) != 0) ||
+        (Header.Version != TILED_HEIGHT_MAP_VERSION)) {
+        printf("%s: '%s' is not a tiled heightmap\n", __FUNCTION__, pFilename);
+        fclose(f);
+        return false;
+    }
+
+    HeightMap.InitArray2D(Header.TerrainSize, Header.TerrainSize);
+
+    int TileSamples = Header.TileSize + 1;
+    std::vector<float> Tile(TileSamples * TileSamples);
+
+    for (int TileZ = 0 ; TileZ < Header.NumTilesPerSide ; TileZ++) {
+        for (int TileX = 0 ; TileX < Header.NumTilesPerSide ; TileX++) {
+            if (fread(&Tile[0], sizeof(float), Tile.size(), f) != Tile.size()) {
+                printf("%s: '%s' is truncated\n", __FUNCTION__, pFilename);
+                fclose(f);
+                return false;
+            }
+
+            for (int z = 0 ; z < TileSamples ; z++) {
+                for (int x = 0 ; x < TileSamples ; x++) {
+                    HeightMap.Set(TileX * Header.TileSize + x, TileZ * Header.TileSize + z, Tile[z * TileSamples + x]);
+                }
+            }
+        }
+    }
+
+    fclose(f);
+
+    return true;
+}
@@ -0,0 +1,67 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TILED_HEIGHT_MAP_H
+#define TILED_HEIGHT_MAP_H
+
+#include <stdio.h>
+#include <vector>
+#include <mutex>
+
+#include "ogldev_array_2d.h"
+
+// A heightmap file which is written one tile at a time by the out of core
+// generators (see TiledMidpointDisp and TiledFaultFormation). The file
+// starts with a TiledHeightMapHeader followed by the tiles in row major
+// order. Each tile has (TileSize + 1) x (TileSize + 1) samples so adjacent
+// tiles share their edges. The generators write raw heights and Finish
+// remaps the whole file to the height range.
+class TiledHeightMapFile {
+ public:
+
+    TiledHeightMapFile() {}
+
+    ~TiledHeightMapFile();
+
+    bool Create(const char* pFilename, int NumTilesPerSide, int TileSize, int NumThreads);
+
+    // Can be called from several threads, each one with its own index in
+    // [0, NumThreads). The tiles can be written in any order.
+    void WriteTile(int TileIndex, const std::vector<float>& Tile, int ThreadIndex);
+
+    // remaps the heights to [MinHeight, MaxHeight] and closes the file
+    bool Finish(float MinHeight, float MaxHeight);
+
+    // Reads the entire map. Only for maps which fit in memory.
+    static bool Load(const char* pFilename, Array2D<float>& HeightMap);
+
+ private:
+
+    bool Normalize(float MinHeight, float MaxHeight);
+
+    int m_tileSize = 0;
+    int m_numTilesPerSide = 0;
+    FILE* m_pFile = NULL;
+    std::mutex m_fileMutex;
+    bool m_writeError = false;
+    std::vector<float> m_threadMin;
+    std::vector<float> m_threadMax;
+};
+
+#endif
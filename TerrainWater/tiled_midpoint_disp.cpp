@@ -0,0 +1,230 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+#include "ogldev_util.h"
+#include "tiled_midpoint_disp.h"
+
+void TiledMidpointDisp::Window::InitWindow(int x0, int z0, int size, int stride)
+{
+    X0 = x0;
+    Z0 = z0;
+    Size = size;
+    Stride = stride;
+    Heights.assign(size * size, 0.0f);
+}
+
+
+bool TiledMidpointDisp::CreateTiledMidpointDisplacement(const char* pFilename, int NumTilesPerSide, int TileSize, float Roughness,
+                                                        float MinHeight, float MaxHeight, unsigned int Seed, int NumThreads)
+{
+    if (Roughness < 0.0f) {
+        printf("%s: roughness must be positive - %f\n", __FUNCTION__, Roughness);
+        return false;
+    }
+
+    if ((TileSize < 2) || ((TileSize & (TileSize - 1)) != 0) ||
+        (NumTilesPerSide < 1) || ((NumTilesPerSide & (NumTilesPerSide - 1)) != 0)) {
+        printf("%s: the tile size (%d) and the number of tiles (%d) must be powers of two\n", __FUNCTION__, TileSize, NumTilesPerSide);
+        return false;
+    }
+
+    m_terrainSize = NumTilesPerSide * TileSize + 1;
+    m_tileSize = TileSize;
+    m_numTilesPerSide = NumTilesPerSide;
+    m_heightReduce = powf(2.0f, -Roughness);
+    m_seed = Seed;
+
+    long long Start = GetCurrentTimeMillis();
+
+    NumThreads = std::max(NumThreads, 1);
+
+    if (!m_file.Create(pFilename, NumTilesPerSide, TileSize, NumThreads)) {
+        return false;
+    }
+
+    CreateCoarseGrid();
+
+    m_nextTile = 0;
+
+    std::vector<std::thread> Threads;
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        Threads.push_back(std::thread(&TiledMidpointDisp::ProcessTiles, this, i));
+    }
+
+    for (int i = 0 ; i < NumThreads ; i++) {
+        Threads[i].join();
+    }
+
+    if (!m_file.Finish(MinHeight, MaxHeight)) {
+        printf("%s: error writing '%s'\n", __FUNCTION__, pFilename);
+        return false;
+    }
+
+    size_t WindowBytes = (size_t)(3 * TileSize + 1) * (3 * TileSize + 1) * sizeof(float);
+    size_t TileBytes = (size_t)(TileSize + 1) * (TileSize + 1) * sizeof(float);
+    size_t CoarseBytes = m_coarseGrid.Heights.size() * sizeof(float);
+
+    printf("Tiled midpoint displacement: %dx%d samples, %d tiles, %d threads, %lld ms\n",
+           m_terrainSize, m_terrainSize, NumTilesPerSide * NumTilesPerSide, NumThreads, GetCurrentTimeMillis() - Start);
+    printf("Working memory %zu KB (full heightmap %zu KB)\n",
+           (CoarseBytes + NumThreads * (WindowBytes + TileBytes)) / 1024,
+           (size_t)m_terrainSize * m_terrainSize * sizeof(float) / 1024);
+
+    return true;
+}
+
+
+// a random value in [-1, 1] which depends only on the position and the seed
+float TiledMidpointDisp::Displacement(int x, int z) const
+{
+    unsigned int h = m_seed;
+    h ^= (unsigned int)x * 0x27d4eb2dU;
+    h = (h ^ (h >> 15)) * 0x85ebca6bU;
+    h ^= (unsigned int)z * 0x165667b1U;
+    h = (h ^ (h >> 13)) * 0xc2b2ae35U;
+    h ^= h >> 16;
+
+    return (float)(h & 0xffffff) / (float)0xffffff * 2.0f - 1.0f;
+}
+
+
+float TiledMidpointDisp::GetLevelHeight(int RectSize) const
+{
+    float CurHeight = (float)(m_terrainSize - 1) / 2.0f;
+
+    for (int r = m_terrainSize - 1 ; r > RectSize ; r /= 2) {
+        CurHeight *= m_heightReduce;
+    }
+
+    return CurHeight;
+}
+
+
+// Runs the diamond and the square steps of a single level on the part of
+// the window inside the region. The bounds of the region are multiples of
+// RectSize. Samples outside the region are treated as missing just like
+// the samples beyond the edges of the terrain.
+void TiledMidpointDisp::ProcessLevel(Window& w, const Region& r, int RectSize, float CurHeight) const
+{
+    int HalfRectSize = RectSize / 2;
+
+    // the center of every rect
+    for (int z = r.Z0 + HalfRectSize ; z < r.Z1 ; z += RectSize) {
+        for (int x = r.X0 + HalfRectSize ; x < r.X1 ; x += RectSize) {
+            float TopLeft     = w.At(x - HalfRectSize, z - HalfRectSize);
+            float TopRight    = w.At(x + HalfRectSize, z - HalfRectSize);
+            float BottomLeft  = w.At(x - HalfRectSize, z + HalfRectSize);
+            float BottomRight = w.At(x + HalfRectSize, z + HalfRectSize);
+
+            float MidPoint = (TopLeft + TopRight + BottomLeft + BottomRight) / 4.0f;
+
+            w.At(x, z) = MidPoint + Displacement(x, z) * CurHeight;
+        }
+    }
+
+    // the middle of every edge from its two corners and the two neighboring centers
+    for (int z = r.Z0 ; z <= r.Z1 ; z += HalfRectSize) {
+        int StartX = (((z - r.Z0) / HalfRectSize) % 2 == 0) ? r.X0 + HalfRectSize : r.X0;
+
+        for (int x = StartX ; x <= r.X1 ; x += RectSize) {
+            float Sum = 0.0f;
+            int Count = 0;
+
+            const int Offsets[4][2] = { { -HalfRectSize, 0 }, { HalfRectSize, 0 }, { 0, -HalfRectSize }, { 0, HalfRectSize } };
+
+            for (int i = 0 ; i < 4 ; i++) {
+                int nx = x + Offsets[i][0];
+                int nz = z + Offsets[i][1];
+
+                if (r.Contains(nx, nz)) {
+                    Sum += w.At(nx, nz);
+                    Count++;
+                }
+            }
+
+            w.At(x, z) = Sum / (float)Count + Displacement(x, z) * CurHeight;
+        }
+    }
+}
+
+
+// the levels above the tile size only touch the corners of the tiles
+void TiledMidpointDisp::CreateCoarseGrid()
+{
+    m_coarseGrid.InitWindow(0, 0, m_numTilesPerSide + 1, m_tileSize);
+
+    Region r = { 0, 0, m_terrainSize - 1, m_terrainSize - 1 };
+
+    for (int RectSize = m_terrainSize - 1 ; RectSize > m_tileSize ; RectSize /= 2) {
+        ProcessLevel(m_coarseGrid, r, RectSize, GetLevelHeight(RectSize));
+    }
+}
+
+
+void TiledMidpointDisp::ProcessTiles(int ThreadIndex)
+{
+    int NumTiles = m_numTilesPerSide * m_numTilesPerSide;
+    int LastSample = m_terrainSize - 1;
+
+    Window w;
+    std::vector<float> Tile((m_tileSize + 1) * (m_tileSize + 1));
+
+    for (int TileIndex = m_nextTile++ ; TileIndex < NumTiles ; TileIndex = m_nextTile++) {
+        int TileX0 = (TileIndex % m_numTilesPerSide) * m_tileSize;
+        int TileZ0 = (TileIndex / m_numTilesPerSide) * m_tileSize;
+
+        // the window has room for one tile on each side
+        w.InitWindow(TileX0 - m_tileSize, TileZ0 - m_tileSize, 3 * m_tileSize + 1, 1);
+
+        for (int z = std::max(w.Z0, 0) ; z <= std::min(TileZ0 + 2 * m_tileSize, LastSample) ; z += m_tileSize) {
+            for (int x = std::max(w.X0, 0) ; x <= std::min(TileX0 + 2 * m_tileSize, LastSample) ; x += m_tileSize) {
+                w.At(x, z) = m_coarseGrid.At(x, z);
+            }
+        }
+
+        // The samples of the next level are correct only at a distance of
+        // half a rect from the border of the region so each level works on
+        // a border which is as wide as its rect.
+        for (int RectSize = m_tileSize ; RectSize >= 2 ; RectSize /= 2) {
+            Region r;
+            r.X0 = std::max(TileX0 - RectSize, 0);
+            r.Z0 = std::max(TileZ0 - RectSize, 0);
+            r.X1 = std::min(TileX0 + m_tileSize + RectSize, LastSample);
+            r.Z1 = std::min(TileZ0 + m_tileSize + RectSize, LastSample);
+
+            ProcessLevel(w, r, RectSize, GetLevelHeight(RectSize));
+        }
+
+        int Index = 0;
+
+        for (int z = TileZ0 ; z <= TileZ0 + m_tileSize ; z++) {
+            for (int x = TileX0 ; x <= TileX0 + m_tileSize ; x++) {
+                Tile[Index++] = w.At(x, z);
+            }
+        }
+
+        m_file.WriteTile(TileIndex, Tile, ThreadIndex);
+    }
+}
+
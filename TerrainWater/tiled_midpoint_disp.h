@@ -0,0 +1,87 @@
+/*
+
+        Copyright 2023 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#ifndef TILED_MIDPOINT_DISP_H
+#define TILED_MIDPOINT_DISP_H
+
+#include <vector>
+#include <atomic>
+
+#include "tiled_height_map.h"
+
+// Midpoint displacement for heightmaps which don't fit in memory. The
+// levels down to the tile size are computed on a coarse grid which holds
+// only the tile corners. Every tile is then refined on its own together
+// with the border it needs from its neighbors. The border shrinks with the
+// rect size so it is one tile wide at the first level and one sample wide
+// at the last. The random displacement is a hash of the sample position
+// so the tiles can be processed in parallel and in any order. Finished
+// tiles are written to disk (see TiledHeightMapFile) and the memory use
+// depends only on the tile size and the number of threads.
+class TiledMidpointDisp {
+ public:
+
+    TiledMidpointDisp() {}
+
+    bool CreateTiledMidpointDisplacement(const char* pFilename, int NumTilesPerSide, int TileSize, float Roughness,
+                                         float MinHeight, float MaxHeight, unsigned int Seed, int NumThreads);
+
+ private:
+
+    // A square set of samples which are Stride apart starting at (X0, Z0)
+    struct Window {
+        int X0 = 0;
+        int Z0 = 0;
+        int Size = 0;
+        int Stride = 1;
+        std::vector<float> Heights;
+
+        void InitWindow(int x0, int z0, int size, int stride);
+
+        float& At(int x, int z) { return Heights[((z - Z0) / Stride) * Size + (x - X0) / Stride]; }
+    };
+
+    struct Region {
+        int X0, Z0, X1, Z1;
+
+        bool Contains(int x, int z) const { return (x >= X0) && (x <= X1) && (z >= Z0) && (z <= Z1); }
+    };
+
+    void ProcessLevel(Window& w, const Region& r, int RectSize, float CurHeight) const;
+
+    void CreateCoarseGrid();
+
+    void ProcessTiles(int ThreadIndex);
+
+    float Displacement(int x, int z) const;
+
+    float GetLevelHeight(int RectSize) const;
+
+    int m_terrainSize = 0;
+    int m_tileSize = 0;
+    int m_numTilesPerSide = 0;
+    float m_heightReduce = 1.0f;
+    unsigned int m_seed = 0;
+
+    Window m_coarseGrid;
+    TiledHeightMapFile m_file;
+    std::atomic<int> m_nextTile;
+};
+
+#endif
@@ -21,6 +21,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <chrono>
 #include <GL/glew.h>
 
 
@@ -32,10 +33,33 @@
 #include "ogldev_basic_mesh.h"
 #include "ogldev_world_transform.h"
 #include "ogldev_phong_renderer.h"
+#include "ogldev_animation_system.h"
 
 #define WINDOW_WIDTH  2560
 #define WINDOW_HEIGHT 1440
 
+// see PhongDemo::RunBenchmark
+enum BENCHMARK {
+    BENCHMARK_NONE,
+    BENCHMARK_ANIMATION,
+    BENCHMARK_CROWD,
+    BENCHMARK_SKINNING,
+};
+
+static const int ANIM_BENCHMARK_PASSES = 20;
+static const int ANIM_BENCHMARK_BUCKETS = 10;
+static const int CROWD_BENCHMARK_UPDATES = 50;
+static const int SKINNING_BENCHMARK_FRAMES = 100;
+
+// every multithreaded benchmark runs on one thread and then on all the cores (zero)
+static const int BENCHMARK_THREAD_COUNTS[] = { 1, 0 };
+
+static double GetElapsedMs(const std::chrono::steady_clock::time_point& Start)
+{
+    std::chrono::duration<double, std::milli> Elapsed = std::chrono::steady_clock::now() - Start;
+    return Elapsed.count();
+}
+
 static void KeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 static void CursorPosCallback(GLFWwindow* window, double x, double y);
 static void MouseButtonCallback(GLFWwindow* window, int Button, int Action, int Mode);
@@ -96,6 +120,206 @@ public:
     }
 
 
+    // must be called before Init, see SkinnedMesh::SetAnimationBakeRate
+    void SetAnimationBakeRate(float SamplesPerSecond) { m_animationBakeRate = SamplesPerSecond; }
+
+
+    // must be called before Init, see SkinnedMesh::EnableCPUSkinning
+    void EnableCPUSkinning() { m_cpuSkinning = true; }
+
+
+    // must be called after Init
+    void RunBenchmark(BENCHMARK Benchmark)
+    {
+        if (pMesh1->NumAnimations() == 0) {
+            printf("The mesh has no animations\n");
+            return;
+        }
+
+        switch (Benchmark) {
+        case BENCHMARK_ANIMATION:
+            RunAnimationBenchmark();
+            break;
+
+        case BENCHMARK_CROWD:
+            RunCrowdBenchmark();
+            break;
+
+        case BENCHMARK_SKINNING:
+            RunSkinningBenchmark();
+            break;
+
+        default:
+            break;
+        }
+    }
+
+
+    // Samples the first animation at 60 frames per second and prints the average
+    // cost of a frame in every tenth of the clip. With the keyframe cursors the
+    // cost should be the same across the clip. The same number of frames is then
+    // sampled at random times which forces the cursors to fall back to a search.
+    void RunAnimationBenchmark()
+    {
+        float DurationSec = pMesh1->GetAnimationDurationSec(0);
+        int NumFrames = std::max((int)(DurationSec * 60.0f), 1);
+
+        vector<Matrix4f> Transforms;
+        double BucketMs[ANIM_BENCHMARK_BUCKETS] = {};
+        int BucketFrames[ANIM_BENCHMARK_BUCKETS] = {};
+
+        for (int Pass = 0 ; Pass < ANIM_BENCHMARK_PASSES ; Pass++) {
+            for (int Frame = 0 ; Frame < NumFrames ; Frame++) {
+                std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+                pMesh1->GetBoneTransforms((float)Frame / 60.0f, Transforms);
+
+                int Bucket = std::min(Frame * ANIM_BENCHMARK_BUCKETS / NumFrames, ANIM_BENCHMARK_BUCKETS - 1);
+                BucketMs[Bucket] += GetElapsedMs(Start);
+                BucketFrames[Bucket]++;
+            }
+        }
+
+        printf("Animation of %.2f seconds, %d bones, %d frames per pass\n", DurationSec, pMesh1->NumBones(), NumFrames);
+
+        for (int i = 0 ; i < ANIM_BENCHMARK_BUCKETS ; i++) {
+            printf("%3d%% - %3d%%: %.4f ms per frame\n", i * 10, (i + 1) * 10,
+                   BucketFrames[i] ? BucketMs[i] / (double)BucketFrames[i] : 0.0);
+        }
+
+        double RandomMs = 0.0;
+        int NumRandomFrames = NumFrames * ANIM_BENCHMARK_PASSES;
+
+        for (int Frame = 0 ; Frame < NumRandomFrames ; Frame++) {
+            float AnimationTimeSec = RandomFloat() * DurationSec;
+
+            std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+            pMesh1->GetBoneTransforms(AnimationTimeSec, Transforms);
+
+            RandomMs += GetElapsedMs(Start);
+        }
+
+        printf("random access: %.4f ms per frame\n", RandomMs / (double)NumRandomFrames);
+    }
+
+
+    // Evaluates crowds of instances of the mesh with the animation system, first
+    // on a single thread and then on all the cores, and prints the throughput.
+    // The largest crowd is then spread up to 40 units from the camera and
+    // evaluated with and without the animation LOD.
+    void RunCrowdBenchmark()
+    {
+        int CrowdSizes[] = { 100, 500, 2000 };
+
+        for (int t = 0 ; t < (int)ARRAY_SIZE_IN_ELEMENTS(BENCHMARK_THREAD_COUNTS) ; t++) {
+            AnimationSystem Animations;
+            Animations.InitAnimationSystem(BENCHMARK_THREAD_COUNTS[t]);
+
+            for (int c = 0 ; c < (int)ARRAY_SIZE_IN_ELEMENTS(CrowdSizes) ; c++) {
+                vector<AnimationInstance> Crowd(CrowdSizes[c]);
+                vector<float> TimeOffsets(CrowdSizes[c]);
+
+                for (int i = 0 ; i < CrowdSizes[c] ; i++) {
+                    Crowd[i].pMesh = pMesh1;
+                    Crowd[i].AnimationIndex = i % pMesh1->NumAnimations();
+                    TimeOffsets[i] = RandomFloat() * pMesh1->GetAnimationDurationSec(Crowd[i].AnimationIndex);
+                }
+
+                float TotalMs = 0.0f;
+
+                for (int Update = 0 ; Update < CROWD_BENCHMARK_UPDATES ; Update++) {
+                    for (int i = 0 ; i < CrowdSizes[c] ; i++) {
+                        Crowd[i].AnimationTimeSec = TimeOffsets[i] + (float)Update / 60.0f;
+                    }
+
+                    Animations.Update(Crowd);
+                    TotalMs += Animations.GetLastUpdateMs();
+                }
+
+                float UpdateMs = TotalMs / (float)CROWD_BENCHMARK_UPDATES;
+                float BonesPerMs = (float)Animations.GetPalettes().size() / UpdateMs;
+
+                printf("%d threads, %d characters x %d bones: %.3f ms per update, %.0f bones per ms\n",
+                       Animations.GetNumThreads(), CrowdSizes[c], pMesh1->NumBones(), UpdateMs, BonesPerMs);
+            }
+        }
+
+        int CrowdSize = CrowdSizes[ARRAY_SIZE_IN_ELEMENTS(CrowdSizes) - 1];
+        vector<AnimationInstance> Crowd(CrowdSize);
+
+        for (int i = 0 ; i < CrowdSize ; i++) {
+            Crowd[i].pMesh = pMesh1;
+            Crowd[i].AnimationIndex = i % pMesh1->NumAnimations();
+            Crowd[i].DistanceToCamera = RandomFloat() * 40.0f;
+        }
+
+        for (int Lod = 0 ; Lod < 2 ; Lod++) {
+            AnimationSystem Animations;
+            Animations.InitAnimationSystem();
+
+            if (Lod) {
+                Animations.SetLODDistances(10.0f, 20.0f, 30.0f);
+            }
+
+            float TotalMs = 0.0f;
+            unsigned int TotalBones = 0;
+
+            for (int Update = 0 ; Update < CROWD_BENCHMARK_UPDATES ; Update++) {
+                for (int i = 0 ; i < CrowdSize ; i++) {
+                    Crowd[i].AnimationTimeSec = (float)Update / 60.0f;
+                }
+
+                Animations.Update(Crowd);
+                TotalMs += Animations.GetLastUpdateMs();
+                TotalBones += Animations.GetLastNumEvaluatedBones();
+            }
+
+            printf("LOD %s, %d characters: %.3f ms per update, %u bones evaluated per update\n", Lod ? "on" : "off",
+                   CrowdSize, TotalMs / (float)CROWD_BENCHMARK_UPDATES, TotalBones / CROWD_BENCHMARK_UPDATES);
+        }
+    }
+
+
+    // Skins the mesh on the CPU into system memory, first on a single thread
+    // and then on all the cores, and finally into a mapped GL buffer.
+    void RunSkinningBenchmark()
+    {
+        uint NumVertices = pMesh1->GetNumSkinnedVertices();
+        vector<Vector3f> Vertices(NumVertices * 2);
+
+        vector<Matrix4f> Transforms;
+        pMesh1->GetBoneTransforms(0.0f, Transforms);
+
+        for (int t = 0 ; t < (int)ARRAY_SIZE_IN_ELEMENTS(BENCHMARK_THREAD_COUNTS) ; t++) {
+            std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+            for (int Frame = 0 ; Frame < SKINNING_BENCHMARK_FRAMES ; Frame++) {
+                pMesh1->CalcSkinnedVertices(Transforms.data(), &Vertices[0], &Vertices[1], sizeof(Vector3f) * 2, BENCHMARK_THREAD_COUNTS[t]);
+            }
+
+            printf("%s, %d vertices: %.3f ms per frame\n", BENCHMARK_THREAD_COUNTS[t] == 1 ? "1 thread" : "all threads",
+                   NumVertices, GetElapsedMs(Start) / (double)SKINNING_BENCHMARK_FRAMES);
+        }
+
+        GLuint Buffer = 0;
+        glGenBuffers(1, &Buffer);
+        glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+        glBufferData(GL_ARRAY_BUFFER, NumVertices * sizeof(Vector3f) * 2, NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        std::chrono::steady_clock::time_point Start = std::chrono::steady_clock::now();
+
+        for (int Frame = 0 ; Frame < SKINNING_BENCHMARK_FRAMES ; Frame++) {
+            pMesh1->CalcSkinnedVerticesToBuffer(Transforms.data(), Buffer);
+        }
+
+        glFinish();
+
+        printf("mapped buffer: %.3f ms per frame\n", GetElapsedMs(Start) / (double)SKINNING_BENCHMARK_FRAMES);
+
+        glDeleteBuffers(1, &Buffer);
+    }
+
+
     void Run()
     {
         while (!glfwWindowShouldClose(window)) {
@@ -250,8 +474,15 @@ private:
         // pMesh1->SetPosition(0.0f, 0.0f, 10.0f);
 
         pMesh1 = new SkinnedMesh();
+        pMesh1->SetAnimationBakeRate(m_animationBakeRate);
+        pMesh1->EnableCPUSkinning(m_cpuSkinning);
         pMesh1->LoadMesh("../Content/Vanguard2.fbx");
         pMesh1->SetPosition(0.0f, 0.0f, 15.0f);
+
+        // everything the demo needs was baked so the Assimp scene can go
+        if (m_animationBakeRate > 0.0f) {
+            pMesh1->ReleaseScene();
+        }
         //        pMesh1->SetRotation(270.0f, 180.0f, 0.0f);
     }
 
@@ -259,6 +490,8 @@ private:
     BasicCamera* m_pGameCamera = NULL;
     PhongRenderer m_phongRenderer;
     SkinnedMesh* pMesh1 = NULL;
+    float m_animationBakeRate = 0.0f;
+    bool m_cpuSkinning = false;
     PersProjInfo persProjInfo;
     PointLight pointLights[LightingTechnique::MAX_POINT_LIGHTS];
     SpotLight spotLights[LightingTechnique::MAX_SPOT_LIGHTS];
@@ -294,8 +527,29 @@ int main(int argc, char** argv)
 {
     app = new PhongDemo();
 
+    BENCHMARK Benchmark = BENCHMARK_NONE;
+
+    for (int i = 1 ; i < argc ; i++) {
+        if (strcmp(argv[i], "--bake-animations") == 0) {
+            app->SetAnimationBakeRate(30.0f);
+        } else if (strcmp(argv[i], "--anim-benchmark") == 0) {
+            Benchmark = BENCHMARK_ANIMATION;
+        } else if (strcmp(argv[i], "--crowd-benchmark") == 0) {
+            Benchmark = BENCHMARK_CROWD;
+        } else if (strcmp(argv[i], "--skinning-benchmark") == 0) {
+            Benchmark = BENCHMARK_SKINNING;
+            app->EnableCPUSkinning();
+        }
+    }
+
     app->Init();
 
+    if (Benchmark != BENCHMARK_NONE) {
+        app->RunBenchmark(Benchmark);
+        delete app;
+        return 0;
+    }
+
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
     glFrontFace(GL_CW);
     glCullFace(GL_BACK);
@@ -0,0 +1,14 @@
+#!/bin/bash
+
+OGLDEV_DIR="../.."
+CPPFLAGS="-I$OGLDEV_DIR/Include -I$OGLDEV_DIR/Common -O2"
+LDFLAGS="`pkg-config --libs glew glfw3` -lglut -lpthread"
+
+g++ texture_compressor.cpp \
+    $OGLDEV_DIR/Common/ogldev_texture_compressor.cpp \
+    $OGLDEV_DIR/Common/ogldev_texture.cpp \
+    $OGLDEV_DIR/Common/ogldev_artifact_cache.cpp \
+    $OGLDEV_DIR/Common/ogldev_glfw.cpp \
+    $OGLDEV_DIR/Common/ogldev_util.cpp \
+    $OGLDEV_DIR/Common/3rdparty/stb_image.cpp \
+    $CPPFLAGS $LDFLAGS -o texture_compressor
@@ -0,0 +1,102 @@
+/*
+
+        Copyright 2022 Etay Meiri
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+// Writes a block compressed container (<image>.ogtc) next to every image on
+// the command line. Texture::Load() and the async texture loader upload the
+// container instead of the image when it is newer than the image.
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ogldev_util.h"
+#include "ogldev_texture_compressor.h"
+#include "3rdparty/stb_image.h"
+
+
+static void Usage(const char* pProgram)
+{
+    printf("Usage: %s [-bc1|-bc3|-bc4|-bc5|-bc7] [-verify] [-srgb] [-threads N] <image> [<image> ...]\n", pProgram);
+    printf("The format is picked from the number of channels of each image when it is not given:\n");
+    printf("    1 - BC4, 2 - BC5, 3 - BC1, 4 - BC3\n");
+    printf("-verify decodes every level and prints its PSNR\n");
+    printf("-srgb filters the mip chain of color textures in linear space - pass it\n");
+    printf("      for the textures that the application loads as sRGB\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+    int Format = -1;
+    bool Verify = false;
+    bool SRGB = false;
+    int NumThreads = 0;
+    int NumFiles = 0;
+    int NumFailed = 0;
+
+    for (int i = 1 ; i < argc ; i++) {
+        if (strcmp(argv[i], "-bc1") == 0) {
+            Format = BLOCK_FORMAT_BC1;
+        } else if (strcmp(argv[i], "-bc3") == 0) {
+            Format = BLOCK_FORMAT_BC3;
+        } else if (strcmp(argv[i], "-bc4") == 0) {
+            Format = BLOCK_FORMAT_BC4;
+        } else if (strcmp(argv[i], "-bc5") == 0) {
+            Format = BLOCK_FORMAT_BC5;
+        } else if (strcmp(argv[i], "-bc7") == 0) {
+            Format = BLOCK_FORMAT_BC7;
+        } else if (strcmp(argv[i], "-verify") == 0) {
+            Verify = true;
+        } else if (strcmp(argv[i], "-srgb") == 0) {
+            SRGB = true;
+        } else if ((strcmp(argv[i], "-threads") == 0) && (i + 1 < argc)) {
+            NumThreads = atoi(argv[++i]);
+        } else if (argv[i][0] == '-') {
+            Usage(argv[0]);
+            return 1;
+        } else {
+            int Width = 0;
+            int Height = 0;
+            int BPP = 0;
+
+            if (!stbi_info(argv[i], &Width, &Height, &BPP)) {
+                printf("Can't read '%s' - %s\n", argv[i], stbi_failure_reason());
+                NumFailed++;
+                continue;
+            }
+
+            BLOCK_FORMAT FileFormat = (Format >= 0) ? (BLOCK_FORMAT)Format : TextureCompressor::GetDefaultFormat(BPP);
+
+            TextureCompressor Compressor(FileFormat);
+            Compressor.SetNumThreads(NumThreads);
+            Compressor.SetSRGB(SRGB);
+
+            if (!Compressor.CompressFile(argv[i], Verify)) {
+                NumFailed++;
+            }
+
+            NumFiles++;
+        }
+    }
+
+    if ((NumFiles == 0) && (NumFailed == 0)) {
+        Usage(argv[0]);
+        return 1;
+    }
+
+    return (NumFailed == 0) ? 0 : 1;
+}